@@ -0,0 +1,294 @@
+/*
+ * Copyright (c) 2020-2021 Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+/**
+ * @file batch_main.cc
+ * @brief Checks the batched 9DOF Kalman filter against the scalar one, and
+ * compares their throughput.
+ *
+ * Build with the PlatformIO "native_batch" environment.
+ *
+ * A few raw sensor logs of the simulated IMU (simulated_imu.cc), each with a
+ * different turn rate and gyro clock error, are recorded in memory. Two sets
+ * of fusion instances then replay them side by side, cycle by cycle, one set
+ * fused by fRun_9DOF_GBY_KALMAN() and the other by fBatchRun_9DOF_GBY_KALMAN()
+ * (see src/sensor_fusion/fusion_batch.h). After every cycle each batched
+ * instance is compared with its scalar twin. Reading the logs and
+ * conditioning the readings (including the magnetic calibration) is the same
+ * for both sets, so it is timed separately from the fusion.
+ *
+ * The two filters round differently wherever the compiler contracts a
+ * multiply and add into one instruction in one of them but not the other, so
+ * the orientations agree to within float rounding rather than exactly. The
+ * differences stay far below the tolerance on average. On the rare cycles
+ * when the a posteriori eCompass is poorly conditioned, a single orientation
+ * can differ by a few tenths of a degree before the filter damps it again,
+ * so the largest difference has a looser bound.
+ *
+ * Usage: program [instances] [simulated_seconds]
+ *   instances defaults to 256, replaying 4 distinct logs of simulated_seconds
+ *   (default 120). The exit status is 1 if the orientations differ from their
+ *   scalar twins by more than 0.01 degrees on average, or by more than 1
+ *   degree in any cycle.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <vector>
+
+#include "sensor_fusion_class.h"
+#include "board.h"
+#include "build.h"
+#include "sensor_fusion/control.h"
+#include "sensor_fusion/fusion.h"
+#include "sensor_fusion/fusion_batch.h"
+#include "sensor_fusion/hal_host.h"
+#include "sensor_fusion/sensor_fusion.h"
+#include "sensor_fusion/sensor_log.h"
+#include "sensor_fusion/status.h"
+#include "simulated_imu.h"
+
+// sensor hardware details, as on the Adafruit breakout board
+#define BOARD_ACCEL_MAG_I2C_ADDR    (0x1F)
+#define BOARD_GYRO_I2C_ADDR         (0x21)
+
+namespace {
+
+const int kNumLogs = 4;
+const double kMeanToleranceDeg = 0.01;
+const double kPeakToleranceDeg = 1.0;
+
+/// a log held in memory, read by one replay instance
+struct LogCursor {
+  const std::vector<uint8_t> *log;
+  size_t position;
+};
+
+uint16_t ReadLogMemory(void *context, uint8_t *destination, uint16_t num_bytes) {
+  LogCursor *cursor = (LogCursor *)context;
+  size_t available = cursor->log->size() - cursor->position;
+  if (num_bytes > available) num_bytes = (uint16_t)available;
+  memcpy(destination, cursor->log->data() + cursor->position, num_bytes);
+  cursor->position += num_bytes;
+  return num_bytes;
+}  // end ReadLogMemory()
+
+/// one fusion instance replaying a log, driven through the C interface
+struct Instance {
+  SensorFusionGlobals sfg;
+  ControlSubsystem control;
+  StatusSubsystem status;
+  PhysicalSensor sensor;
+  SensorLogReplay replay;
+  LogCursor cursor;
+};
+
+inline double NowNs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return 1E9 * ts.tv_sec + ts.tv_nsec;
+}  // end NowNs()
+
+/// Records simulated_seconds of the simulated IMU with config into log.
+bool RecordLog(const SimulatedImuConfig &config, long simulated_seconds,
+               std::vector<uint8_t> *log) {
+  const uint32_t kLoopIntervalMicros = 1000000 / LOOP_RATE_HZ;
+  HostVirtualClockSet(0);
+  SimulatedImu imu(BOARD_ACCEL_MAG_I2C_ADDR, BOARD_GYRO_I2C_ADDR, config);
+  if (!imu.Attach()) {
+    return false;
+  }
+  SensorFusion *sensor_fusion = new SensorFusion();
+  sensor_fusion->InitializeInputOutputSubsystem(NULL, NULL);
+  sensor_fusion->InstallSensor(BOARD_ACCEL_MAG_I2C_ADDR, SensorType::kMagnetometer);
+  sensor_fusion->InstallSensor(BOARD_ACCEL_MAG_I2C_ADDR, SensorType::kAccelerometer);
+  sensor_fusion->InstallSensor(BOARD_ACCEL_MAG_I2C_ADDR, SensorType::kThermometer);
+  sensor_fusion->InstallSensor(BOARD_GYRO_I2C_ADDR, SensorType::kGyroscope);
+  HostVirtualClockAdvance(kLoopIntervalMicros);
+  sensor_fusion->Begin();
+
+  static uint8_t buffer[SENSOR_LOG_MAX_RECORD_BYTES];
+  log->assign(buffer, buffer + sensor_fusion->GetSensorLogHeader(buffer));
+  for (long i = simulated_seconds * LOOP_RATE_HZ; i > 0; i--) {
+    HostVirtualClockAdvance(kLoopIntervalMicros);
+    sensor_fusion->ReadSensors();
+    log->insert(log->end(), buffer, buffer + sensor_fusion->GetSensorLogRecord(buffer));
+    sensor_fusion->RunFusion();
+  }
+  delete sensor_fusion;
+  imu.Detach();
+  return true;
+}  // end RecordLog()
+
+/// Sets up instance to replay log, as SensorFusion::Begin() would.
+bool BeginInstance(Instance *instance, const std::vector<uint8_t> *log) {
+  memset(&instance->replay, 0, sizeof(instance->replay));
+  instance->cursor.log = log;
+  instance->cursor.position = 0;
+  instance->replay.read = ReadLogMemory;
+  instance->replay.context = &instance->cursor;
+  initializeIOSubsystem(&instance->control, NULL, NULL);
+  initializeStatusSubsystem(&instance->status);
+  initSensorFusionGlobals(&instance->sfg, &instance->status, &instance->control);
+  if (SensorLogInstallReplay(&instance->sfg, &instance->sensor, &instance->replay) !=
+      SENSOR_ERROR_NONE) {
+    return false;
+  }
+  HostVirtualClockSet(0);
+  instance->sfg.initializeFusionEngine(&instance->sfg, -1, -1);
+  instance->sfg.setStatus(&instance->sfg, NORMAL);
+  instance->sfg.readSensors(&instance->sfg, 0);
+  return instance->replay.headerValid;
+}  // end BeginInstance()
+
+/// Reads the next log record into instance and conditions it for the fusion.
+/// Returns false at the end of the log.
+bool ReadInstance(Instance *instance) {
+  HostVirtualClockSet(instance->replay.timestamp);
+  instance->sfg.readSensors(&instance->sfg, 1);
+  if (instance->replay.finished) {
+    return false;
+  }
+  HostVirtualClockSet(instance->replay.timestamp);
+  instance->sfg.conditionSensorReadings(&instance->sfg);
+  return true;
+}  // end ReadInstance()
+
+/// angle (deg) between the orientations of two fusion instances
+double AngleBetweenDeg(const Instance &a, const Instance &b) {
+  const Quaternion &p = a.sfg.SV_9DOF_GBY_KALMAN.fqPl;
+  const Quaternion &q = b.sfg.SV_9DOF_GBY_KALMAN.fqPl;
+  // from the chord between them, which unlike the dot product is accurate for small angles
+  double sign = ((double)p.q0 * q.q0 + (double)p.q1 * q.q1 + (double)p.q2 * q.q2 +
+                 (double)p.q3 * q.q3 < 0.0) ? -1.0 : 1.0;
+  double d0 = p.q0 - sign * q.q0, d1 = p.q1 - sign * q.q1;
+  double d2 = p.q2 - sign * q.q2, d3 = p.q3 - sign * q.q3;
+  double chord = sqrt(d0 * d0 + d1 * d1 + d2 * d2 + d3 * d3);
+  return 4.0 * asin((chord < 2.0) ? 0.5 * chord : 1.0) * 180.0 / M_PI;
+}  // end AngleBetweenDeg()
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  long num_instances = (argc > 1) ? atol(argv[1]) : 256;
+  long simulated_seconds = (argc > 2) ? atol(argv[2]) : 120;
+  if (num_instances < 1) num_instances = 1;
+  if (simulated_seconds < 1) simulated_seconds = 1;
+
+  HostTimerInstallClock(HostVirtualClockMicros);
+  const float kYawRates[kNumLogs] = {15.0F, -25.0F, 40.0F, 5.0F};
+  const float kOdrErrors[kNumLogs] = {0.0F, 1.0F, -1.5F, 0.5F};
+  std::vector<uint8_t> logs[kNumLogs];
+  for (int i = 0; i < kNumLogs; i++) {
+    SimulatedImuConfig config;
+    config.yaw_rate_dps = kYawRates[i];
+    config.gyro_odr_error_percent = kOdrErrors[i];
+    if (!RecordLog(config, simulated_seconds, &logs[i])) {
+      printf("trouble attaching simulated sensors\n");
+      return 1;
+    }
+  }
+
+  // each instance replays one of the logs twice, by the scalar and by the batched filter
+  std::vector<Instance *> scalar(num_instances), batched(num_instances);
+  for (long n = 0; n < num_instances; n++) {
+    scalar[n] = new Instance();
+    batched[n] = new Instance();
+    if (!BeginInstance(scalar[n], &logs[n % kNumLogs]) ||
+        !BeginInstance(batched[n], &logs[n % kNumLogs])) {
+      printf("trouble installing replay sensor\n");
+      return 1;
+    }
+  }
+  long num_batches = (num_instances + FUSION_BATCH_LANES - 1) / FUSION_BATCH_LANES;
+  std::vector<FusionBatch9DOF *> batches(num_batches);
+  for (long b = 0; b < num_batches; b++) {
+    batches[b] = new FusionBatch9DOF;
+    long lanes = num_instances - b * FUSION_BATCH_LANES;
+    fBatchInit_9DOF_GBY_KALMAN(batches[b], (int16_t)((lanes > FUSION_BATCH_LANES) ?
+                                                     FUSION_BATCH_LANES : lanes));
+  }
+
+  double read_ns = 0.0, scalar_ns = 0.0, batch_ns = 0.0, max_error_deg = 0.0, sum_error_deg = 0.0;
+  long cycles = 0;
+  bool reading = true;
+  while (reading) {
+    double start_ns = NowNs();
+    for (long n = 0; n < num_instances && reading; n++) {
+      reading = ReadInstance(scalar[n]) && ReadInstance(batched[n]);
+    }
+    if (!reading) {
+      break;
+    }
+    read_ns += 0.5 * (NowNs() - start_ns);
+
+    start_ns = NowNs();
+    for (long n = 0; n < num_instances; n++) {
+      scalar[n]->sfg.runFusion(&scalar[n]->sfg);
+    }
+    scalar_ns += NowNs() - start_ns;
+
+    start_ns = NowNs();
+    for (long n = 0; n < num_instances; n++) {
+      fBatchSetLane_9DOF_GBY_KALMAN(batches[n / FUSION_BATCH_LANES], (int16_t)(n % FUSION_BATCH_LANES),
+                                    &batched[n]->sfg);
+    }
+    for (long b = 0; b < num_batches; b++) {
+      fBatchRun_9DOF_GBY_KALMAN(batches[b]);
+    }
+    for (long n = 0; n < num_instances; n++) {
+      batched[n]->sfg.clearFIFOs(&batched[n]->sfg);
+    }
+    batch_ns += NowNs() - start_ns;
+
+    for (long n = 0; n < num_instances; n++) {
+      scalar[n]->sfg.loopcounter++;
+      batched[n]->sfg.loopcounter++;
+      double error_deg = AngleBetweenDeg(*scalar[n], *batched[n]);
+      if (!(error_deg <= max_error_deg)) max_error_deg = error_deg;
+      sum_error_deg += error_deg;
+    }
+    cycles++;
+  }
+
+  double steps = (double)num_instances * cycles;
+  printf("%ld instances of %d logs, %ld fusion cycles each, %d lanes per batch\n",
+         num_instances, kNumLogs, cycles, FUSION_BATCH_LANES);
+  printf("fusion only:   scalar %9.0f instance-cycles/s, batched %9.0f instance-cycles/s, "
+         "%.2fx\n", 1E9 * steps / scalar_ns, 1E9 * steps / batch_ns, scalar_ns / batch_ns);
+  printf("whole cycle:   scalar %9.0f instance-cycles/s, batched %9.0f instance-cycles/s, "
+         "%.2fx (reads and magnetic calibration included)\n", 1E9 * steps / (read_ns + scalar_ns),
+         1E9 * steps / (read_ns + batch_ns), (read_ns + scalar_ns) / (read_ns + batch_ns));
+  const SV_9DOF_GBY_KALMAN &sv = batched[0]->sfg.SV_9DOF_GBY_KALMAN;
+  double mean_error_deg = (steps > 0.0) ? sum_error_deg / steps : 0.0;
+  printf("instance 0: heading %03.0f, pitch %+4.0f, roll %+4.0f\n", sv.fRhoPl, sv.fThePl, sv.fPhiPl);
+  printf("difference from the scalar filter: mean %.2g deg, largest %.2g deg\n", mean_error_deg,
+         max_error_deg);
+
+  for (long n = 0; n < num_instances; n++) {
+    delete scalar[n];
+    delete batched[n];
+  }
+  for (long b = 0; b < num_batches; b++) {
+    delete batches[b];
+  }
+  if (!(mean_error_deg <= kMeanToleranceDeg)) {
+    printf("FAIL: batched orientations differ from the scalar filter by over %.2f deg on average\n",
+           kMeanToleranceDeg);
+    return 1;
+  }
+  if (!(max_error_deg <= kPeakToleranceDeg)) {
+    printf("FAIL: a batched orientation differs from the scalar filter by over %.2f deg\n",
+           kPeakToleranceDeg);
+    return 1;
+  }
+  printf("batched fusion OK\n");
+  return 0;
+}  // end main()
@@ -0,0 +1,718 @@
+/*
+ * Copyright (c) 2020-2021 Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+/**
+ * @file benchmark_main.cc
+ * @brief Micro-benchmarks for the fusion and magnetic calibration hot paths.
+ *
+ * Build with the PlatformIO "native_benchmark" environment. The fixtures are
+ * produced by running the fusion against the simulated IMU (simulated_imu.cc)
+ * for a few simulated minutes, so every kernel is timed on realistic, but
+ * repeatable, inputs: a converged Kalman state, a full magnetic buffer, and
+ * the matrices that the calibration actually hands to its solvers.
+ *
+ * Each kernel's input state is restored before every timed call, so the
+ * figures are for one call on that fixed input. The cost of reading the clock
+ * is measured at start-up and subtracted. Results are reported as the mean
+ * (ns/call), minimum, median and 99th percentile, and the median is compared
+ * against a baseline file if one is given.
+ *
+ * Usage: program [--baseline file] [--save file] [--threshold percent]
+ *                [--reps n] [--slices]
+ *   --baseline   compare medians against file, exit status 1 on regression
+ *                (a median that rose by over threshold percent and 25 ns)
+ *   --save       write the medians from this run to file as a new baseline
+ *   --threshold  percent increase of a median counted as a regression (15)
+ *   --reps       timed calls per kernel (default 2000)
+ *   --slices     also report every individual magnetic calibration slice
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "board.h"
+#include "build.h"
+#include "sensor_fusion/sensor_fusion.h"
+#include "sensor_fusion/control.h"
+#include "sensor_fusion/driver_sensors.h"
+#include "sensor_fusion/fusion.h"
+#include "sensor_fusion/hal_host.h"
+#include "sensor_fusion/magnetic.h"
+#include "sensor_fusion/matrix.h"
+#include "sensor_fusion/orientation.h"
+#include "sensor_fusion/status.h"
+#include "simulated_imu.h"
+
+// sensor hardware details, as on the Adafruit breakout board
+#define BOARD_ACCEL_MAG_I2C_ADDR    (0x1F)
+#define BOARD_GYRO_I2C_ADDR         (0x21)
+
+namespace {
+
+const long kWarmUpSeconds = 300;   ///< long enough for the 10 element solver to run
+const long kPreviousCalSeconds = 30; ///< age of the buffer that warm started solvers resume from
+const int kMaxSliceCalls = 4000;   ///< guards against a solver that never finishes
+const double kNoiseFloorNs = 25.0; ///< smaller changes of a median are never regressions
+
+/// Summary statistics of one benchmark, all times in nanoseconds.
+struct Result {
+  std::string name;
+  size_t calls;
+  double mean;
+  double min;
+  double median;
+  double p99;
+};
+
+/// Everything captured from the warmed-up fusion, restored before each call.
+struct Fixture {
+  SensorFusionGlobals sfg;
+  ControlSubsystem control;
+  StatusSubsystem status;
+  PhysicalSensor sensors[4];
+  struct SV_6DOF_GY_KALMAN sv_6dof;
+  struct MagBuffer previous_buffer; ///< magnetic buffer kPreviousCalSeconds before the end
+  float eigen_input[10][10];       ///< X^T.X handed to the 10 element eigensolver
+  float inverse_input[4][4];       ///< X^T.X handed to the 4 element inversion
+};
+
+Fixture fixture;
+double timer_overhead_ns = 0.0;
+volatile float sink;               ///< keeps results of pure kernels alive
+
+inline double NowNs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return 1E9 * ts.tv_sec + ts.tv_nsec;
+}  // end NowNs()
+
+Result Summarize(const std::string &name, std::vector<double> samples) {
+  Result result = {name, samples.size(), 0.0, 0.0, 0.0, 0.0};
+  if (samples.empty()) {
+    return result;
+  }
+  std::sort(samples.begin(), samples.end());
+  double sum = 0.0;
+  for (double s : samples) {
+    sum += s;
+  }
+  size_t p99_index = (99 * samples.size() + 99) / 100 - 1;
+  result.mean = sum / samples.size();
+  result.min = samples.front();
+  result.median = samples[samples.size() / 2];
+  result.p99 = samples[std::min(p99_index, samples.size() - 1)];
+  return result;
+}  // end Summarize()
+
+/// Times reps calls of body(), calling setup() untimed before each one.
+template <typename Setup, typename Body>
+Result Measure(const std::string &name, int reps, Setup setup, Body body) {
+  std::vector<double> samples;
+  samples.reserve(reps);
+  for (int i = 0; i < reps; i++) {
+    setup();
+    double start = NowNs();
+    body();
+    double elapsed = NowNs() - start - timer_overhead_ns;
+    samples.push_back(elapsed > 0.0 ? elapsed : 0.0);
+  }
+  return Summarize(name, samples);
+}  // end Measure()
+
+void CalibrateTimer(void) {
+  std::vector<double> samples;
+  for (int i = 0; i < 10000; i++) {
+    double start = NowNs();
+    samples.push_back(NowNs() - start);
+  }
+  timer_overhead_ns = Summarize("timer", samples).median;
+}  // end CalibrateTimer()
+
+/// Largest difference between the 6DOF Kalman gains of a and b, and in
+/// *max_gain the largest gain element of a.
+float GainDifference6DOF(const struct SV_6DOF_GY_KALMAN &a,
+                         const struct SV_6DOF_GY_KALMAN &b, float *max_gain) {
+  float max_difference = 0.0F;
+  for (int i = 0; i < 6; i++) {
+    for (int j = 0; j < 3; j++) {
+      *max_gain = std::max(*max_gain, fabsf(a.fK6x3[i][j]));
+      max_difference = std::max(max_difference, fabsf(a.fK6x3[i][j] - b.fK6x3[i][j]));
+    }
+  }
+  return max_difference;
+}  // end GainDifference6DOF()
+
+/**
+ * Runs the fusion for kWarmUpSeconds against the simulated IMU, as
+ * SensorFusion::ReadSensors() and RunFusion() would, and keeps the end state
+ * together with a 6DOF Kalman state advanced on the same readings. On every
+ * cycle the 6DOF Kalman gain is also recomputed both ways from that cycle's
+ * covariances, and the largest disagreement is reported.
+ */
+bool BuildFixture(void) {
+  const uint32_t kLoopIntervalMicros = 1000000 / LOOP_RATE_HZ;
+  SensorFusionGlobals *sfg = &fixture.sfg;
+
+  HostTimerInstallClock(HostVirtualClockMicros);
+  HostVirtualClockSet(0);
+  static SimulatedImu imu(BOARD_ACCEL_MAG_I2C_ADDR, BOARD_GYRO_I2C_ADDR);
+  if (!imu.Attach()) {
+    return false;
+  }
+
+  initializeIOSubsystem(&fixture.control, NULL, NULL);
+  initializeStatusSubsystem(&fixture.status);
+  initSensorFusionGlobals(sfg, &fixture.status, &fixture.control);
+  sfg->installSensor(sfg, &fixture.sensors[0], BOARD_ACCEL_MAG_I2C_ADDR, 1,
+                     NULL, FXOS8700_Mag_Init, FXOS8700_Mag_Read);
+  sfg->installSensor(sfg, &fixture.sensors[1], BOARD_ACCEL_MAG_I2C_ADDR, 1,
+                     NULL, FXOS8700_Accel_Init, FXOS8700_Accel_Read);
+  sfg->installSensor(sfg, &fixture.sensors[2], BOARD_ACCEL_MAG_I2C_ADDR, 1,
+                     NULL, FXOS8700_Therm_Init, FXOS8700_Therm_Read);
+  sfg->installSensor(sfg, &fixture.sensors[3], BOARD_GYRO_I2C_ADDR, 1,
+                     NULL, FXAS21002_Init, FXAS21002_Read);
+  HostVirtualClockAdvance(kLoopIntervalMicros);
+  sfg->initializeFusionEngine(sfg, 0, 0);
+  sfg->setStatus(sfg, NORMAL);
+  fInit_6DOF_GY_KALMAN(&fixture.sv_6dof, &sfg->Accel, &sfg->Gyro);
+
+  static struct SV_6DOF_GY_KALMAN gain_generic, gain_block;
+  float max_gain = 0.0F, max_difference = 0.0F;
+  for (long i = 0; i < kWarmUpSeconds * LOOP_RATE_HZ; i++) {
+    HostVirtualClockAdvance(kLoopIntervalMicros);
+    sfg->readSensors(sfg, 1);
+    sfg->conditionSensorReadings(sfg);
+    fRun_6DOF_GY_KALMAN(&fixture.sv_6dof, &sfg->Accel, &sfg->Gyro);
+    sfg->runFusion(sfg);
+    gain_generic = gain_block = fixture.sv_6dof;
+    fKalmanGain_6DOF_GY_Generic(&gain_generic);
+    fKalmanGain_6DOF_GY_Block(&gain_block);
+    max_difference = std::max(max_difference,
+                              GainDifference6DOF(gain_generic, gain_block, &max_gain));
+    sfg->loopcounter++;
+    sfg->queueStatus(sfg, NORMAL);
+    if (i == (kWarmUpSeconds - kPreviousCalSeconds) * LOOP_RATE_HZ) {
+      fixture.previous_buffer = sfg->MagBuffer;
+    }
+  }
+  // read one more cycle without fusing it, so that the Kalman filters are
+  // timed integrating a full gyro FIFO (runFusion() empties the FIFOs)
+  HostVirtualClockAdvance(kLoopIntervalMicros);
+  sfg->readSensors(sfg, 1);
+  sfg->conditionSensorReadings(sfg);
+  imu.Detach();
+  HostTimerInstallClock(NULL);
+  printf("6DOF Kalman gain over %ld cycles: block and generic differ by at most "
+         "%.3g (largest gain %.3g)\n", kWarmUpSeconds * LOOP_RATE_HZ,
+         max_difference, max_gain);
+
+  // let any calibration in progress finish, so the solvers start from rest
+  for (int i = 0; sfg->MagCal.iCalInProgress && i < kMaxSliceCalls; i++) {
+    fRunMagCalibration(&sfg->MagCal, &sfg->MagBuffer, &sfg->Mag, sfg->loopcounter);
+  }
+  printf("Fixture: %ld s simulated, %d readings in magnetic buffer, solver %d, "
+         "fit error %.1f%%\n", kWarmUpSeconds, sfg->MagBuffer.iMagBufferCount,
+         (int)sfg->MagCal.iValidMagCal, sfg->MagCal.fFitErrorpc);
+  return sfg->MagBuffer.iMagBufferCount >= MINMEASUREMENTS10CAL;
+}  // end BuildFixture()
+
+void BenchFusion(int reps, std::vector<Result> *results) {
+  SensorFusionGlobals *sfg = &fixture.sfg;
+  static struct SV_9DOF_GBY_KALMAN sv_9dof;
+  static struct SV_6DOF_GY_KALMAN sv_6dof;
+
+  results->push_back(Measure(
+      "fRun_9DOF_GBY_KALMAN", reps,
+      [&] { sv_9dof = sfg->SV_9DOF_GBY_KALMAN; },
+      [&] {
+        fRun_9DOF_GBY_KALMAN(&sv_9dof, &sfg->Accel, &sfg->Mag, &sfg->Gyro,
+                             &sfg->MagCal);
+      }));
+
+  // both ways of computing the 9DOF Kalman gain, from the covariances left by
+  // the fixture's last cycle (fRun_9DOF_GBY_KALMAN above uses the build.h choice)
+  static struct SV_9DOF_GBY_KALMAN gain_generic, gain_block;
+  gain_generic = gain_block = sfg->SV_9DOF_GBY_KALMAN;
+  results->push_back(Measure("kalman9_gain/generic", reps, [] {},
+                             [&] { fKalmanGain_9DOF_GBY_Generic(&gain_generic); }));
+  results->push_back(Measure("kalman9_gain/block", reps, [] {},
+                             [&] { fKalmanGain_9DOF_GBY_Block(&gain_block); }));
+  float max_gain = 0.0F, max_difference = 0.0F;
+  for (int i = 0; i < 9; i++) {
+    for (int j = 0; j < 6; j++) {
+      max_gain = std::max(max_gain, fabsf(gain_generic.fK9x6[i][j]));
+      max_difference = std::max(
+          max_difference, fabsf(gain_generic.fK9x6[i][j] - gain_block.fK9x6[i][j]));
+    }
+  }
+  printf("9DOF Kalman gain: block and generic differ by at most %.3g "
+         "(largest gain %.3g)\n", max_difference, max_gain);
+
+  results->push_back(Measure(
+      "fRun_6DOF_GY_KALMAN", reps,
+      [&] { sv_6dof = fixture.sv_6dof; },
+      [&] { fRun_6DOF_GY_KALMAN(&sv_6dof, &sfg->Accel, &sfg->Gyro); }));
+
+  // both ways of computing the 6DOF Kalman gain, as for the 9DOF gain above
+  static struct SV_6DOF_GY_KALMAN gain6_generic, gain6_block;
+  gain6_generic = gain6_block = fixture.sv_6dof;
+  results->push_back(Measure("kalman6_gain/generic", reps, [] {},
+                             [&] { fKalmanGain_6DOF_GY_Generic(&gain6_generic); }));
+  results->push_back(Measure("kalman6_gain/block", reps, [] {},
+                             [&] { fKalmanGain_6DOF_GY_Block(&gain6_block); }));
+
+  // rotation vector of one gyro sample, as integrated by the Kalman filters
+  float rvec[3];
+  for (int i = CHX; i <= CHZ; i++) {
+    rvec[i] = sfg->Gyro.fYs[i];
+  }
+  Quaternion q;
+  results->push_back(Measure(
+      "fQuaternionFromRotationVectorDeg", reps, [] {},
+      [&] {
+        fQuaternionFromRotationVectorDeg(&q, rvec, 1.0F / (float)GYRO_ODR_HZ);
+        sink = q.q0;
+      }));
+}  // end BenchFusion()
+
+/// Largest element of A.inv(A) - I, evaluated in double, for the n x n
+/// row-major matrix a inverted by fmatrixAeqInvSymA() if symmetric is true and
+/// by fmatrixAeqInvA() otherwise.
+double InverseResidual(const float *a, int n, bool symmetric) {
+  float inverse[6][6];
+  float *rows[6];
+  int8_t col_ind[6], row_ind[6], pivot[6], ierror;
+  for (int i = 0; i < n; i++) {
+    rows[i] = inverse[i];
+    memcpy(inverse[i], a + i * n, n * sizeof(float));
+  }
+  if (symmetric) {
+    fmatrixAeqInvSymA(rows, n, &ierror);
+  } else {
+    fmatrixAeqInvA(rows, col_ind, row_ind, pivot, n, &ierror);
+  }
+  double residual = 0.0;
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < n; j++) {
+      double sum = (i == j) ? -1.0 : 0.0;
+      for (int k = 0; k < n; k++) {
+        sum += (double)a[i * n + k] * inverse[k][j];
+      }
+      residual = std::max(residual, fabs(sum));
+    }
+  }
+  return residual;
+}  // end InverseResidual()
+
+void BenchMatrix(int reps, std::vector<Result> *results) {
+  static float a10[10][10];
+  static float eigval[10];
+  static float eigvec[10][10];
+  results->push_back(Measure(
+      "fEigenCompute10", reps,
+      [&] { memcpy(a10, fixture.eigen_input, sizeof(a10)); },
+      [&] { fEigenCompute10(a10, eigval, eigvec, 10); }));
+
+  static float a4[4][4];
+  float *rows[4] = {a4[0], a4[1], a4[2], a4[3]};
+  int8_t col_ind[4], row_ind[4], pivot[4], ierror;
+  results->push_back(Measure(
+      "fmatrixAeqInvA", reps,
+      [&] { memcpy(a4, fixture.inverse_input, sizeof(a4)); },
+      [&] { fmatrixAeqInvA(rows, col_ind, row_ind, pivot, 4, &ierror); }));
+  results->push_back(Measure(
+      "fmatrixAeqInvSymA", reps,
+      [&] { memcpy(a4, fixture.inverse_input, sizeof(a4)); },
+      [&] { fmatrixAeqInvSymA(rows, 4, &ierror); }));
+
+  // accuracy of both inversions on X^T.X above and on the 6x6 innovation
+  // covariance C.Qw.C^T + Qv that the generic 9DOF Kalman gain inverts,
+  // rebuilt from the fixture's last cycle
+  static float a6[6][6];
+  const struct SV_9DOF_GBY_KALMAN &sv = fixture.sfg.SV_9DOF_GBY_KALMAN;
+  for (int i = 0; i < 6; i++) {
+    const int k = (i < 3) ? i + 6 : i + 3;
+    for (int j = 0; j < 6; j++) {
+      a6[i][j] = sv.fQwCT9x6[i][j] - sv.fAlphaOver2 * sv.fQwCT9x6[k][j];
+    }
+    a6[i][i] += sv.fQv6x1[i];
+  }
+  for (int i = 1; i < 6; i++) {
+    for (int j = 0; j < i; j++) {
+      a6[i][j] = a6[j][i];
+    }
+  }
+  printf("max |A.inv(A) - I|: 4x4 X^T.X fmatrixAeqInvA %.3g fmatrixAeqInvSymA %.3g, "
+         "6x6 Kalman fmatrixAeqInvA %.3g fmatrixAeqInvSymA %.3g\n",
+         InverseResidual(&fixture.inverse_input[0][0], 4, false),
+         InverseResidual(&fixture.inverse_input[0][0], 4, true),
+         InverseResidual(&a6[0][0], 6, false), InverseResidual(&a6[0][0], 6, true));
+}  // end BenchMatrix()
+
+/**
+ * Times iUpdateMagBuffer() on each of its four paths. The bin that the
+ * current reading falls into is found by inserting it into an empty buffer,
+ * then the full buffer from the fixture is doctored so the call takes the
+ * wanted path. Case 1 is timed both when the reading before it fell into the
+ * same bin, as it mostly does at run time, and when it fell into another
+ * one, so the running sums are brought up to date for that bin
+ * (F_INCREMENTAL_MAG_SUMS). Case 4 is timed both when the reading is close to
+ * the one already in the bin (overwrite) and when it is not (search for a
+ * free bin). The buffers are reindexed after doctoring. Reports the slowest
+ * path, which bounds the cost of every magnetometer sample.
+ */
+void BenchMagBuffer(int reps, std::vector<Result> *results) {
+  SensorFusionGlobals *sfg = &fixture.sfg;
+  const int32_t loopcounter = sfg->loopcounter;
+  static struct MagBuffer probe, work;
+  static struct MagSensor far, other;
+  static struct MagBuffer cases[6];
+  static const char *names[6] = {
+      "iUpdateMagBuffer/1_full_occupied", "iUpdateMagBuffer/2_full_empty",
+      "iUpdateMagBuffer/3_filling_empty", "iUpdateMagBuffer/4_filling_close",
+      "iUpdateMagBuffer/4_filling_mesh", "iUpdateMagBuffer/1_full_moved"};
+
+  // returns the bin j * MAGBUFFSIZEY + k that a reading falls into
+  auto bin_of = [&](struct MagSensor *mag) {
+    probe = sfg->MagBuffer;
+    probe.iMagBufferCount = 0;
+    for (int j = 0; j < MAGBUFFSIZEX; j++)
+      for (int k = 0; k < MAGBUFFSIZEY; k++)
+        iMagBufferClearBin(&probe, j, k);
+    iReindexMagBuffer(&probe, loopcounter);
+    iUpdateMagBuffer(&probe, mag, loopcounter);
+    for (int j = 0; j < MAGBUFFSIZEX; j++)
+      for (int k = 0; k < MAGBUFFSIZEY; k++)
+        if (iMagBufferBinActive(&probe, j, k)) return j * MAGBUFFSIZEY + k;
+    return 0;
+  };
+  const int bin = bin_of(&sfg->Mag);
+  const int bj = bin / MAGBUFFSIZEY, bk = bin % MAGBUFFSIZEY;
+
+  // the reading before case 1_full_moved, mirrored in x so that it falls into another bin
+  other = sfg->Mag;
+  other.iBc[CHX] = -other.iBc[CHX];
+  const int other_bin = bin_of(&other);
+
+  // the meshed reading is moved well outside the constellation, in the same bins, so that no measurement is close
+  // to it and the search for one is never cut short
+  far = sfg->Mag;
+  for (int i = CHX; i <= CHZ; i++) {
+    far.iBs[i] += 40 * MESHDELTACOUNTS;
+  }
+  for (int c = 0; c < 6; c++) {
+    cases[c] = sfg->MagBuffer;
+    cases[c].iMagBufferCount = (c < 2 || c == 5) ? MAXMEASUREMENTS : MAXMEASUREMENTS - 1;
+    if (c == 1 || c == 2) {
+      iMagBufferClearBin(&cases[c], bj, bk);
+    } else {
+      iMagBufferSetBin(&cases[c], bj, bk, loopcounter - 1);
+    }
+    for (int i = CHX; i <= CHZ; i++) {
+      MAGBUFFER_BS(&cases[c], i, bj, bk) = sfg->Mag.iBs[i] + ((c == 4) ? 4 * MESHDELTACOUNTS : 0);
+    }
+    if (c == 5) {
+      iMagBufferSetBin(&cases[c], other_bin / MAGBUFFSIZEY, other_bin % MAGBUFFSIZEY, loopcounter - 2);
+    }
+    iReindexMagBuffer(&cases[c], loopcounter);
+    if (c == 5) {
+      iUpdateMagBuffer(&cases[c], &other, loopcounter);
+    }
+    results->push_back(Measure(
+        names[c], reps, [&] { work = cases[c]; },
+        [&] { iUpdateMagBuffer(&work, (c == 4) ? &far : &sfg->Mag, loopcounter); }));
+  }
+
+  const Result *worst = NULL;
+  for (size_t r = results->size() - 6; r < results->size(); r++) {
+    if (worst == NULL || (*results)[r].p99 > worst->p99) {
+      worst = &(*results)[r];
+    }
+  }
+  printf("iUpdateMagBuffer worst path %s: p99 %.1f ns per sample (F_MAG_BUFFER_INDEX %d)\n",
+         worst->name.c_str(), worst->p99, F_MAG_BUFFER_INDEX);
+}  // end BenchMagBuffer()
+
+/// Range of time slices of a sliced solver that do the same kind of work.
+struct SlicePhase {
+  const char *name;
+  int first;
+  int last;
+};
+
+#define MAGBUFFSIZE (MAGBUFFSIZEX * MAGBUFFSIZEY)
+const SlicePhase kPhases4[] = {
+    {"0_init", 0, 0},
+    {"1_accumulate", 1, MAGBUFFSIZEX},
+    {"2_invert", MAGBUFFSIZEX + 1, MAGBUFFSIZEX + 1},
+    {"3_solve", MAGBUFFSIZEX + 2, MAGBUFFSIZEX + 2},
+};
+const SlicePhase kPhases7[] = {
+    {"0_init", 0, 0},
+    {"1_accumulate", 1, MAGBUFFSIZE},
+    {"2_eigen_setup", MAGBUFFSIZE + 1, MAGBUFFSIZE + 1},
+    {"3_eigen_sweep", MAGBUFFSIZE + 2, MAGBUFFSIZE + 22},
+    {"4_eigen_check", MAGBUFFSIZE + 23, MAGBUFFSIZE + 23},
+    {"5_solve", MAGBUFFSIZE + 24, MAGBUFFSIZE + 24},
+};
+const SlicePhase kPhases10[] = {
+    {"0_init", 0, 0},
+    {"1_accumulate", 1, MAGBUFFSIZE},
+    {"2_eigen_setup", MAGBUFFSIZE + 1, MAGBUFFSIZE + 1},
+    {"3_eigen_sweep", MAGBUFFSIZE + 2, MAGBUFFSIZE + 46},
+    {"4_eigen_check", MAGBUFFSIZE + 47, MAGBUFFSIZE + 47},
+    {"5_ellipsoid", MAGBUFFSIZE + 48, MAGBUFFSIZE + 48},
+    {"6_eigen3_sweep", MAGBUFFSIZE + 49, MAGBUFFSIZE + 51},
+    {"7_eigen3_check", MAGBUFFSIZE + 52, MAGBUFFSIZE + 52},
+    {"8_solve", MAGBUFFSIZE + 53, MAGBUFFSIZE + 53},
+};
+
+typedef void (magCalSlice_t)(struct MagCalibration *, struct MagBuffer *,
+                             struct MagSensor *);
+
+/**
+ * Runs a sliced solver from start to finish runs times, timing every call
+ * against the slice number it was entered with. Reports each phase of the
+ * solver, the worst single slice, and the sum of all slices of one solve.
+ * While running, the solver input is captured for the matrix benchmarks.
+ * If previous is not NULL, the solver first solves that buffer untimed, and
+ * every timed solve resumes the eigen-decomposition from its eigenvectors
+ * (F_WARM_START_EIGEN); otherwise every solve starts from the identity.
+ */
+void BenchMagCalSlices(const char *solver_name, int8_t solver, magCalSlice_t *slice,
+                       const SlicePhase *phases, size_t num_phases, int runs,
+                       const struct MagBuffer *previous, bool report_slices,
+                       std::vector<Result> *results) {
+  SensorFusionGlobals *sfg = &fixture.sfg;
+  static struct MagCalibration start, cal;
+  static struct MagBuffer buffer;
+  std::map<int, std::vector<double> > by_slice;
+  std::vector<double> totals, worst;
+  int slices = 0;
+
+  start = sfg->MagCal;
+#if F_WARM_START_EIGEN
+  start.iWarmStartSize = 0;
+  if (previous != NULL) {
+    buffer = *previous;
+    start.iInitiateMagCal = solver;
+    start.iCalInProgress = solver;
+    for (int call = 0; start.iCalInProgress && call < kMaxSliceCalls; call++) {
+      slice(&start, &buffer, &sfg->Mag);
+    }
+  }
+#endif
+  for (int run = 0; run < runs; run++) {
+    cal = start;
+    buffer = sfg->MagBuffer;
+    cal.iInitiateMagCal = solver;
+    cal.iCalInProgress = solver;
+    cal.iEigenSweeps = 0;
+    double total = 0.0, max = 0.0;
+    for (slices = 0; cal.iCalInProgress && slices < kMaxSliceCalls; slices++) {
+      int timeslice = cal.itimeslice;
+      if (cal.iInitiateMagCal) {
+        timeslice = 0;
+      }
+      double start = NowNs();
+      slice(&cal, &buffer, &sfg->Mag);
+      double elapsed = NowNs() - start - timer_overhead_ns;
+      if (elapsed < 0.0) {
+        elapsed = 0.0;
+      }
+      by_slice[timeslice].push_back(elapsed);
+      total += elapsed;
+      max = std::max(max, elapsed);
+      if (run == 0 && previous == NULL && solver == 10 && timeslice == MAGBUFFSIZE + 1) {
+        memcpy(fixture.eigen_input, cal.pScratch->fmatA, sizeof(fixture.eigen_input));
+      }
+      if (run == 0 && solver == 4 && timeslice == MAGBUFFSIZEX + 1) {
+        for (int i = 0; i < 4; i++)
+          for (int j = 0; j < 4; j++)
+            fixture.inverse_input[i][j] = cal.pScratch->fmatA[i][j];
+      }
+    }
+    totals.push_back(total);
+    worst.push_back(max);
+  }
+  if (solver != 4) {
+    printf("%s: %d eigen-decomposition sweeps and %d slices per solve\n",
+           solver_name, cal.iEigenSweeps, slices);
+  }
+
+  std::string prefix = std::string(solver_name) + "/";
+  for (size_t p = 0; p < num_phases; p++) {
+    std::vector<double> samples;
+    for (int s = phases[p].first; s <= phases[p].last; s++) {
+      samples.insert(samples.end(), by_slice[s].begin(), by_slice[s].end());
+    }
+    // a phase that the solver skips, such as the accumulation set from the running sums, is not reported
+    if (samples.empty()) {
+      continue;
+    }
+    results->push_back(Summarize(prefix + phases[p].name, samples));
+  }
+  results->push_back(Summarize(prefix + "worst_slice", worst));
+  results->push_back(Summarize(prefix + "all_slices", totals));
+  if (report_slices) {
+    for (auto &s : by_slice) {
+      results->push_back(Summarize(prefix + "slice_" + std::to_string(s.first), s.second));
+    }
+  }
+}  // end BenchMagCalSlices()
+
+void BenchOutput(int reps, std::vector<Result> *results) {
+  SensorFusionGlobals *sfg = &fixture.sfg;
+  // every optional packet on, the heaviest case
+  fixture.control.QuaternionPacketType = Q9;
+  fixture.control.AngularVelocityPacketOn = true;
+  fixture.control.DebugPacketOn = true;
+  fixture.control.RPCPacketOn = true;
+  fixture.control.AltPacketOn = true;
+  results->push_back(Measure("CreateOutgoingPackets", reps, [] {},
+                             [&] { CreateOutgoingPackets(sfg); }));
+}  // end BenchOutput()
+
+std::map<std::string, double> ReadBaseline(const char *path) {
+  std::map<std::string, double> baseline;
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    printf("Cannot read baseline %s\n", path);
+    return baseline;
+  }
+  char line[256], name[200];
+  double median;
+  while (fgets(line, sizeof(line), file)) {
+    if (line[0] != '#' && 2 == sscanf(line, "%199s %lf", name, &median)) {
+      baseline[name] = median;
+    }
+  }
+  fclose(file);
+  return baseline;
+}  // end ReadBaseline()
+
+bool SaveBaseline(const char *path, const std::vector<Result> &results) {
+  FILE *file = fopen(path, "w");
+  if (file == NULL) {
+    return false;
+  }
+  fprintf(file, "# benchmark baseline: name median_ns\n");
+  fprintf(file, "# medians are only comparable on the machine that produced them\n");
+  fprintf(file, "# regenerate with: program --save %s\n", path);
+  for (const Result &r : results) {
+    fprintf(file, "%s %.1f\n", r.name.c_str(), r.median);
+  }
+  fclose(file);
+  return true;
+}  // end SaveBaseline()
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  const char *baseline_path = NULL;
+  const char *save_path = NULL;
+  double threshold_percent = 15.0;
+  int reps = 2000;
+  bool report_slices = false;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--baseline") && i + 1 < argc) {
+      baseline_path = argv[++i];
+    } else if (!strcmp(argv[i], "--save") && i + 1 < argc) {
+      save_path = argv[++i];
+    } else if (!strcmp(argv[i], "--threshold") && i + 1 < argc) {
+      threshold_percent = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--reps") && i + 1 < argc) {
+      reps = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--slices")) {
+      report_slices = true;
+    } else {
+      printf("usage: %s [--baseline file] [--save file] [--threshold percent] "
+             "[--reps n] [--slices]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (reps < 1) {
+    reps = 1;
+  }
+
+  if (!BuildFixture()) {
+    printf("Could not build the benchmark fixture\n");
+    return 2;
+  }
+  printf("State: MagBuffer %zu bytes, MagCalibration %zu bytes, SensorFusionGlobals %zu bytes "
+         "(F_COMPACT_MAG_BUFFER %d)\n", sizeof(struct MagBuffer), sizeof(struct MagCalibration),
+         sizeof(SensorFusionGlobals), F_COMPACT_MAG_BUFFER);
+  CalibrateTimer();
+  printf("Timer overhead %.1f ns (subtracted)\n\n", timer_overhead_ns);
+
+  std::vector<Result> results;
+  int slice_runs = std::max(1, reps / 20);
+  BenchFusion(reps, &results);
+  BenchMagCalSlices("magcal4", 4, fUpdateMagCalibration4Slice, kPhases4,
+                    sizeof(kPhases4) / sizeof(kPhases4[0]), slice_runs,
+                    NULL, report_slices, &results);
+  BenchMagCalSlices("magcal7", 7, fUpdateMagCalibration7Slice, kPhases7,
+                    sizeof(kPhases7) / sizeof(kPhases7[0]), slice_runs,
+                    NULL, report_slices, &results);
+  BenchMagCalSlices("magcal10", 10, fUpdateMagCalibration10Slice, kPhases10,
+                    sizeof(kPhases10) / sizeof(kPhases10[0]), slice_runs,
+                    NULL, report_slices, &results);
+#if F_WARM_START_EIGEN
+  BenchMagCalSlices("magcal7_warm", 7, fUpdateMagCalibration7Slice, kPhases7,
+                    sizeof(kPhases7) / sizeof(kPhases7[0]), slice_runs,
+                    &fixture.previous_buffer, report_slices, &results);
+  BenchMagCalSlices("magcal10_warm", 10, fUpdateMagCalibration10Slice, kPhases10,
+                    sizeof(kPhases10) / sizeof(kPhases10[0]), slice_runs,
+                    &fixture.previous_buffer, report_slices, &results);
+#endif
+  BenchMatrix(reps, &results);
+  BenchMagBuffer(reps, &results);
+  BenchOutput(reps, &results);
+
+  std::map<std::string, double> baseline;
+  if (baseline_path != NULL) {
+    baseline = ReadBaseline(baseline_path);
+  }
+  int regressions = 0;
+  printf("%-36s %7s %10s %10s %10s %10s %10s %8s\n", "benchmark", "calls",
+         "ns/call", "min", "median", "p99", "baseline", "change");
+  for (const Result &r : results) {
+    printf("%-36s %7zu %10.1f %10.1f %10.1f %10.1f", r.name.c_str(), r.calls,
+           r.mean, r.min, r.median, r.p99);
+    auto b = baseline.find(r.name);
+    if (b != baseline.end() && b->second > 0.0) {
+      double change = 100.0 * (r.median - b->second) / b->second;
+      bool regressed = (change > threshold_percent) &&
+                       (r.median - b->second > kNoiseFloorNs);
+      regressions += regressed;
+      printf(" %10.1f %+7.1f%%%s\n", b->second, change, regressed ? " REGRESSION" : "");
+    } else {
+      printf("\n");
+    }
+  }
+
+  if (save_path != NULL) {
+    if (!SaveBaseline(save_path, results)) {
+      printf("Cannot write baseline %s\n", save_path);
+      return 2;
+    }
+    printf("\nBaseline saved to %s\n", save_path);
+  }
+  if (regressions) {
+    printf("\n%d benchmark(s) regressed by more than %.0f%%\n", regressions,
+           threshold_percent);
+    return 1;
+  }
+  return 0;
+}  // end main()
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2020-2021 Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+/**
+ * @file history_main.cc
+ * @brief Checks SensorFusion::GetOrientationAt() on the simulated IMU.
+ *
+ * Build with the PlatformIO "native_history" environment.
+ *
+ * After the magnetic calibration has settled, each cycle the orientation is
+ * requested half a loop period after the latest read, as a consumer stamping
+ * GPS fixes or camera frames would. That extrapolated answer, and the latest
+ * result held unchanged, are compared with the interpolated answer for the
+ * same time once the following read has been fused. Results queried at their
+ * own timestamps must come back unchanged.
+ *
+ * Usage: program [simulated_seconds]
+ *   simulated_seconds defaults to 120, of which the first 60 are not measured.
+ *   The exit status is 1 if a check fails.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sensor_fusion_class.h"
+#include "board.h"
+#include "build.h"
+#include "sensor_fusion/hal_host.h"
+#include "simulated_imu.h"
+
+// sensor hardware details, as on the Adafruit breakout board
+#define BOARD_ACCEL_MAG_I2C_ADDR    (0x1F)
+#define BOARD_GYRO_I2C_ADDR         (0x21)
+
+namespace {
+
+const uint32_t kLoopIntervalMicros = 1000000 / LOOP_RATE_HZ;
+const long kSettlingSeconds = 60;
+
+/// rotation angle (deg) between two orientation quaternions, from conjg(a) * b
+/// (atan2 rather than acos of the dot product, which is ill-conditioned near 0)
+double AngleBetweenDeg(const Quaternion &a, const Quaternion &b) {
+  double w = (double)a.q0 * b.q0 + (double)a.q1 * b.q1 + (double)a.q2 * b.q2 + (double)a.q3 * b.q3;
+  double x = (double)a.q0 * b.q1 - (double)a.q1 * b.q0 - (double)a.q2 * b.q3 + (double)a.q3 * b.q2;
+  double y = (double)a.q0 * b.q2 + (double)a.q1 * b.q3 - (double)a.q2 * b.q0 - (double)a.q3 * b.q1;
+  double z = (double)a.q0 * b.q3 - (double)a.q1 * b.q2 + (double)a.q2 * b.q1 - (double)a.q3 * b.q0;
+  return 2.0 * atan2(sqrt(x * x + y * y + z * z), fabs(w)) * 180.0 / M_PI;
+}  // end AngleBetweenDeg()
+
+struct ErrorStats {
+  double sum = 0.0;
+  double max = 0.0;
+  long count = 0;
+  void Add(double error) {
+    sum += error;
+    if (error > max) max = error;
+    count++;
+  }
+};
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  long simulated_seconds = (argc > 1) ? atol(argv[1]) : 120;
+  if (simulated_seconds <= kSettlingSeconds) simulated_seconds = kSettlingSeconds + 1;
+  long num_loops = simulated_seconds * LOOP_RATE_HZ;
+
+  HostTimerInstallClock(HostVirtualClockMicros);
+  HostVirtualClockSet(0);
+  SimulatedImu imu(BOARD_ACCEL_MAG_I2C_ADDR, BOARD_GYRO_I2C_ADDR);
+  if (!imu.Attach()) {
+    printf("trouble attaching simulated sensors\n");
+    return 1;
+  }
+  SensorFusion *sensor_fusion = new SensorFusion();
+  sensor_fusion->InitializeInputOutputSubsystem(NULL, NULL);
+  sensor_fusion->InstallSensor(BOARD_ACCEL_MAG_I2C_ADDR, SensorType::kMagnetometer);
+  sensor_fusion->InstallSensor(BOARD_ACCEL_MAG_I2C_ADDR, SensorType::kAccelerometer);
+  sensor_fusion->InstallSensor(BOARD_ACCEL_MAG_I2C_ADDR, SensorType::kThermometer);
+  sensor_fusion->InstallSensor(BOARD_GYRO_I2C_ADDR, SensorType::kGyroscope);
+  HostVirtualClockAdvance(kLoopIntervalMicros);
+  sensor_fusion->Begin();
+
+  ErrorStats extrapolated;    // extrapolated orientation vs interpolated later
+  ErrorStats held;            // latest orientation vs interpolated later
+  ErrorStats replayed;        // a past result vs the history at its timestamp
+  long query_failures = 0;
+  bool pending = false;
+  uint32_t query_micros = 0;
+  Quaternion query_extrapolated = Quaternion(), query_held = Quaternion();
+  FusionSnapshot previous = FusionSnapshot();
+  previous.iLoopcounter = -1;
+
+  for (long i = 0; i < num_loops; i++) {
+    HostVirtualClockAdvance(kLoopIntervalMicros);
+    sensor_fusion->ReadSensors();
+    sensor_fusion->RunFusion();
+    if (i < kSettlingSeconds * LOOP_RATE_HZ) continue;
+
+    // the time asked about last cycle now lies within the history
+    Quaternion q;
+    if (pending) {
+      if (!sensor_fusion->GetOrientationAt(query_micros, &q)) query_failures++;
+      extrapolated.Add(AngleBetweenDeg(query_extrapolated, q));
+      held.Add(AngleBetweenDeg(query_held, q));
+    }
+    if (previous.iLoopcounter >= 0) {
+      if (!sensor_fusion->GetOrientationAt(previous.iTimestamp, &q)) query_failures++;
+      replayed.Add(AngleBetweenDeg(previous.fqPl, q));
+    }
+
+    // ask about a time half way to the next read
+    FusionSnapshot snapshot;
+    sensor_fusion->GetOrientationSnapshot(&snapshot);
+    query_micros = snapshot.iTimestamp + kLoopIntervalMicros / 2;
+    if (!sensor_fusion->GetOrientationAt(query_micros, &query_extrapolated)) query_failures++;
+    query_held = snapshot.fqPl;
+    pending = true;
+    previous = snapshot;
+  }
+  imu.Detach();
+
+  printf("%ld queries half a loop period (%lu us) ahead of the latest read:\n",
+         extrapolated.count, (unsigned long)(kLoopIntervalMicros / 2));
+  printf("  extrapolated: mean error %.4f deg, max %.4f deg\n",
+         extrapolated.sum / extrapolated.count, extrapolated.max);
+  printf("  latest held:  mean error %.4f deg, max %.4f deg\n",
+         held.sum / held.count, held.max);
+  printf("%ld past results requested at their timestamps: max error %.6f deg\n",
+         replayed.count, replayed.max);
+
+  int result = 0;
+  if (query_failures != 0) {
+    printf("FAIL: %ld queries outside the history\n", query_failures);
+    result = 1;
+  }
+  if (replayed.max > 1E-3) {
+    printf("FAIL: past results not returned unchanged\n");
+    result = 1;
+  }
+  if (extrapolated.sum >= held.sum) {
+    printf("FAIL: extrapolation no better than the latest result\n");
+    result = 1;
+  }
+  if (result == 0) printf("orientation history OK\n");
+  return result;
+}
@@ -0,0 +1,90 @@
+/**
+ * @file host_main.cc
+ * @brief Example host program, running the SensorFusion class on a workstation.
+ *
+ * Build with the PlatformIO "native" environment (pio run -e native). The
+ * simulated FXOS8700/FXAS21002 pair from simulated_imu.cc is attached to the
+ * host I2C bus and the fusion loop is run against the virtual clock, so a
+ * simulated minute of operation takes a fraction of a second. At the end the
+ * host CPU time spent per fusion cycle is printed.
+ *
+ * Usage: program [simulated_seconds] [nvm_file]
+ *   simulated_seconds defaults to 60.
+ *   nvm_file, if given, holds calibrations between runs (as EEPROM would).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "sensor_fusion_class.h"
+#include "board.h"
+#include "build.h"
+#include "sensor_fusion/hal_host.h"
+#include "simulated_imu.h"
+
+// sensor hardware details, as on the Adafruit breakout board
+#define BOARD_ACCEL_MAG_I2C_ADDR    (0x1F)
+#define BOARD_GYRO_I2C_ADDR         (0x21)
+
+int main(int argc, char *argv[]) {
+  const uint32_t kLoopIntervalMicros = 1000000 / LOOP_RATE_HZ;
+  long simulated_seconds = (argc > 1) ? atol(argv[1]) : 60;
+  if (argc > 2) {
+    HostNvmSetFile(argv[2]);
+  }
+
+  // run the whole HAL from the virtual clock, so results are repeatable
+  HostTimerInstallClock(HostVirtualClockMicros);
+  HostVirtualClockSet(0);
+
+  SimulatedImu imu(BOARD_ACCEL_MAG_I2C_ADDR, BOARD_GYRO_I2C_ADDR);
+  if (!imu.Attach()) {
+    printf("trouble attaching simulated sensors\n");
+    return 1;
+  }
+
+  SensorFusion *sensor_fusion = new SensorFusion();
+  sensor_fusion->InitializeInputOutputSubsystem(NULL, NULL);
+  sensor_fusion->InstallSensor(BOARD_ACCEL_MAG_I2C_ADDR, SensorType::kMagnetometer);
+  sensor_fusion->InstallSensor(BOARD_ACCEL_MAG_I2C_ADDR, SensorType::kAccelerometer);
+  sensor_fusion->InstallSensor(BOARD_ACCEL_MAG_I2C_ADDR, SensorType::kThermometer);
+  sensor_fusion->InstallSensor(BOARD_GYRO_I2C_ADDR, SensorType::kGyroscope);
+  // let the sensor FIFOs fill once so the first read in Begin() finds data
+  HostVirtualClockAdvance(kLoopIntervalMicros);
+  sensor_fusion->Begin();
+  printf("Fusion status: %d\n", sensor_fusion->GetSystemStatus());
+
+  long num_loops = simulated_seconds * LOOP_RATE_HZ;
+  clock_t cpu_start = clock();
+  for (long i = 1; i <= num_loops; i++) {
+    HostVirtualClockAdvance(kLoopIntervalMicros);
+    sensor_fusion->ReadSensors();
+    sensor_fusion->RunFusion();
+    if (0 == i % LOOP_RATE_HZ) {
+      printf("%5lds: Heading %03.0f, Pitch %+4.0f, Roll %+4.0f, TurnRate %+5.0f, "
+             "B %3.0f uT, Inc %3.0f deg, Solver %2.0f, FitErr %5.1f%%, Status %d\n",
+             i / LOOP_RATE_HZ,
+             sensor_fusion->GetHeadingDegrees(),
+             sensor_fusion->GetPitchDegrees(),
+             sensor_fusion->GetRollDegrees(),
+             sensor_fusion->GetTurnRateDegPerS(),
+             sensor_fusion->GetMagneticBMag(),
+             sensor_fusion->GetMagneticInclinationDeg(),
+             sensor_fusion->GetMagneticCalSolver(),
+             sensor_fusion->GetMagneticFitError(),
+             sensor_fusion->GetSystemStatus());
+    }
+  }
+  double cpu_secs = (double)(clock() - cpu_start) / CLOCKS_PER_SEC;
+  if (num_loops > 0) {
+    printf("%ld fusion cycles, %.2f us host CPU per cycle\n", num_loops,
+           1E6 * cpu_secs / num_loops);
+  }
+
+  if (argc > 2) {
+    sensor_fusion->SaveMagneticCalibration();
+  }
+  delete sensor_fusion;
+  return 0;
+}  // end main()
@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2020-2021 Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+/**
+ * @file mag_snapshot_main.cc
+ * @brief Restarts the fusion on the file-backed NVM to check the magnetic buffer snapshot.
+ *
+ * Build with the PlatformIO "native_mag_snapshot" environment. Needs
+ * F_MAG_BUFFER_SNAPSHOT in build.h.
+ *
+ * The simulated IMU (simulated_imu.cc) is run from an empty NVM file until
+ * the 10 element calibration is in use, and SaveMagneticCalibration() then
+ * saves the calibration and the magnetic buffer. The fusion is then started
+ * again on the same file:
+ *  - restart: the buffer must be restored in full, calibrations must
+ *    resume at once, and the readings must be kept once the readings
+ *    after the start have been checked against the saved calibration;
+ *  - moved iron: with the hard iron of the magnetometer changed, the
+ *    restored readings must be discarded after that check;
+ *  - corrupted: with a byte of the saved snapshot changed, nothing may be
+ *    restored.
+ *
+ * Usage: program [nvm_file]
+ *   nvm_file defaults to mag_snapshot.nvm, and is overwritten. The exit
+ *   status is 1 if a check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sensor_fusion_class.h"
+#include "board.h"
+#include "build.h"
+#include "sensor_fusion/hal_host.h"
+#include "sensor_fusion/magnetic.h"
+#include "simulated_imu.h"
+
+// sensor hardware details, as on the Adafruit breakout board
+#define BOARD_ACCEL_MAG_I2C_ADDR    (0x1F)
+#define BOARD_GYRO_I2C_ADDR         (0x21)
+
+namespace {
+
+const uint32_t kLoopIntervalMicros = 1000000 / LOOP_RATE_HZ;
+const long kFirstStartSeconds = 1200;   ///< longest run to reach the 10 element calibration
+const long kRestartSeconds = 2 * MAGSNAPSHOTCHECKSECS;  ///< length of each restarted run
+const long kCorruptOffset = 256 + 100;  ///< file offset of a byte of the snapshot's readings
+const float kFitErrorAgingPc = 0.01F;   ///< more than the fit error ages over a restarted run
+
+/// Fusion on the simulated IMU, started on the NVM file set by HostNvmSetFile().
+class SimulatedRun {
+ public:
+  explicit SimulatedRun(const SimulatedImuConfig &config = SimulatedImuConfig())
+      : imu_(BOARD_ACCEL_MAG_I2C_ADDR, BOARD_GYRO_I2C_ADDR, config) {
+    HostVirtualClockSet(0);
+    imu_.Attach();
+    sensor_fusion_.InitializeInputOutputSubsystem(NULL, NULL);
+    sensor_fusion_.InstallSensor(BOARD_ACCEL_MAG_I2C_ADDR, SensorType::kMagnetometer);
+    sensor_fusion_.InstallSensor(BOARD_ACCEL_MAG_I2C_ADDR, SensorType::kAccelerometer);
+    sensor_fusion_.InstallSensor(BOARD_ACCEL_MAG_I2C_ADDR, SensorType::kThermometer);
+    sensor_fusion_.InstallSensor(BOARD_GYRO_I2C_ADDR, SensorType::kGyroscope);
+    HostVirtualClockAdvance(kLoopIntervalMicros);
+    sensor_fusion_.Begin();
+  }
+  ~SimulatedRun() { imu_.Detach(); }
+
+  /// Runs one fusion loop.
+  void Step(void) {
+    HostVirtualClockAdvance(kLoopIntervalMicros);
+    sensor_fusion_.ReadSensors();
+    sensor_fusion_.RunFusion();
+    loops_++;
+  }
+
+  /// Returns the number of calibrations solved since the start.
+  uint32_t CalibrationsSolved(void) { return sensor_fusion_.GetMagneticCalCount(); }
+
+  float Seconds(void) const { return (float)loops_ / LOOP_RATE_HZ; }
+  SensorFusion *fusion(void) { return &sensor_fusion_; }
+
+ private:
+  SimulatedImu imu_;
+  SensorFusion sensor_fusion_;
+  long loops_ = 0;
+};
+
+/// Runs a restarted fusion for kRestartSeconds, reporting when its first calibration was solved and the
+/// readings in the buffer once the check of the readings after the start is over.
+void RunRestart(SimulatedRun *run, const char *name, int *restored, int *after_check,
+                float *first_solved_s) {
+  *restored = run->fusion()->GetMagneticBufferCount();
+  *after_check = -1;
+  *first_solved_s = -1.0F;
+  for (long i = 0; i < kRestartSeconds * LOOP_RATE_HZ; i++) {
+    run->Step();
+    if (i + 1 == (MAGSNAPSHOTCHECKSECS + 1) * LOOP_RATE_HZ) {
+      *after_check = run->fusion()->GetMagneticBufferCount();
+    }
+    if ((*first_solved_s < 0.0F) && (run->CalibrationsSolved() > 0)) {
+      *first_solved_s = run->Seconds();
+    }
+  }
+  printf("%-11s %3d readings restored, first calibration solved at %4.1f s, %3d readings at %d s, "
+         "fit error %4.1f%% at %ld s\n",
+         name, *restored, *first_solved_s, *after_check, MAGSNAPSHOTCHECKSECS + 1,
+         run->fusion()->GetMagneticFitError(), kRestartSeconds);
+}  // end RunRestart()
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  const char *nvm_path = (argc > 1) ? argv[1] : "mag_snapshot.nvm";
+  int result = 0;
+  int restored, after_check;
+  float first_solved_s;
+
+  HostTimerInstallClock(HostVirtualClockMicros);
+  remove(nvm_path);
+  HostNvmSetFile(nvm_path);
+
+  // first start, from an empty NVM, until the 10 element calibration is in use
+  int saved = 0;
+  float saved_fit_error = 0.0F;
+  {
+    SimulatedRun run;
+    float first_solved = -1.0F;
+    while ((run.fusion()->GetMagneticCalSolver() != 10.0F) &&
+           (run.Seconds() < kFirstStartSeconds)) {
+      run.Step();
+      if ((first_solved < 0.0F) && (run.CalibrationsSolved() > 0)) {
+        first_solved = run.Seconds();
+      }
+    }
+    if (run.fusion()->GetMagneticCalSolver() != 10.0F) {
+      printf("FAIL: no 10 element calibration after %ld s\n", kFirstStartSeconds);
+      return 1;
+    }
+    saved = run.fusion()->GetMagneticBufferCount();
+    saved_fit_error = run.fusion()->GetMagneticFitError();
+    run.fusion()->SaveMagneticCalibration();
+    printf("%-11s first calibration solved at %4.1f s, 10 element calibration at %5.1f s, "
+           "%3d readings saved, fit error %4.1f%%\n",
+           "first start", first_solved, run.Seconds(), saved, saved_fit_error);
+  }
+
+  // restart with the same sensor: the whole buffer is restored and calibrations resume at once. each solver is
+  // tried again, and replaces the saved calibration only if it fits as well
+  {
+    SimulatedRun run;
+    RunRestart(&run, "restart", &restored, &after_check, &first_solved_s);
+    if ((restored != saved) || (after_check < saved) || (first_solved_s < 0.0F) ||
+        (first_solved_s > 1.0F)) {
+      printf("FAIL: the snapshot was not restored and used at once\n");
+      result = 1;
+    }
+    if ((run.fusion()->GetMagneticCalSolver() == 0.0F) ||
+        (run.fusion()->GetMagneticFitError() > saved_fit_error + kFitErrorAgingPc)) {
+      printf("FAIL: the calibration in use is worse than the saved one\n");
+      result = 1;
+    }
+  }
+
+  // restart with the hard iron moved: the restored readings no longer fit and are discarded
+  {
+    SimulatedImuConfig config;
+    config.hard_iron_counts[0] += 150;
+    SimulatedRun run(config);
+    RunRestart(&run, "moved iron", &restored, &after_check, &first_solved_s);
+    if ((restored != saved) || (after_check >= MINMEASUREMENTS4CAL)) {
+      printf("FAIL: the stale snapshot was not discarded\n");
+      result = 1;
+    }
+  }
+
+  // restart with the snapshot corrupted: nothing is restored
+  FILE *fp = fopen(nvm_path, "r+b");
+  if ((NULL == fp) || (0 != fseek(fp, kCorruptOffset, SEEK_SET))) {
+    printf("FAIL: cannot open %s\n", nvm_path);
+    return 1;
+  }
+  int c = fgetc(fp);
+  fseek(fp, kCorruptOffset, SEEK_SET);
+  fputc(c ^ 0x01, fp);
+  fclose(fp);
+  {
+    SimulatedRun run;
+    RunRestart(&run, "corrupted", &restored, &after_check, &first_solved_s);
+    if (restored != 0) {
+      printf("FAIL: a corrupted snapshot was restored\n");
+      result = 1;
+    }
+  }
+
+  if (result == 0) printf("magnetic buffer snapshot OK\n");
+  return result;
+}
@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2020-2021 Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+/**
+ * @file magcal_worker_main.cc
+ * @brief Solves the magnetic calibrations in a worker thread, off the fusion loop.
+ *
+ * Build with the PlatformIO "native_magcal_worker" environment.
+ *
+ * Three runs are made on the simulated IMU (simulated_imu.cc):
+ *  - sliced: the calibrations are solved in time slices of RunFusion();
+ *  - lockstep: after EnableBackgroundMagCalibration(), the fusion thread
+ *    itself calls RunBackgroundMagCalibration() after every RunFusion(), so
+ *    each calibration is collected on the cycle after it was handed over,
+ *    and the run is repeatable;
+ *  - threaded: one thread calls RunFusion() and another
+ *    RunBackgroundMagCalibration(), as the fusion and worker tasks would.
+ *    The fusion thread waits fusion_period_us of host time per cycle, so
+ *    that the simulated time does not race ahead of the worker.
+ * Both background runs must end with a calibration from at least the sliced
+ * run's solver, whose field strength agrees with the sliced run's, having
+ * solved more calibrations.
+ * The longest RunFusion() of each run, in host time, shows the calibration
+ * leaving the fusion loop.
+ *
+ * Usage: program [simulated_seconds] [fusion_period_us]
+ *   simulated_seconds defaults to 600 and fusion_period_us to 100.
+ *   The exit status is 1 if a check fails.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "sensor_fusion_class.h"
+#include "board.h"
+#include "build.h"
+#include "sensor_fusion/hal_host.h"
+#include "simulated_imu.h"
+
+// sensor hardware details, as on the Adafruit breakout board
+#define BOARD_ACCEL_MAG_I2C_ADDR    (0x1F)
+#define BOARD_GYRO_I2C_ADDR         (0x21)
+
+namespace {
+
+const uint32_t kLoopIntervalMicros = 1000000 / LOOP_RATE_HZ;
+const float kMaxFieldDifferenceMicroT = 1.0F;
+
+enum class Mode { kSliced, kLockstep, kThreaded };
+
+struct RunResult {
+  float solver;                 ///< solver of the calibration in use at the end
+  float field_ut;               ///< its geomagnetic field strength (uT)
+  float fit_error_pc;           ///< its fit error (%)
+  uint32_t calibrations;        ///< calibrations solved
+  double longest_fusion_us;     ///< longest RunFusion() (host us)
+};
+
+SensorFusion *StartFusion(void) {
+  SensorFusion *sensor_fusion = new SensorFusion();
+  sensor_fusion->InitializeInputOutputSubsystem(NULL, NULL);
+  sensor_fusion->InstallSensor(BOARD_ACCEL_MAG_I2C_ADDR, SensorType::kMagnetometer);
+  sensor_fusion->InstallSensor(BOARD_ACCEL_MAG_I2C_ADDR, SensorType::kAccelerometer);
+  sensor_fusion->InstallSensor(BOARD_ACCEL_MAG_I2C_ADDR, SensorType::kThermometer);
+  sensor_fusion->InstallSensor(BOARD_GYRO_I2C_ADDR, SensorType::kGyroscope);
+  HostVirtualClockAdvance(kLoopIntervalMicros);
+  sensor_fusion->Begin();
+  return sensor_fusion;
+}  // end StartFusion()
+
+RunResult Run(Mode mode, long num_loops, uint32_t fusion_period_us) {
+  HostVirtualClockSet(0);
+  SimulatedImu imu(BOARD_ACCEL_MAG_I2C_ADDR, BOARD_GYRO_I2C_ADDR);
+  imu.Attach();
+  SensorFusion *sensor_fusion = StartFusion();
+  if (mode != Mode::kSliced && !sensor_fusion->EnableBackgroundMagCalibration()) {
+    printf("could not enable the background magnetic calibration\n");
+    exit(1);
+  }
+
+  std::atomic<bool> fusion_done(false);
+  std::thread worker;
+  if (mode == Mode::kThreaded) {
+    worker = std::thread([&]() {
+      while (!fusion_done.load()) {
+        if (!sensor_fusion->RunBackgroundMagCalibration()) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  RunResult result = {};
+  for (long i = 0; i < num_loops; i++) {
+    HostVirtualClockAdvance(kLoopIntervalMicros);
+    sensor_fusion->ReadSensors();
+    auto start = std::chrono::steady_clock::now();
+    sensor_fusion->RunFusion();
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    result.longest_fusion_us = std::max(result.longest_fusion_us, elapsed.count());
+    if (mode == Mode::kLockstep) {
+      sensor_fusion->RunBackgroundMagCalibration();
+    } else if (mode == Mode::kThreaded) {
+      std::this_thread::sleep_for(std::chrono::microseconds(fusion_period_us));
+    }
+  }
+  fusion_done = true;
+  if (worker.joinable()) {
+    worker.join();
+  }
+
+  result.calibrations = sensor_fusion->GetMagneticCalCount();
+  result.solver = sensor_fusion->GetMagneticCalSolver();
+  result.field_ut = sensor_fusion->GetMagneticBMag();
+  result.fit_error_pc = sensor_fusion->GetMagneticFitError();
+  imu.Detach();
+  delete sensor_fusion;
+  return result;
+}  // end Run()
+
+void PrintResult(const char *name, const RunResult &result) {
+  printf("%-9s solver %2.0f, B %.3f uT, fit error %.2f%%, %lu calibrations solved, "
+         "longest RunFusion() %.0f us\n",
+         name, result.solver, result.field_ut, result.fit_error_pc,
+         (unsigned long)result.calibrations, result.longest_fusion_us);
+}  // end PrintResult()
+
+/// Returns false, with a message, if a background run did not calibrate as well and as often as the sliced run.
+bool CheckBackground(const char *name, const RunResult &background, const RunResult &sliced) {
+  bool ok = true;
+  if (background.solver < sliced.solver ||
+      fabsf(background.field_ut - sliced.field_ut) > kMaxFieldDifferenceMicroT) {
+    printf("FAIL: %s calibration differs from the sliced one\n", name);
+    ok = false;
+  }
+  if (background.calibrations <= sliced.calibrations) {
+    printf("FAIL: %s run solved no more calibrations than the sliced run\n", name);
+    ok = false;
+  }
+  return ok;
+}  // end CheckBackground()
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  long simulated_seconds = (argc > 1) ? atol(argv[1]) : 600;
+  long num_loops = simulated_seconds * LOOP_RATE_HZ;
+  uint32_t fusion_period_us = (argc > 2) ? (uint32_t)atol(argv[2]) : 100;
+  int result = 0;
+
+  HostTimerInstallClock(HostVirtualClockMicros);
+
+  RunResult sliced = Run(Mode::kSliced, num_loops, 0);
+  PrintResult("sliced", sliced);
+  RunResult lockstep = Run(Mode::kLockstep, num_loops, 0);
+  PrintResult("lockstep", lockstep);
+  RunResult repeat = Run(Mode::kLockstep, num_loops, 0);
+  RunResult threaded = Run(Mode::kThreaded, num_loops, fusion_period_us);
+  PrintResult("threaded", threaded);
+
+  if (!CheckBackground("lockstep", lockstep, sliced) ||
+      !CheckBackground("threaded", threaded, sliced)) {
+    result = 1;
+  }
+  if (repeat.field_ut != lockstep.field_ut || repeat.fit_error_pc != lockstep.fit_error_pc ||
+      repeat.calibrations != lockstep.calibrations) {
+    printf("FAIL: lockstep runs differ\n");
+    result = 1;
+  }
+
+  if (result == 0) printf("background magnetic calibration OK\n");
+  return result;
+}
@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2020-2021 Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+/**
+ * @file pipeline_main.cc
+ * @brief Runs the pipelined sensor reads with a reader and a fusion thread.
+ *
+ * Build with the PlatformIO "native_pipeline" environment.
+ *
+ * Three runs are made on the simulated IMU (simulated_imu.cc):
+ *  - sequential: ReadSensors() and RunFusion() back to back in one thread;
+ *  - pipelined: after EnablePipelinedReads(), one thread calls ReadSensors()
+ *    and another RunFusion(). The reader waits whenever the ring is full, so
+ *    no batch is lost and the fused results must be identical to the
+ *    sequential run;
+ *  - overrun: the fusion thread is slowed down and the reader does not wait,
+ *    so batches are discarded. The overruns must be reported.
+ *
+ * Usage: program [simulated_seconds] [fusion_delay_us]
+ *   simulated_seconds defaults to 120. fusion_delay_us (default 2000) is
+ *   the extra time the fusion thread takes per cycle in the overrun run.
+ *   The exit status is 1 if a check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "sensor_fusion_class.h"
+#include "board.h"
+#include "build.h"
+#include "sensor_fusion/hal_host.h"
+#include "sensor_fusion/sensor_pipeline.h"
+#include "simulated_imu.h"
+
+// sensor hardware details, as on the Adafruit breakout board
+#define BOARD_ACCEL_MAG_I2C_ADDR    (0x1F)
+#define BOARD_GYRO_I2C_ADDR         (0x21)
+
+namespace {
+
+const uint32_t kLoopIntervalMicros = 1000000 / LOOP_RATE_HZ;
+
+SensorFusion *StartFusion(void) {
+  SensorFusion *sensor_fusion = new SensorFusion();
+  sensor_fusion->InitializeInputOutputSubsystem(NULL, NULL);
+  sensor_fusion->InstallSensor(BOARD_ACCEL_MAG_I2C_ADDR, SensorType::kMagnetometer);
+  sensor_fusion->InstallSensor(BOARD_ACCEL_MAG_I2C_ADDR, SensorType::kAccelerometer);
+  sensor_fusion->InstallSensor(BOARD_ACCEL_MAG_I2C_ADDR, SensorType::kThermometer);
+  sensor_fusion->InstallSensor(BOARD_GYRO_I2C_ADDR, SensorType::kGyroscope);
+  HostVirtualClockAdvance(kLoopIntervalMicros);
+  sensor_fusion->Begin();
+  return sensor_fusion;
+}  // end StartFusion()
+
+void PrintSnapshot(const char *name, const FusionSnapshot &snapshot) {
+  printf("%-10s cycle %6d: q = (%+.7f %+.7f %+.7f %+.7f), heading %7.3f, "
+         "pitch %+7.3f, roll %+7.3f\n",
+         name, (int)snapshot.iLoopcounter, snapshot.fqPl.q0, snapshot.fqPl.q1,
+         snapshot.fqPl.q2, snapshot.fqPl.q3, snapshot.fHeadingDeg,
+         snapshot.fPitchDeg, snapshot.fRollDeg);
+}  // end PrintSnapshot()
+
+void PrintStats(const char *name, const SensorPipelineStats &stats) {
+  printf("%-10s %lu batches produced, %lu consumed, %lu overruns, "
+         "max depth %lu of %d\n",
+         name, (unsigned long)stats.iProduced, (unsigned long)stats.iConsumed,
+         (unsigned long)stats.iOverruns, (unsigned long)stats.iMaxDepth,
+         SENSOR_PIPELINE_DEPTH);
+}  // end PrintStats()
+
+FusionSnapshot RunSequential(long num_loops) {
+  HostVirtualClockSet(0);
+  SimulatedImu imu(BOARD_ACCEL_MAG_I2C_ADDR, BOARD_GYRO_I2C_ADDR);
+  imu.Attach();
+  SensorFusion *sensor_fusion = StartFusion();
+  for (long i = 0; i < num_loops; i++) {
+    HostVirtualClockAdvance(kLoopIntervalMicros);
+    sensor_fusion->ReadSensors();
+    sensor_fusion->RunFusion();
+  }
+  FusionSnapshot snapshot;
+  sensor_fusion->GetOrientationSnapshot(&snapshot);
+  imu.Detach();
+  return snapshot;
+}  // end RunSequential()
+
+/// Runs num_loops reads in one thread and fuses them in another. With
+/// wait_when_full the reader holds back while the ring is full; otherwise it
+/// reads at a steady wall clock pace of one cycle per read_interval_us.
+FusionSnapshot RunPipelined(long num_loops, bool wait_when_full,
+                            uint32_t read_interval_us, uint32_t fusion_delay_us,
+                            SensorPipelineStats *stats) {
+  HostVirtualClockSet(0);
+  SimulatedImu imu(BOARD_ACCEL_MAG_I2C_ADDR, BOARD_GYRO_I2C_ADDR);
+  imu.Attach();
+  SensorFusion *sensor_fusion = StartFusion();
+  if (!sensor_fusion->EnablePipelinedReads()) {
+    printf("could not enable pipelined reads\n");
+    exit(1);
+  }
+  std::atomic<bool> reads_done(false);
+
+  std::thread reader([&]() {
+    for (long i = 0; i < num_loops; i++) {
+      SensorPipelineStats now;
+      while (wait_when_full) {
+        sensor_fusion->GetPipelineStats(&now);
+        if (now.iProduced - now.iConsumed < SENSOR_PIPELINE_DEPTH) break;
+        std::this_thread::yield();
+      }
+      HostVirtualClockAdvance(kLoopIntervalMicros);
+      sensor_fusion->ReadSensors();
+      if (read_interval_us > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(read_interval_us));
+      }
+    }
+    reads_done = true;
+  });
+
+  std::thread fusion([&]() {
+    for (;;) {
+      SensorPipelineStats now;
+      bool done = reads_done.load();
+      sensor_fusion->GetPipelineStats(&now);
+      if (now.iProduced == now.iConsumed) {
+        if (done) break;
+        std::this_thread::yield();
+        continue;
+      }
+      sensor_fusion->RunFusion();
+      if (fusion_delay_us > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(fusion_delay_us));
+      }
+    }
+  });
+
+  reader.join();
+  fusion.join();
+  FusionSnapshot snapshot;
+  sensor_fusion->GetOrientationSnapshot(&snapshot);
+  sensor_fusion->GetPipelineStats(stats);
+  imu.Detach();
+  return snapshot;
+}  // end RunPipelined()
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  long simulated_seconds = (argc > 1) ? atol(argv[1]) : 120;
+  uint32_t fusion_delay_us = (argc > 2) ? (uint32_t)atol(argv[2]) : 2000;
+  long num_loops = simulated_seconds * LOOP_RATE_HZ;
+  int result = 0;
+
+  HostTimerInstallClock(HostVirtualClockMicros);
+
+  FusionSnapshot sequential = RunSequential(num_loops);
+  PrintSnapshot("sequential", sequential);
+
+  SensorPipelineStats stats;
+  FusionSnapshot pipelined = RunPipelined(num_loops, true, 0, 0, &stats);
+  PrintSnapshot("pipelined", pipelined);
+  PrintStats("pipelined", stats);
+  if (sequential.fqPl.q0 != pipelined.fqPl.q0 || sequential.fqPl.q1 != pipelined.fqPl.q1 ||
+      sequential.fqPl.q2 != pipelined.fqPl.q2 || sequential.fqPl.q3 != pipelined.fqPl.q3 ||
+      sequential.iLoopcounter != pipelined.iLoopcounter || stats.iOverruns != 0) {
+    printf("FAIL: pipelined results differ from sequential ones\n");
+    result = 1;
+  }
+
+  // a short run is enough to overflow the ring
+  long overrun_loops = (num_loops < 10 * LOOP_RATE_HZ) ? num_loops : 10 * LOOP_RATE_HZ;
+  RunPipelined(overrun_loops, false, fusion_delay_us / 4, fusion_delay_us, &stats);
+  PrintStats("overrun", stats);
+  if (stats.iOverruns == 0 || stats.iConsumed != stats.iProduced ||
+      stats.iProduced + stats.iOverruns != (uint32_t)overrun_loops) {
+    printf("FAIL: overruns not accounted for\n");
+    result = 1;
+  }
+
+  if (result == 0) printf("pipelined reads OK\n");
+  return result;
+}
@@ -0,0 +1,281 @@
+/*
+ * Copyright (c) 2020-2021 Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+/**
+ * @file sensor_log_main.cc
+ * @brief Records raw sensor logs, and replays them through the fusion.
+ *
+ * Build with the PlatformIO "native_replay" environment.
+ *
+ * Usage: program record log_file [simulated_seconds]
+ *          runs the simulated IMU (simulated_imu.cc) and writes a raw sensor
+ *          log in the format described in sensor_log.h. simulated_seconds
+ *          defaults to 600.
+ *        program replay log_file [nvm_file]
+ *          feeds a log, from the simulator or from a board (see
+ *          SensorFusion::GetSensorLogRecord()), through the fusion as fast as
+ *          possible. nvm_file, if given, holds calibrations between runs.
+ *        program parallel log_file [instances]
+ *          replays the log through a number of fusion instances at once, one
+ *          per thread (default 64), and checks that every instance ends with
+ *          the same result as one replaying on its own. The exit status is 1
+ *          if any differs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <thread>
+#include <vector>
+
+#include "sensor_fusion_class.h"
+#include "board.h"
+#include "build.h"
+#include "sensor_fusion/hal_host.h"
+#include "sensor_fusion/sensor_log.h"
+#include "simulated_imu.h"
+
+// sensor hardware details, as on the Adafruit breakout board
+#define BOARD_ACCEL_MAG_I2C_ADDR    (0x1F)
+#define BOARD_GYRO_I2C_ADDR         (0x21)
+
+namespace {
+
+uint16_t ReadLogFile(void *context, uint8_t *destination, uint16_t num_bytes) {
+  return (uint16_t)fread(destination, 1, num_bytes, (FILE *)context);
+}  // end ReadLogFile()
+
+/// a log held in memory, read by one replay instance
+struct LogCursor {
+  const std::vector<uint8_t> *log;
+  size_t position;
+};
+
+uint16_t ReadLogMemory(void *context, uint8_t *destination, uint16_t num_bytes) {
+  LogCursor *cursor = (LogCursor *)context;
+  size_t available = cursor->log->size() - cursor->position;
+  if (num_bytes > available) num_bytes = (uint16_t)available;
+  memcpy(destination, cursor->log->data() + cursor->position, num_bytes);
+  cursor->position += num_bytes;
+  return num_bytes;
+}  // end ReadLogMemory()
+
+int Record(const char *log_path, long simulated_seconds) {
+  const uint32_t kLoopIntervalMicros = 1000000 / LOOP_RATE_HZ;
+  FILE *log = fopen(log_path, "wb");
+  if (log == NULL) {
+    printf("cannot create %s\n", log_path);
+    return 1;
+  }
+
+  HostTimerInstallClock(HostVirtualClockMicros);
+  HostVirtualClockSet(0);
+  SimulatedImu imu(BOARD_ACCEL_MAG_I2C_ADDR, BOARD_GYRO_I2C_ADDR);
+  if (!imu.Attach()) {
+    printf("trouble attaching simulated sensors\n");
+    return 1;
+  }
+
+  SensorFusion *sensor_fusion = new SensorFusion();
+  sensor_fusion->InitializeInputOutputSubsystem(NULL, NULL);
+  sensor_fusion->InstallSensor(BOARD_ACCEL_MAG_I2C_ADDR, SensorType::kMagnetometer);
+  sensor_fusion->InstallSensor(BOARD_ACCEL_MAG_I2C_ADDR, SensorType::kAccelerometer);
+  sensor_fusion->InstallSensor(BOARD_ACCEL_MAG_I2C_ADDR, SensorType::kThermometer);
+  sensor_fusion->InstallSensor(BOARD_GYRO_I2C_ADDR, SensorType::kGyroscope);
+  HostVirtualClockAdvance(kLoopIntervalMicros);
+  sensor_fusion->Begin();
+
+  static uint8_t buffer[SENSOR_LOG_MAX_RECORD_BYTES];
+  size_t bytes = fwrite(buffer, 1, sensor_fusion->GetSensorLogHeader(buffer), log);
+  long num_loops = simulated_seconds * LOOP_RATE_HZ;
+  for (long i = 1; i <= num_loops; i++) {
+    HostVirtualClockAdvance(kLoopIntervalMicros);
+    sensor_fusion->ReadSensors();
+    bytes += fwrite(buffer, 1, sensor_fusion->GetSensorLogRecord(buffer), log);
+    sensor_fusion->RunFusion();
+  }
+  fclose(log);
+  printf("%ld records, %zu bytes (%.0f bytes/s of log) written to %s\n",
+         num_loops, bytes, (double)bytes / (simulated_seconds ? simulated_seconds : 1),
+         log_path);
+  printf("Heading %03.0f, Solver %2.0f, FitErr %5.1f%% at end of recording\n",
+         sensor_fusion->GetHeadingDegrees(), sensor_fusion->GetMagneticCalSolver(),
+         sensor_fusion->GetMagneticFitError());
+  delete sensor_fusion;
+  return 0;
+}  // end Record()
+
+int Replay(const char *log_path, const char *nvm_path) {
+  FILE *log = fopen(log_path, "rb");
+  if (log == NULL) {
+    printf("cannot open %s\n", log_path);
+    return 1;
+  }
+  if (nvm_path != NULL) {
+    HostNvmSetFile(nvm_path);
+  }
+  // the HAL clock follows the log, so timing seen by the library is as recorded
+  HostTimerInstallClock(HostVirtualClockMicros);
+
+  SensorLogReplay replay;
+  memset(&replay, 0, sizeof(replay));
+  replay.read = ReadLogFile;
+  replay.context = log;
+
+  SensorFusion *sensor_fusion = new SensorFusion();
+  sensor_fusion->InitializeInputOutputSubsystem(NULL, NULL);
+  if (!sensor_fusion->InstallReplaySensor(&replay)) {
+    printf("trouble installing replay sensor\n");
+    return 1;
+  }
+  sensor_fusion->Begin();
+  if (!replay.headerValid) {
+    printf("%s is not a sensor log\n", log_path);
+    return 1;
+  }
+
+  uint32_t first_timestamp = replay.timestamp;
+  uint32_t report_interval = 60 * replay.iFusionHz;
+  clock_t cpu_start = clock();
+  while (true) {
+    sensor_fusion->ReadSensors();
+    if (replay.finished) {
+      break;
+    }
+    HostVirtualClockSet(replay.timestamp);
+    sensor_fusion->RunFusion();
+    if (report_interval && 0 == replay.iRecords % report_interval) {
+      printf("%5lus: Heading %03.0f, Pitch %+4.0f, Roll %+4.0f, "
+             "B %3.0f uT, Solver %2.0f, FitErr %5.1f%%, Status %d\n",
+             (unsigned long)(replay.iRecords / replay.iFusionHz),
+             sensor_fusion->GetHeadingDegrees(),
+             sensor_fusion->GetPitchDegrees(),
+             sensor_fusion->GetRollDegrees(),
+             sensor_fusion->GetMagneticBMag(),
+             sensor_fusion->GetMagneticCalSolver(),
+             sensor_fusion->GetMagneticFitError(),
+             sensor_fusion->GetSystemStatus());
+    }
+  }
+  double cpu_secs = (double)(clock() - cpu_start) / CLOCKS_PER_SEC;
+  double log_secs = 1E-6 * (replay.timestamp - first_timestamp);
+  fclose(log);
+
+  printf("%lu records replayed, %lu corrupt records skipped\n",
+         (unsigned long)replay.iRecords, (unsigned long)replay.iCorrupt);
+  if (cpu_secs > 0.0) {
+    printf("%.0f s of log in %.2f s host CPU: %.0fx real time, %.0f records/s\n",
+           log_secs, cpu_secs, log_secs / cpu_secs, replay.iRecords / cpu_secs);
+  }
+  if (nvm_path != NULL) {
+    sensor_fusion->SaveMagneticCalibration();
+  }
+  delete sensor_fusion;
+  return 0;
+}  // end Replay()
+
+/// Replays the whole of log through a fusion instance of its own, following
+/// the calling thread's clock. Returns false if the log could not be replayed.
+bool ReplayInstance(const std::vector<uint8_t> *log, FusionSnapshot *result) {
+  LogCursor cursor = {log, 0};
+  SensorLogReplay replay;
+  memset(&replay, 0, sizeof(replay));
+  replay.read = ReadLogMemory;
+  replay.context = &cursor;
+  HostThreadClockSet(0);
+
+  SensorFusion *sensor_fusion = new SensorFusion();
+  sensor_fusion->InitializeInputOutputSubsystem(NULL, NULL);
+  bool success = sensor_fusion->InstallReplaySensor(&replay);
+  if (success) {
+    sensor_fusion->Begin();
+    success = replay.headerValid;
+  }
+  while (success) {
+    sensor_fusion->ReadSensors();
+    if (replay.finished) {
+      break;
+    }
+    HostThreadClockSet(replay.timestamp);
+    sensor_fusion->RunFusion();
+    std::this_thread::yield();  // interleave the instances, even on a single core
+  }
+  sensor_fusion->GetOrientationSnapshot(result);
+  delete sensor_fusion;
+  return success;
+}  // end ReplayInstance()
+
+int ReplayParallel(const char *log_path, long instances) {
+  FILE *file = fopen(log_path, "rb");
+  if (file == NULL) {
+    printf("cannot open %s\n", log_path);
+    return 1;
+  }
+  std::vector<uint8_t> log;
+  uint8_t chunk[4096];
+  size_t bytes;
+  while ((bytes = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    log.insert(log.end(), chunk, chunk + bytes);
+  }
+  fclose(file);
+  // each thread follows its own log time
+  HostTimerInstallClock(HostThreadClockMicros);
+
+  FusionSnapshot reference;
+  if (!ReplayInstance(&log, &reference)) {
+    printf("%s is not a sensor log\n", log_path);
+    return 1;
+  }
+
+  std::vector<FusionSnapshot> results(instances);
+  std::vector<char> replayed(instances);
+  std::vector<std::thread> threads;
+  clock_t cpu_start = clock();
+  for (long i = 0; i < instances; i++) {
+    threads.emplace_back([&, i]() { replayed[i] = ReplayInstance(&log, &results[i]); });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  double cpu_secs = (double)(clock() - cpu_start) / CLOCKS_PER_SEC;
+
+  long differing = 0;
+  for (long i = 0; i < instances; i++) {
+    if (!replayed[i] || memcmp(&results[i].fqPl, &reference.fqPl, sizeof(Quaternion)) != 0 ||
+        results[i].iLoopcounter != reference.iLoopcounter) {
+      differing++;
+    }
+  }
+  printf("%ld instances replayed %d cycles each in %.2f s host CPU, %ld differ from a lone "
+         "replay\n", instances, (int)reference.iLoopcounter, cpu_secs, differing);
+  if (differing != 0) {
+    printf("FAIL: instances interfere with each other\n");
+    return 1;
+  }
+  printf("parallel replays OK\n");
+  return 0;
+}  // end ReplayParallel()
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc >= 3 && !strcmp(argv[1], "record")) {
+    return Record(argv[2], (argc > 3) ? atol(argv[3]) : 600);
+  }
+  if (argc >= 3 && !strcmp(argv[1], "replay")) {
+    return Replay(argv[2], (argc > 3) ? argv[3] : NULL);
+  }
+  if (argc >= 3 && !strcmp(argv[1], "parallel")) {
+    long instances = (argc > 3) ? atol(argv[3]) : 64;
+    return ReplayParallel(argv[2], (instances > 0) ? instances : 1);
+  }
+  printf("usage: %s record log_file [simulated_seconds]\n"
+         "       %s replay log_file [nvm_file]\n"
+         "       %s parallel log_file [instances]\n", argv[0], argv[0], argv[0]);
+  return 2;
+}  // end main()
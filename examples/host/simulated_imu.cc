@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2020-2021 Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+/**
+ * @file simulated_imu.cc
+ * @brief Simulated FXOS8700 + FXAS21002 pair for the host I2C bus.
+ */
+
+#include "simulated_imu.h"
+
+#include <math.h>
+#include <stddef.h>
+
+#include "build.h"
+#include "sensor_fusion/hal_timer.h"
+
+// register addresses and constants, as used by driver_fxos8700.c and driver_fxas21002.c
+#define SIM_FXOS8700_STATUS       0x00
+#define SIM_FXOS8700_OUT_X_MSB    0x01
+#define SIM_FXOS8700_WHO_AM_I     0x0D
+#define SIM_FXOS8700_M_OUT_X_MSB  0x33
+#define SIM_FXOS8700_TEMP         0x51
+#define SIM_FXOS8700_WHO_AM_I_VAL 0xC7
+#define SIM_FXAS21002_STATUS      0x00
+#define SIM_FXAS21002_OUT_X_MSB   0x01
+#define SIM_FXAS21002_WHO_AM_I    0x0C
+#define SIM_FXAS21002_WHO_AM_I_VAL 0xD7
+#define SIM_FIFO_DEPTH            32
+#define SIM_ACCEL_COUNTS_PER_G    8192.0F
+#define SIM_MAG_COUNTS_PER_UT     10.0F
+#define SIM_GYRO_COUNTS_PER_DPS   16.0F
+
+static const double kDegToRad = 3.14159265358979323846 / 180.0;
+
+// current HAL time in microseconds, from whichever clock is installed
+static uint32_t NowMicros(void) {
+  int32_t now;
+  SystickStartCount(&now);
+  return (uint32_t)now;
+}
+
+// place a sample into a big-endian 6 byte register image
+static void PackSample(const int16_t sample[3], uint8_t *destination) {
+  for (int i = 0; i < 3; i++) {
+    destination[2 * i] = (uint8_t)((uint16_t)sample[i] >> 8);
+    destination[2 * i + 1] = (uint8_t)((uint16_t)sample[i] & 0xFF);
+  }
+}
+
+static int16_t Saturate(float value) {
+  if (value > 32767.0F) return 32767;
+  if (value < -32767.0F) return -32767;
+  return (int16_t)lrintf(value);
+}
+
+SimulatedImu::SimulatedImu(uint8_t accel_mag_addr, uint8_t gyro_addr,
+                           const SimulatedImuConfig &config)
+    : config_(config) {
+  accel_mag_endpoint_.address = accel_mag_addr;
+  accel_mag_endpoint_.context = this;
+  accel_mag_endpoint_.read = AccelMagRead;
+  accel_mag_endpoint_.write = RegisterWrite;
+  accel_mag_endpoint_.next = NULL;
+  gyro_endpoint_.address = gyro_addr;
+  gyro_endpoint_.context = this;
+  gyro_endpoint_.read = GyroRead;
+  gyro_endpoint_.write = RegisterWrite;
+  gyro_endpoint_.next = NULL;
+  start_micros_ = NowMicros();
+}  // end SimulatedImu()
+
+SimulatedImu::~SimulatedImu() { Detach(); }
+
+/**
+ * @brief Place both simulated ICs on the host I2C bus.
+ * @return True if both addresses were free.
+ */
+bool SimulatedImu::Attach(void) {
+  start_micros_ = NowMicros();
+  accel_consumed_ = 0;
+  gyro_consumed_ = 0;
+  return HostI2CAttachEndpoint(&accel_mag_endpoint_) &&
+         HostI2CAttachEndpoint(&gyro_endpoint_);
+}  // end Attach()
+
+void SimulatedImu::Detach(void) {
+  HostI2CDetachEndpoint(&accel_mag_endpoint_);
+  HostI2CDetachEndpoint(&gyro_endpoint_);
+}  // end Detach()
+
+/**
+ * @brief Get the simulated attitude at the current HAL time.
+ * Angles are those of OrientVector(): yaw from north, increasing without
+ * wrapping, then pitch and roll, all in the NED frame.
+ */
+void SimulatedImu::TrueAttitude(float *yaw_deg, float *pitch_deg, float *roll_deg) {
+  const double kTwoPi = 2.0 * 3.14159265358979323846;
+  double t_secs = (NowMicros() - start_micros_) * 1E-6;
+  *yaw_deg = (float)(config_.yaw_rate_dps * t_secs);
+  *pitch_deg = (float)(config_.pitch_amplitude_deg * sin(kTwoPi * t_secs / config_.pitch_period_s));
+  *roll_deg = (float)(config_.roll_amplitude_deg * sin(kTwoPi * t_secs / config_.roll_period_s));
+}  // end TrueAttitude()
+
+// Number of samples waiting in a FIFO of a sensor running at odr_hz.
+// Samples older than the FIFO depth are lost, as on the real part.
+uint8_t SimulatedImu::FifoCount(uint32_t *consumed, double odr_hz) {
+  uint32_t produced = (uint32_t)((NowMicros() - start_micros_) * odr_hz / 1E6);
+  if (produced - *consumed > SIM_FIFO_DEPTH) {
+    *consumed = produced - SIM_FIFO_DEPTH;
+  }
+  return (uint8_t)(produced - *consumed);
+}  // end FifoCount()
+
+// Actual ODR of the gyro, including its clock error.
+double SimulatedImu::GyroOdrHz(void) {
+  return GYRO_ODR_HZ * (1.0 + config_.gyro_odr_error_percent / 100.0);
+}  // end GyroOdrHz()
+
+// Rotate a world-fixed NED vector into the body frame at time t_secs.
+// Attitude is yaw-pitch-roll (ZYX) with yaw = rate * t and sinusoidal
+// pitch and roll, so body = Rx(roll)^T Ry(pitch)^T Rz(yaw)^T world.
+void SimulatedImu::OrientVector(const float world[3], double t_secs, float body[3]) {
+  double yaw = config_.yaw_rate_dps * kDegToRad * t_secs;
+  double pitch = config_.pitch_amplitude_deg * kDegToRad *
+                 sin(2.0 * 3.14159265358979323846 * t_secs / config_.pitch_period_s);
+  double roll = config_.roll_amplitude_deg * kDegToRad *
+                sin(2.0 * 3.14159265358979323846 * t_secs / config_.roll_period_s);
+  double v[3] = {world[0], world[1], world[2]};
+  double tmp;
+  // undo yaw
+  tmp = cos(yaw) * v[0] + sin(yaw) * v[1];
+  v[1] = -sin(yaw) * v[0] + cos(yaw) * v[1];
+  v[0] = tmp;
+  // undo pitch
+  tmp = cos(pitch) * v[0] - sin(pitch) * v[2];
+  v[2] = sin(pitch) * v[0] + cos(pitch) * v[2];
+  v[0] = tmp;
+  // undo roll
+  tmp = cos(roll) * v[1] + sin(roll) * v[2];
+  v[2] = -sin(roll) * v[1] + cos(roll) * v[2];
+  v[1] = tmp;
+  for (int i = 0; i < 3; i++) {
+    body[i] = (float)v[i];
+  }
+}  // end OrientVector()
+
+// Body frame angular velocity (deg/s) from the Euler angle rates.
+void SimulatedImu::BodyRate(double t_secs, float omega[3]) {
+  const double kTwoPi = 2.0 * 3.14159265358979323846;
+  double wp = kTwoPi / config_.pitch_period_s;
+  double wr = kTwoPi / config_.roll_period_s;
+  double pitch = config_.pitch_amplitude_deg * kDegToRad * sin(wp * t_secs);
+  double roll = config_.roll_amplitude_deg * kDegToRad * sin(wr * t_secs);
+  double yaw_dot = config_.yaw_rate_dps;
+  double pitch_dot = config_.pitch_amplitude_deg * wp * cos(wp * t_secs);
+  double roll_dot = config_.roll_amplitude_deg * wr * cos(wr * t_secs);
+  omega[0] = (float)(roll_dot - yaw_dot * sin(pitch));
+  omega[1] = (float)(pitch_dot * cos(roll) + yaw_dot * cos(pitch) * sin(roll));
+  omega[2] = (float)(-pitch_dot * sin(roll) + yaw_dot * cos(pitch) * cos(roll));
+}  // end BodyRate()
+
+// Accelerometer sample number index, in sensor (not NED) axes.
+void SimulatedImu::SampleAccel(uint32_t index, int16_t sample[3]) {
+  static const float kGravity[3] = {0.0F, 0.0F, 1.0F};
+  float ned[3];
+  OrientVector(kGravity, (double)index / ACCEL_ODR_HZ, ned);
+  // inverse of ApplyAccelHAL() for NED
+  sample[0] = Saturate(ned[1] * SIM_ACCEL_COUNTS_PER_G + Noise(config_.accel_noise_counts));
+  sample[1] = Saturate(ned[0] * SIM_ACCEL_COUNTS_PER_G + Noise(config_.accel_noise_counts));
+  sample[2] = Saturate(ned[2] * SIM_ACCEL_COUNTS_PER_G + Noise(config_.accel_noise_counts));
+}  // end SampleAccel()
+
+// Magnetometer sample at the current time, in sensor axes.
+void SimulatedImu::SampleMag(int16_t sample[3]) {
+  float inclination = (float)(config_.inclination_deg * kDegToRad);
+  float field[3] = {config_.geomagnetic_b_ut * cosf(inclination), 0.0F,
+                    config_.geomagnetic_b_ut * sinf(inclination)};
+  float ned[3];
+  OrientVector(field, (NowMicros() - start_micros_) * 1E-6, ned);
+  // inverse of ApplyMagHAL() for NED
+  sample[0] = Saturate(-ned[1] * SIM_MAG_COUNTS_PER_UT + config_.hard_iron_counts[0] +
+                       Noise(config_.mag_noise_counts));
+  sample[1] = Saturate(-ned[0] * SIM_MAG_COUNTS_PER_UT + config_.hard_iron_counts[1] +
+                       Noise(config_.mag_noise_counts));
+  sample[2] = Saturate(-ned[2] * SIM_MAG_COUNTS_PER_UT + config_.hard_iron_counts[2] +
+                       Noise(config_.mag_noise_counts));
+}  // end SampleMag()
+
+// Gyroscope sample number index, in sensor axes.
+void SimulatedImu::SampleGyro(uint32_t index, int16_t sample[3]) {
+  float ned[3];
+  BodyRate((double)index / GyroOdrHz(), ned);
+  // inverse of ApplyGyroHAL() for NED
+  sample[0] = Saturate(-ned[1] * SIM_GYRO_COUNTS_PER_DPS + Noise(config_.gyro_noise_counts));
+  sample[1] = Saturate(-ned[0] * SIM_GYRO_COUNTS_PER_DPS + Noise(config_.gyro_noise_counts));
+  sample[2] = Saturate(-ned[2] * SIM_GYRO_COUNTS_PER_DPS + Noise(config_.gyro_noise_counts));
+}  // end SampleGyro()
+
+// uniform pseudo-random noise in [-peak, peak], repeatable from run to run
+int16_t SimulatedImu::Noise(int16_t peak) {
+  if (peak <= 0) {
+    return 0;
+  }
+  noise_state_ = noise_state_ * 1664525U + 1013904223U;
+  return (int16_t)((int32_t)((noise_state_ >> 16) % (2U * peak + 1U)) - peak);
+}  // end Noise()
+
+bool SimulatedImu::AccelMagRead(void *context, uint8_t reg, uint8_t *destination,
+                                int num_bytes) {
+  SimulatedImu *imu = (SimulatedImu *)context;
+  int16_t sample[3];
+  switch (reg) {
+    case SIM_FXOS8700_WHO_AM_I:
+      destination[0] = SIM_FXOS8700_WHO_AM_I_VAL;
+      return (num_bytes == 1);
+    case SIM_FXOS8700_STATUS:
+      destination[0] = imu->FifoCount(&imu->accel_consumed_, ACCEL_ODR_HZ);
+      return (num_bytes == 1);
+    case SIM_FXOS8700_OUT_X_MSB:
+      // burst read with address wrap: 6 bytes per FIFO packet
+      for (int i = 0; i + 6 <= num_bytes; i += 6) {
+        imu->SampleAccel(imu->accel_consumed_++, sample);
+        PackSample(sample, &destination[i]);
+      }
+      return (num_bytes % 6 == 0);
+    case SIM_FXOS8700_M_OUT_X_MSB:
+      imu->SampleMag(sample);
+      PackSample(sample, destination);
+      return (num_bytes == 6);
+    case SIM_FXOS8700_TEMP:
+      destination[0] = (uint8_t)imu->config_.temperature_c;
+      return (num_bytes == 1);
+    default:
+      return false;
+  }
+}  // end AccelMagRead()
+
+bool SimulatedImu::GyroRead(void *context, uint8_t reg, uint8_t *destination,
+                            int num_bytes) {
+  SimulatedImu *imu = (SimulatedImu *)context;
+  int16_t sample[3];
+  switch (reg) {
+    case SIM_FXAS21002_WHO_AM_I:
+      destination[0] = SIM_FXAS21002_WHO_AM_I_VAL;
+      return (num_bytes == 1);
+    case SIM_FXAS21002_STATUS:
+      destination[0] = imu->FifoCount(&imu->gyro_consumed_, imu->GyroOdrHz());
+      return (num_bytes == 1);
+    case SIM_FXAS21002_OUT_X_MSB:
+      for (int i = 0; i + 6 <= num_bytes; i += 6) {
+        imu->SampleGyro(imu->gyro_consumed_++, sample);
+        PackSample(sample, &destination[i]);
+      }
+      return (num_bytes % 6 == 0);
+    default:
+      return false;
+  }
+}  // end GyroRead()
+
+// configuration writes are accepted and ignored: the simulation always runs
+// at the ODRs given in build.h, the gyro off by gyro_odr_error_percent
+bool SimulatedImu::RegisterWrite(void *context, uint8_t reg, const uint8_t *value,
+                                 unsigned int num_bytes) {
+  (void)context;
+  (void)reg;
+  (void)value;
+  return (num_bytes > 0);
+}  // end RegisterWrite()
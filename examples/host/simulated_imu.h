@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2020-2021 Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+/**
+ * @file simulated_imu.h
+ * @brief Simulated FXOS8700 + FXAS21002 pair for the host I2C bus.
+ *
+ * The simulated board turns steadily in yaw while rocking in pitch and roll
+ * with incommensurate periods, which sweeps the geomagnetic vector over most
+ * of the sphere and so gives the magnetic calibration a usable constellation. FIFO depths follow
+ * the HAL clock (see hal_host.h) and the ODRs requested in build.h, so the
+ * unmodified FXOS8700_Read() and FXAS21002_Read() drivers see the same
+ * register traffic they would on real hardware.
+ */
+
+#ifndef SIMULATED_IMU_H_
+#define SIMULATED_IMU_H_
+
+#include <stdint.h>
+
+#include "sensor_fusion/hal_host.h"
+
+/**
+ * Motion and sensor error parameters for the simulated board.
+ * Angles are in degrees, fields in uT, rates in deg/s, all in the NED frame
+ * that the fusion sees after hal_axis_remap.c is applied.
+ */
+struct SimulatedImuConfig {
+  float yaw_rate_dps = 15.0F;                      ///< steady turn rate
+  float pitch_amplitude_deg = 50.0F;               ///< peak pitch
+  float pitch_period_s = 23.0F;                    ///< pitch oscillation period
+  float roll_amplitude_deg = 70.0F;                ///< peak roll
+  float roll_period_s = 37.0F;                     ///< roll oscillation period
+  float geomagnetic_b_ut = 50.0F;                  ///< field strength
+  float inclination_deg = 60.0F;                   ///< field dip angle
+  int16_t hard_iron_counts[3] = {300, -150, 80};   ///< magnetometer offset, sensor frame
+  int16_t accel_noise_counts = 20;                 ///< peak uniform noise
+  int16_t mag_noise_counts = 5;                    ///< peak uniform noise
+  int16_t gyro_noise_counts = 3;                   ///< peak uniform noise
+  float gyro_odr_error_percent = 0.0F;             ///< gyro clock error: actual ODR vs GYRO_ODR_HZ
+  int8_t temperature_c = 23;                       ///< die temperature
+};
+
+/**
+ * Owns the two I2C endpoints and the state of the simulated motion.
+ */
+class SimulatedImu {
+ public:
+  explicit SimulatedImu(uint8_t accel_mag_addr = 0x1F, uint8_t gyro_addr = 0x21,
+                        const SimulatedImuConfig &config = SimulatedImuConfig());
+  ~SimulatedImu();
+  bool Attach(void);
+  void Detach(void);
+  void TrueAttitude(float *yaw_deg, float *pitch_deg, float *roll_deg);
+
+ private:
+  static bool AccelMagRead(void *context, uint8_t reg, uint8_t *destination,
+                           int num_bytes);
+  static bool GyroRead(void *context, uint8_t reg, uint8_t *destination,
+                       int num_bytes);
+  static bool RegisterWrite(void *context, uint8_t reg, const uint8_t *value,
+                            unsigned int num_bytes);
+  uint8_t FifoCount(uint32_t *consumed, double odr_hz);
+  double GyroOdrHz(void);
+  void OrientVector(const float world[3], double t_secs, float body[3]);
+  void BodyRate(double t_secs, float omega[3]);
+  void SampleAccel(uint32_t index, int16_t sample[3]);
+  void SampleMag(int16_t sample[3]);
+  void SampleGyro(uint32_t index, int16_t sample[3]);
+  int16_t Noise(int16_t peak);
+
+  SimulatedImuConfig config_;
+  HostI2CEndpoint accel_mag_endpoint_;
+  HostI2CEndpoint gyro_endpoint_;
+  uint32_t start_micros_;
+  uint32_t accel_consumed_ = 0;     ///< accel samples already read out of FIFO
+  uint32_t gyro_consumed_ = 0;      ///< gyro samples already read out of FIFO
+  uint32_t noise_state_ = 12345U;   ///< LCG state, fixed for repeatable runs
+};  // end SimulatedImu
+
+#endif  // SIMULATED_IMU_H_
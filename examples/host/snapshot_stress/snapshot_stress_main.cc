@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2020-2021 Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+/**
+ * @file snapshot_stress_main.cc
+ * @brief Multi-threaded stress test of the fusion result snapshot.
+ *
+ * Build with the PlatformIO "native_snapshot_stress" environment.
+ *
+ * Two checks are run, each with one writer thread and several reader threads:
+ *  - latch: the writer publishes synthetic snapshots as fast as it can, every
+ *    field derived from the publication number, and the readers check that
+ *    each snapshot they get is complete and that publications never go
+ *    backwards. Half of the readers wait for an odd sequence count before
+ *    reading, so that many reads land on copy 1 while the writer fills copy 0,
+ *    and there must be some. For comparison the same words are also written
+ *    to a plain buffer without the sequence counter, and torn reads of it are
+ *    counted.
+ *  - fusion: the writer runs SensorFusion on the simulated IMU, and the
+ *    readers call GetOrientationSnapshot() and check that the cycle counter
+ *    only advances with the publications and that valid orientations are unit
+ *    quaternions.
+ *
+ * Usage: program [seconds] [readers]
+ *   seconds (default 5) is the wall time of each check, readers defaults to 3.
+ *   The exit status is 1 if a torn or out-of-order snapshot was read, or if no
+ *   read of the latch landed on copy 1.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "sensor_fusion_class.h"
+#include "board.h"
+#include "build.h"
+#include "sensor_fusion/fusion_snapshot.h"
+#include "sensor_fusion/hal_host.h"
+#include "simulated_imu.h"
+
+// sensor hardware details, as on the Adafruit breakout board
+#define BOARD_ACCEL_MAG_I2C_ADDR    (0x1F)
+#define BOARD_GYRO_I2C_ADDR         (0x21)
+
+namespace {
+
+/// what each reader saw
+struct ReaderResult {
+  uint64_t reads = 0;
+  uint64_t new_snapshots = 0;   ///< reads that returned a later publication
+  uint64_t copy1_reads = 0;     ///< reads of copy 1, made while the writer filled copy 0
+  uint64_t torn = 0;            ///< fields not all from the same publication
+  uint64_t out_of_order = 0;    ///< publication earlier than one already seen
+  uint64_t unsafe_reads = 0;    ///< reads of the unsynchronized buffer
+  uint64_t unsafe_torn = 0;     ///< torn reads of the unsynchronized buffer
+};
+
+/// Synthetic snapshot for publication n; every word differs between publications.
+FusionSnapshot MakeSnapshot(uint32_t n) {
+  FusionSnapshot snapshot;
+  float f = (float)(n & 0xFFFFF);  // exact in a float
+  snapshot.fqPl.q0 = f;
+  snapshot.fqPl.q1 = f + 0.25F;
+  snapshot.fqPl.q2 = f + 0.5F;
+  snapshot.fqPl.q3 = f + 0.75F;
+  snapshot.fHeadingDeg = -f;
+  snapshot.fPitchDeg = -f - 0.25F;
+  snapshot.fRollDeg = -f - 0.5F;
+  snapshot.fTurnRateDegPerS = f * 2.0F;
+  snapshot.fPitchRateDegPerS = f * 4.0F;
+  snapshot.fRollRateDegPerS = f * 8.0F;
+  snapshot.fAccelGees[0] = f * 0.5F;
+  snapshot.fAccelGees[1] = f * 0.25F;
+  snapshot.fAccelGees[2] = f * 0.125F;
+  snapshot.iTimestamp = n * 25000U;
+  snapshot.iLoopcounter = (int32_t)n;
+  snapshot.iStatus = (int32_t)(n ^ 0x5A5A5A5AU);
+  snapshot.iValid = (int32_t)~n;
+  return snapshot;
+}  // end MakeSnapshot()
+
+bool IsComplete(const FusionSnapshot &snapshot) {
+  FusionSnapshot expected = MakeSnapshot((uint32_t)snapshot.iLoopcounter);
+  return 0 == memcmp(&snapshot, &expected, sizeof(FusionSnapshot));
+}  // end IsComplete()
+
+void StressLatch(double seconds, int num_readers) {
+  static FusionSnapshotLatch latch;
+  static uint32_t unsafe_words[FUSION_SNAPSHOT_WORDS];
+  std::atomic<bool> stop(false);
+  std::vector<ReaderResult> results(num_readers);
+  std::vector<std::thread> readers;
+  uint32_t publications = 0;
+
+  FusionSnapshotReset(&latch);
+  for (int r = 0; r < num_readers; r++) {
+    readers.emplace_back([&, r]() {
+      ReaderResult &result = results[r];
+      uint32_t last = 0;
+      while (!stop.load(std::memory_order_relaxed)) {
+        // odd readers start while copy 0 is being written. a read returning the publication before an odd
+        // sequence 2n + 1 seen beforehand, n, must have been made at that sequence, from copy 1
+        uint32_t sequence = __atomic_load_n(&latch.iSequence, __ATOMIC_ACQUIRE);
+        while ((r & 1) && !(sequence & 1) && !stop.load(std::memory_order_relaxed)) {
+          sequence = __atomic_load_n(&latch.iSequence, __ATOMIC_ACQUIRE);
+        }
+        FusionSnapshot snapshot;
+        uint32_t count = FusionSnapshotRead(&latch, &snapshot);
+        result.reads++;
+        if ((sequence & 1) && count == (sequence >> 1)) result.copy1_reads++;
+        if (count == 0) continue;
+        if (!IsComplete(snapshot) || (uint32_t)snapshot.iLoopcounter != count) {
+          result.torn++;
+        }
+        if (count < last) result.out_of_order++;
+        if (count > last) result.new_snapshots++;
+        last = count;
+
+        // the same words, written without the sequence counter
+        uint32_t words[FUSION_SNAPSHOT_WORDS];
+        for (unsigned i = 0; i < FUSION_SNAPSHOT_WORDS; i++) {
+          words[i] = __atomic_load_n(&unsafe_words[i], __ATOMIC_RELAXED);
+        }
+        memcpy(&snapshot, words, sizeof(FusionSnapshot));
+        result.unsafe_reads++;
+        if (snapshot.iLoopcounter != 0 && !IsComplete(snapshot)) result.unsafe_torn++;
+      }
+    });
+  }
+
+  auto end = std::chrono::steady_clock::now() + std::chrono::duration<double>(seconds);
+  while (std::chrono::steady_clock::now() < end) {
+    for (int i = 0; i < 1000; i++) {
+      FusionSnapshot snapshot = MakeSnapshot(++publications);
+      FusionSnapshotPublish(&latch, &snapshot);
+      uint32_t words[FUSION_SNAPSHOT_WORDS];
+      memcpy(words, &snapshot, sizeof(FusionSnapshot));
+      for (unsigned k = 0; k < FUSION_SNAPSHOT_WORDS; k++) {
+        __atomic_store_n(&unsafe_words[k], words[k], __ATOMIC_RELAXED);
+      }
+    }
+  }
+  stop = true;
+  for (auto &reader : readers) reader.join();
+
+  ReaderResult total;
+  for (const auto &result : results) {
+    total.reads += result.reads;
+    total.new_snapshots += result.new_snapshots;
+    total.copy1_reads += result.copy1_reads;
+    total.torn += result.torn;
+    total.out_of_order += result.out_of_order;
+    total.unsafe_reads += result.unsafe_reads;
+    total.unsafe_torn += result.unsafe_torn;
+  }
+  printf("latch: %u publications, %llu reads (%llu new, %llu of copy 1), %llu torn, %llu out of order\n",
+         publications, (unsigned long long)total.reads,
+         (unsigned long long)total.new_snapshots, (unsigned long long)total.copy1_reads,
+         (unsigned long long)total.torn, (unsigned long long)total.out_of_order);
+  printf("       without the sequence counter: %llu of %llu reads torn\n",
+         (unsigned long long)total.unsafe_torn, (unsigned long long)total.unsafe_reads);
+  if (total.torn != 0 || total.out_of_order != 0) exit(1);
+  if (total.copy1_reads == 0) {
+    printf("no read landed on copy 1\n");
+    exit(1);
+  }
+}  // end StressLatch()
+
+void StressFusion(double seconds, int num_readers) {
+  const uint32_t kLoopIntervalMicros = 1000000 / LOOP_RATE_HZ;
+  std::atomic<bool> stop(false);
+  std::vector<ReaderResult> results(num_readers);
+  std::vector<std::thread> readers;
+  std::vector<uint64_t> bad_quaternions(num_readers, 0);
+
+  HostTimerInstallClock(HostVirtualClockMicros);
+  HostVirtualClockSet(0);
+  SimulatedImu imu(BOARD_ACCEL_MAG_I2C_ADDR, BOARD_GYRO_I2C_ADDR);
+  if (!imu.Attach()) {
+    printf("trouble attaching simulated sensors\n");
+    exit(1);
+  }
+  SensorFusion *sensor_fusion = new SensorFusion();
+  sensor_fusion->InitializeInputOutputSubsystem(NULL, NULL);
+  sensor_fusion->InstallSensor(BOARD_ACCEL_MAG_I2C_ADDR, SensorType::kMagnetometer);
+  sensor_fusion->InstallSensor(BOARD_ACCEL_MAG_I2C_ADDR, SensorType::kAccelerometer);
+  sensor_fusion->InstallSensor(BOARD_ACCEL_MAG_I2C_ADDR, SensorType::kThermometer);
+  sensor_fusion->InstallSensor(BOARD_GYRO_I2C_ADDR, SensorType::kGyroscope);
+  HostVirtualClockAdvance(kLoopIntervalMicros);
+  sensor_fusion->Begin();
+
+  for (int r = 0; r < num_readers; r++) {
+    readers.emplace_back([&, r]() {
+      ReaderResult &result = results[r];
+      uint32_t last = 0;
+      int32_t last_loopcounter = 0;
+      while (!stop.load(std::memory_order_relaxed)) {
+        FusionSnapshot snapshot;
+        uint32_t count = sensor_fusion->GetOrientationSnapshot(&snapshot);
+        result.reads++;
+        if (count == 0) continue;
+        // each publication follows one increment of the loop counter, or none
+        // for the gyro predictions in between fusions (LOOP_RATE_HZ > FUSION_HZ)
+        if (last != 0 && (snapshot.iLoopcounter < last_loopcounter ||
+                          snapshot.iLoopcounter - last_loopcounter > (int32_t)(count - last))) {
+          result.torn++;
+        }
+        last_loopcounter = snapshot.iLoopcounter;
+        if (count < last) result.out_of_order++;
+        if (count > last) result.new_snapshots++;
+        last = count;
+        if (snapshot.iValid) {
+          const Quaternion &q = snapshot.fqPl;
+          float norm = sqrtf(q.q0 * q.q0 + q.q1 * q.q1 + q.q2 * q.q2 + q.q3 * q.q3);
+          if (fabsf(norm - 1.0F) > 1E-3F) bad_quaternions[r]++;
+        }
+      }
+    });
+  }
+
+  long cycles = 0;
+  auto end = std::chrono::steady_clock::now() + std::chrono::duration<double>(seconds);
+  while (std::chrono::steady_clock::now() < end) {
+    HostVirtualClockAdvance(kLoopIntervalMicros);
+    sensor_fusion->ReadSensors();
+    sensor_fusion->RunFusion();
+    cycles++;
+  }
+  stop = true;
+  for (auto &reader : readers) reader.join();
+  imu.Detach();
+  HostTimerInstallClock(NULL);
+
+  ReaderResult total;
+  uint64_t total_bad_quaternions = 0;
+  for (int r = 0; r < num_readers; r++) {
+    total.reads += results[r].reads;
+    total.new_snapshots += results[r].new_snapshots;
+    total.torn += results[r].torn;
+    total.out_of_order += results[r].out_of_order;
+    total_bad_quaternions += bad_quaternions[r];
+  }
+  printf("fusion: %ld cycles (%.0f simulated s), %llu reads (%llu new), %llu torn, "
+         "%llu out of order, %llu non-unit quaternions\n",
+         cycles, (double)cycles / LOOP_RATE_HZ, (unsigned long long)total.reads,
+         (unsigned long long)total.new_snapshots, (unsigned long long)total.torn,
+         (unsigned long long)total.out_of_order, (unsigned long long)total_bad_quaternions);
+  if (total.torn != 0 || total.out_of_order != 0 || total_bad_quaternions != 0) exit(1);
+}  // end StressFusion()
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  double seconds = (argc > 1) ? atof(argv[1]) : 5.0;
+  int num_readers = (argc > 2) ? atoi(argv[2]) : 3;
+  if (num_readers < 1) num_readers = 1;
+
+  printf("%d reader threads, %u hardware threads\n", num_readers,
+         std::thread::hardware_concurrency());
+  StressLatch(seconds, num_readers);
+  StressFusion(seconds, num_readers);
+  printf("no torn snapshots\n");
+  return 0;
+}
@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2020-2021 Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+/**
+ * @file templated_main.cc
+ * @brief Checks the compile-time configured sensor_fusion::SensorFusion
+ * template against the SensorFusion class.
+ *
+ * Build with the PlatformIO "native_templated" environment.
+ *
+ * A template instance reading the simulated IMU (simulated_imu.cc) through
+ * the Fxos8700Fxas21002 sensor set records a raw sensor log. The log is then
+ * replayed side by side, cycle by cycle, by the SensorFusion class and by two
+ * template instances returning NED and ENU results (see
+ * src/sensor_fusion_template.h). The NED instance must give exactly the
+ * orientation of the class, its angles must agree with the NXP Euler angles,
+ * and the ENU instance must give the same orientation expressed in ENU. The
+ * time per read and fusion of the class and of the template is reported.
+ *
+ * Usage: program [simulated_seconds]
+ *   simulated_seconds defaults to 120. The exit status is 1 if a check fails.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <vector>
+
+#include "sensor_fusion_class.h"
+#include "sensor_fusion_template.h"
+#include "board.h"
+#include "build.h"
+#include "sensor_fusion/hal_host.h"
+#include "sensor_fusion/sensor_log.h"
+#include "simulated_imu.h"
+
+// sensor hardware details, as on the Adafruit breakout board
+#define BOARD_ACCEL_MAG_I2C_ADDR    (0x1F)
+#define BOARD_GYRO_I2C_ADDR         (0x21)
+
+namespace {
+
+typedef sensor_fusion::FusionAlgorithms<sensor_fusion::Kalman9Dof> Kalman9Dof;
+typedef sensor_fusion::SensorFusion<
+    Kalman9Dof, sensor_fusion::Ned,
+    sensor_fusion::Fxos8700Fxas21002<BOARD_ACCEL_MAG_I2C_ADDR, BOARD_GYRO_I2C_ADDR> >
+    HardwareNedFusion;
+typedef sensor_fusion::SensorFusion<Kalman9Dof, sensor_fusion::Ned,
+                                    sensor_fusion::ReplaySensors> ReplayNedFusion;
+typedef sensor_fusion::SensorFusion<Kalman9Dof, sensor_fusion::Enu,
+                                    sensor_fusion::ReplaySensors> ReplayEnuFusion;
+
+const double kToleranceDeg = 0.01;
+// the NXP angles come from fRPl, and fQuaternionFromRotationMatrix() loses about 0.1 deg of
+// precision converting it to fqPl for rotations close to a half turn, where q0 is small
+const double kNxpAngleToleranceDeg = 0.25;
+const float kGimbalLockPitchDeg = 85.0F;  // yaw and roll are ill-defined beyond
+
+/// a log held in memory, read by one replay
+struct LogCursor {
+  const std::vector<uint8_t> *log;
+  size_t position;
+};
+
+uint16_t ReadLogMemory(void *context, uint8_t *destination, uint16_t num_bytes) {
+  LogCursor *cursor = (LogCursor *)context;
+  size_t available = cursor->log->size() - cursor->position;
+  if (num_bytes > available) num_bytes = (uint16_t)available;
+  memcpy(destination, cursor->log->data() + cursor->position, num_bytes);
+  cursor->position += num_bytes;
+  return num_bytes;
+}  // end ReadLogMemory()
+
+/// a replay of the log in memory, with its own position
+struct Replay {
+  SensorLogReplay replay;
+  LogCursor cursor;
+  Replay(const std::vector<uint8_t> *log) {
+    memset(&replay, 0, sizeof(replay));
+    cursor.log = log;
+    cursor.position = 0;
+    replay.read = ReadLogMemory;
+    replay.context = &cursor;
+  }
+};
+
+inline double NowNs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return 1E9 * ts.tv_sec + ts.tv_nsec;
+}  // end NowNs()
+
+/// angle (deg) between two orientation quaternions, from the chord between them
+double AngleBetweenDeg(const Quaternion &p, const Quaternion &q) {
+  double sign = ((double)p.q0 * q.q0 + (double)p.q1 * q.q1 + (double)p.q2 * q.q2 +
+                 (double)p.q3 * q.q3 < 0.0) ? -1.0 : 1.0;
+  double d0 = p.q0 - sign * q.q0, d1 = p.q1 - sign * q.q1;
+  double d2 = p.q2 - sign * q.q2, d3 = p.q3 - sign * q.q3;
+  double chord = sqrt(d0 * d0 + d1 * d1 + d2 * d2 + d3 * d3);
+  return 4.0 * asin((chord < 2.0) ? 0.5 * chord : 1.0) * 180.0 / M_PI;
+}  // end AngleBetweenDeg()
+
+/// magnitude (deg) of the difference between two angles, modulo 360
+double AngleDifferenceDeg(double a, double b) {
+  double difference = fmod(fabs(a - b), 360.0);
+  return (difference > 180.0) ? 360.0 - difference : difference;
+}  // end AngleDifferenceDeg()
+
+/// Records simulated_seconds of the simulated IMU into log, read by a template instance.
+bool RecordLog(long simulated_seconds, std::vector<uint8_t> *log) {
+  const uint32_t kLoopIntervalMicros = 1000000 / LOOP_RATE_HZ;
+  HostVirtualClockSet(0);
+  SimulatedImu imu(BOARD_ACCEL_MAG_I2C_ADDR, BOARD_GYRO_I2C_ADDR);
+  if (!imu.Attach()) {
+    return false;
+  }
+  HardwareNedFusion *fusion = new HardwareNedFusion();
+  HostVirtualClockAdvance(kLoopIntervalMicros);
+  fusion->Begin();
+
+  static uint8_t buffer[SENSOR_LOG_MAX_RECORD_BYTES];
+  log->assign(buffer, buffer + SensorLogEncodeHeader(fusion->GetGlobals(), buffer));
+  for (long i = simulated_seconds * LOOP_RATE_HZ; i > 0; i--) {
+    HostVirtualClockAdvance(kLoopIntervalMicros);
+    fusion->ReadSensors();
+    log->insert(log->end(), buffer,
+                buffer + SensorLogEncodeRecord(fusion->GetGlobals(),
+                                               HostVirtualClockMicros(), buffer));
+    fusion->RunFusion();
+  }
+  bool valid = fusion->IsDataValid();
+  delete fusion;
+  imu.Detach();
+  return valid;
+}  // end RecordLog()
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  long simulated_seconds = (argc > 1) ? atol(argv[1]) : 120;
+  if (simulated_seconds < 1) simulated_seconds = 1;
+
+  HostTimerInstallClock(HostVirtualClockMicros);
+  std::vector<uint8_t> log;
+  if (!RecordLog(simulated_seconds, &log)) {
+    printf("FAIL: recording with the Fxos8700Fxas21002 sensor set\n");
+    return 1;
+  }
+
+  // three replays of the same log, fused by the class and the NED and ENU templates
+  Replay class_replay(&log), ned_replay(&log), enu_replay(&log);
+  SensorFusion *class_fusion = new SensorFusion();
+  ReplayNedFusion *ned_fusion = new ReplayNedFusion();
+  ReplayEnuFusion *enu_fusion = new ReplayEnuFusion();
+  ReplayNedFusion::Config ned_config;
+  ReplayEnuFusion::Config enu_config;
+  ned_config.replay = &ned_replay.replay;
+  enu_config.replay = &enu_replay.replay;
+  HostVirtualClockSet(0);
+  class_fusion->InstallReplaySensor(&class_replay.replay);
+  class_fusion->Begin();
+  if (!ned_fusion->Begin(ned_config) || !enu_fusion->Begin(enu_config)) {
+    printf("FAIL: installing the replay sensor set\n");
+    return 1;
+  }
+
+  double class_ns = 0.0, template_ns = 0.0;
+  double class_error_deg = 0.0, enu_error_deg = 0.0;
+  double nxp_angle_error_deg = 0.0, enu_angle_error_deg = 0.0;
+  long cycles = 0;
+  for (;;) {
+    // each replays at the timestamps of the log, as in examples/host/batch
+    double start_ns = NowNs();
+    HostVirtualClockSet(class_replay.replay.timestamp);
+    class_fusion->ReadSensors();
+    HostVirtualClockSet(class_replay.replay.timestamp);
+    class_fusion->RunFusion();
+    class_ns += NowNs() - start_ns;
+    if (class_replay.replay.finished) {
+      break;
+    }
+
+    start_ns = NowNs();
+    HostVirtualClockSet(ned_replay.replay.timestamp);
+    ned_fusion->ReadSensors();
+    HostVirtualClockSet(ned_replay.replay.timestamp);
+    ned_fusion->RunFusion();
+    template_ns += NowNs() - start_ns;
+    HostVirtualClockSet(enu_replay.replay.timestamp);
+    enu_fusion->ReadSensors();
+    HostVirtualClockSet(enu_replay.replay.timestamp);
+    enu_fusion->RunFusion();
+    cycles++;
+
+    Quaternion class_q, ned_q, enu_q, expected_enu_q;
+    class_fusion->GetOrientationQuaternion(&class_q);
+    ned_fusion->GetOrientationQuaternion(&ned_q);
+    enu_fusion->GetOrientationQuaternion(&enu_q);
+    double error_deg = AngleBetweenDeg(class_q, ned_q);
+    if (!(error_deg <= class_error_deg)) class_error_deg = error_deg;
+    sensor_fusion::Enu::FromNed(ned_q, &expected_enu_q);
+    error_deg = AngleBetweenDeg(expected_enu_q, enu_q);
+    if (!(error_deg <= enu_error_deg)) enu_error_deg = error_deg;
+
+    // the NXP angles, and ENU yaw 90 - NED yaw, pitch -NED pitch, roll NED roll
+    const SV_9DOF_GBY_KALMAN &sv = ned_fusion->GetGlobals()->SV_9DOF_GBY_KALMAN;
+    if (ned_fusion->IsDataValid() && fabsf(sv.fThePr) < kGimbalLockPitchDeg) {
+      double errors[6] = {
+          AngleDifferenceDeg(ned_fusion->GetYawDegrees(), sv.fPsiPr),
+          AngleDifferenceDeg(ned_fusion->GetPitchDegrees(), sv.fThePr),
+          AngleDifferenceDeg(ned_fusion->GetRollDegrees(), sv.fPhiPr),
+          AngleDifferenceDeg(enu_fusion->GetYawDegrees(), 90.0 - ned_fusion->GetYawDegrees()),
+          AngleDifferenceDeg(enu_fusion->GetPitchDegrees(), -ned_fusion->GetPitchDegrees()),
+          AngleDifferenceDeg(enu_fusion->GetRollDegrees(), ned_fusion->GetRollDegrees())};
+      for (int i = 0; i < 3; i++) {
+        if (!(errors[i] <= nxp_angle_error_deg)) nxp_angle_error_deg = errors[i];
+        if (!(errors[i + 3] <= enu_angle_error_deg)) enu_angle_error_deg = errors[i + 3];
+      }
+    }
+  }
+
+  printf("%ld fusion cycles; class %.2f us, template %.2f us per read and fusion\n",
+         cycles, 1E-3 * class_ns / cycles, 1E-3 * template_ns / cycles);
+  printf("RAM per instance: template %u bytes, class %u bytes plus its members\n",
+         (unsigned)sizeof(ReplayNedFusion),
+         (unsigned)(sizeof(SensorFusionGlobals) + sizeof(ControlSubsystem) +
+                    sizeof(StatusSubsystem) + MAX_NUM_SENSORS * sizeof(PhysicalSensor)));
+  printf("NED template vs class: largest difference %.2g deg\n", class_error_deg);
+  printf("ENU template vs NED converted: largest difference %.2g deg\n", enu_error_deg);
+  printf("NED yaw, pitch, roll vs NXP angles: largest difference %.2g deg\n",
+         nxp_angle_error_deg);
+  printf("ENU yaw, pitch, roll vs 90 - NED yaw, -NED pitch, NED roll: largest difference "
+         "%.2g deg\n", enu_angle_error_deg);
+  printf("final: NED yaw %03.0f pitch %+4.0f roll %+4.0f, ENU yaw %03.0f pitch %+4.0f "
+         "roll %+4.0f\n", ned_fusion->GetYawDegrees(), ned_fusion->GetPitchDegrees(),
+         ned_fusion->GetRollDegrees(), enu_fusion->GetYawDegrees(),
+         enu_fusion->GetPitchDegrees(), enu_fusion->GetRollDegrees());
+
+  bool ok = cycles > 0 && class_error_deg == 0.0 && enu_error_deg <= kToleranceDeg &&
+            nxp_angle_error_deg <= kNxpAngleToleranceDeg && enu_angle_error_deg <= kToleranceDeg;
+  delete class_fusion;
+  delete ned_fusion;
+  delete enu_fusion;
+  if (!ok) {
+    printf("FAIL: template results differ\n");
+    return 1;
+  }
+  printf("templated fusion OK\n");
+  return 0;
+}  // end main()
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2020-2021 Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+/**
+ * @file timing_main.cc
+ * @brief Checks the heading when loops run late and the gyro clock is off.
+ *
+ * Build with the PlatformIO "native_timing" environment.
+ *
+ * The simulated IMU (simulated_imu.cc) turns steadily while its gyro runs
+ * with a clock error, and every few cycles the loop is called late, as it
+ * would be after a long WiFi or flash operation. Once the magnetic
+ * calibration has settled, the fused heading is compared with the simulated
+ * one. With F_MEASURED_TIME_INTEGRATION the gyro is integrated over the time
+ * its samples actually span; rebuild with it set to 0x0000 to see the error
+ * when each fusion is taken to cover 1/FUSION_HZ.
+ *
+ * Usage: program [simulated_seconds] [gyro_odr_error_percent] [late_us]
+ *   simulated_seconds defaults to 120, of which the first 60 are not measured.
+ *   gyro_odr_error_percent defaults to 2. late_us (default 10000) is how late
+ *   every fourth loop runs. The exit status is 1 if the mean heading error
+ *   exceeds 1 degree.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sensor_fusion_class.h"
+#include "board.h"
+#include "build.h"
+#include "sensor_fusion/hal_host.h"
+#include "simulated_imu.h"
+
+// sensor hardware details, as on the Adafruit breakout board
+#define BOARD_ACCEL_MAG_I2C_ADDR    (0x1F)
+#define BOARD_GYRO_I2C_ADDR         (0x21)
+
+namespace {
+
+const uint32_t kLoopIntervalMicros = 1000000 / LOOP_RATE_HZ;
+const long kSettlingSeconds = 60;
+const long kLateLoopEvery = 4;
+
+/// heading (deg) of the board for the simulated yaw, as GetHeadingDegrees() reports it
+/// with the board's X axis to the bow
+double ExpectedHeadingDeg(double yaw_deg) {
+  return fmod(fmod(yaw_deg - 90.0, 360.0) + 360.0, 360.0);
+}  // end ExpectedHeadingDeg()
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  long simulated_seconds = (argc > 1) ? atol(argv[1]) : 120;
+  float odr_error_percent = (argc > 2) ? (float)atof(argv[2]) : 2.0F;
+  uint32_t late_us = (argc > 3) ? (uint32_t)atol(argv[3]) : 10000;
+  if (simulated_seconds <= kSettlingSeconds) simulated_seconds = kSettlingSeconds + 1;
+
+  HostTimerInstallClock(HostVirtualClockMicros);
+  HostVirtualClockSet(0);
+  SimulatedImuConfig config;
+  config.gyro_odr_error_percent = odr_error_percent;
+  SimulatedImu imu(BOARD_ACCEL_MAG_I2C_ADDR, BOARD_GYRO_I2C_ADDR, config);
+  if (!imu.Attach()) {
+    printf("trouble attaching simulated sensors\n");
+    return 1;
+  }
+  SensorFusion *sensor_fusion = new SensorFusion();
+  sensor_fusion->InitializeInputOutputSubsystem(NULL, NULL);
+  sensor_fusion->InstallSensor(BOARD_ACCEL_MAG_I2C_ADDR, SensorType::kMagnetometer);
+  sensor_fusion->InstallSensor(BOARD_ACCEL_MAG_I2C_ADDR, SensorType::kAccelerometer);
+  sensor_fusion->InstallSensor(BOARD_ACCEL_MAG_I2C_ADDR, SensorType::kThermometer);
+  sensor_fusion->InstallSensor(BOARD_GYRO_I2C_ADDR, SensorType::kGyroscope);
+  HostVirtualClockAdvance(kLoopIntervalMicros);
+  sensor_fusion->Begin();
+
+  double error_sum = 0.0, error_max = 0.0;
+  long error_count = 0;
+  uint64_t settling_micros = (uint64_t)kSettlingSeconds * 1000000U;
+  uint64_t elapsed_micros = 0;
+  for (long i = 0; elapsed_micros < (uint64_t)simulated_seconds * 1000000U; i++) {
+    uint32_t interval = kLoopIntervalMicros + ((i % kLateLoopEvery == 0) ? late_us : 0);
+    HostVirtualClockAdvance(interval);
+    elapsed_micros += interval;
+    sensor_fusion->ReadSensors();
+    sensor_fusion->RunFusion();
+    if (elapsed_micros < settling_micros) continue;
+
+    float yaw, pitch, roll;
+    imu.TrueAttitude(&yaw, &pitch, &roll);
+    double error = fabs(sensor_fusion->GetHeadingDegrees() - ExpectedHeadingDeg(yaw));
+    if (error > 180.0) error = 360.0 - error;
+    error_sum += error;
+    if (error > error_max) error_max = error;
+    error_count++;
+  }
+  imu.Detach();
+
+  printf("gyro clock error %+.2f%%, every %ld loops %lu us late, measured integration %s\n",
+         odr_error_percent, kLateLoopEvery, (unsigned long)late_us,
+         F_MEASURED_TIME_INTEGRATION ? "on" : "off");
+  printf("%ld headings: mean error %.3f deg, max %.3f deg\n", error_count,
+         error_sum / error_count, error_max);
+  if (error_sum / error_count > 1.0) {
+    printf("FAIL: heading does not follow the simulated one\n");
+    return 1;
+  }
+  printf("heading timing OK\n");
+  return 0;
+}
@@ -16,7 +16,9 @@
 #ifndef _BOARD_H_
 #define _BOARD_H_
 
+#ifndef SENSOR_FUSION_HOST
 #include <Arduino.h>
+#endif
 
 #ifndef BOARD_USES_HW_GPIO_NUMBERS
     #define BOARD_USES_HW_GPIO_NUMBERS
@@ -45,6 +47,13 @@ extern "C" {
   #include <esp32-hal-gpio.h>       //needed for pinMode() etc.
 #endif
 
+#ifdef SENSOR_FUSION_HOST
+// host build has no GPIO. Sensor ICs are simulated on the host I2C bus (see hal_host.h)
+    #define HIGH (0x01)
+    #define LOW (0x00)
+    #define OUTPUT (0x01)
+#endif
+
 // Specify the specific sensor IC(s) used 
 #include "sensor_fusion/driver_fxos8700.h"
 #include "sensor_fusion/driver_fxas21002.h"
@@ -58,9 +67,27 @@ extern "C" {
 // sensor hardware details
 #define GYRO_FIFO_SIZE  32	///< FXAX21000, FXAS21002 have 32 element FIFO
 #define ACCEL_FIFO_SIZE 32	///< FXOS8700 (accel), MMA8652, FXLS8952 all have 32 element FIFO
-#define MAG_FIFO_SIZE 	1	///< FXOS8700 (mag) and MAG3110 have no FIFO so equivalent to 1 element FIFO. For 
-//these ICs we save 6 bytes * 31 = 186 bytes of RAM by setting this FIFO size to 1
+#define MAG_FIFO_SIZE 	(LOOP_RATE_HZ / FUSION_HZ)	///< FXOS8700 (mag) and MAG3110 have no FIFO so equivalent to 1 element FIFO. For 
+//these ICs we save 6 bytes * 31 = 186 bytes of RAM by setting this FIFO size to 1, or to one sample per read
+//between fusions when LOOP_RATE_HZ is a multiple of FUSION_HZ (see build.h)
 
+#ifdef SENSOR_FUSION_HOST
+// No LEDs on the host; status is available from SensorFusion::GetSystemStatus()
+#define LOGIC_LED_ON  1U
+#define LOGIC_LED_OFF 0U
+#define LED_RED_INIT(output)
+#define LED_RED_ON()
+#define LED_RED_OFF()
+#define LED_RED_TOGGLE()
+#define LED_GREEN_INIT(output)
+#define LED_GREEN_ON()
+#define LED_GREEN_OFF()
+#define LED_GREEN_TOGGLE()
+#define LED_BLUE_INIT(output)
+#define LED_BLUE_ON()
+#define LED_BLUE_OFF()
+#define LED_BLUE_TOGGLE()
+#else
 // Board LED mappings for ESP32 WROVER-KIT
 #define LOGIC_LED_ON  1U
 #define LOGIC_LED_OFF 0U
@@ -100,6 +127,7 @@ extern "C" {
 #define LED_BLUE_OFF() digitalWrite(BOARD_LED_BLUE_GPIO_PIN, LOW); // Turn off LED_BLUE 
 #define LED_BLUE_TOGGLE() \
     digitalWrite(BOARD_LED_BLUE_GPIO_PIN, !digitalRead(BOARD_LED_BLUE_GPIO_PIN)); // Toggle LED_BLUE
+#endif  // SENSOR_FUSION_HOST
 
 // Functions that have no equivalent and are unneeded
 #define CLOCK_EnableClock(x)        //found in status.c
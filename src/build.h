@@ -73,6 +73,57 @@ extern "C" {
     0x4000 ///< 9DOF accel, mag and gyro algorithm selector                  - 0x4000 to include, 0x0000 otherwise
 ///@}
 
+/// @name FusionImplementationOptions
+/// Alternative implementations of parts of the fusion algorithms. Each gives the same results as
+/// the original NXP code to within float rounding.
+///@{
+#define F_6DOF_GY_BLOCK_GAIN \
+    0x0001 ///< 6DOF Kalman gain computed per axis in closed form (see fusion.c) - 0x0001 to use, 0x0000 for the general 3x3 inversion
+#define F_9DOF_GBY_BLOCK_GAIN \
+    0x0001 ///< 9DOF Kalman gain computed per axis in closed form (see fusion.c) - 0x0001 to use, 0x0000 for the general 6x6 inversion
+#define F_MEASURED_TIME_INTEGRATION \
+    0x0001 ///< gyro integrated at its measured sample interval (see sensor_fusion.c) - 0x0001 to use, 0x0000 for 1/FUSION_HZ per fusion
+// The 7 and 10 element magnetic calibrations resume the eigen-decomposition from the eigenvectors of the previous
+// calibration and stop once the off-diagonal elements are negligible (EIGENTOLERANCE in magnetic.h) rather than zero.
+#define F_WARM_START_EIGEN \
+    0x0001 ///< warm started magnetic calibration eigen-decomposition (see magnetic.c) - 0x0001 to use, 0x0000 to start from the identity
+// The magnetic buffer keeps exact running sums of its measurements, from which the 7 and 10 element calibrations set
+// their measurement matrix in one time slice instead of one slice per buffer bin.
+#define F_INCREMENTAL_MAG_SUMS \
+    0x0001 ///< magnetic calibration sums maintained by iUpdateMagBuffer() (see magnetic.c) - 0x0001 to use, 0x0000 to rescan
+// iUpdateMagBuffer() finds its bins by bisection, the oldest measurement from a list in age order and nearby
+// measurements from a spatial hash, rather than by scanning the tangent table and the whole buffer. The indexes
+// cost 2608 bytes in every magnetic buffer, too much for the RAM of the ESP8266, where the scans are kept.
+#ifdef ESP8266
+#define F_MAG_BUFFER_INDEX \
+    0x0000 ///< indexed magnetic buffer updates (see magnetic.c) - 0x0001 to use, 0x0000 to scan
+#else
+#define F_MAG_BUFFER_INDEX \
+    0x0001 ///< indexed magnetic buffer updates (see magnetic.c) - 0x0001 to use, 0x0000 to scan
+#endif
+// The magnetic buffer keeps the x, y, z of each reading together, 16 bit time stamps and a bitmap of its occupied bins,
+// and shares one constant tangent table, rather than 32 bit time indices and a tangent table in every instance.
+#define F_COMPACT_MAG_BUFFER \
+    0x0001 ///< compact magnetic buffer layout (see magnetic.h) - 0x0001 to use, 0x0000 for the NXP layout
+// Saving the magnetic calibration also saves the readings of the magnetic buffer, which are restored at the next
+// start so that calibrations resume at once rather than after the buffer refills. Needs about 3 kB more NVM.
+#define F_MAG_BUFFER_SNAPSHOT \
+    0x0001 ///< magnetic buffer saved with the magnetic calibration (see calibration_storage.cc) - 0x0001 to use, 0x0000 to start empty
+// The fixed size kernels of matrix_kernels.h use SSE or NEON where the host has them. The results agree to within
+// float rounding, and are identical where the compiler does not fuse multiplies and adds (-ffp-contract=off).
+#define F_MATRIX_KERNEL_SIMD \
+    0x0001 ///< SIMD matrix kernels on a host build (see matrix_kernels.h) - 0x0001 to use, 0x0000 for scalar
+// Gyro integration and the 6DOF and 9DOF Kalman measurement updates in fixed point, and exact integer sums for the
+// magnetic calibration (see fixed_point.h), replacing soft-float arithmetic on processors without an FPU.
+#ifdef ESP8266
+#define F_FIXED_POINT_FUSION \
+    0x0001 ///< fixed point gyro integration, Kalman updates and magnetic calibration sums - 0x0001 to use, 0x0000 for float
+#else
+#define F_FIXED_POINT_FUSION \
+    0x0000 ///< fixed point gyro integration, Kalman updates and magnetic calibration sums - 0x0001 to use, 0x0000 for float
+#endif
+///@}
+
 /// @name SensorParameters
 // The Output Data Rates (ODR) are set by the calls to *_Init() for each physical sensor.
 // If a sensor has a FIFO, then it can be read once/fusion cycle; if not, then read more often
@@ -81,8 +132,13 @@ extern "C" {
 #define MAG_ODR_HZ      200 ///< (int) requested magnetometer ODR Hz (overridden by ACCEL_ODR_HZ for FXOS8700)
 #define LOOP_RATE_HZ     40 //adjust according to the size of the FIFOs on sensors. If no FIFO (e.g. 
 //FXOS8700 magnetometer) and don't want to skip any readings then need to read at same rate as ODR. 
-//If FIFO exists or willing to skip readings, then usually set same as FUSION_HZ. See also sensor_fusion_class.h
+//If FIFO exists or willing to skip readings, then usually set same as FUSION_HZ. A multiple of FUSION_HZ (up to
+//GYRO_ODR_HZ) gives multi-rate fusion: the orientation is predicted from the gyro on every read and corrected by
+//the Kalman filter at FUSION_HZ. See also sensor_fusion_class.h
 #define FUSION_HZ       40  ///< (int) rate of fusion algorithm execution
+// Each fusion runs one time slice of the magnetic calibration, then more while they fit in this many microseconds
+// (see processMagData() in sensor_fusion.c). 0 runs exactly one slice per fusion.
+#define MAG_CAL_BUDGET_MICROS   1000    ///< (int) time per fusion for magnetic calibration slices (us)
 
 // Output data rate parameters
 #define MAXPACKETRATEHZ 40  //max rate at which data packets can practically be sent (e.g. to Fusion Toolbox)
@@ -94,6 +150,13 @@ extern "C" {
 #define F_USE_WIRELESS_UART     0x0000	///< 0x0001 to include, 0x0000 otherwise
 #define F_USE_WIRED_UART        0x0000	///< 0x0002 to include, 0x0000 otherwise
 
+//Execution time statistics for each stage of the fusion cycle (see sensor_fusion/timing_stats.h).
+//Costs about 3.4 KB of RAM per fusion instance and two timer reads per stage per cycle, so it is off in firmware.
+//The native environments of platformio.ini turn it on with -D F_TIMING_STATS=1.
+#ifndef F_TIMING_STATS
+#define F_TIMING_STATS          0x0000	///< 0x0001 to include, 0x0000 otherwise
+#endif
+
 //#define INCLUDE_DEBUG_FUNCTIONS // Comment this line to disable the ApplyPerturbation function
 
 
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2020-2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file calibration_scratch.h
+    \brief Scratch matrices shared by the calibration solvers of one fusion instance.
+
+    The magnetic and precision accelerometer calibrations both need a pair of
+    10x10 matrices and two vectors as working space, but only while they are
+    solving. Each fusion instance owns a single CalibrationScratch, and a
+    calibration leases it for as long as it is solving.
+
+    The magnetic calibration is spread over many fusion cycles and holds its
+    lease from the first slice to the last. The precision accelerometer
+    calibration runs to completion in the call that stores a measurement, so
+    it takes the scratch even from a magnetic calibration in progress, which
+    is then abandoned and started again (see fRunMagCalibration()).
+*/
+
+#ifndef CALIBRATION_SCRATCH_H
+#define CALIBRATION_SCRATCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/// @name Calibration Scratch Owners
+///@{
+#define CALSCRATCH_FREE     0       ///< no calibration holds the scratch
+#define CALSCRATCH_MAG      1       ///< held by the magnetic calibration
+#define CALSCRATCH_ACCEL    2       ///< held by the precision accelerometer calibration
+///@}
+
+/// Scratch matrices and vectors for the calibration solvers
+struct CalibrationScratch
+{
+	float fmatA[10][10];			        ///< scratch 10x10 float matrix used by calibration algorithms
+	float fmatB[10][10];			        ///< scratch 10x10 float matrix used by calibration algorithms
+	float fvecA[10];				///< scratch 10x1 vector used by calibration algorithms
+	float fvecB[4];					///< scratch 4x1 vector used by calibration algorithms
+	uint16_t iLease;				///< number of the current or last lease, never 0 once one is granted
+	int8_t iOwner;					///< CALSCRATCH_FREE or the calibration holding lease iLease
+};
+
+/// @name Calibration Scratch Leases
+/// A lease is identified by the number these return, which is never 0. The holder passes it back to check that
+/// the lease has not been taken from it, and to release it.
+///@{
+/// marks the scratch as held by no calibration
+static inline void fInitializeCalibrationScratch(struct CalibrationScratch *pthisScratch)
+{
+	pthisScratch->iLease = 0;
+	pthisScratch->iOwner = CALSCRATCH_FREE;
+}
+
+/// leases the scratch to iOwner if it is free, returning the lease number, or 0 if another lease is held
+static inline uint16_t iLeaseCalibrationScratch(struct CalibrationScratch *pthisScratch, int8_t iOwner)
+{
+	if (pthisScratch->iOwner != CALSCRATCH_FREE) return 0;
+	if (++(pthisScratch->iLease) == 0) pthisScratch->iLease = 1;
+	pthisScratch->iOwner = iOwner;
+	return pthisScratch->iLease;
+}
+
+/// leases the scratch to iOwner, ending any lease held, and returns the lease number
+static inline uint16_t iTakeCalibrationScratch(struct CalibrationScratch *pthisScratch, int8_t iOwner)
+{
+	pthisScratch->iOwner = CALSCRATCH_FREE;
+	return iLeaseCalibrationScratch(pthisScratch, iOwner);
+}
+
+/// returns true if lease iLease is still held
+static inline int8_t iHoldsCalibrationScratch(const struct CalibrationScratch *pthisScratch, uint16_t iLease)
+{
+	return (int8_t) ((pthisScratch->iOwner != CALSCRATCH_FREE) && (pthisScratch->iLease == iLease));
+}
+
+/// ends lease iLease, if it is still held
+static inline void fReleaseCalibrationScratch(struct CalibrationScratch *pthisScratch, uint16_t iLease)
+{
+	if (iHoldsCalibrationScratch(pthisScratch, iLease)) pthisScratch->iOwner = CALSCRATCH_FREE;
+}
+///@}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CALIBRATION_SCRATCH_H
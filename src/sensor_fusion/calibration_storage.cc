@@ -10,17 +10,35 @@
     \brief Provides functions to store calibration to NVM
 
     Written for use on Arduino-Espressif environment where EEPROM library available.
-    
+    On a host build (SENSOR_FUSION_HOST) the EEPROM is file-backed, see hal_nvm_host.cc
+
+    With F_MAG_BUFFER_SNAPSHOT, saving the magnetic calibration also saves a
+    snapshot of the magnetic buffer after the calibrations: the bitmap of its
+    occupied bins, then the reading and age of each, in bin order. At start up
+    RestoreMagBufferSnapshotFromNVM() refills the buffer from it, provided it
+    was saved with the calibration that was loaded, so that calibrations
+    resume at once instead of after minutes of motion. The first readings
+    after the restore are then checked against that calibration (see
+    magnetic.c), and the snapshot is discarded if they no longer fit it.
 */
 #include <stdio.h>
+#include <string.h>
 
+#ifdef SENSOR_FUSION_HOST
+#include "hal_host.h"
+#else
 #include <EEPROM.h>
+#endif
 
 #include "sensor_fusion.h"
 #include "calibration_storage.h"
 #include "debug_print.h"
 
+#if F_USING_MAG && F_MAG_BUFFER_SNAPSHOT
+#define CALIBRATION_STORAGE_SIZE_BYTES 3328
+#else
 #define CALIBRATION_STORAGE_SIZE_BYTES 256
+#endif
 #define CALIBRATION_BUF_MAGNETIC_START 0
 #define CALIBRATION_BUF_MAGNETIC_HDR_SIZE 4
 #define CALIBRATION_BUF_MAGNETIC_HDR_MAGIC 0x12345678
@@ -41,6 +59,39 @@
 	#error insufficient space allocated for calibration buffer
 #endif
 
+#if F_USING_MAG && F_MAG_BUFFER_SNAPSHOT
+// the magnetic buffer snapshot follows the first 256 bytes, so the calibrations keep their place
+#define CALIBRATION_BUF_MAGSNAPSHOT_START 256
+#define CALIBRATION_BUF_MAGSNAPSHOT_HDR_SIZE 4
+#define CALIBRATION_BUF_MAGSNAPSHOT_HDR_MAGIC 0x12345678
+#define CALIBRATION_BUF_MAGSNAPSHOT_FORMAT ((1UL << 16) | (MAGBUFFSIZEX << 8) | MAGBUFFSIZEY)  // version, bins
+#define CALIBRATION_BUF_MAGSNAPSHOT_VAL_START (CALIBRATION_BUF_MAGSNAPSHOT_START + CALIBRATION_BUF_MAGSNAPSHOT_HDR_SIZE)
+#define CALIBRATION_BUF_MAGSNAPSHOT_BINS_START (CALIBRATION_BUF_MAGSNAPSHOT_VAL_START + sizeof(MagSnapshotHeader))
+
+// snapshot of the magnetic buffer, followed in NVM by iCount MagSnapshotBin in bin order
+typedef struct MagSnapshotHeader {
+  uint16_t iChecksum;                   // Fletcher-16 of the rest of the header and the bins
+  uint16_t iCount;                      // number of occupied bins
+  uint32_t iFormat;                     // CALIBRATION_BUF_MAGSNAPSHOT_FORMAT when saved
+  float fV[3];                          // hard iron offset of the calibration saved with the snapshot (uT)
+  float fB;                             // and its geomagnetic field strength (uT)
+  uint32_t iActive[MAGACTIVEWORDS];     // one bit per occupied bin (j * MAGBUFFSIZEY + k)
+} MagSnapshotHeader;
+
+typedef struct MagSnapshotBin {
+  int16_t iBs[3];                       // uncalibrated reading (counts)
+  uint16_t iAge;                        // age when saved (fusion cycles), held to MAGAGELIMIT
+} MagSnapshotBin;
+
+// the restored readings are taken to be this many fusion cycles older than when saved, which also keeps their time
+// indices clear of the empty marker -1 of the NXP buffer layout at loopcounter 0
+#define MAGSNAPSHOT_RESTORE_AGE 2
+
+static_assert(CALIBRATION_BUF_MAGSNAPSHOT_BINS_START + MAXMEASUREMENTS * sizeof(MagSnapshotBin) <=
+                  CALIBRATION_STORAGE_SIZE_BYTES,
+              "insufficient space allocated for magnetic buffer snapshot");
+#endif  // if F_USING_MAG && F_MAG_BUFFER_SNAPSHOT
+
 #ifdef ESP8266
 // define a replacement for EEPROM.readBytes(), which is only available in the
 // ESP32 library
@@ -71,7 +122,7 @@ bool GetMagCalibrationFromNVM( float *cal_values ) {
     EepromReadBytes(CALIBRATION_BUF_MAGNETIC_START, buf_magic,
                     CALIBRATION_BUF_MAGNETIC_HDR_SIZE);
 #endif
-#ifdef ESP32
+#if defined(ESP32) || defined(SENSOR_FUSION_HOST)
     EEPROM.readBytes(CALIBRATION_BUF_MAGNETIC_START, buf_magic,
                      CALIBRATION_BUF_MAGNETIC_HDR_SIZE);
 #endif
@@ -89,7 +140,7 @@ bool GetMagCalibrationFromNVM( float *cal_values ) {
         CALIBRATION_BUF_MAGNETIC_START + CALIBRATION_BUF_MAGNETIC_HDR_SIZE,
         cal_values, CALIBRATION_BUF_MAGNETIC_VAL_SIZE);
 #endif
-#ifdef ESP32
+#if defined(ESP32) || defined(SENSOR_FUSION_HOST)
     EEPROM.readBytes(
         CALIBRATION_BUF_MAGNETIC_START + CALIBRATION_BUF_MAGNETIC_HDR_SIZE,
         cal_values, CALIBRATION_BUF_MAGNETIC_VAL_SIZE);
@@ -115,7 +166,7 @@ bool GetGyroCalibrationFromNVM( float *cal_values ) {
     EepromReadBytes(CALIBRATION_BUF_GYRO_START, buf_magic,
                     CALIBRATION_BUF_GYRO_HDR_SIZE);
 #endif
-#ifdef ESP32
+#if defined(ESP32) || defined(SENSOR_FUSION_HOST)
     EEPROM.readBytes(CALIBRATION_BUF_GYRO_START, buf_magic,
                      CALIBRATION_BUF_GYRO_HDR_SIZE);
 #endif
@@ -132,7 +183,7 @@ bool GetGyroCalibrationFromNVM( float *cal_values ) {
     EepromReadBytes(CALIBRATION_BUF_GYRO_START + CALIBRATION_BUF_GYRO_HDR_SIZE,
                     cal_values, CALIBRATION_BUF_GYRO_VAL_SIZE);
 #endif
-#ifdef ESP32
+#if defined(ESP32) || defined(SENSOR_FUSION_HOST)
     EEPROM.readBytes(CALIBRATION_BUF_GYRO_START + CALIBRATION_BUF_GYRO_HDR_SIZE,
                      cal_values, CALIBRATION_BUF_GYRO_VAL_SIZE);
 #endif
@@ -158,7 +209,7 @@ bool GetAccelCalibrationFromNVM( float *cal_values ) {
     EepromReadBytes(CALIBRATION_BUF_ACCEL_START, buf_magic,
                      CALIBRATION_BUF_ACCEL_HDR_SIZE);
 #endif
-#ifdef ESP32
+#if defined(ESP32) || defined(SENSOR_FUSION_HOST)
     EEPROM.readBytes(CALIBRATION_BUF_ACCEL_START, buf_magic,
                      CALIBRATION_BUF_ACCEL_HDR_SIZE);
 #endif
@@ -176,7 +227,7 @@ bool GetAccelCalibrationFromNVM( float *cal_values ) {
         CALIBRATION_BUF_ACCEL_START + CALIBRATION_BUF_ACCEL_HDR_SIZE,
         cal_values, CALIBRATION_BUF_ACCEL_VAL_SIZE);
 #endif
-#ifdef ESP32
+#if defined(ESP32) || defined(SENSOR_FUSION_HOST)
     EEPROM.readBytes(
         CALIBRATION_BUF_ACCEL_START + CALIBRATION_BUF_ACCEL_HDR_SIZE,
         cal_values, CALIBRATION_BUF_ACCEL_VAL_SIZE);
@@ -187,6 +238,127 @@ bool GetAccelCalibrationFromNVM( float *cal_values ) {
     return false;
 }//end GetAccelCalibrationFromNVM()
 
+#if F_USING_MAG && F_MAG_BUFFER_SNAPSHOT
+// reads bytes from the NVM opened by EEPROM.begin()
+static void ReadNVM(int start_loc, void *buffer, int num_bytes) {
+#ifdef ESP8266
+    EepromReadBytes(start_loc, buffer, num_bytes);
+#endif
+#if defined(ESP32) || defined(SENSOR_FUSION_HOST)
+    EEPROM.readBytes(start_loc, buffer, num_bytes);
+#endif
+}//end ReadNVM()
+
+// continues the Fletcher-16 checksum sum over num_bytes of data
+static uint16_t MagSnapshotChecksum(uint16_t sum, const void *data, int num_bytes) {
+    const uint8_t *pData = (const uint8_t *)data;
+    uint16_t sum1 = sum & 0xFF;
+    uint16_t sum2 = sum >> 8;
+    for (int i = 0; i < num_bytes; i++) {
+      sum1 = (sum1 + pData[i]) % 255;
+      sum2 = (sum2 + sum1) % 255;
+    }
+    return (uint16_t)((sum2 << 8) | sum1);
+}//end MagSnapshotChecksum()
+
+// writes the snapshot of the magnetic buffer, and the calibration in use, into the NVM image buf_NVM
+static void WriteMagBufferSnapshot(SensorFusionGlobals *sfg, uint8_t *buf_NVM) {
+    struct MagBuffer *pBuffer = &(sfg->MagBuffer);
+    MagSnapshotHeader header;
+    MagSnapshotBin bin;
+    uint8_t *pBins = buf_NVM + CALIBRATION_BUF_MAGSNAPSHOT_BINS_START;
+    int32_t age;
+
+    memset(&header, 0, sizeof(header));
+    for (int8_t j = 0; j < MAGBUFFSIZEX; j++) {
+      for (int8_t k = 0; k < MAGBUFFSIZEY; k++) {
+        if (iMagBufferBinActive(pBuffer, j, k) && (header.iCount < MAXMEASUREMENTS)) {
+          for (int i = CHX; i <= CHZ; i++) bin.iBs[i] = MAGBUFFER_BS(pBuffer, i, j, k);
+          age = iMagBufferBinAge(pBuffer, j, k, sfg->loopcounter);
+          bin.iAge = (uint16_t)((age < 0) ? 0 : ((age > MAGAGELIMIT) ? MAGAGELIMIT : age));
+          memcpy(pBins + header.iCount * sizeof(bin), &bin, sizeof(bin));
+          header.iActive[(j * MAGBUFFSIZEY + k) >> 5] |= (uint32_t)1 << ((j * MAGBUFFSIZEY + k) & 31);
+          header.iCount++;
+        }
+      }
+    }
+    header.iFormat = CALIBRATION_BUF_MAGSNAPSHOT_FORMAT;
+    for (int i = CHX; i <= CHZ; i++) header.fV[i] = sfg->MagCal.fV[i];
+    header.fB = sfg->MagCal.fB;
+    header.iChecksum = MagSnapshotChecksum(0, (uint8_t *)&header + sizeof(header.iChecksum),
+                                           sizeof(header) - sizeof(header.iChecksum));
+    header.iChecksum = MagSnapshotChecksum(header.iChecksum, pBins, header.iCount * sizeof(bin));
+
+    uint32_t itmp32 = CALIBRATION_BUF_MAGSNAPSHOT_HDR_MAGIC;
+    memcpy(buf_NVM + CALIBRATION_BUF_MAGSNAPSHOT_START, &itmp32, CALIBRATION_BUF_MAGSNAPSHOT_HDR_SIZE);
+    memcpy(buf_NVM + CALIBRATION_BUF_MAGSNAPSHOT_VAL_START, &header, sizeof(header));
+}//end WriteMagBufferSnapshot()
+#endif  // if F_USING_MAG && F_MAG_BUFFER_SNAPSHOT
+
+//refill the empty magnetic buffer from the snapshot saved with the magnetic calibration, if that is the
+//calibration in use, and start the check of the readings that follow (see fCheckMagBufferSnapshot()).
+//Call after fInitializeMagCalibration(). Returns true if the buffer was restored.
+bool RestoreMagBufferSnapshotFromNVM(SensorFusionGlobals *sfg) {
+    if( NULL == sfg ) {
+      return false;
+    }
+#if F_USING_MAG && F_MAG_BUFFER_SNAPSHOT
+    struct MagBuffer *pBuffer = &(sfg->MagBuffer);
+    MagSnapshotHeader header;
+    MagSnapshotBin bin;
+    uint32_t magic_value;
+    uint16_t checksum;
+    int count = 0;
+    bool valid;
+
+    EEPROM.begin(
+        CALIBRATION_STORAGE_SIZE_BYTES);  // access chunk of emulated EEPROM
+    //the snapshot must be intact, of this buffer layout and saved with the calibration in use
+    ReadNVM(CALIBRATION_BUF_MAGSNAPSHOT_START, &magic_value, CALIBRATION_BUF_MAGSNAPSHOT_HDR_SIZE);
+    ReadNVM(CALIBRATION_BUF_MAGSNAPSHOT_VAL_START, &header, sizeof(header));
+    valid = (CALIBRATION_BUF_MAGSNAPSHOT_HDR_MAGIC == magic_value) &&
+            (CALIBRATION_BUF_MAGSNAPSHOT_FORMAT == header.iFormat) &&
+            (header.iCount <= MAXMEASUREMENTS) && (0 != sfg->MagCal.iValidMagCal) &&
+            (header.fV[CHX] == sfg->MagCal.fV[CHX]) && (header.fV[CHY] == sfg->MagCal.fV[CHY]) &&
+            (header.fV[CHZ] == sfg->MagCal.fV[CHZ]) && (header.fB == sfg->MagCal.fB);
+    if (valid) {
+      for (int n = 0; n < MAGBUFFSIZEX * MAGBUFFSIZEY; n++) {
+        count += (header.iActive[n >> 5] >> (n & 31)) & 1;
+      }
+      checksum = MagSnapshotChecksum(0, (uint8_t *)&header + sizeof(header.iChecksum),
+                                     sizeof(header) - sizeof(header.iChecksum));
+      for (int n = 0; n < header.iCount; n++) {
+        ReadNVM(CALIBRATION_BUF_MAGSNAPSHOT_BINS_START + n * sizeof(bin), &bin, sizeof(bin));
+        checksum = MagSnapshotChecksum(checksum, &bin, sizeof(bin));
+      }
+      valid = (count == header.iCount) && (checksum == header.iChecksum);
+    }
+    if (!valid) {
+      EEPROM.end();
+      return false;
+    }
+
+    //store each reading in its bin at its age
+    count = 0;
+    for (int8_t j = 0; j < MAGBUFFSIZEX; j++) {
+      for (int8_t k = 0; k < MAGBUFFSIZEY; k++) {
+        if ((header.iActive[(j * MAGBUFFSIZEY + k) >> 5] >> ((j * MAGBUFFSIZEY + k) & 31)) & 1) {
+          ReadNVM(CALIBRATION_BUF_MAGSNAPSHOT_BINS_START + count * sizeof(bin), &bin, sizeof(bin));
+          for (int i = CHX; i <= CHZ; i++) MAGBUFFER_BS(pBuffer, i, j, k) = bin.iBs[i];
+          iMagBufferSetBin(pBuffer, j, k, sfg->loopcounter - MAGSNAPSHOT_RESTORE_AGE - (int32_t)bin.iAge);
+          count++;
+        }
+      }
+    }
+    EEPROM.end();
+    pBuffer->iMagBufferCount = (int16_t)count;
+    iReindexMagBuffer(pBuffer, sfg->loopcounter);
+    sfg->MagCal.iSnapshotChecks = MAGSNAPSHOTCHECKSECS * FUSION_HZ;
+    sfg->MagCal.fSnapshotErrorSq = 0.0F;
+    return true;
+#endif  // if F_USING_MAG && F_MAG_BUFFER_SNAPSHOT
+    return false;
+}//end RestoreMagBufferSnapshotFromNVM()
 
 void SaveMagCalibrationToNVM(SensorFusionGlobals *sfg)
 {
@@ -217,6 +389,10 @@ void SaveMagCalibrationToNVM(SensorFusionGlobals *sfg)
         ++pDst;
         ++pSrc;
 	}
+#if F_MAG_BUFFER_SNAPSHOT
+    //bytes[256-]: the magnetic buffer the calibration came from, written in the same commit
+    WriteMagBufferSnapshot(sfg, buf_NVM);
+#endif
     // write the whole buffer contents to NVM
     if( ! EEPROM.commit() ) {
 		debug_log("EEPROM write mag cal failed\n");
@@ -325,6 +501,10 @@ void EraseMagCalibrationFromNVM(void)
         ++pDst;
         ++pSrc;
     }
+#if F_USING_MAG && F_MAG_BUFFER_SNAPSHOT
+    //the magnetic buffer snapshot goes with the calibration
+    memcpy(buf_NVM + CALIBRATION_BUF_MAGSNAPSHOT_START, &itmp32, CALIBRATION_BUF_MAGSNAPSHOT_HDR_SIZE);
+#endif
     // write the whole buffer contents to NVM
     if( ! EEPROM.commit() ) {
 		debug_log("EEPROM clear magnetic cal failed\n");
@@ -19,6 +19,7 @@ extern "C" {
 bool GetMagCalibrationFromNVM( float *cal_values );
 bool GetGyroCalibrationFromNVM( float *cal_values );
 bool GetAccelCalibrationFromNVM( float *cal_values );
+bool RestoreMagBufferSnapshotFromNVM(SensorFusionGlobals *sfg);
 void SaveMagCalibrationToNVM(SensorFusionGlobals *sfg);
 void SaveGyroCalibrationToNVM(SensorFusionGlobals *sfg);
 void SaveAccelCalibrationToNVM(SensorFusionGlobals *sfg);
@@ -14,7 +14,12 @@
     and F_USE_WIRELESS_UART in build.h, and on arguments to initializeIOSubsystem(). 
     The command interpreter is located in control_input.c
     The streaming functions that format the data into the output are in control_output.c
+    On a host build (SENSOR_FUSION_HOST) the serial port is a host Stream (see hal_host.h)
+    and there is no WiFi transport.
 */
+#ifdef SENSOR_FUSION_HOST
+  #include "hal_host.h"
+#else
 #include <Arduino.h>
 #include <HardwareSerial.h>
 #ifdef ESP8266
@@ -23,13 +28,46 @@
 #ifdef ESP32
   #include <WiFi.h>
 #endif
+#endif
+#include <string.h>
 #include "sensor_fusion.h" // Requires sensor_fusion.h to occur first in the #include stackup
 #include "build.h"
 #include "control.h"
+#include "hal_timer.h"
 
-// global structures
-uint8_t sUARTOutputBuffer[MAX_LEN_SERIAL_OUTPUT_BUF];
+#ifdef SENSOR_FUSION_HOST
+// Host version of SendSerialBytesOut(): writes the output buffer to the Stream
+// passed as serial_port. tcp_client is ignored.
+int8_t SendSerialBytesOut(SensorFusionGlobals *sfg)
+{
+    ControlSubsystem *pComm = sfg->pControlSubsystem;
+    Stream *serial_port = (Stream *) (pComm->serial_port);
+    int32_t start_ticks;
+    TIMING_START(start_ticks);
+    if (serial_port && (pComm->bytes_to_send > 0)) {
+      serial_port->write(pComm->serial_out_buf, pComm->bytes_to_send);
+    }
+    pComm->bytes_to_send = 0;
+    TIMING_STOP(sfg, TIMING_SEND_SERIAL, start_ticks);
+    return (0);
+}//end SendSerialBytesOut()
 
+// Host version of ReceiveIncomingCommands(): reads command bytes from the
+// Stream passed as serial_port. tcp_client is ignored.
+int8_t ReceiveIncomingCommands(SensorFusionGlobals *sfg)
+{
+    uint8_t     data;
+    Stream *serial_port = (Stream *) sfg->pControlSubsystem->serial_port;
+
+    if( serial_port ) {
+        while (0 < serial_port->available() )
+      {   data = (uint8_t) serial_port->read();
+          DecodeCommandBytes(sfg, &data, 1);
+      }
+    }
+    return 0;
+}//end ReceiveIncomingCommands()
+#else
 // Blocking function to write multiple bytes to specified output(s): a UART
 //  or a TCP socket
 // On ESP32, hardware UART has internal FIFO of length 0x7f, and once the
@@ -38,6 +76,8 @@ uint8_t sUARTOutputBuffer[MAX_LEN_SERIAL_OUTPUT_BUF];
 int8_t SendSerialBytesOut(SensorFusionGlobals *sfg)
 {
   ControlSubsystem *pComm = sfg->pControlSubsystem;
+  int32_t start_ticks;
+  TIMING_START(start_ticks);
   // track number of bytes separately to run wired/wireless output in parallel
     uint16_t bytes_left_wired = 0;
     HardwareSerial *serial_port = (HardwareSerial *) (pComm->serial_port);
@@ -76,6 +116,7 @@ int8_t SendSerialBytesOut(SensorFusionGlobals *sfg)
       }
     }//end while() there are unsent bytes
     pComm->bytes_to_send = 0;
+    TIMING_STOP(sfg, TIMING_SEND_SERIAL, start_ticks);
     return (0);
 }//end SendSerialBytesOut()
 
@@ -107,6 +148,7 @@ int8_t ReceiveIncomingCommands(SensorFusionGlobals *sfg)
 
     return 0;
 }//end ReceiveIncomingCommands()
+#endif  // SENSOR_FUSION_HOST
 
 /// Initialize the control subsystem and all related hardware
 bool initializeIOSubsystem(
@@ -122,8 +164,16 @@ bool initializeIOSubsystem(
         pComm->DebugPacketOn = false;                // transmit debug packet
         pComm->RPCPacketOn = true;                  // transmit roll, pitch, compass packet
         pComm->AltPacketOn = false;                 // Altitude packet
+        pComm->TimingPacketOn = false;              // execution time statistics packet
         pComm->AccelCalPacketOn = false;
-        pComm->serial_out_buf = sUARTOutputBuffer;
+        pComm->serial_out_buf = pComm->sUARTOutputBuffer;
+        pComm->bytes_to_send = 0;
+        strcpy(pComm->iCommandBuffer, "~~~~");
+        pComm->iThrottle = 0;
+        pComm->iTimeStamp = 0;
+        pComm->iPacketNumber = 0;
+        pComm->MagneticPacketID = 0;
+        pComm->iTimingPacketStage = 0;
         pComm->write = SendSerialBytesOut;
         pComm->stream = CreateOutgoingPackets;
         pComm->readCommands = ReceiveIncomingCommands;
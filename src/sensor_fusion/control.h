@@ -55,9 +55,17 @@ typedef struct ControlSubsystem {
 	volatile uint8_t DebugPacketOn;			// flag to enable debug packet
 	volatile uint8_t RPCPacketOn;			// flag to enable roll, pitch, compass packet
 	volatile uint8_t AltPacketOn;			// flag to enable altitude packet
+	volatile uint8_t TimingPacketOn;		// flag to enable execution time statistics packet
 	volatile int8_t  AccelCalPacketOn;      // variable used to coordinate accelerometer calibration
     uint8_t         *serial_out_buf;        //buffer containing the output stream (data packet)
     uint16_t        bytes_to_send;          //how many bytes in output stream waiting to go out
+    uint8_t         sUARTOutputBuffer[MAX_LEN_SERIAL_OUTPUT_BUF];  //storage for serial_out_buf
+    char            iCommandBuffer[5];      //delay line of the last 4 command bytes, plus unused \0 (control_input.c)
+    int32_t         iThrottle;              //packet rate divider state (control_output.c)
+    uint32_t        iTimeStamp;             //1MHz time stamp of the outgoing packets
+    uint8_t         iPacketNumber;          //number of the outgoing packets
+    int16_t         MagneticPacketID;       //number of the magnetic buffer packets
+    uint8_t         iTimingPacketStage;     //timing stage to be transmitted next
     const void *serial_port;           //cast to Serial * and used to output to the serial port
     const void *tcp_client;            //cast to WiFiClient * and used to output to a connected TCP client
 
@@ -35,6 +35,9 @@
 #define cmd_RPCminus    (((((('R' << 8) | 'P') << 8) | 'C') << 8) | '-') // "RPC-" = Roll/Pitch/Compass off
 #define cmd_ALTplus     (((((('A' << 8) | 'L') << 8) | 'T') << 8) | '+') // "ALT+" = Altitude packet on
 #define cmd_ALTminus    (((((('A' << 8) | 'L') << 8) | 'T') << 8) | '-') // "ALT-" = Altitude packet off
+#define cmd_TMplus      (((((('T' << 8) | 'M') << 8) | '+') << 8) | ' ') // "TM+ " = enable execution time statistics packet transmission
+#define cmd_TMminus     (((((('T' << 8) | 'M') << 8) | '-') << 8) | ' ') // "TM- " = disable execution time statistics packet transmission
+#define cmd_TMR         (((((('T' << 8) | 'M') << 8) | 'R') << 8) | ' ') // "TMR " = reset execution time statistics
 #define cmd_RST         (((((('R' << 8) | 'S') << 8) | 'T') << 8) | ' ') // "RST " = Soft reset
 #define cmd_RINS        (((((('R' << 8) | 'I') << 8) | 'N') << 8) | 'S') // "RINS" = Reset INS inertial navigation velocity and position
 #define cmd_SVAC        (((((('S' << 8) | 'V') << 8) | 'A') << 8) | 'C') // "SVAC" = save all calibrations to non-volatile storage
@@ -69,7 +72,7 @@
 
 void DecodeCommandBytes(SensorFusionGlobals *sfg, uint8_t input_buffer[], uint16_t nbytes)
 {
-  static char iCommandBuffer[5] = "~~~~";	// 5 bytes long to include the unused terminating \0
+  char *iCommandBuffer = sfg->pControlSubsystem->iCommandBuffer;	// delay line of command bytes
   int32_t isum;		// 32 bit command identifier
   int16_t i, j;		// loop counters
 
@@ -167,6 +170,24 @@ void DecodeCommandBytes(SensorFusionGlobals *sfg, uint8_t input_buffer[], uint16
                     iCommandBuffer[3] = '~';
 		break;
 
+		case cmd_TMplus: // "TM+ " = enable execution time statistics packet transmission
+                    sfg->pControlSubsystem->TimingPacketOn = true;
+                    iCommandBuffer[3] = '~';
+		break;
+
+		case cmd_TMminus: // "TM- " = disable execution time statistics packet transmission
+                    sfg->pControlSubsystem->TimingPacketOn = false;
+                    iCommandBuffer[3] = '~';
+		break;
+
+		case cmd_TMR: // "TMR " = reset execution time statistics, keeping the overrun thresholds
+#if F_TIMING_STATS
+                    for (j = 0; j < TIMING_NUM_STAGES; j++)   // j is free here, i is the byte counter
+                        TimingStatReset(&(sfg->Timing.stage[j]));
+#endif
+                    iCommandBuffer[3] = '~';
+		break;
+
 		case cmd_RST: // "RST " = Soft reset
                     // reset sensor fusion
                     fInitializeFusion(sfg);
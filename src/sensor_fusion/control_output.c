@@ -17,6 +17,7 @@
 #include "build.h"
 #include "control.h"        // Command/Streaming interface - application specific
 #include "fusion_testing.h" // will include SensorPerturbations for test purposes
+#include "hal_timer.h"      // systick functions for execution time statistics
 
 // OutputBufAppendItem() appends a variable number of source bytes to a destination buffer
 // for transmission as the output packet.
@@ -91,9 +92,8 @@ void ReadCommonParams( SV_ptr data,
 }//end ReadCommonParams()
 
 // Throttle back output stream by fractional multiplier
-bool Throttle()
+bool Throttle(ControlSubsystem *pComm)
 {
-    static int32_t iThrottle = 0;
     bool skip;
     // The UART (serial over USB and over WiFi / Bluetooth)
     // is limited to 115kbps which is more than adequate for the 31kbps
@@ -103,10 +103,10 @@ bool Throttle()
     // support a higher rate, the limit is set to MAXPACKETRATEHZ=40Hz.
 
     // the increment applied to iThrottle is in the range 0 to (RATERESOLUTION - 1)
-    iThrottle += ((int32_t) MAXPACKETRATEHZ * (int32_t) RATERESOLUTION) / (int32_t) FUSION_HZ;
-    if (iThrottle >= RATERESOLUTION) {
+    pComm->iThrottle += ((int32_t) MAXPACKETRATEHZ * (int32_t) RATERESOLUTION) / (int32_t) FUSION_HZ;
+    if (pComm->iThrottle >= RATERESOLUTION) {
         // update the throttle counter and transmit the packets over UART (USB and Bluetooth)
-	iThrottle -= RATERESOLUTION;
+	pComm->iThrottle -= RATERESOLUTION;
         skip = false;
     } else {
         skip = true;
@@ -117,10 +117,10 @@ bool Throttle()
 // prepare packets to send, e.g. via Bluetooth, or UART to OpenSDA / USB
 void CreateOutgoingPackets(SensorFusionGlobals *sfg)
 {
-    uint8_t         *output_buf = sfg->pControlSubsystem->serial_out_buf;
+    ControlSubsystem *pComm = sfg->pControlSubsystem;
+    uint8_t         *output_buf = pComm->serial_out_buf;
     Quaternion      fq;                 // quaternion to be transmitted
     float           ftmp;               // scratch
-    static uint32_t iTimeStamp = 0;     // 1MHz time stamp
     uint16_t        iIndex;             // output buffer counter
     int32_t         scratch32;          // scratch int32_t
     int16_t         scratch16;          // scratch int16_t
@@ -137,14 +137,15 @@ void CreateOutgoingPackets(SensorFusionGlobals *sfg)
                     DebugPacketOn,
                     RPCPacketOn;
     int8_t          AccelCalPacketOn;
-    static uint8_t  iPacketNumber = 0;  // packet number
+    int32_t         iStart;             // systick at start of packet creation
 
     // update the 1MHz time stamp counter expected by the PC GUI (independent of project clock rates)
-    iTimeStamp += 1000000 / FUSION_HZ;
+    pComm->iTimeStamp += 1000000 / FUSION_HZ;
 
 #if (MAXPACKETRATEHZ < FUSION_HZ)
-    if (Throttle()) return;  // need to skip packet transmission to avoid UART overrun
+    if (Throttle(pComm)) return;  // need to skip packet transmission to avoid UART overrun
 #endif
+    TIMING_START(iStart);
 
     // cache local copies of control flags so we don't have to keep dereferencing pointers below
     quaternion_type quaternionPacketType;
@@ -167,8 +168,9 @@ void CreateOutgoingPackets(SensorFusionGlobals *sfg)
     // Magnetic type 6: range 0 to 16 = 18 bytes
     // Kalman packet 7: range 0 to 47 = 48 bytes
     // Precision Accelerometer packet 8: range 0 to 46 = 47 bytes
+    // Timing statistics packet 9: range 0 to 28 = 29 bytes
     //
-    // Total excluding intermittent packet 8 is:
+    // Total excluding intermittent packet 8 and optional packet 9 is:
     // 152 bytes vs 256 bytes size of output_buf
     // at 25Hz, data rate is 25*152 = 3800 bytes/sec = 38.0kbaud = 33% of 115.2kbaud
     // at 40Hz, data rate is 40*152 = 6080 bytes/sec = 60.8kbaud = 53% of 115.2kbaud
@@ -187,11 +189,11 @@ void CreateOutgoingPackets(SensorFusionGlobals *sfg)
     OutputBufAppendItem(output_buf, &iIndex, &tmpuint8_t, 1);
 
     // [2]: packet number byte
-    OutputBufAppendItem(output_buf, &iIndex, &iPacketNumber, 1);
-    iPacketNumber++;
+    OutputBufAppendItem(output_buf, &iIndex, &pComm->iPacketNumber, 1);
+    pComm->iPacketNumber++;
 
     // [6-3]: 1MHz time stamp (4 bytes)
-    OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &iTimeStamp, 4);
+    OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &pComm->iTimeStamp, 4);
 
     // [12-7]: integer accelerometer data words (scaled to 8192 counts per g for PC GUI)
     // send non-zero data only if the accelerometer sensor is enabled and used by the selected quaternion
@@ -446,8 +448,8 @@ void CreateOutgoingPackets(SensorFusionGlobals *sfg)
         OutputBufAppendItem(output_buf, &iIndex, &tmpuint8_t, 1);
 
         // [2]: packet number byte
-        OutputBufAppendItem(output_buf, &iIndex, &iPacketNumber, 1);
-        iPacketNumber++;
+        OutputBufAppendItem(output_buf, &iIndex, &pComm->iPacketNumber, 1);
+        pComm->iPacketNumber++;
 
         // [4-3] software version number
         scratch16 = THISBUILD;
@@ -474,11 +476,11 @@ void CreateOutgoingPackets(SensorFusionGlobals *sfg)
         OutputBufAppendItem(output_buf, &iIndex, &tmpuint8_t, 1);
 
         // [2]: packet number byte
-        OutputBufAppendItem(output_buf, &iIndex, &iPacketNumber, 1);
-        iPacketNumber++;
+        OutputBufAppendItem(output_buf, &iIndex, &pComm->iPacketNumber, 1);
+        pComm->iPacketNumber++;
 
         // [6-3]: time stamp (4 bytes)
-        OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &iTimeStamp, 4);
+        OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &pComm->iTimeStamp, 4);
 
         // [12-7]: add the scaled angular velocity vector to the output buffer
         OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &iOmega[CHX], 2);
@@ -503,11 +505,11 @@ void CreateOutgoingPackets(SensorFusionGlobals *sfg)
         OutputBufAppendItem(output_buf, &iIndex, &tmpuint8_t, 1);
 
         // [2]: packet number byte
-        OutputBufAppendItem(output_buf, &iIndex, &iPacketNumber, 1);
-        iPacketNumber++;
+        OutputBufAppendItem(output_buf, &iIndex, &pComm->iPacketNumber, 1);
+        pComm->iPacketNumber++;
 
         // [6-3]: time stamp (4 bytes)
-        OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &iTimeStamp, 4);
+        OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &pComm->iTimeStamp, 4);
 
         // [12-7]: add the angles (resolution 0.1 deg per count) to the transmit buffer
         OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &iPhi, 2);
@@ -535,11 +537,11 @@ void CreateOutgoingPackets(SensorFusionGlobals *sfg)
             OutputBufAppendItem(output_buf, &iIndex, &tmpuint8_t, 1);
 
             // [2]: packet number byte
-            OutputBufAppendItem(output_buf, &iIndex, &iPacketNumber, 1);
-            iPacketNumber++;
+            OutputBufAppendItem(output_buf, &iIndex, &pComm->iPacketNumber, 1);
+            pComm->iPacketNumber++;
 
             // [6-3]: time stamp (4 bytes)
-            OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &iTimeStamp,
+            OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &pComm->iTimeStamp,
                            4);
 
             // [10-7]: altitude (4 bytes, metres times 1000)
@@ -562,7 +564,6 @@ void CreateOutgoingPackets(SensorFusionGlobals *sfg)
     // this packet is only transmitted if a magnetic algorithm is computed
     // ************************************************************************
 #if F_USING_MAG
-    static int16_t  MagneticPacketID = 0;   // magnetic packet number
     if (sfg->iFlags & F_USING_MAG)
     {
         // [0]: packet start byte
@@ -573,8 +574,8 @@ void CreateOutgoingPackets(SensorFusionGlobals *sfg)
         OutputBufAppendItem(output_buf, &iIndex, &tmpuint8_t, 1);
 
         // [2]: packet number byte
-        OutputBufAppendItem(output_buf, &iIndex, &iPacketNumber, 1);
-        iPacketNumber++;
+        OutputBufAppendItem(output_buf, &iIndex, &pComm->iPacketNumber, 1);
+        pComm->iPacketNumber++;
 
         // [4-3]: number of active measurements in the magnetic buffer
         OutputBufAppendItem(output_buf, &iIndex,
@@ -592,7 +593,7 @@ void CreateOutgoingPackets(SensorFusionGlobals *sfg)
         OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &scratch16, 2);
 
         // always calculate magnetic buffer row and column (low overhead and saves warnings)
-        k = MagneticPacketID - 10;
+        k = pComm->MagneticPacketID - 10;
         j = k / MAGBUFFSIZEX;
         i = k - j * MAGBUFFSIZEX;
 
@@ -601,23 +602,23 @@ void CreateOutgoingPackets(SensorFusionGlobals *sfg)
         // ID 5 to 9 inclusive are for future expansion
         // ID 10 to (MAGBUFFSIZEX=12) * (MAGBUFFSIZEY=24)-1 or 10 to 10+288-1 are magnetic buffer elements
         // where the convention is used that a negative value indicates empty buffer element (index=-1)
-        if ((MagneticPacketID >= 10) && (sfg->MagBuffer.index[i][j] == -1))
+        if ((pComm->MagneticPacketID >= 10) && !iMagBufferBinActive(&(sfg->MagBuffer), i, j))
         {
             // use negative ID to indicate inactive magnetic buffer element
-            scratch16 = -MagneticPacketID;
+            scratch16 = -pComm->MagneticPacketID;
             OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &scratch16, 2);
         }
         else
         {
             // use positive ID unchanged for variable or active magnetic buffer entry
-            scratch16 = MagneticPacketID;
+            scratch16 = pComm->MagneticPacketID;
             OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &scratch16, 2);
         }
 
         // [12-11]: int16_t: variable 1 to be transmitted this iteration
         // [14-13]: int16_t: variable 2 to be transmitted this iteration
         // [16-15]: int16_t: variable 3 to be transmitted this iteration
-        switch (MagneticPacketID)
+        switch (pComm->MagneticPacketID)
         {
             case 0:
                 // item 1: currently unused
@@ -676,18 +677,18 @@ void CreateOutgoingPackets(SensorFusionGlobals *sfg)
             default:
                 // 10 and upwards: this handles the magnetic buffer elements
                 OutputBufAppendItem(output_buf, &iIndex,
-                               (uint8_t *) &(sfg->MagBuffer.iBs[CHX][i][j]), 2);
+                               (uint8_t *) &MAGBUFFER_BS(&(sfg->MagBuffer), CHX, i, j), 2);
                 OutputBufAppendItem(output_buf, &iIndex,
-                               (uint8_t *) &(sfg->MagBuffer.iBs[CHY][i][j]), 2);
+                               (uint8_t *) &MAGBUFFER_BS(&(sfg->MagBuffer), CHY, i, j), 2);
                 OutputBufAppendItem(output_buf, &iIndex,
-                               (uint8_t *) &(sfg->MagBuffer.iBs[CHZ][i][j]), 2);
+                               (uint8_t *) &MAGBUFFER_BS(&(sfg->MagBuffer), CHZ, i, j), 2);
                 break;
         }
 
         // wrap the variable ID back to zero if necessary
-        MagneticPacketID++;
-        if (MagneticPacketID >= (10 + MAGBUFFSIZEX * MAGBUFFSIZEY))
-            MagneticPacketID = 0;
+        pComm->MagneticPacketID++;
+        if (pComm->MagneticPacketID >= (10 + MAGBUFFSIZEX * MAGBUFFSIZEY))
+            pComm->MagneticPacketID = 0;
 
         // [17]: add the tail byte for the magnetic packet type 6
         output_buf[iIndex++] = 0x7E;
@@ -722,8 +723,8 @@ void CreateOutgoingPackets(SensorFusionGlobals *sfg)
             OutputBufAppendItem(output_buf, &iIndex, &tmpuint8_t, 1);
 
             // [2]: packet number byte
-            OutputBufAppendItem(output_buf, &iIndex, &iPacketNumber, 1);
-            iPacketNumber++;
+            OutputBufAppendItem(output_buf, &iIndex, &pComm->iPacketNumber, 1);
+            pComm->iPacketNumber++;
 
             // [4-3]: fzgErr[CHX] resolution scaled by 30000
             // [6-5]: fzgErr[CHY] resolution scaled by 30000
@@ -863,8 +864,8 @@ void CreateOutgoingPackets(SensorFusionGlobals *sfg)
         OutputBufAppendItem(output_buf, &iIndex, &tmpuint8_t, 1);
 
         // [2]: packet number byte
-        OutputBufAppendItem(output_buf, &iIndex, &iPacketNumber, 1);
-        iPacketNumber++;
+        OutputBufAppendItem(output_buf, &iIndex, &pComm->iPacketNumber, 1);
+        pComm->iPacketNumber++;
 
         // [3]: AccelCalPacketOn in range 0-11 denotes stored location and MAXORIENTATIONS denotes transmit
         // precision accelerometer calibration on power on before any measurements have been obtained.
@@ -941,6 +942,58 @@ void CreateOutgoingPackets(SensorFusionGlobals *sfg)
         sfg->pControlSubsystem->AccelCalPacketOn = -1;
     }
 #endif  // F_USING_ACCEL
+#if F_TIMING_STATS
+    // *************************************************************************
+    // fixed length packet type 9 carrying the execution time statistics of one
+    // stage of the fusion cycle (see timing_stats.h). Successive packets step
+    // through the stages that have been timed at least once.
+    // total size is 0 to 28 equals 29 bytes
+    // *************************************************************************
+    if (sfg->pControlSubsystem->TimingPacketOn)
+    {
+        TimingSummary timing;
+
+        // find the next stage with samples, giving up after one full lap
+        for (i = 0; i < TIMING_NUM_STAGES; i++)
+        {
+            if (pComm->iTimingPacketStage >= TIMING_NUM_STAGES) pComm->iTimingPacketStage = 0;
+            if (sfg->Timing.stage[pComm->iTimingPacketStage].iCount > 0) break;
+            pComm->iTimingPacketStage++;
+        }
+        TimingStatSummarize(&(sfg->Timing.stage[pComm->iTimingPacketStage]), &timing);
+
+        // [0]: packet start byte
+        output_buf[iIndex++] = 0x7E;
+
+        // [1]: packet type 9 byte
+        tmpuint8_t = 0x09;
+        OutputBufAppendItem(output_buf, &iIndex, &tmpuint8_t, 1);
+
+        // [2]: packet number byte
+        OutputBufAppendItem(output_buf, &iIndex, &pComm->iPacketNumber, 1);
+        pComm->iPacketNumber++;
+
+        // [3]: stage (timing_stage_t)
+        OutputBufAppendItem(output_buf, &iIndex, &pComm->iTimingPacketStage, 1);
+
+        // [7-4]: number of samples
+        // [11-8]: minimum (us)
+        // [15-12]: maximum (us)
+        // [19-16]: mean (us)
+        // [23-20]: 99th percentile (us)
+        // [27-24]: number of samples over budget
+        OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &(timing.iCount), 4);
+        OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &(timing.iMin), 4);
+        OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &(timing.iMax), 4);
+        OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &(timing.iMean), 4);
+        OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &(timing.iP99), 4);
+        OutputBufAppendItem(output_buf, &iIndex, (uint8_t *) &(timing.iOverruns), 4);
+
+        // [28]: add the tail byte for the timing packet type 9
+        output_buf[iIndex++] = 0x7E;
+        pComm->iTimingPacketStage++;
+    }
+#endif  // F_TIMING_STATS
     // ********************************************************************************
     // all packets have now been constructed in the output buffer.
     // The final iIndex++ gives the number of bytes to transmit which is one more than
@@ -948,5 +1001,6 @@ void CreateOutgoingPackets(SensorFusionGlobals *sfg)
     // ********************************************************************************
     sfg->pControlSubsystem->bytes_to_send = iIndex;
 
+    TIMING_STOP(sfg, TIMING_CREATE_PACKETS, iStart);
     return;
 }
@@ -4,12 +4,20 @@
     Can disable these prints by compiling without defining ENABLE_DEBUG_LOG
 */
 
-#include <HardwareSerial.h>
+#ifdef SENSOR_FUSION_HOST
+  #include <stdio.h>
+#else
+  #include <HardwareSerial.h>
+#endif
 #include "build.h"
 #include "debug_print.h"
 
 #if (ENABLE_DEBUG_LOG == 1)
 void debug_log(const char* str) {
+#ifdef SENSOR_FUSION_HOST
+   fprintf(stderr, "%s\n", str);
+#else
    Serial.println(str);
+#endif
 }
 #endif
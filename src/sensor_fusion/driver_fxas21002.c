@@ -40,12 +40,6 @@ const registerReadlist_t    FXAS21002_F_STATUS_READ[] =
     { .readFrom = FXAS21002_STATUS, .numBytes = 1 }, __END_READ_DATA__
 };
 
-// Command definition to read the gyro FIFO.
-registerReadlist_t          FXAS21002_DATA_READ[] =
-{
-    { .readFrom = FXAS21002_OUT_X_MSB, .numBytes = 6 }, __END_READ_DATA__
-};
-
 // Each entry in a RegisterWriteList is composed of: register address, value to write, bit-mask to apply to write (0 enables)
 const registerwritelist_t   FXAS21000_INITIALIZATION[] =
 {
@@ -219,6 +213,10 @@ int8_t FXAS21002_Init(struct PhysicalSensor *sensor, SensorFusionGlobals *sfg)
 int8_t FXAS21002_Read(struct PhysicalSensor *sensor, SensorFusionGlobals *sfg)
 {
     uint8_t     I2C_Buffer[6 * GYRO_FIFO_SIZE]; // I2C read buffer
+    registerReadlist_t DataRead[] =             // read command, set up for each burst below
+    {
+        { .readFrom = FXAS21002_OUT_X_MSB, .numBytes = 6 }, __END_READ_DATA__
+    };
     uint8_t      j;                              // scratch
     uint8_t     fifo_packet_count = 1;
     int32_t     status;
@@ -249,14 +247,14 @@ int8_t FXAS21002_Read(struct PhysicalSensor *sensor, SensorFusionGlobals *sfg)
           if (sfg->Gyro.iWhoAmI == FXAS21002_WHO_AM_I_WHOAMI_OLD_VALUE) {
 //    if (true) {
             // read six sequential gyro output bytes
-            FXAS21002_DATA_READ[0].readFrom = FXAS21002_OUT_X_MSB;
-            FXAS21002_DATA_READ[0].numBytes = 6;
+            DataRead[0].readFrom = FXAS21002_OUT_X_MSB;
+            DataRead[0].numBytes = 6;
 
             // for FXAS21000, perform sequential 6 byte reads
             for (j = 0; j < fifo_packet_count; j++) {
               // read one set of measurements totalling 6 bytes
               status = Sensor_I2C_Read(&sensor->deviceInfo,
-                                       sensor->addr, FXAS21002_DATA_READ,
+                                       sensor->addr, DataRead,
                                        I2C_Buffer);
 
               if (status == SENSOR_ERROR_NONE) {
@@ -274,20 +272,20 @@ int8_t FXAS21002_Read(struct PhysicalSensor *sensor, SensorFusionGlobals *sfg)
         // for FXAS21002, clear the FIFO in burst reads using WRAPTOONE feature, which decreases read time to 2 ms. 
         //Noticed that I2C reads > 126 bytes don't work, so limit the number of FIFO packets per burst read.
 #define MAX_FIFO_PACKETS_PER_READ 11        
-        FXAS21002_DATA_READ[0].readFrom = FXAS21002_OUT_X_MSB;
+        DataRead[0].readFrom = FXAS21002_OUT_X_MSB;
         while( (fifo_packet_count > 0)  && (status==SENSOR_ERROR_NONE)) {
             if( MAX_FIFO_PACKETS_PER_READ < fifo_packet_count ) {
-               FXAS21002_DATA_READ[0].numBytes = MAX_FIFO_PACKETS_PER_READ * 6;
+               DataRead[0].numBytes = MAX_FIFO_PACKETS_PER_READ * 6;
                fifo_packet_count -= MAX_FIFO_PACKETS_PER_READ;
             }else {
-                FXAS21002_DATA_READ[0].numBytes = fifo_packet_count * 6;
+                DataRead[0].numBytes = fifo_packet_count * 6;
                 fifo_packet_count = 0;
             }
             status = Sensor_I2C_Read(&sensor->deviceInfo,
-                                     sensor->addr, FXAS21002_DATA_READ,
+                                     sensor->addr, DataRead,
                                      I2C_Buffer);
             if (status==SENSOR_ERROR_NONE) {
-                for (j = 0; j < FXAS21002_DATA_READ[0].numBytes; j+=6) {
+                for (j = 0; j < DataRead[0].numBytes; j+=6) {
                     // place the measurements read into the gyroscope buffer structure
                     sample[CHX] = (I2C_Buffer[j + 0] << 8) | I2C_Buffer[j + 1];
                     sample[CHY] = (I2C_Buffer[j + 2] << 8) | I2C_Buffer[j + 3];
@@ -32,12 +32,6 @@ const registerReadlist_t    FXOS8700_F_STATUS_READ[] =
     { .readFrom = FXOS8700_STATUS, .numBytes = 1 }, __END_READ_DATA__
 };
 
-// Command definition to read the number of entries in the accel FIFO.
-registerReadlist_t          FXOS8700_DATA_READ[] =
-{
-    { .readFrom = FXOS8700_OUT_X_MSB, .numBytes = 6 }, __END_READ_DATA__
-};
-
 // Each entry in a RegisterWriteList is composed of: register address, value to write, bit-mask to apply to write (0 enables)
 const registerwritelist_t   FXOS8700_Initialization[] =
 {
@@ -194,6 +188,10 @@ int8_t FXOS8700_Init(struct PhysicalSensor *sensor, SensorFusionGlobals *sfg) {
 #if F_USING_ACCEL
 int8_t FXOS8700_Accel_Read(struct PhysicalSensor *sensor, SensorFusionGlobals *sfg) {
     uint8_t                     I2C_Buffer[6 * ACCEL_FIFO_SIZE];    // I2C read buffer
+    registerReadlist_t          DataRead[] =    // read command, set up for each burst below
+    {
+        { .readFrom = FXOS8700_OUT_X_MSB, .numBytes = 6 }, __END_READ_DATA__
+    };
     int32_t                     status;         // I2C transaction status
     int8_t                      j;              // scratch
     uint8_t                     fifo_packet_count;
@@ -229,19 +227,19 @@ int8_t FXOS8700_Accel_Read(struct PhysicalSensor *sensor, SensorFusionGlobals *s
     // auto-increment and wrap turned on, the registers are read
     // 0x01,0x02,...0x05,0x06,0x01,0x02,...  So we read 6 bytes per packet.
 #define MAX_FIFO_PACKETS_PER_READ 15  // for max of 90 bytes per I2C xaction.
-    FXOS8700_DATA_READ[0].readFrom = FXOS8700_OUT_X_MSB;  
+    DataRead[0].readFrom = FXOS8700_OUT_X_MSB;  
     while ((fifo_packet_count > 0) && (status == SENSOR_ERROR_NONE)) {
       if (MAX_FIFO_PACKETS_PER_READ < fifo_packet_count) {
-        FXOS8700_DATA_READ[0].numBytes = 6 * MAX_FIFO_PACKETS_PER_READ;
+        DataRead[0].numBytes = 6 * MAX_FIFO_PACKETS_PER_READ;
         fifo_packet_count -= MAX_FIFO_PACKETS_PER_READ;
       } else {
-        FXOS8700_DATA_READ[0].numBytes = 6 * fifo_packet_count;
+        DataRead[0].numBytes = 6 * fifo_packet_count;
         fifo_packet_count = 0;
       }
       status = Sensor_I2C_Read(&sensor->deviceInfo,
-                               sensor->addr, FXOS8700_DATA_READ, I2C_Buffer);
+                               sensor->addr, DataRead, I2C_Buffer);
       if (status == SENSOR_ERROR_NONE) {
-        for (j = 0; j < FXOS8700_DATA_READ[0].numBytes; j+=6) {
+        for (j = 0; j < DataRead[0].numBytes; j+=6) {
             // place the measurements read into the accelerometer buffer structure 
             sample[CHX] = (I2C_Buffer[j + 0] << 8) | (I2C_Buffer[j + 1]); 
             sample[CHY] = (I2C_Buffer[j + 2] << 8) | (I2C_Buffer[j + 3]); 
@@ -260,6 +258,10 @@ int8_t FXOS8700_Accel_Read(struct PhysicalSensor *sensor, SensorFusionGlobals *s
 // read FXOS8700 magnetometer over I2C
 int8_t FXOS8700_Mag_Read(struct PhysicalSensor *sensor, SensorFusionGlobals *sfg) {
     uint8_t                     I2C_Buffer[6];  // I2C read buffer
+    const registerReadlist_t    DataRead[] =    // read command for the six magnetometer output bytes
+    {
+        { .readFrom = FXOS8700_M_OUT_X_MSB, .numBytes = 6 }, __END_READ_DATA__
+    };
     int32_t                     status;         // I2C transaction status
     int16_t                     sample[3];
 
@@ -269,9 +271,7 @@ int8_t FXOS8700_Mag_Read(struct PhysicalSensor *sensor, SensorFusionGlobals *sfg
     }
 
     // read the six sequential magnetometer output bytes
-    FXOS8700_DATA_READ[0].readFrom = FXOS8700_M_OUT_X_MSB;
-    FXOS8700_DATA_READ[0].numBytes = 6;
-    status =  Sensor_I2C_Read(&sensor->deviceInfo, sensor->addr, FXOS8700_DATA_READ, I2C_Buffer );
+    status =  Sensor_I2C_Read(&sensor->deviceInfo, sensor->addr, DataRead, I2C_Buffer );
     if (status==SENSOR_ERROR_NONE) {
         // place the 6 bytes read into the magnetometer structure
         sample[CHX] = (I2C_Buffer[0] << 8) | I2C_Buffer[1];
@@ -287,6 +287,10 @@ int8_t FXOS8700_Mag_Read(struct PhysicalSensor *sensor, SensorFusionGlobals *sfg
 // read temperature register over I2C
 int8_t FXOS8700_Therm_Read(struct PhysicalSensor *sensor, SensorFusionGlobals *sfg) {
     int8_t                      I2C_Buffer;     // I2C read buffer
+    const registerReadlist_t    DataRead[] =    // read command for the temperature register
+    {
+        { .readFrom = FXOS8700_TEMP, .numBytes = 1 }, __END_READ_DATA__
+    };
     int32_t                     status;         // I2C transaction status
 
     if(!(sensor->isInitialized)) {
@@ -294,9 +298,7 @@ int8_t FXOS8700_Therm_Read(struct PhysicalSensor *sensor, SensorFusionGlobals *s
     }
 
     // read the Temperature register 0x51
-    FXOS8700_DATA_READ[0].readFrom = FXOS8700_TEMP;
-    FXOS8700_DATA_READ[0].numBytes = 1;
-    status =  Sensor_I2C_Read(&sensor->deviceInfo, sensor->addr, FXOS8700_DATA_READ, (uint8_t*)(&I2C_Buffer) );
+    status =  Sensor_I2C_Read(&sensor->deviceInfo, sensor->addr, DataRead, (uint8_t*)(&I2C_Buffer) );
     if (status==SENSOR_ERROR_NONE) {
         // convert the byte to temperature and place in sfg structure
         sfg->Temp.temperatureC = (float)I2C_Buffer * 0.96; //section 14.3 of manual says 0.96 degC/LSB
@@ -0,0 +1,360 @@
+/*
+ * Copyright (c) 2020-2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file fixed_point.c
+    \brief Q30 fixed point arithmetic for targets without a floating point unit.
+
+    See fixed_point.h for a description of the number format.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "sensor_fusion.h"
+#include "fixed_point.h"        // Header for this .c file
+
+// Q30 reciprocals of the series coefficients used by iQ30FromHalfAngleVector()
+#define Q30_ONEOVER6    ((int32_t) 178956971)
+#define Q30_ONEOVER24   ((int32_t) 44739243)
+#define Q30_ONEOVER120  ((int32_t) 8947849)
+#define Q30_ONEOVER720  ((int32_t) 1491308)
+
+// rounds a sum of Q60 products to Q30
+#define Q60_TO_Q30(i)   ((int32_t) (((i) + (1 << 29)) >> 30))
+
+// bounds of the int64_t results of the fixed point conversions and divisions, so that sums of two don't overflow
+#define FIXED64_MAX     ((int64_t) 0x3FFFFFFFFFFFFFFF)
+
+// Q30 coefficients of the initial estimate 24/17 - 8/17 * d of 1 / d for d in [1, 2), within 1/17
+#define Q30_24OVER17    ((int64_t) 1515870810)
+#define Q30_8OVER17     ((int64_t) 505290270)
+
+// function returns the float fA in fixed point with iQ fractional bits, rounded, taking the mantissa and exponent
+// from the IEEE bits so that no float arithmetic is needed. Denormals give zero and results beyond +-2^62
+// (including infinities and NaN) saturate.
+int64_t iFixed64FromFloat(float fA, int8_t iQ)
+{
+	uint32_t ibits;             // IEEE bits of fA
+	int64_t  iMantissa;         // mantissa with the implicit leading bit
+	int16_t  iShift;            // left shift of the mantissa to the fixed point value
+
+	memcpy(&ibits, &fA, sizeof(ibits));
+	if (!(ibits & 0x7F800000)) return 0;
+	iMantissa = (int64_t) ((ibits & 0x007FFFFF) | 0x00800000);
+	iShift = (int16_t) ((int16_t) ((ibits >> 23) & 0xFF) - 150 + iQ);
+	if ((iShift > 38) || ((ibits & 0x7F800000) == 0x7F800000))
+		iMantissa = FIXED64_MAX;
+	else if (iShift >= 0)
+		iMantissa <<= iShift;
+	else if (iShift >= -24)
+		iMantissa = (iMantissa + ((int64_t) 1 << (-iShift - 1))) >> -iShift;
+	else
+		iMantissa = 0;
+
+	return (ibits & 0x80000000) ? -iMantissa : iMantissa;
+}
+
+// function returns the float fA in fixed point with iQ fractional bits as iFixed64FromFloat() does, saturating
+// at +-(2^31 - 1)
+int32_t iFixedFromFloat(float fA, int8_t iQ)
+{
+	return iSat32(iFixed64FromFloat(fA, iQ));
+}
+
+// function returns the fixed point iA with iQ fractional bits as a float, rounded to 24 bits, by building the
+// IEEE bits from the position of the leading bit. Results below the smallest normal float give zero.
+float fFloatFromFixed(int64_t iA, int8_t iQ)
+{
+	uint64_t iAbs;              // |iA|
+	uint32_t iMantissa;         // 24 bit mantissa with the leading bit
+	uint32_t ibits;             // IEEE bits of the result
+	int16_t  iLead;             // position of the leading bit of iAbs
+	int16_t  iExp;              // biased exponent
+	float    fA;                // result
+
+	if (!iA) return 0.0F;
+	iAbs = (iA < 0) ? (uint64_t) -(iA + 1) + 1 : (uint64_t) iA;
+	iLead = (int16_t) (63 - __builtin_clzll(iAbs));
+	if (iLead > 23)
+	{
+		iMantissa = (uint32_t) (((iAbs >> (iLead - 24)) + 1) >> 1);
+		if (iMantissa >> 24)
+		{
+			iMantissa >>= 1;
+			iLead++;
+		}
+	}
+	else
+		iMantissa = (uint32_t) (iAbs << (23 - iLead));
+	iExp = (int16_t) (iLead - iQ + 127);
+	if (iExp <= 0) return 0.0F;
+	if (iExp >= 255)
+	{
+		iExp = 255;
+		iMantissa = 0;
+	}
+	ibits = ((iA < 0) ? 0x80000000 : 0) | ((uint32_t) iExp << 23) | (iMantissa & 0x007FFFFF);
+	memcpy(&fA, &ibits, sizeof(fA));
+
+	return fA;
+}
+
+// function returns the right shift that leaves iA with a magnitude of at most 2^30 and, unless iA is zero, at least 2^29.
+// The shift is negative when iA must be shifted left. Applying the shift of the largest of several values to all of
+// them brings them to a common scale that keeps products of two, and sums of two such products, within 64 bits.
+int8_t iFixedNormShift(int64_t iA)
+{
+	uint64_t iAbs;              // |iA|
+
+	if (!iA) return 0;
+	iAbs = (iA < 0) ? (uint64_t) -(iA + 1) + 1 : (uint64_t) iA;
+
+	return (int8_t) (34 - __builtin_clzll(iAbs));
+}
+
+// function returns iA shifted right by iShift with rounding, or left by -iShift when iShift is negative
+int64_t iFixedShift(int64_t iA, int8_t iShift)
+{
+	if (iShift > 0)
+		return (iA + ((int64_t) 1 << (iShift - 1))) >> iShift;
+
+	return iA * ((int64_t) 1 << -iShift);
+}
+
+// function returns the Q30 square root of the Q30 value iA, rounded, or zero if iA is not positive.
+// The digit by digit method needs only shifts, compares and subtractions.
+int32_t iQ30Sqrt(int32_t iA)
+{
+	uint64_t iRem;              // remainder, starting from iA * 2^30
+	uint64_t iRoot;             // root developed so far
+	uint64_t iBit;              // current power of 4
+
+	if (iA <= 0) return 0;
+	iRem = (uint64_t) iA << 30;
+	iRoot = 0;
+	iBit = (uint64_t) 1 << 60;
+	while (iBit > iRem) iBit >>= 2;
+	while (iBit)
+	{
+		if (iRem >= iRoot + iBit)
+		{
+			iRem -= iRoot + iBit;
+			iRoot = (iRoot >> 1) + iBit;
+		}
+		else
+			iRoot >>= 1;
+		iBit >>= 2;
+	}
+	if (iRem > iRoot) iRoot++;
+
+	return (int32_t) iRoot;
+}
+
+// function sets *pR to the reciprocal of the positive integer iA. iA is normalized to d in [2^30, 2^31) and
+// three Newton steps y = y + y * (1 - d * y) from 24/17 - 8/17 * d give 1 / d to the Q30 rounding of the products,
+// with no division. Returns false, leaving *pR unchanged, if iA is not positive.
+int8_t iSetFixedReciprocal(FixedReciprocal *pR, int64_t iA)
+{
+	int64_t  id;                // iA normalized to [2^30, 2^31) (Q30 value in [1, 2))
+	int64_t  iy;                // estimate of 1 / d (Q30)
+	int8_t   iExp;              // iA = id * 2^iExp
+	int8_t   i;                 // loop counter
+
+	if (iA <= 0) return false;
+	iExp = (int8_t) (iFixedNormShift(iA) - 1);
+	id = iFixedShift(iA, iExp);
+	if (id >> 31)
+	{
+		id >>= 1;
+		iExp++;
+	}
+
+	iy = Q30_24OVER17 - ((Q30_8OVER17 * id + (1 << 29)) >> 30);
+	for (i = 0; i < 3; i++)
+		iy += (iy * (Q30_ONE - ((id * iy + (1 << 29)) >> 30)) + (1 << 29)) >> 30;
+	pR->iMantissa = (int32_t) iy;
+	pR->iExp = iExp;
+
+	return true;
+}
+
+// function returns iA / A * 2^iQ, rounded and saturated at +-(2^62 - 1), where *pR holds the reciprocal of A
+// from iSetFixedReciprocal(). With iA and A both in fixed point, iQ sets the fractional bits of the result.
+// iA is rounded to 31 significant bits first.
+int64_t iMulFixedReciprocal(int64_t iA, const FixedReciprocal *pR, int8_t iQ)
+{
+	int64_t  iProduct;          // iA * mantissa of the reciprocal
+	int16_t  iShift;            // right shift of iProduct to the result
+	int8_t   iNorm;             // right shift of iA to 31 bits
+
+	if (!iA) return 0;
+	iNorm = (int8_t) (iFixedNormShift(iA) - 1);
+	if (iNorm < 0) iNorm = 0;
+	iProduct = iFixedShift(iA, iNorm) * pR->iMantissa;
+	iShift = (int16_t) (60 + pR->iExp - iNorm - iQ);
+	if (iShift > 62) return 0;
+	if (iShift > 0) return (iProduct + ((int64_t) 1 << (iShift - 1))) >> iShift;
+	if ((iShift < -62) || (iProduct > (FIXED64_MAX >> -iShift)) || (iProduct < -(FIXED64_MAX >> -iShift)))
+		return (iProduct < 0) ? -FIXED64_MAX : FIXED64_MAX;
+
+	return iProduct * ((int64_t) 1 << -iShift);
+}
+
+// function converts a float quaternion to Q30
+void qQ30FromQuaternion(QuaternionQ30 *pqA, const Quaternion *pqB)
+{
+	pqA->q0 = iFixedFromFloat(pqB->q0, 30);
+	pqA->q1 = iFixedFromFloat(pqB->q1, 30);
+	pqA->q2 = iFixedFromFloat(pqB->q2, 30);
+	pqA->q3 = iFixedFromFloat(pqB->q3, 30);
+
+	return;
+}
+
+// function converts a Q30 quaternion to float
+void fQuaternionFromQ30(Quaternion *pqA, const QuaternionQ30 *pqB)
+{
+	pqA->q0 = fFloatFromFixed(pqB->q0, 30);
+	pqA->q1 = fFloatFromFixed(pqB->q1, 30);
+	pqA->q2 = fFloatFromFixed(pqB->q2, 30);
+	pqA->q3 = fFloatFromFixed(pqB->q3, 30);
+
+	return;
+}
+
+// function computes the Q30 quaternion product qA = qA * qB, as qAeqAxB() does in float.
+// each component is summed in 64 bits and rounded once.
+void qQ30AeqAxB(QuaternionQ30 *pqA, const QuaternionQ30 *pqB)
+{
+	int64_t a0 = pqA->q0, a1 = pqA->q1, a2 = pqA->q2, a3 = pqA->q3;
+
+	pqA->q0 = Q60_TO_Q30(a0 * pqB->q0 - a1 * pqB->q1 - a2 * pqB->q2 - a3 * pqB->q3);
+	pqA->q1 = Q60_TO_Q30(a0 * pqB->q1 + a1 * pqB->q0 + a2 * pqB->q3 - a3 * pqB->q2);
+	pqA->q2 = Q60_TO_Q30(a0 * pqB->q2 - a1 * pqB->q3 + a2 * pqB->q0 + a3 * pqB->q1);
+	pqA->q3 = Q60_TO_Q30(a0 * pqB->q3 + a1 * pqB->q2 - a2 * pqB->q1 + a3 * pqB->q0);
+
+	return;
+}
+
+// function normalizes a Q30 quaternion that is close to unit length, such as one built up from
+// products of unit quaternions. One Newton step for 1/sqrt(n) from 1 leaves an error of 3/8 (n - 1)^2,
+// under 1E-8 for |n - 1| < 2^-13. Quaternions further from unit length are normalized in float by
+// fqAeqNormqA().
+void qQ30AeqNormqA(QuaternionQ30 *pqA)
+{
+	int64_t  iNormSq;           // squared norm (Q30)
+	int32_t  iScale;            // Newton estimate of 1/sqrt(iNormSq) (Q30)
+	Quaternion fq;              // float copy for the fallback
+
+	iNormSq = ((int64_t) pqA->q0 * pqA->q0 + (int64_t) pqA->q1 * pqA->q1 +
+			   (int64_t) pqA->q2 * pqA->q2 + (int64_t) pqA->q3 * pqA->q3) >> 30;
+	if ((iNormSq > Q30_ONE + (Q30_ONE >> 13)) || (iNormSq < Q30_ONE - (Q30_ONE >> 13)))
+	{
+		fQuaternionFromQ30(&fq, pqA);
+		fqAeqNormqA(&fq);
+		qQ30FromQuaternion(pqA, &fq);
+		return;
+	}
+
+	// scale = (3 - n) / 2
+	iScale = (int32_t) ((3 * (int64_t) Q30_ONE - iNormSq) >> 1);
+	pqA->q0 = iMulQ30(pqA->q0, iScale);
+	pqA->q1 = iMulQ30(pqA->q1, iScale);
+	pqA->q2 = iMulQ30(pqA->q2, iScale);
+	pqA->q3 = iMulQ30(pqA->q3, iScale);
+
+	return;
+}
+
+// function computes the rotation quaternion pq = [cos(|h|), sin(|h|) * h / |h|] for a rotation of 2|h| rad
+// about the axis h, with ih[] the Q30 half angle vector h (rad). This is what fQuaternionFromRotationVectorDeg()
+// computes in float, using MacLaurin series for sin(|h|)/|h| and cos(|h|) to the sixth power of |h| so that
+// no square root or division is needed. The series are accurate to 5E-8 up to |h| = 0.25 rad.
+// Returns false, leaving pq unchanged, if |h| exceeds Q30_MAX_HALF_ANGLE.
+int8_t iQ30FromHalfAngleVector(QuaternionQ30 *pq, const int32_t ih[])
+{
+	int32_t  ih2;               // |h|^2 (Q30)
+	int32_t  ih4;               // |h|^4 (Q30)
+	int32_t  ih6;               // |h|^6 (Q30)
+	int32_t  isinc;             // sin(|h|) / |h| (Q30)
+	int64_t  itmp;              // scratch
+
+	itmp = ((int64_t) ih[CHX] * ih[CHX] + (int64_t) ih[CHY] * ih[CHY] + (int64_t) ih[CHZ] * ih[CHZ]) >> 30;
+	if (itmp > iMulQ30(Q30_MAX_HALF_ANGLE, Q30_MAX_HALF_ANGLE)) return false;
+	ih2 = (int32_t) itmp;
+	ih4 = iMulQ30(ih2, ih2);
+	ih6 = iMulQ30(ih4, ih2);
+
+	// sin(x) / x = 1 - x^2 / 6 + x^4 / 120 and cos(x) = 1 - x^2 / 2 + x^4 / 24 - x^6 / 720
+	isinc = Q30_ONE - iMulQ30(ih2, Q30_ONEOVER6) + iMulQ30(ih4, Q30_ONEOVER120);
+	pq->q0 = Q30_ONE - (ih2 >> 1) + iMulQ30(ih4, Q30_ONEOVER24) - iMulQ30(ih6, Q30_ONEOVER720);
+	pq->q1 = iMulQ30(ih[CHX], isinc);
+	pq->q2 = iMulQ30(ih[CHY], isinc);
+	pq->q3 = iMulQ30(ih[CHZ], isinc);
+
+	return true;
+}
+
+// function computes the Q30 rotation matrix iR from the Q30 unit quaternion pq, as fRotationMatrixFromQuaternion()
+// does in float. Each element is twice a sum of two Q60 products, rounded once.
+void iQ30RotationMatrixFromQuaternion(int32_t iR[][3], const QuaternionQ30 *pq)
+{
+	int64_t q0 = pq->q0, q1 = pq->q1, q2 = pq->q2, q3 = pq->q3;
+
+	iR[CHX][CHX] = (int32_t) (((q0 * q0 + q1 * q1 + (1 << 28)) >> 29) - Q30_ONE);
+	iR[CHY][CHY] = (int32_t) (((q0 * q0 + q2 * q2 + (1 << 28)) >> 29) - Q30_ONE);
+	iR[CHZ][CHZ] = (int32_t) (((q0 * q0 + q3 * q3 + (1 << 28)) >> 29) - Q30_ONE);
+	iR[CHX][CHY] = (int32_t) ((q1 * q2 + q0 * q3 + (1 << 28)) >> 29);
+	iR[CHY][CHX] = (int32_t) ((q1 * q2 - q0 * q3 + (1 << 28)) >> 29);
+	iR[CHX][CHZ] = (int32_t) ((q1 * q3 - q0 * q2 + (1 << 28)) >> 29);
+	iR[CHZ][CHX] = (int32_t) ((q1 * q3 + q0 * q2 + (1 << 28)) >> 29);
+	iR[CHY][CHZ] = (int32_t) ((q2 * q3 + q0 * q1 + (1 << 28)) >> 29);
+	iR[CHZ][CHY] = (int32_t) ((q2 * q3 - q0 * q1 + (1 << 28)) >> 29);
+
+	return;
+}
+
+// function computes the Q30 vector iv = iR * iu of a Q30 rotation matrix and a Q30 vector, as fk3x1VeqRu() does in float
+void iQ30k3x1VeqRu(int32_t iv[], int32_t iR[][3], const int32_t iu[])
+{
+	int8_t i;                   // loop counter
+
+	for (i = CHX; i <= CHZ; i++)
+		iv[i] = Q60_TO_Q30((int64_t) iR[i][CHX] * iu[CHX] + (int64_t) iR[i][CHY] * iu[CHY] +
+						   (int64_t) iR[i][CHZ] * iu[CHZ]);
+
+	return;
+}
+
+// function sets iv to the vector component of the quaternion that rotates the Q30 unit vector iu onto the Q30 unit
+// vector iw, which fveqconjgquq() computes in float: -(iu x iw) / sqrt(2 * (1 + iu.iw)). Returns false, leaving iv
+// unchanged, for rotations beyond 120 deg, where sqrt(1 + iu.iw) is too small to divide by in Q30, so that the caller
+// can use fveqconjgquq() instead.
+int8_t iQ30veqconjgquq(int32_t iv[], const int32_t iu[], const int32_t iw[])
+{
+	FixedReciprocal iRecip;     // reciprocal of the scalar component
+	int64_t  iCross[3];         // iu x iw (Q60)
+	int64_t  iq0Sq;             // square of the scalar component (1 + iu.iw) / 2 (Q30)
+	int8_t   i;                 // loop counter
+
+	iq0Sq = ((int64_t) iu[CHX] * iw[CHX] + (int64_t) iu[CHY] * iw[CHY] + (int64_t) iu[CHZ] * iw[CHZ] +
+			 ((int64_t) Q30_ONE << 30) + ((int64_t) 1 << 30)) >> 31;
+	if (iq0Sq < (Q30_ONE >> 2)) return false;
+	if (iq0Sq > Q30_ONE) iq0Sq = Q30_ONE;
+	iSetFixedReciprocal(&iRecip, iQ30Sqrt((int32_t) iq0Sq));
+
+	iCross[CHX] = (int64_t) iu[CHY] * iw[CHZ] - (int64_t) iu[CHZ] * iw[CHY];
+	iCross[CHY] = (int64_t) iu[CHZ] * iw[CHX] - (int64_t) iu[CHX] * iw[CHZ];
+	iCross[CHZ] = (int64_t) iu[CHX] * iw[CHY] - (int64_t) iu[CHY] * iw[CHX];
+
+	// the Q60 cross product over the Q30 scalar component is Q30, and halved gives the vector component
+	for (i = CHX; i <= CHZ; i++)
+		iv[i] = iSat32(iMulFixedReciprocal(-iCross[i], &iRecip, -1));
+
+	return true;
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2020-2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file fixed_point.h
+    \brief Q30 fixed point arithmetic for targets without a floating point unit.
+
+    Used when F_FIXED_POINT_FUSION is set in build.h. A Q30 number is an
+    int32_t holding the value multiplied by 2^30, so it covers -2 to +2 with a
+    resolution of 9.3E-10. That suits the components of unit quaternions and
+    the small rotations between gyro samples: near q0 = 1 a float only resolves
+    6E-8. Products are formed in 64 bits and rounded back to Q30, which costs a
+    few integer instructions where soft-float costs a library call.
+
+    The Kalman measurement updates also need quantities that span many orders
+    of magnitude, such as covariances. Those are held in int64_t with the
+    binary point given by a separate shift (Q56 is the value times 2^56), and
+    are brought to 30 bits by a computed shift before they are multiplied or
+    divided. Conversions to and from float work on the IEEE bits directly, so
+    they need no soft-float calls either.
+*/
+
+#ifndef FIXED_POINT_H
+#define FIXED_POINT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "orientation.h"
+
+/// @name Q30 Constants and Conversions
+///@{
+#define Q30_ONE             ((int32_t) 0x40000000)      ///< 1.0 in Q30
+#define Q30_FROM_FLOAT(f)   ((int32_t) ((f) * 1073741824.0F + (((f) >= 0.0F) ? 0.5F : -0.5F)))
+#define Q30_TO_FLOAT(i)     ((float) (i) * 9.31322574615478515625E-10F)
+#define Q30_MAX_HALF_ANGLE  ((int32_t) 0x10000000)      ///< 0.25 rad, limit of iQ30FromHalfAngleVector()
+///@}
+
+/// quaternion with Q30 components
+typedef struct QuaternionQ30
+{
+	int32_t q0;	        ///< scalar component
+	int32_t q1;	        ///< x vector component
+	int32_t q2;	        ///< y vector component
+	int32_t q3;	        ///< z vector component
+} QuaternionQ30;
+
+/// reciprocal 1 / A of a positive integer A, held as iMantissa * 2^-(60 + iExp) with iMantissa in (2^29, 2^30]
+typedef struct FixedReciprocal
+{
+	int32_t iMantissa;	///< 2^60 / (A * 2^-iExp), rounded
+	int8_t iExp;		///< binary exponent of A less 30
+} FixedReciprocal;
+
+/// returns the Q30 product iA * iB, rounded
+static inline int32_t iMulQ30(int32_t iA, int32_t iB)
+{
+	return (int32_t) (((int64_t) iA * iB + (1 << 29)) >> 30);
+}
+
+/// returns iA saturated to +-(2^31 - 1)
+static inline int32_t iSat32(int64_t iA)
+{
+	return (int32_t) ((iA > INT32_MAX) ? INT32_MAX : ((iA < -INT32_MAX) ? -INT32_MAX : iA));
+}
+
+/// @name Fixed Point Conversions and Scaling
+///@{
+int32_t iFixedFromFloat(float fA, int8_t iQ);
+int64_t iFixed64FromFloat(float fA, int8_t iQ);
+float fFloatFromFixed(int64_t iA, int8_t iQ);
+int8_t iFixedNormShift(int64_t iA);
+int64_t iFixedShift(int64_t iA, int8_t iShift);
+int32_t iQ30Sqrt(int32_t iA);
+int8_t iSetFixedReciprocal(FixedReciprocal *pR, int64_t iA);
+int64_t iMulFixedReciprocal(int64_t iA, const FixedReciprocal *pR, int8_t iQ);
+///@}
+
+/// @name Q30 Quaternion Functions
+///@{
+void qQ30FromQuaternion(QuaternionQ30 *pqA, const Quaternion *pqB);
+void fQuaternionFromQ30(Quaternion *pqA, const QuaternionQ30 *pqB);
+void qQ30AeqAxB(QuaternionQ30 *pqA, const QuaternionQ30 *pqB);
+void qQ30AeqNormqA(QuaternionQ30 *pqA);
+int8_t iQ30FromHalfAngleVector(QuaternionQ30 *pq, const int32_t ih[]);
+void iQ30RotationMatrixFromQuaternion(int32_t iR[][3], const QuaternionQ30 *pq);
+void iQ30k3x1VeqRu(int32_t iv[], int32_t iR[][3], const int32_t iu[]);
+int8_t iQ30veqconjgquq(int32_t iv[], const int32_t iu[], const int32_t iw[]);
+///@}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FIXED_POINT_H
@@ -19,8 +19,10 @@
 #include "approximations.h"
 #include "calibration_storage.h"
 #include "fusion.h"
+#include "fixed_point.h"
 #include "hal_timer.h"                  // Hardware Abstraction Layer timer functions
 #include "matrix.h"
+#include "matrix_kernels.h"
 #include "orientation.h"
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
@@ -236,7 +238,7 @@ void fInit_3DOF_Y_BASIC(struct SV_3DOF_Y_BASIC *pthisSV)
     pthisSV->fdeltat = 1.0F / (float) FUSION_HZ;
 
     // initialize orientation estimate to flat
-    f3x3matrixAeqI(pthisSV->fR);
+    fk3x3AeqI(pthisSV->fR);
     fqAeq1(&(pthisSV->fq));
 
     // clear the reset flag
@@ -276,6 +278,20 @@ void fInit_6DOF_GB_BASIC(struct SV_6DOF_GB_BASIC *pthisSV,
     return;
 }   // end fInit_6DOF_GB_BASIC
 
+// function sets the 6DOF Kalman filter time step fdeltat (s) and the terms derived from it, if it has changed
+static void fSetDeltat_6DOF_GY_KALMAN(struct SV_6DOF_GY_KALMAN *pthisSV, float fdeltat)
+{
+    if (fdeltat == pthisSV->fdeltat) return;
+
+    pthisSV->fdeltat = fdeltat;
+    pthisSV->fAlphaOver2 = FPIOVER180 * fdeltat / 2.0F;
+    pthisSV->fAlphaSqOver4 = pthisSV->fAlphaOver2 * pthisSV->fAlphaOver2;
+    pthisSV->fAlphaQwbOver6 = pthisSV->fAlphaOver2 * pthisSV->fQwbOver3;
+    pthisSV->fAlphaSqQvYQwbOver12 = pthisSV->fAlphaSqOver4 * (FQVY_6DOF_GY_KALMAN + FQWB_6DOF_GY_KALMAN) / 3.0F;
+
+    return;
+} // end fSetDeltat_6DOF_GY_KALMAN
+
 // function initalizes the 6DOF accel + gyro Kalman filter algorithm
 void fInit_6DOF_GY_KALMAN(struct SV_6DOF_GY_KALMAN *pthisSV,
                           struct AccelSensor *pthisAccel,
@@ -284,12 +300,9 @@ void fInit_6DOF_GY_KALMAN(struct SV_6DOF_GY_KALMAN *pthisSV,
     int8_t    i;          // loop counter
 
     // compute and store useful product terms to save floating point calculations later
-    pthisSV->fdeltat = 1.0F / (float) FUSION_HZ;
     pthisSV->fQwbOver3 = FQWB_6DOF_GY_KALMAN / 3.0F;
-    pthisSV->fAlphaOver2 = FPIOVER180 * pthisSV->fdeltat / 2.0F;
-    pthisSV->fAlphaSqOver4 = pthisSV->fAlphaOver2 * pthisSV->fAlphaOver2;
-    pthisSV->fAlphaQwbOver6 = pthisSV->fAlphaOver2 * pthisSV->fQwbOver3;
-    pthisSV->fAlphaSqQvYQwbOver12 = pthisSV->fAlphaSqOver4 * (FQVY_6DOF_GY_KALMAN + FQWB_6DOF_GY_KALMAN) / 3.0F;
+    pthisSV->fdeltat = 0.0F;
+    fSetDeltat_6DOF_GY_KALMAN(pthisSV, 1.0F / (float) FUSION_HZ);
     pthisSV->fMaxGyroOffsetChange = sqrtf(fabs(FQWB_6DOF_GY_KALMAN)) / (float)FUSION_HZ;
 
     // zero the a posteriori gyro offset and error vectors
@@ -338,6 +351,38 @@ void fInit_6DOF_GY_KALMAN(struct SV_6DOF_GY_KALMAN *pthisSV,
     return;
 }                       // end fInit_6DOF_GY_KALMAN
 
+// function sets the 9DOF Kalman filter time step fdeltat (s) and the terms derived from it, if it has changed
+void fSetDeltat_9DOF_GBY_KALMAN(struct SV_9DOF_GBY_KALMAN *pthisSV, float fdeltat)
+{
+    if (fdeltat == pthisSV->fdeltat) return;
+
+    pthisSV->fdeltat = fdeltat;
+    pthisSV->fgdeltat = GTOMSEC2 * fdeltat;
+    pthisSV->fAlphaOver2 = FPIOVER180 * fdeltat / 2.0F;
+    pthisSV->fAlphaSqOver4 = pthisSV->fAlphaOver2 * pthisSV->fAlphaOver2;
+    pthisSV->fAlphaQwbOver6 = pthisSV->fAlphaOver2 * pthisSV->fQwbOver3;
+    pthisSV->fAlphaSqQvYQwbOver12 = pthisSV->fAlphaSqOver4 * (FQVY_9DOF_GBY_KALMAN + FQWB_9DOF_GBY_KALMAN) / 3.0F;
+
+    return;
+} // end fSetDeltat_9DOF_GBY_KALMAN
+
+// function restarts the 9DOF gyro prediction from the a posteriori orientation and angular velocity
+void fResetPrediction_9DOF_GBY_KALMAN(struct SV_9DOF_GBY_KALMAN *pthisSV)
+{
+    int8_t i;
+
+    pthisSV->fqPr = pthisSV->fqPl;
+    pthisSV->fPhiPr = pthisSV->fPhiPl;
+    pthisSV->fThePr = pthisSV->fThePl;
+    pthisSV->fPsiPr = pthisSV->fPsiPl;
+    pthisSV->fRhoPr = pthisSV->fRhoPl;
+    pthisSV->fChiPr = pthisSV->fChiPl;
+    for (i = CHX; i <= CHZ; i++) pthisSV->fOmegaPr[i] = pthisSV->fOmega[i];
+    pthisSV->iFIFOPredicted = 0;
+
+    return;
+} // end fResetPrediction_9DOF_GBY_KALMAN
+
 // function initializes the 9DOF Kalman filter
 void fInit_9DOF_GBY_KALMAN(struct SV_9DOF_GBY_KALMAN *pthisSV, struct AccelSensor *pthisAccel, struct MagSensor *pthisMag,
     struct GyroSensor *pthisGyro, struct MagCalibration *pthisMagCal)
@@ -346,13 +391,9 @@ void fInit_9DOF_GBY_KALMAN(struct SV_9DOF_GBY_KALMAN *pthisSV, struct AccelSenso
     int8_t i;// loop counter
 
     // compute and store useful product terms to save floating point calculations later
-    pthisSV->fdeltat = 1.0F / (float) FUSION_HZ;
-    pthisSV->fgdeltat = GTOMSEC2 * pthisSV->fdeltat;
     pthisSV->fQwbOver3 = FQWB_9DOF_GBY_KALMAN / 3.0F;
-    pthisSV->fAlphaOver2 = FPIOVER180 * pthisSV->fdeltat / 2.0F;
-    pthisSV->fAlphaSqOver4 = pthisSV->fAlphaOver2 * pthisSV->fAlphaOver2;
-    pthisSV->fAlphaQwbOver6 = pthisSV->fAlphaOver2 * pthisSV->fQwbOver3;
-    pthisSV->fAlphaSqQvYQwbOver12 = pthisSV->fAlphaSqOver4 * (FQVY_9DOF_GBY_KALMAN + FQWB_9DOF_GBY_KALMAN) / 3.0F;
+    pthisSV->fdeltat = 0.0F;
+    fSetDeltat_9DOF_GBY_KALMAN(pthisSV, 1.0F / (float) FUSION_HZ);
     pthisSV->fMaxGyroOffsetChange = sqrtf(fabs(FQWB_9DOF_GBY_KALMAN)) / (float)FUSION_HZ;
 
     // zero the a posteriori error vectors and inertial outputs
@@ -397,6 +438,7 @@ void fInit_9DOF_GBY_KALMAN(struct SV_9DOF_GBY_KALMAN *pthisSV, struct AccelSenso
         pthisMag->fBc, pthisAccel->fGc, &ftmp, &ftmp);
 #endif
     fQuaternionFromRotationMatrix(pthisSV->fRPl, &(pthisSV->fqPl));
+    fResetPrediction_9DOF_GBY_KALMAN(pthisSV);
 
     // clear the reset flag
     pthisSV->resetflag = false;
@@ -625,32 +667,421 @@ void fRun_6DOF_GB_BASIC(struct SV_6DOF_GB_BASIC *pthisSV,
     return;
 }   // end fRun_6DOF_GB_BASIC
 
+#if F_FIXED_POINT_FUSION
+// integrates the gyro FIFO into the a priori orientation quaternion *pqMi in Q30 fixed point, subtracting the gyro
+// offset fbPl (deg/s), with finterval (s) between measurements. This is the same rotation as calling
+// fQuaternionFromRotationVectorDeg() and qAeqAxB() for each
+// FIFO measurement, but the only float operations are the conversions made once per call: the gyro offset to 1/256
+// counts, and the half rotation angle per count to a Q30 mantissa and a shift. The result is normalized. A measurement
+// rotating further than iQ30FromHalfAngleVector() accepts is integrated with the float functions instead.
+static void fIntegrateGyroFIFOQ30(Quaternion *pqMi, struct GyroSensor *pthisGyro, const float fbPl[], float finterval)
+{
+    QuaternionQ30   iqMi;               // a priori orientation quaternion (Q30)
+    QuaternionQ30   iqInc;              // incremental rotation quaternion (Q30)
+    Quaternion      ftmpq;              // incremental rotation quaternion for the float fallback
+    float           ftmpA3x1[3];        // angular velocity for the float fallback (deg/s)
+    float           fmantissa;          // mantissa of the half rotation angle per count
+    int32_t         iOffset[3];         // gyro offset (1/256 counts)
+    int32_t         iRate[3];           // angular velocity less offset (1/256 counts)
+    int32_t         ih[3];              // half rotation angle vector of one measurement (Q30 rad)
+    int32_t         iMantissa;          // fmantissa in Q30
+    int             iExponent;          // binary exponent of the half rotation angle per count
+    int8_t          iShift;             // right shift from (1/256 counts) * iMantissa to Q30 rad
+    int8_t          i,
+                    j;                  // loop counters
+
+    // the half rotation angle per count is fmantissa * 2^iExponent with fmantissa in [0.5, 1), so the
+    // Q30 half angle is (1/256 counts) * 2^8 * fmantissa * 2^iExponent * 2^30 = (iRate * iMantissa) >> (8 - iExponent)
+    fmantissa = frexpf(0.5F * FPIOVER180 * pthisGyro->fDegPerSecPerCount * finterval, &iExponent);
+    iMantissa = Q30_FROM_FLOAT(fmantissa);
+    iShift = (int8_t) (8 - iExponent);
+    if ((iShift < 1) || (iShift > 62) || (pthisGyro->fDegPerSecPerCount == 0.0F))
+    {
+        // outside any realistic gyro scale so integrate in float
+        for (j = 0; j < pthisGyro->iFIFOCount; j++)
+        {
+            for (i = CHX; i <= CHZ; i++)
+                ftmpA3x1[i] = (float) pthisGyro->iYsFIFO[j][i] * pthisGyro->fDegPerSecPerCount - fbPl[i];
+            fQuaternionFromRotationVectorDeg(&ftmpq, ftmpA3x1, finterval);
+            qAeqAxB(pqMi, &ftmpq);
+        }
+        return;
+    }
+    for (i = CHX; i <= CHZ; i++)
+        iOffset[i] = (int32_t) (256.0F * fbPl[i] / pthisGyro->fDegPerSecPerCount + ((fbPl[i] >= 0.0F) ? 0.5F : -0.5F));
+
+    qQ30FromQuaternion(&iqMi, pqMi);
+    for (j = 0; j < pthisGyro->iFIFOCount; j++)
+    {
+        for (i = CHX; i <= CHZ; i++)
+        {
+            iRate[i] = (int32_t) pthisGyro->iYsFIFO[j][i] * 256 - iOffset[i];
+            ih[i] = (int32_t) (((int64_t) iRate[i] * iMantissa + ((int64_t) 1 << (iShift - 1))) >> iShift);
+        }
+        if (!iQ30FromHalfAngleVector(&iqInc, ih))
+        {
+            for (i = CHX; i <= CHZ; i++)
+                ftmpA3x1[i] = (float) pthisGyro->iYsFIFO[j][i] * pthisGyro->fDegPerSecPerCount - fbPl[i];
+            fQuaternionFromRotationVectorDeg(&ftmpq, ftmpA3x1, finterval);
+            qQ30FromQuaternion(&iqInc, &ftmpq);
+        }
+        qQ30AeqAxB(&iqMi, &iqInc);
+    }
+    qQ30AeqNormqA(&iqMi);
+    fQuaternionFromQ30(pqMi, &iqMi);
+
+    return;
+}   // end fIntegrateGyroFIFOQ30
+
+// sets the Q30 measurement error iZErr, and its float copy fZErr, to the vector component of the quaternion that
+// rotates the Q30 unit vector iu onto iw. Rotations beyond those iQ30veqconjgquq() accepts use fveqconjgquq().
+static void fZErrQ30(float fZErr[], int32_t iZErr[], const int32_t iu[], const int32_t iw[])
+{
+    Quaternion      ftmpq;              // rotation quaternion for the float fallback
+    float           fu[3], fw[3];       // iu and iw for the float fallback
+    int8_t          i;                  // loop counter
+
+    if (!iQ30veqconjgquq(iZErr, iu, iw))
+    {
+        for (i = CHX; i <= CHZ; i++)
+        {
+            fu[i] = fFloatFromFixed(iu[i], 30);
+            fw[i] = fFloatFromFixed(iw[i], 30);
+        }
+        fveqconjgquq(&ftmpq, fu, fw);
+        iZErr[CHX] = iFixedFromFloat(ftmpq.q1, 30);
+        iZErr[CHY] = iFixedFromFloat(ftmpq.q2, 30);
+        iZErr[CHZ] = iFixedFromFloat(ftmpq.q3, 30);
+    }
+    for (i = CHX; i <= CHZ; i++)
+        fZErr[i] = fFloatFromFixed(iZErr[i], 30);
+
+    return;
+}   // end fZErrQ30
+#endif
+
+// integrates the gyro FIFO into the orientation quaternion *pq, subtracting the gyro offset fbPl (deg/s), with
+// finterval (s) between measurements. This is the prediction step shared by the Kalman filters and by
+// fPredict_9DOF_GBY_KALMAN().
+static void fIntegrateGyroFIFO(Quaternion *pq, struct GyroSensor *pthisGyro, const float fbPl[], float finterval)
+{
+#if F_FIXED_POINT_FUSION
+    fIntegrateGyroFIFOQ30(pq, pthisGyro, fbPl, finterval);
+#else
+    Quaternion  ftmpq;              // incremental rotation quaternion
+    float       ftmpA3x1[3];        // angular velocity (deg/s)
+    int8_t      i,
+                j;                  // loop counters
+
+    for (j = 0; j < pthisGyro->iFIFOCount; j++)
+    {
+        // calculate the instantaneous angular velocity subtracting the gyro offset
+        for (i = CHX; i <= CHZ; i++)
+            ftmpA3x1[i] = (float) pthisGyro->iYsFIFO[j][i] * pthisGyro->fDegPerSecPerCount - fbPl[i];
+
+        // compute the incremental rotation quaternion ftmpq and integrate the orientation quaternion
+        fQuaternionFromRotationVectorDeg(&ftmpq, ftmpA3x1, finterval);
+        qAeqAxB(pq, &ftmpq);
+    }
+#endif
+
+    return;
+}   // end fIntegrateGyroFIFO
+
+// Kalman gain of the 6DOF filter K = Qw * C^T * inv(C * Qw * C^T + Qv) computed with general matrix
+// operations and a 3x3 inversion. Sets fQwCT6x3 and fK6x3 from fQw6x6, fQv and fAlphaOver2.
+void fKalmanGain_6DOF_GY_Generic(struct SV_6DOF_GY_KALMAN *pthisSV)
+{
+    float       ftmpA3x3[3][3];     // scratch 3x3 matrix
+    float       fC3x6ik;            // element i, k of measurement matrix C
+    float       fC3x6jk;            // element j, k of measurement matrix C
+    int8_t        ierror;             // matrix inversion error flag
+    int8_t        i,
+                j,
+                k;                  // loop counters
+
+    // row pointers for 3x3 matrix inversion
+    float       *pfRows[3];
+
+    // set fQwCT6x3 = Qw.C^T where Qw has size 6x6 and C^T has size 6x3
+    for (i = 0; i < 6; i++)         // loop over rows
+    {
+        for (j = 0; j < 3; j++)     // loop over columns
+        {
+            pthisSV->fQwCT6x3[i][j] = 0.0F;
+
+            // accumulate matrix sum
+            for (k = 0; k < 6; k++)
+            {
+                // determine fC3x6[j][k] since the matrix is highly sparse
+                fC3x6jk = 0.0F;
+                if (k == j) fC3x6jk = 1.0F;
+                if (k == (j + 3)) fC3x6jk = -pthisSV->fAlphaOver2;
+
+                // accumulate fQwCT6x3[i][j] += Qw6x6[i][k] * C[j][k]
+                if ((pthisSV->fQw6x6[i][k] != 0.0F) && (fC3x6jk != 0.0F))
+                {
+                    if (fC3x6jk == 1.0F)
+                        pthisSV->fQwCT6x3[i][j] += pthisSV->fQw6x6[i][k];
+                    else
+                        pthisSV->fQwCT6x3[i][j] += pthisSV->fQw6x6[i][k] * fC3x6jk;
+                }
+            }
+        }
+    }
+
+    // set symmetric ftmpA3x3 = C.(Qw.C^T) + Qv = C.fQwCT6x3 + Qv
+    for (i = 0; i < 3; i++)         // loop over rows
+    {
+        for (j = i; j < 3; j++)     // loop over on and above diagonal columns
+        {
+            // zero off diagonal and set diagonal to Qv
+            if (i == j)
+                ftmpA3x3[i][j] = pthisSV->fQv;
+            else
+                ftmpA3x3[i][j] = 0.0F;
+
+            // accumulate matrix sum
+            for (k = 0; k < 6; k++)
+            {
+                // determine fC3x6[i][k]
+                fC3x6ik = 0.0F;
+                if (k == i) fC3x6ik = 1.0F;
+                if (k == (i + 3)) fC3x6ik = -pthisSV->fAlphaOver2;
+
+                // accumulate ftmpA3x3[i][j] += C[i][k] & fQwCT6x3[k][j]
+                if ((fC3x6ik != 0.0F) && (pthisSV->fQwCT6x3[k][j] != 0.0F))
+                {
+                    if (fC3x6ik == 1.0F)
+                        ftmpA3x3[i][j] += pthisSV->fQwCT6x3[k][j];
+                    else
+                        ftmpA3x3[i][j] += fC3x6ik * pthisSV->fQwCT6x3[k][j];
+                }
+            }
+        }
+    }
+
+    // set ftmpA3x3 below diagonal elements to above diagonal elements
+    ftmpA3x3[1][0] = ftmpA3x3[0][1];
+    ftmpA3x3[2][0] = ftmpA3x3[0][2];
+    ftmpA3x3[2][1] = ftmpA3x3[1][2];
+
+    // invert the symmetric positive definite ftmpA3x3 in situ to give ftmpA3x3 = inv(C * Qw * C^T + Qv) = inv(ftmpA3x3)
+    for (i = 0; i < 3; i++) pfRows[i] = ftmpA3x3[i];
+    fmatrixAeqInvSymA(pfRows, 3, &ierror);
+
+    // on successful inversion set Kalman gain matrix fK6x3 = Qw * C^T * inv(C * Qw * C^T + Qv) = fQwCT6x3 * ftmpA3x3
+    if (!ierror)
+    {
+        // normal case
+        for (i = 0; i < 6; i++)     // loop over rows
+        {
+            for (j = 0; j < 3; j++) // loop over columns
+            {
+                pthisSV->fK6x3[i][j] = 0.0F;
+                for (k = 0; k < 3; k++)
+                {
+                    if ((pthisSV->fQwCT6x3[i][k] != 0.0F) &&
+                        (ftmpA3x3[k][j] != 0.0F))
+                    {
+                        pthisSV->fK6x3[i][j] += pthisSV->fQwCT6x3[i][k] * ftmpA3x3[k][j];
+                    }
+                }
+            }
+        }
+    }
+    else
+    {
+        // ftmpA3x3 was singular so set Kalman gain matrix fK6x3 to zero
+        for (i = 0; i < 6; i++)     // loop over rows
+        {
+            for (j = 0; j < 3; j++) // loop over columns
+            {
+                pthisSV->fK6x3[i][j] = 0.0F;
+            }
+        }
+    }
+
+    return;
+}   // end fKalmanGain_6DOF_GY_Generic
+
+// Kalman gain of the 6DOF filter computed per axis in closed form. The measurement matrix C is
+// [I | -alpha/2 * I] and Qw only couples the gravity and gyro offset errors of the same axis, so
+// C * Qw * C^T + Qv is diagonal and each axis needs one reciprocal instead of a 3x3 inversion. The
+// zero elements of fQwCT6x3 and fK6x3 are exactly those left at zero by fKalmanGain_6DOF_GY_Generic().
+void fKalmanGain_6DOF_GY_Block(struct SV_6DOF_GY_KALMAN *pthisSV)
+{
+    float       fh;                 // alpha / 2, the gyro offset coefficient in C
+    float       fS[3];              // diagonal of C * Qw * C^T + Qv
+    int8_t      ig, ib;             // rows of the gravity and gyro offset states for one axis
+    int8_t      i, j;               // loop counters
+
+    for (i = 0; i < 6; i++)
+        for (j = 0; j < 3; j++)
+            pthisSV->fQwCT6x3[i][j] = pthisSV->fK6x3[i][j] = 0.0F;
+
+    fh = pthisSV->fAlphaOver2;
+    for (ig = CHX; ig <= CHZ; ig++)
+    {
+        ib = ig + 3;
+
+        // the non-zero elements of Qw * C^T in column ig
+        pthisSV->fQwCT6x3[ig][ig] = pthisSV->fQw6x6[ig][ig] - fh * pthisSV->fQw6x6[ig][ib];
+        pthisSV->fQwCT6x3[ib][ig] = pthisSV->fQw6x6[ig][ib] - fh * pthisSV->fQw6x6[ib][ib];
+
+        // C * (Qw * C^T) + Qv on the diagonal
+        fS[ig] = pthisSV->fQv + pthisSV->fQwCT6x3[ig][ig] - fh * pthisSV->fQwCT6x3[ib][ig];
+
+        // singular so leave the whole Kalman gain matrix at zero, as the generic path does
+        if (fS[ig] == 0.0F) return;
+    }
+
+    // K = (Qw * C^T) * inv(C * Qw * C^T + Qv)
+    for (ig = CHX; ig <= CHZ; ig++)
+    {
+        ib = ig + 3;
+        fS[ig] = 1.0F / fS[ig];
+        pthisSV->fK6x3[ig][ig] = pthisSV->fQwCT6x3[ig][ig] * fS[ig];
+        pthisSV->fK6x3[ib][ig] = pthisSV->fQwCT6x3[ib][ig] * fS[ig];
+    }
+
+    return;
+}   // end fKalmanGain_6DOF_GY_Block
+
+#if F_FIXED_POINT_FUSION
+// Kalman measurement update of fRun_6DOF_GY_KALMAN() in fixed point, from the normalized accelerometer gravity vector
+// fg3DOF and the a priori orientation quaternion *pfqMi to the a posteriori orientation quaternion fqPl. The gain is
+// solved per axis as in fKalmanGain_6DOF_GY_Block(), with the gyro offset error expressed as the tilt alpha / 2 * b
+// it causes in one iteration so that the states of an axis share one scale. Vectors, tilts and measurement errors
+// are Q30 and covariances Q56. fZErr, fqgErrPl and fbErrPl are set as in float, but fQw6x6, fQwCT6x3 and fK6x3 are
+// not computed. The measurement noise fQv must already be set.
+static void fUpdate_6DOF_GY_KALMAN_Q30(struct SV_6DOF_GY_KALMAN *pthisSV, const Quaternion *pfqMi, const float fg3DOF[])
+{
+    QuaternionQ30   iqPl;               // a priori, then a posteriori orientation quaternion (Q30)
+    QuaternionQ30   iq;                 // gravity tilt correction quaternion (Q30)
+    Quaternion      ftmpq;              // tilt correction quaternion for the float fallback
+    FixedReciprocal iRecip;             // reciprocal of C * Qw * C^T + Qv for one axis
+    int32_t         iR[3][3];           // a priori orientation matrix (Q30)
+    int32_t         ig3DOF[3];          // accelerometer gravity vector (Q30)
+    int32_t         igMi[3];            // a priori gravity vector (Q30)
+    int32_t         iZErr[3];           // measurement error (Q30)
+    int32_t         iqgErr[3];          // a posteriori gravity tilt error (Q30)
+    int64_t         ibetaErr[3];        // a posteriori gyro offset error as a tilt (Q56)
+    int64_t         iQv;                // measurement noise (Q56)
+    int64_t         ic;                 // alpha^2 / 4 * (Qvy + Qwb) / 3 (Q56)
+    int64_t         iQwb;               // alpha^2 / 4 * Qwb / 3 (Q56)
+    int64_t         iQgg, iQbb, iQgb;   // elements of Qw for one axis (Q56)
+    int64_t         iPg, iPb;           // elements of Qw * C^T for one axis (Q56)
+    int64_t         itmp;               // scratch
+    int32_t         iqg, ibeta;         // previous gravity tilt error (Q30) and gyro offset error as a tilt (Q34)
+    float           ftmp;               // scratch
+    int8_t          iShift;             // right shift of iPg and iPb to 30 bits
+    int8_t          i, j;               // loop counters
+
+    // the a priori gravity vector is the z column of the a priori orientation matrix
+    qQ30FromQuaternion(&iqPl, pfqMi);
+    iQ30RotationMatrixFromQuaternion(iR, &iqPl);
+    for (i = CHX; i <= CHZ; i++)
+    {
+        ig3DOF[i] = iFixedFromFloat(fg3DOF[i], 30);
+#if THISCOORDSYSTEM == NED
+        igMi[i] = iR[i][CHZ];
+#else // ANDROID and WIN8
+        igMi[i] = -iR[i][CHZ];
+#endif
+    }
+    fZErrQ30(pthisSV->fZErr, iZErr, ig3DOF, igMi);
+
+    // Qw and Qw * C^T per axis, where C = [I | -I] once the gyro offset error is a tilt, then the errors
+    // K * Z = Qw * C^T * Z / (C * Qw * C^T + Qv)
+    iQv = iFixed64FromFloat(pthisSV->fQv, 56);
+    ic = iFixed64FromFloat(pthisSV->fAlphaSqQvYQwbOver12, 56);
+    iQwb = iFixed64FromFloat(pthisSV->fAlphaSqOver4 * pthisSV->fQwbOver3, 56);
+    for (i = CHX; i <= CHZ; i++)
+    {
+        iqg = iFixedFromFloat(pthisSV->fqgErrPl[i], 30);
+        ibeta = iFixedFromFloat(pthisSV->fAlphaOver2 * pthisSV->fbErrPl[i], 34);
+        itmp = iFixedShift((int64_t) ibeta * ibeta, 12);
+        iQbb = itmp + iQwb;
+        iQgg = iFixedShift((int64_t) iqg * iqg, 4) + itmp + ic;
+        iQgb = iFixedShift((int64_t) iqg * ibeta, 8) - iQbb;
+        iPg = iQgg - iQgb;
+        iPb = iQgb - iQbb;
+
+        // singular so leave all the errors at zero, as the float path does
+        if (!iSetFixedReciprocal(&iRecip, iQv + iPg - iPb))
+        {
+            for (j = CHX; j <= CHZ; j++)
+            {
+                iqgErr[j] = 0;
+                ibetaErr[j] = 0;
+            }
+            break;
+        }
+        iShift = iFixedNormShift(iPg);
+        if (iFixedNormShift(iPb) > iShift) iShift = iFixedNormShift(iPb);
+        iqgErr[i] = iSat32(iMulFixedReciprocal(iFixedShift(iPg, iShift) * iZErr[i], &iRecip, iShift));
+        ibetaErr[i] = iMulFixedReciprocal(iFixedShift(iPb, iShift) * iZErr[i], &iRecip, 26 + iShift);
+    }
+    ftmp = 1.0F / pthisSV->fAlphaOver2;
+    for (i = CHX; i <= CHZ; i++)
+    {
+        pthisSV->fqgErrPl[i] = fFloatFromFixed(iqgErr[i], 30);
+        pthisSV->fbErrPl[i] = fFloatFromFixed(ibetaErr[i], 56) * ftmp;
+    }
+
+    // the gravity tilt correction (conjugate) quaternion, a 180 deg rotation if the vector component exceeds unity
+    iq.q1 = -iqgErr[CHX];
+    iq.q2 = -iqgErr[CHY];
+    iq.q3 = -iqgErr[CHZ];
+    itmp = (((int64_t) iq.q1 * iq.q1) >> 30) + (((int64_t) iq.q2 * iq.q2) >> 30) + (((int64_t) iq.q3 * iq.q3) >> 30);
+    if (itmp <= Q30_ONE)
+        iq.q0 = iQ30Sqrt((int32_t) (Q30_ONE - itmp));
+    else
+    {
+        ftmpq.q0 = 0.0F;
+        ftmpq.q1 = fFloatFromFixed(iq.q1, 30);
+        ftmpq.q2 = fFloatFromFixed(iq.q2, 30);
+        ftmpq.q3 = fFloatFromFixed(iq.q3, 30);
+        fqAeqNormqA(&ftmpq);
+        qQ30FromQuaternion(&iq, &ftmpq);
+    }
+
+    // fqPl = fqMi.(fqgErrPl)* normalized, with a non-negative scalar component as fqAeqNormqA() leaves it
+    qQ30AeqAxB(&iqPl, &iq);
+    qQ30AeqNormqA(&iqPl);
+    if (iqPl.q0 < 0)
+    {
+        iqPl.q0 = -iqPl.q0;
+        iqPl.q1 = -iqPl.q1;
+        iqPl.q2 = -iqPl.q2;
+        iqPl.q3 = -iqPl.q3;
+    }
+    fQuaternionFromQ30(&(pthisSV->fqPl), &iqPl);
+
+    return;
+}   // end fUpdate_6DOF_GY_KALMAN_Q30
+#endif
+
 // 6DOF accelerometer+gyroscope orientation function implemented using indirect complementary Kalman filter
 void fRun_6DOF_GY_KALMAN(struct SV_6DOF_GY_KALMAN *pthisSV,
                          struct AccelSensor *pthisAccel,
                          struct GyroSensor *pthisGyro)
 {
     // local scalars and arrays
+#if !F_FIXED_POINT_FUSION
     float       ftmpMi3x1[3];       // temporary vector used for a priori calculations
+#endif
     float       ftmp3DOF3x1[3];     // temporary vector used for 3DOF calculations
-    float       ftmpA3x3[3][3];     // scratch 3x3 matrix
     float       fQvGQa;             // accelerometer noise covariance to 1g sphere
-    float       fC3x6ik;            // element i, k of measurement matrix C
-    float       fC3x6jk;            // element j, k of measurement matrix C
     float       fmodGc;             // modulus of fGc[]
     Quaternion  fqMi;               // a priori orientation quaternion
     Quaternion  ftmpq;              // scratch quaternion
     float       ftmp;               // scratch float
-    int8_t        ierror;             // matrix inversion error flag
-    int8_t        i,
-                j,
-                k;                  // loop counters
-
-    // working arrays for 3x3 matrix inversion
-    float       *pfRows[3];
-    int8_t        iColInd[3];
-    int8_t        iRowInd[3];
-    int8_t        iPivot[3];
+    int8_t        i;                  // loop counter
+#if !F_FIXED_POINT_FUSION
+    int8_t        j;                  // loop counter
+#endif
 
     // if requested, do a reset initialization with no further processing
     if (pthisSV->resetflag)
@@ -670,22 +1101,15 @@ void fRun_6DOF_GY_KALMAN(struct SV_6DOF_GY_KALMAN *pthisSV,
     fqMi = pthisSV->fqPl;
     if (pthisGyro->iFIFOCount > 0)
     {
-        // set ftmp to the interval between the FIFO gyro measurements
-        ftmp = pthisSV->fdeltat / (float) pthisGyro->iFIFOCount;
-
-        // normal case, loop over all the buffered gyroscope measurements
-        for (j = 0; j < pthisGyro->iFIFOCount; j++)
-        {
-            // calculate the instantaneous angular velocity subtracting the gyro offset
-            for (i = CHX; i <= CHZ; i++)
-                ftmpMi3x1[i] = (float) pthisGyro->iYsFIFO[j][i] *
-                    pthisGyro->fDegPerSecPerCount -
-                    pthisSV->fbPl[i];
-
-            // compute the incremental rotation quaternion ftmpq and integrate the a priori orientation quaternion fqMi
-            fQuaternionFromRotationVectorDeg(&ftmpq, ftmpMi3x1, ftmp);
-            qAeqAxB(&fqMi, &ftmpq);
-        }
+#if F_MEASURED_TIME_INTEGRATION
+        // normal case, integrate all the buffered gyroscope measurements at their measured interval, which
+        // also gives the time step of this iteration however long the loop actually took
+        fSetDeltat_6DOF_GY_KALMAN(pthisSV, (float) pthisGyro->iFIFOCount * pthisGyro->fSampleInterval);
+        fIntegrateGyroFIFO(&fqMi, pthisGyro, pthisSV->fbPl, pthisGyro->fSampleInterval);
+#else
+        // normal case, integrate all the buffered gyroscope measurements at the average interval between them
+        fIntegrateGyroFIFO(&fqMi, pthisGyro, pthisSV->fbPl, pthisSV->fdeltat / (float) pthisGyro->iFIFOCount);
+#endif
     }
     else
     {
@@ -728,6 +1152,16 @@ void fRun_6DOF_GY_KALMAN(struct SV_6DOF_GY_KALMAN *pthisSV,
     // -1g in accelerometer z axis (z up) when PCB is flat so no correction needed
 #endif
 
+    // calculate the vector fQv containing the diagonal elements of the measurement covariance matrix Qv
+    ftmp = fmodGc - 1.0F;
+    fQvGQa = 3.0F * ftmp * ftmp;
+    if (fQvGQa < FQVG_6DOF_GY_KALMAN) fQvGQa = FQVG_6DOF_GY_KALMAN;
+    pthisSV->fQv = ONEOVER12 * fQvGQa + pthisSV->fAlphaSqQvYQwbOver12;
+
+#if F_FIXED_POINT_FUSION
+    // compute the measurement error and the a posteriori orientation quaternion fqPl in fixed point
+    fUpdate_6DOF_GY_KALMAN_Q30(pthisSV, &fqMi, ftmp3DOF3x1);
+#else
     // set ftmpMi3x1 to the a priori gravity vector in the sensor frame from the a priori quaternion
     ftmpMi3x1[CHX] = 2.0F * (fqMi.q1 * fqMi.q3 - fqMi.q0 * fqMi.q2);
     ftmpMi3x1[CHY] = 2.0F * (fqMi.q2 * fqMi.q3 + fqMi.q0 * fqMi.q1);
@@ -798,111 +1232,12 @@ void fRun_6DOF_GY_KALMAN(struct SV_6DOF_GY_KALMAN *pthisSV,
         pthisSV->fAlphaOver2 *
         pthisSV->fQw6x6[5][5];
 
-    // calculate the vector fQv containing the diagonal elements of the measurement covariance matrix Qv
-    ftmp = fmodGc - 1.0F;
-    fQvGQa = 3.0F * ftmp * ftmp;
-    if (fQvGQa < FQVG_6DOF_GY_KALMAN) fQvGQa = FQVG_6DOF_GY_KALMAN;
-    pthisSV->fQv = ONEOVER12 * fQvGQa + pthisSV->fAlphaSqQvYQwbOver12;
-
     // calculate the 6x3 Kalman gain matrix K = Qw * C^T * inv(C * Qw * C^T + Qv)
-    // set fQwCT6x3 = Qw.C^T where Qw has size 6x6 and C^T has size 6x3
-    for (i = 0; i < 6; i++)         // loop over rows
-    {
-        for (j = 0; j < 3; j++)     // loop over columns
-        {
-            pthisSV->fQwCT6x3[i][j] = 0.0F;
-
-            // accumulate matrix sum
-            for (k = 0; k < 6; k++)
-            {
-                // determine fC3x6[j][k] since the matrix is highly sparse
-                fC3x6jk = 0.0F;
-                if (k == j) fC3x6jk = 1.0F;
-                if (k == (j + 3)) fC3x6jk = -pthisSV->fAlphaOver2;
-
-                // accumulate fQwCT6x3[i][j] += Qw6x6[i][k] * C[j][k]
-                if ((pthisSV->fQw6x6[i][k] != 0.0F) && (fC3x6jk != 0.0F))
-                {
-                    if (fC3x6jk == 1.0F)
-                        pthisSV->fQwCT6x3[i][j] += pthisSV->fQw6x6[i][k];
-                    else
-                        pthisSV->fQwCT6x3[i][j] += pthisSV->fQw6x6[i][k] * fC3x6jk;
-                }
-            }
-        }
-    }
-
-    // set symmetric ftmpA3x3 = C.(Qw.C^T) + Qv = C.fQwCT6x3 + Qv
-    for (i = 0; i < 3; i++)         // loop over rows
-    {
-        for (j = i; j < 3; j++)     // loop over on and above diagonal columns
-        {
-            // zero off diagonal and set diagonal to Qv
-            if (i == j)
-                ftmpA3x3[i][j] = pthisSV->fQv;
-            else
-                ftmpA3x3[i][j] = 0.0F;
-
-            // accumulate matrix sum
-            for (k = 0; k < 6; k++)
-            {
-                // determine fC3x6[i][k]
-                fC3x6ik = 0.0F;
-                if (k == i) fC3x6ik = 1.0F;
-                if (k == (i + 3)) fC3x6ik = -pthisSV->fAlphaOver2;
-
-                // accumulate ftmpA3x3[i][j] += C[i][k] & fQwCT6x3[k][j]
-                if ((fC3x6ik != 0.0F) && (pthisSV->fQwCT6x3[k][j] != 0.0F))
-                {
-                    if (fC3x6ik == 1.0F)
-                        ftmpA3x3[i][j] += pthisSV->fQwCT6x3[k][j];
-                    else
-                        ftmpA3x3[i][j] += fC3x6ik * pthisSV->fQwCT6x3[k][j];
-                }
-            }
-        }
-    }
-
-    // set ftmpA3x3 below diagonal elements to above diagonal elements
-    ftmpA3x3[1][0] = ftmpA3x3[0][1];
-    ftmpA3x3[2][0] = ftmpA3x3[0][2];
-    ftmpA3x3[2][1] = ftmpA3x3[1][2];
-
-    // invert ftmpA3x3 in situ to give ftmpA3x3 = inv(C * Qw * C^T + Qv) = inv(ftmpA3x3)
-    for (i = 0; i < 3; i++) pfRows[i] = ftmpA3x3[i];
-    fmatrixAeqInvA(pfRows, iColInd, iRowInd, iPivot, 3, &ierror);
-
-    // on successful inversion set Kalman gain matrix fK6x3 = Qw * C^T * inv(C * Qw * C^T + Qv) = fQwCT6x3 * ftmpA3x3
-    if (!ierror)
-    {
-        // normal case
-        for (i = 0; i < 6; i++)     // loop over rows
-        {
-            for (j = 0; j < 3; j++) // loop over columns
-            {
-                pthisSV->fK6x3[i][j] = 0.0F;
-                for (k = 0; k < 3; k++)
-                {
-                    if ((pthisSV->fQwCT6x3[i][k] != 0.0F) &&
-                        (ftmpA3x3[k][j] != 0.0F))
-                    {
-                        pthisSV->fK6x3[i][j] += pthisSV->fQwCT6x3[i][k] * ftmpA3x3[k][j];
-                    }
-                }
-            }
-        }
-    }
-    else
-    {
-        // ftmpA3x3 was singular so set Kalman gain matrix fK6x3 to zero
-        for (i = 0; i < 6; i++)     // loop over rows
-        {
-            for (j = 0; j < 3; j++) // loop over columns
-            {
-                pthisSV->fK6x3[i][j] = 0.0F;
-            }
-        }
-    }
+#if F_6DOF_GY_BLOCK_GAIN
+    fKalmanGain_6DOF_GY_Block(pthisSV);
+#else
+    fKalmanGain_6DOF_GY_Generic(pthisSV);
+#endif
 
     // calculate the a posteriori gravity and geomagnetic tilt quaternion errors and gyro offset error vector
     // from the Kalman matrix fK6x3 and from the measurement error vector fZErr.
@@ -954,8 +1289,11 @@ void fRun_6DOF_GY_KALMAN(struct SV_6DOF_GY_KALMAN *pthisSV,
     // apply the gravity tilt correction quaternion so fqPl = fqMi.(fqgErrPl)* = fqMi.ftmpq and normalize
     qAeqBxC(&(pthisSV->fqPl), &fqMi, &ftmpq);
 
-    // normalize the a posteriori quaternion and compute the a posteriori rotation matrix and rotation vector
+    // normalize the a posteriori quaternion
     fqAeqNormqA(&(pthisSV->fqPl));
+#endif
+
+    // compute the a posteriori rotation matrix and rotation vector
     fRotationMatrixFromQuaternion(pthisSV->fRPl, &(pthisSV->fqPl));
     fRotationVectorDegFromQuaternion(&(pthisSV->fqPl), pthisSV->fRVecPl);
 
@@ -974,7 +1312,7 @@ void fRun_6DOF_GY_KALMAN(struct SV_6DOF_GY_KALMAN *pthisSV,
     // compute the linear acceleration fAccGl in the global frame
     // first de-rotate the accelerometer measurement fGc from the sensor to global frame
     // using the transpose (inverse) of the orientation matrix fRPl
-    fveqRu(pthisSV->fAccGl, pthisSV->fRPl, pthisAccel->fGc, 1);
+    fk3x1VeqRTu(pthisSV->fAccGl, pthisSV->fRPl, pthisAccel->fGc);
 
     // sutract the fixed gravity vector in the global frame leaving linear acceleration
 #if THISCOORDSYSTEM == NED
@@ -1009,6 +1347,328 @@ void fRun_6DOF_GY_KALMAN(struct SV_6DOF_GY_KALMAN *pthisSV,
     return;
 }   // end fRun_6DOF_GY_KALMAN
 #if F_9DOF_GBY_KALMAN
+// Kalman gain of the 9DOF filter K = Qw * C^T * inv(C * Qw * C^T + Qv) computed with general matrix
+// operations and a 6x6 inversion. Sets fQwCT9x6 and fK9x6 from fQw9x9, fQv6x1 and fAlphaOver2.
+void fKalmanGain_9DOF_GBY_Generic(struct SV_9DOF_GBY_KALMAN *pthisSV)
+{
+    float       ftmpA6x6[6][6];     // scratch 6x6 matrix
+    float       fC6x9ik;            // element i, k of measurement matrix C
+    float       fC6x9jk;            // element j, k of measurement matrix C
+    int8_t        ierror;             // matrix inversion error flag
+    int8_t        i,
+                j,
+                k;                  // loop counters
+
+    // row pointers for 6x6 matrix inversion
+    float       *pfRows[6];
+
+    // set fQwCT9x6 = Qw.C^T where Qw has size 9x9 and C^T has size 9x6
+    for (i = 0; i < 9; i++) { // loop over rows
+        for (j = 0; j < 6; j++) { // loop over columns
+            pthisSV->fQwCT9x6[i][j] = 0.0F;
+            // accumulate matrix sum
+            for (k = 0; k < 9; k++) {
+                // determine fC6x9[j][k] since the matrix is highly sparse
+                fC6x9jk = 0.0F;
+                // handle rows 0 to 2
+                if (j < 3) {
+                    if (k == j) fC6x9jk = 1.0F;
+                    if (k == (j + 6)) fC6x9jk = -pthisSV->fAlphaOver2;
+                } else if (j < 6) {
+                    // handle rows 3 to 5
+                    if (k == j) fC6x9jk = 1.0F;
+                    if (k == (j + 3)) fC6x9jk = -pthisSV->fAlphaOver2;
+                }
+
+                // accumulate fQwCT9x6[i][j] += Qw9x9[i][k] * C[j][k]
+                if ((pthisSV->fQw9x9[i][k] != 0.0F) && (fC6x9jk != 0.0F)) {
+                    if (fC6x9jk == 1.0F) pthisSV->fQwCT9x6[i][j] += pthisSV->fQw9x9[i][k];
+                    else pthisSV->fQwCT9x6[i][j] += pthisSV->fQw9x9[i][k] * fC6x9jk;
+                }
+            }
+        }
+    }
+
+    // set symmetric ftmpA6x6 = C.(Qw.C^T) + Qv = C.fQwCT9x6 + Qv
+    for (i = 0; i < 6; i++) { // loop over rows
+      for (j = i; j < 6; j++) { // loop over on and above diagonal columns
+          // zero off diagonal and set diagonal to Qv
+          if (i == j) ftmpA6x6[i][j] = pthisSV->fQv6x1[i];
+          else ftmpA6x6[i][j] = 0.0F;
+          // accumulate matrix sum
+          for (k = 0; k < 9; k++) {
+              // determine fC6x9[i][k]
+              fC6x9ik = 0.0F;
+              // handle rows 0 to 2
+              if (i < 3) {
+                  if (k == i) fC6x9ik = 1.0F;
+                  if (k == (i + 6)) fC6x9ik = -pthisSV->fAlphaOver2;
+              } else if (i < 6) {
+                  // handle rows 3 to 5
+                  if (k == i) fC6x9ik = 1.0F;
+                  if (k == (i + 3)) fC6x9ik = -pthisSV->fAlphaOver2;
+              }
+
+              // accumulate ftmpA6x6[i][j] += C[i][k] & fQwCT9x6[k][j]
+              if ((fC6x9ik != 0.0F) && (pthisSV->fQwCT9x6[k][j] != 0.0F)) {
+                  if (fC6x9ik == 1.0F) ftmpA6x6[i][j] += pthisSV->fQwCT9x6[k][j];
+                  else ftmpA6x6[i][j] += fC6x9ik * pthisSV->fQwCT9x6[k][j];
+              }
+          }
+      }
+    }
+    // set ftmpA6x6 below diagonal elements to above diagonal elements
+    fk6x6AeqSymUpper(ftmpA6x6);
+
+    // invert the symmetric positive definite ftmpA6x6 in situ to give ftmpA6x6 = inv(C * Qw * C^T + Qv) = inv(ftmpA6x6)
+    for (i = 0; i < 6; i++)
+        pfRows[i] = ftmpA6x6[i];
+    fmatrixAeqInvSymA(pfRows, 6, &ierror);
+
+    // on successful inversion set Kalman gain matrix K9x6 = Qw * C^T * inv(C * Qw * C^T + Qv) = fQwCT9x6 * ftmpA6x6
+    if (!ierror) {
+        // normal case
+        fk9x6AeqBxC(pthisSV->fK9x6, pthisSV->fQwCT9x6, ftmpA6x6);
+    } else {
+        // ftmpA6x6 was singular so set Kalman gain matrix to zero
+        for (i = 0; i < 9; i++) // loop over rows
+            for (j = 0; j < 6; j++) // loop over columns
+                pthisSV->fK9x6[i][j] = 0.0F;
+    }
+    return;
+}   // end fKalmanGain_9DOF_GBY_Generic
+
+// Kalman gain of the 9DOF filter computed per axis in closed form. The measurement matrix C is
+// [I | 0 | -alpha/2 * I] for the gravity rows and [0 | I | -alpha/2 * I] for the geomagnetic rows, and
+// Qw only couples the gravity, geomagnetic and gyro offset errors of the same axis. The 9 states and
+// 6 measurements therefore split into three independent problems of 3 states (gravity, geomagnetic and
+// gyro offset error on one axis) and 2 measurements, each needing only a 2x2 inversion. The zero
+// elements of fQwCT9x6 and fK9x6 are exactly those left at zero by fKalmanGain_9DOF_GBY_Generic().
+void fKalmanGain_9DOF_GBY_Block(struct SV_9DOF_GBY_KALMAN *pthisSV)
+{
+    float       fh;                 // alpha / 2, the gyro offset coefficient in C
+    float       fQgg, fQmm, fQbb;   // diagonal elements of Qw for one axis
+    float       fQgb, fQmb;         // gravity-gyro offset and geomagnetic-gyro offset elements of Qw for one axis
+    float       fS00, fS01, fS11;   // symmetric 2x2 C * Qw * C^T + Qv for one axis
+    float       fdet;               // determinant of the 2x2 matrix
+    float       finv00, finv01, finv11; // inverse of the 2x2 matrix
+    int8_t      ig, im, ib;         // rows of the gravity, geomagnetic and gyro offset states for one axis
+    int8_t      i, j;               // loop counters
+
+    for (i = 0; i < 9; i++)
+        for (j = 0; j < 6; j++)
+            pthisSV->fQwCT9x6[i][j] = pthisSV->fK9x6[i][j] = 0.0F;
+
+    fh = pthisSV->fAlphaOver2;
+    for (ig = CHX; ig <= CHZ; ig++) {
+        im = ig + 3;
+        ib = ig + 6;
+        fQgg = pthisSV->fQw9x9[ig][ig];
+        fQmm = pthisSV->fQw9x9[im][im];
+        fQbb = pthisSV->fQw9x9[ib][ib];
+        fQgb = pthisSV->fQw9x9[ig][ib];
+        fQmb = pthisSV->fQw9x9[im][ib];
+
+        // the non-zero elements of Qw * C^T: columns ig (gravity measurement) and im (geomagnetic measurement)
+        pthisSV->fQwCT9x6[ig][ig] = fQgg - fh * fQgb;
+        pthisSV->fQwCT9x6[im][ig] = -fh * fQmb;
+        pthisSV->fQwCT9x6[ib][ig] = fQgb - fh * fQbb;
+        pthisSV->fQwCT9x6[ig][im] = -fh * fQgb;
+        pthisSV->fQwCT9x6[im][im] = fQmm - fh * fQmb;
+        pthisSV->fQwCT9x6[ib][im] = fQmb - fh * fQbb;
+
+        // C * (Qw * C^T) + Qv restricted to this axis
+        fS00 = pthisSV->fQv6x1[ig] + pthisSV->fQwCT9x6[ig][ig] - fh * pthisSV->fQwCT9x6[ib][ig];
+        fS01 = pthisSV->fQwCT9x6[ig][im] - fh * pthisSV->fQwCT9x6[ib][im];
+        fS11 = pthisSV->fQv6x1[im] + pthisSV->fQwCT9x6[im][im] - fh * pthisSV->fQwCT9x6[ib][im];
+
+        fdet = fS00 * fS11 - fS01 * fS01;
+        if (fdet == 0.0F) {
+            // singular so set the whole Kalman gain matrix to zero, as the generic path does
+            for (i = 0; i < 9; i++)
+                for (j = 0; j < 6; j++)
+                    pthisSV->fK9x6[i][j] = 0.0F;
+            return;
+        }
+        finv00 = 1.0F / fdet;
+        finv01 = -fS01 * finv00;
+        finv11 = fS00 * finv00;
+        finv00 *= fS11;
+
+        // K = (Qw * C^T) * inv(C * Qw * C^T + Qv) for the three states of this axis
+        for (i = ig; i <= ib; i += 3) {
+            pthisSV->fK9x6[i][ig] = pthisSV->fQwCT9x6[i][ig] * finv00 + pthisSV->fQwCT9x6[i][im] * finv01;
+            pthisSV->fK9x6[i][im] = pthisSV->fQwCT9x6[i][ig] * finv01 + pthisSV->fQwCT9x6[i][im] * finv11;
+        }
+    }
+
+    return;
+}   // end fKalmanGain_9DOF_GBY_Block
+
+#if F_FIXED_POINT_FUSION
+// Kalman measurement update of fRun_9DOF_GBY_KALMAN() in fixed point, from the a priori orientation quaternion *pfqMi
+// and the eCompass orientation fR6DOF, with the sine and cosine of its inclination angle, to the normalized a posteriori
+// gravity and geomagnetic vectors fgPl and fmPl. The gain is solved per axis as in fKalmanGain_9DOF_GBY_Block(), with
+// the gyro offset error expressed as the tilt alpha / 2 * b it causes in one iteration so that the states of an axis
+// share one scale. Vectors, tilts and measurement errors are Q30 and covariances Q56. fZErr, fqgErrPl, fqmErrPl and
+// fbErrPl are set as in float, but fQw9x9, fQwCT9x6 and fK9x6 are not computed. The measurement noise fQv6x1 must
+// already be set.
+static void fUpdate_9DOF_GBY_KALMAN_Q30(struct SV_9DOF_GBY_KALMAN *pthisSV, const Quaternion *pfqMi,
+                                        float fR6DOF[][3], float fsinDelta6DOF, float fcosDelta6DOF,
+                                        float fgPl[], float fmPl[])
+{
+    QuaternionQ30   iq;                 // a priori orientation, then tilt correction quaternion (Q30)
+    FixedReciprocal iRecip;             // reciprocal of the determinant of C * Qw * C^T + Qv for one axis
+    int32_t         iR[3][3];           // a priori orientation, then tilt correction matrix (Q30)
+    int32_t         ig6DOF[3];          // eCompass gravity vector (Q30)
+    int32_t         im6DOF[3];          // eCompass geomagnetic vector (Q30)
+    int32_t         igMi[3];            // a priori gravity vector (Q30)
+    int32_t         imMi[3];            // a priori geomagnetic vector (Q30)
+    int32_t         itmpA3x1[3];        // a posteriori gravity or geomagnetic vector (Q30)
+    int32_t         iZErr[6];           // measurement error (Q30)
+    int32_t         iErr[2][3];         // a posteriori gravity and geomagnetic tilt errors (Q30)
+    int64_t         ibetaErr[3];        // a posteriori gyro offset error as a tilt (Q56)
+    int64_t         iQvg, iQvm;         // gravity and geomagnetic measurement noise (Q56)
+    int64_t         ic;                 // alpha^2 / 4 * (Qvy + Qwb) / 3 (Q56)
+    int64_t         iQwb;               // alpha^2 / 4 * Qwb / 3 (Q56)
+    int64_t         iQgg, iQmm, iQbb;   // diagonal elements of Qw for one axis (Q56)
+    int64_t         iQgb, iQmb;         // gravity-gyro offset and geomagnetic-gyro offset elements of Qw (Q56)
+    int64_t         iP[3][2];           // rows g, m and b of Qw * C^T for one axis (Q56)
+    int64_t         iS[3];              // S00, S01 and S11 of the symmetric C * Qw * C^T + Qv for one axis (Q56)
+    int64_t         iw[2];              // adjugate of C * Qw * C^T + Qv times the measurement errors of one axis
+    int64_t         ix;                 // one a posteriori error times the determinant
+    int64_t         itmp;               // scratch
+    int32_t         isin, icos;         // sine and cosine of the eCompass inclination angle (Q30)
+    int32_t         isinPl, icosPl;     // sine and cosine of the a posteriori inclination angle (Q30)
+    int32_t         iqg, iqm, ibeta;    // previous tilt errors (Q30) and gyro offset error as a tilt (Q34)
+    float           ftmp;               // scratch
+    int8_t          iSShift;            // right shift of iS to 30 bits
+    int8_t          iwShift;            // right shift of iw to 30 bits
+    int8_t          iPShift;            // right shift of one row of iP to 30 bits
+    int8_t          i, j, k;            // loop counters
+
+    // the a priori gravity vector is the z column of the a priori orientation matrix and the geomagnetic vector is
+    // the x (NED) or y (ENU) column rotated down by the inclination angle, as for the eCompass vectors
+    qQ30FromQuaternion(&iq, pfqMi);
+    iQ30RotationMatrixFromQuaternion(iR, &iq);
+    isin = iFixedFromFloat(fsinDelta6DOF, 30);
+    icos = iFixedFromFloat(fcosDelta6DOF, 30);
+    isinPl = iFixedFromFloat(pthisSV->fsinDeltaPl, 30);
+    icosPl = iFixedFromFloat(pthisSV->fcosDeltaPl, 30);
+    for (i = CHX; i <= CHZ; i++)
+    {
+#if THISCOORDSYSTEM == NED
+        ig6DOF[i] = iFixedFromFloat(fR6DOF[i][CHZ], 30);
+        im6DOF[i] = iMulQ30(iFixedFromFloat(fR6DOF[i][CHX], 30), icos) + iMulQ30(ig6DOF[i], isin);
+        igMi[i] = iR[i][CHZ];
+        imMi[i] = iMulQ30(iR[i][CHX], icosPl) + iMulQ30(igMi[i], isinPl);
+#else // ANDROID and WIN8 (both ENU coordinate systems)
+        ig6DOF[i] = -iFixedFromFloat(fR6DOF[i][CHZ], 30);
+        im6DOF[i] = iMulQ30(iFixedFromFloat(fR6DOF[i][CHY], 30), icos) + iMulQ30(ig6DOF[i], isin);
+        igMi[i] = -iR[i][CHZ];
+        imMi[i] = iMulQ30(iR[i][CHY], icosPl) + iMulQ30(igMi[i], isinPl);
+#endif
+    }
+    fZErrQ30(pthisSV->fZErr, iZErr, ig6DOF, igMi);
+    fZErrQ30(pthisSV->fZErr + 3, iZErr + 3, im6DOF, imMi);
+
+    // Qw and Qw * C^T per axis, where C = [I | 0 | -I; 0 | I | -I] once the gyro offset error is a tilt, then the
+    // errors K * Z = Qw * C^T * adj(S) * Z / det(S) with S = C * Qw * C^T + Qv
+    iQvg = iFixed64FromFloat(pthisSV->fQv6x1[CHX], 56);
+    iQvm = iFixed64FromFloat(pthisSV->fQv6x1[CHX + 3], 56);
+    ic = iFixed64FromFloat(pthisSV->fAlphaSqQvYQwbOver12, 56);
+    iQwb = iFixed64FromFloat(pthisSV->fAlphaSqOver4 * pthisSV->fQwbOver3, 56);
+    for (i = CHX; i <= CHZ; i++)
+    {
+        iqg = iFixedFromFloat(pthisSV->fqgErrPl[i], 30);
+        iqm = iFixedFromFloat(pthisSV->fqmErrPl[i], 30);
+        ibeta = iFixedFromFloat(pthisSV->fAlphaOver2 * pthisSV->fbErrPl[i], 34);
+        itmp = iFixedShift((int64_t) ibeta * ibeta, 12);
+        iQbb = itmp + iQwb;
+        iQgg = iFixedShift((int64_t) iqg * iqg, 4) + itmp + ic;
+        iQmm = iFixedShift((int64_t) iqm * iqm, 4) + itmp + ic;
+        iQgb = iFixedShift((int64_t) iqg * ibeta, 8) - iQbb;
+        iQmb = iFixedShift((int64_t) iqm * ibeta, 8) - iQbb;
+        iP[0][0] = iQgg - iQgb;
+        iP[0][1] = -iQgb;
+        iP[1][0] = -iQmb;
+        iP[1][1] = iQmm - iQmb;
+        iP[2][0] = iQgb - iQbb;
+        iP[2][1] = iQmb - iQbb;
+        iS[0] = iQvg + iP[0][0] - iP[2][0];
+        iS[1] = iP[0][1] - iP[2][1];
+        iS[2] = iQvm + iP[1][1] - iP[2][1];
+
+        // scale S to 30 bits for its determinant and adjugate
+        iSShift = iFixedNormShift(iS[0]);
+        for (k = 1; k < 3; k++)
+            if (iFixedNormShift(iS[k]) > iSShift) iSShift = iFixedNormShift(iS[k]);
+        for (k = 0; k < 3; k++)
+            iS[k] = iFixedShift(iS[k], iSShift);
+
+        // singular so set all the errors to zero, as the float path does
+        if (!iSetFixedReciprocal(&iRecip, iS[0] * iS[2] - iS[1] * iS[1]))
+        {
+            for (j = CHX; j <= CHZ; j++)
+            {
+                iErr[0][j] = iErr[1][j] = 0;
+                ibetaErr[j] = 0;
+            }
+            break;
+        }
+
+        iw[0] = iS[2] * iZErr[i] - iS[1] * iZErr[i + 3];
+        iw[1] = iS[0] * iZErr[i + 3] - iS[1] * iZErr[i];
+        iwShift = iFixedNormShift(iw[0]);
+        if (iFixedNormShift(iw[1]) > iwShift) iwShift = iFixedNormShift(iw[1]);
+        iw[0] = iFixedShift(iw[0], iwShift);
+        iw[1] = iFixedShift(iw[1], iwShift);
+
+        // the numerator of each error is in Q(142 - iSShift - iwShift - iPShift) and the determinant in
+        // Q(112 - 2 * iSShift), so the ratio is in Q(30 + iSShift - iwShift - iPShift)
+        for (j = 0; j < 3; j++)
+        {
+            iPShift = iFixedNormShift(iP[j][0]);
+            if (iFixedNormShift(iP[j][1]) > iPShift) iPShift = iFixedNormShift(iP[j][1]);
+            ix = iFixedShift(iP[j][0], iPShift) * iw[0] + iFixedShift(iP[j][1], iPShift) * iw[1];
+            if (j < 2)
+                iErr[j][i] = iSat32(iMulFixedReciprocal(ix, &iRecip, iwShift + iPShift - iSShift));
+            else
+                ibetaErr[i] = iMulFixedReciprocal(ix, &iRecip, 26 + iwShift + iPShift - iSShift);
+        }
+    }
+    ftmp = 1.0F / pthisSV->fAlphaOver2;
+    for (i = CHX; i <= CHZ; i++)
+    {
+        pthisSV->fqgErrPl[i] = fFloatFromFixed(iErr[0][i], 30);
+        pthisSV->fqmErrPl[i] = fFloatFromFixed(iErr[1][i], 30);
+        pthisSV->fbErrPl[i] = fFloatFromFixed(ibetaErr[i], 56) * ftmp;
+    }
+
+    // rotate the a priori gravity and geomagnetic vectors by their tilt correction (conjugate) quaternions
+    for (j = 0; j < 2; j++)
+    {
+        iq.q1 = -iErr[j][CHX];
+        iq.q2 = -iErr[j][CHY];
+        iq.q3 = -iErr[j][CHZ];
+        itmp = Q30_ONE - (((int64_t) iq.q1 * iq.q1) >> 30) - (((int64_t) iq.q2 * iq.q2) >> 30) -
+            (((int64_t) iq.q3 * iq.q3) >> 30);
+        iq.q0 = iQ30Sqrt(iSat32((itmp < 0) ? -itmp : itmp));
+        iQ30RotationMatrixFromQuaternion(iR, &iq);
+        iQ30k3x1VeqRu(itmpA3x1, iR, (j == 0) ? igMi : imMi);
+        for (i = CHX; i <= CHZ; i++)
+        {
+            if (j == 0)
+                fgPl[i] = fFloatFromFixed(itmpA3x1[i], 30);
+            else
+                fmPl[i] = fFloatFromFixed(itmpA3x1[i], 30);
+        }
+    }
+
+    return;
+}   // end fUpdate_9DOF_GBY_KALMAN_Q30
+#endif
+
 // 9DOF accelerometer+magnetometer+gyroscope orientation function implemented using indirect complementary Kalman filter
 void fRun_9DOF_GBY_KALMAN(struct SV_9DOF_GBY_KALMAN *pthisSV,
                           struct AccelSensor *pthisAccel,
@@ -1017,19 +1677,21 @@ void fRun_9DOF_GBY_KALMAN(struct SV_9DOF_GBY_KALMAN *pthisSV,
                           struct MagCalibration *pthisMagCal)
 {
     // local scalars and arrays
-    float       ftmpA6x6[6][6];     // scratch 6x6 matrix
+#if !F_FIXED_POINT_FUSION
     float       fRMi[3][3];         // a priori orientation matrix
-    float       fR6DOF[3][3];       // eCompass (6DOF accelerometer+magnetometer) orientation matrix
     float       fgMi[3];            // a priori estimate of the gravity vector (sensor frame)
     float       fmMi[3];            // a priori estimate of the geomagnetic vector (sensor frame)
+    float       ftmpA3x3[3][3];     // scratch 3x3 matrix
+    float       ftmpA9x1[9];        // scratch 9x1 vector
+#endif
+    float       fR6DOF[3][3];       // eCompass (6DOF accelerometer+magnetometer) orientation matrix
     float       fgPl[3];            // a posteriori estimate of the gravity vector (sensor frame)
     float       fmPl[3];            // a posteriori estimate of the geomagnetic vector (sensor frame)
-    float       ftmpA3x3[3][3];     // scratch 3x3 matrix
+#if !F_FIXED_POINT_FUSION || (THISCOORDSYSTEM == ANDROID)
     float       ftmpA3x1[3];        // scratch 3x1 vector
+#endif
     float       fQvGQa;             // accelerometer noise covariance to 1g sphere
     float       fQvBQd;             // magnetometer noise covariance to geomagnetic sphere
-    float       fC6x9ik;            // element i, k of measurement matrix C
-    float       fC6x9jk;            // element j, k of measurement matrix C
     Quaternion  fqMi;               // a priori orientation quaternion
     Quaternion  fq6DOF;             // eCompass (6DOF accelerometer+magnetometer) orientation quaternion
     Quaternion  ftmpq;              // scratch quaternion used for gyro integration
@@ -1039,16 +1701,10 @@ void fRun_9DOF_GBY_KALMAN(struct SV_9DOF_GBY_KALMAN *pthisSV,
     float       fmodGc;    // modulus of calibrated accelerometer measurement (g)
     float       fmodBc;    // modulus of calibrated magnetometer measurement (uT)
     float       ftmp;               // scratch float
-    int8_t        ierror;             // matrix inversion error flag
-    int8_t        i,
-                j,
-                k;                  // loop counters
-
-    // working arrays for 6x6 matrix inversion
-    float       *pfRows[6];
-    int8_t       iColInd[6];
-    int8_t        iRowInd[6];
-    int8_t        iPivot[6];
+    int8_t        i;                  // loop counter
+#if !F_FIXED_POINT_FUSION
+    int8_t        j;                  // loop counter
+#endif
 
     // if requested, do a reset initialization with no further processing
     if (pthisSV->resetflag) {
@@ -1063,17 +1719,15 @@ void fRun_9DOF_GBY_KALMAN(struct SV_9DOF_GBY_KALMAN *pthisSV,
     // and incrementally rotate fqMi by the contents of the gyro FIFO buffer
     fqMi = pthisSV->fqPl;
     if (pthisGyro->iFIFOCount > 0) {
-        // set ftmp to the average interval between FIFO gyro measurements
-        ftmp = pthisSV->fdeltat / (float)pthisGyro->iFIFOCount;
-
-        // normal case, loop over all the buffered gyroscope measurements
-        for (j = 0; j < pthisGyro->iFIFOCount; j++) {
-        // calculate the instantaneous angular velocity subtracting the gyro offset
-            for (i = CHX; i <= CHZ; i++) ftmpA3x1[i] = (float)pthisGyro->iYsFIFO[j][i] * pthisGyro->fDegPerSecPerCount - pthisSV->fbPl[i];
-            // compute the incremental rotation quaternion ftmpq and integrate the a priori orientation quaternion fqMi
-            fQuaternionFromRotationVectorDeg(&ftmpq, ftmpA3x1, ftmp);
-            qAeqAxB(&fqMi, &ftmpq);
-        }
+#if F_MEASURED_TIME_INTEGRATION
+        // normal case, integrate all the buffered gyroscope measurements at their measured interval, which
+        // also gives the time step of this iteration however long the loop actually took
+        fSetDeltat_9DOF_GBY_KALMAN(pthisSV, (float) pthisGyro->iFIFOCount * pthisGyro->fSampleInterval);
+        fIntegrateGyroFIFO(&fqMi, pthisGyro, pthisSV->fbPl, pthisGyro->fSampleInterval);
+#else
+        // normal case, integrate all the buffered gyroscope measurements at the average interval between them
+        fIntegrateGyroFIFO(&fqMi, pthisGyro, pthisSV->fbPl, pthisSV->fdeltat / (float) pthisGyro->iFIFOCount);
+#endif
     } else {
         // special case with no new FIFO measurements, use the previous iteration's average gyro reading to compute
         // the incremental rotation quaternion ftmpq and integrate the a priori orientation quaternion fqMi
@@ -1081,8 +1735,10 @@ void fRun_9DOF_GBY_KALMAN(struct SV_9DOF_GBY_KALMAN *pthisSV,
         qAeqAxB(&fqMi, &ftmpq);
     }
 
+#if !F_FIXED_POINT_FUSION
     // compute the a priori orientation matrix fRMi from the new a priori orientation quaternion fqMi
     fRotationMatrixFromQuaternion(fRMi, &fqMi);
+#endif
 
     // compute the 6DOF orientation matrix fR6DOF, inclination angle fDelta6DOF and the squared
     // deviations of the accelerometer and magnetometer measurements from the 1g gravity and geomagnetic spheres.
@@ -1114,13 +1770,23 @@ void fRun_9DOF_GBY_KALMAN(struct SV_9DOF_GBY_KALMAN *pthisSV,
     // ii) setting the geomagnetic inclination angle fDeltaPl now that the first calibrated 6DOF estimate is available
     if (pthisMagCal->iValidMagCal && !pthisSV->iFirstAccelMagLock) {
         fqMi = pthisSV->fqPl = fq6DOF;
-        f3x3matrixAeqB(fRMi, fR6DOF);
+#if !F_FIXED_POINT_FUSION
+        fk3x3AeqB(fRMi, fR6DOF);
+#endif
         pthisSV->fDeltaPl = fDelta6DOF;
         pthisSV->fsinDeltaPl = fsinDelta6DOF;
         pthisSV->fcosDeltaPl = fcosDelta6DOF;
         pthisSV->iFirstAccelMagLock = true;
     }
 
+    // calculate the vector fQv6x1 containing the diagonal elements of the measurement covariance matrix Qv
+    pthisSV->fQv6x1[0] = pthisSV->fQv6x1[1] = pthisSV->fQv6x1[2] = ONEOVER12 * fQvGQa + pthisSV->fAlphaSqQvYQwbOver12;
+    pthisSV->fQv6x1[3] = pthisSV->fQv6x1[4] = pthisSV->fQv6x1[5] = ONEOVER12 * fQvBQd / pthisMagCal->fBSq + pthisSV->fAlphaSqQvYQwbOver12;
+
+#if F_FIXED_POINT_FUSION
+    // compute the measurement errors and the a posteriori gravity and geomagnetic vectors fgPl and fmPl in fixed point
+    fUpdate_9DOF_GBY_KALMAN_Q30(pthisSV, &fqMi, fR6DOF, fsinDelta6DOF, fcosDelta6DOF, fgPl, fmPl);
+#else
     // set ftmpA3x1 to the normalized 6DOF gravity vector and set fgMi to the normalized a priori gravity vector
     // with both estimates computed in the sensor frame
 #if THISCOORDSYSTEM == NED
@@ -1215,111 +1881,20 @@ void fRun_9DOF_GBY_KALMAN(struct SV_9DOF_GBY_KALMAN *pthisSV,
         for (j = 0; j < i; j++)
             pthisSV->fQw9x9[i][j] = pthisSV->fQw9x9[j][i];
 
-    // calculate the vector fQv6x1 containing the diagonal elements of the measurement covariance matrix Qv
-    pthisSV->fQv6x1[0] = pthisSV->fQv6x1[1] = pthisSV->fQv6x1[2] = ONEOVER12 * fQvGQa + pthisSV->fAlphaSqQvYQwbOver12;
-    pthisSV->fQv6x1[3] = pthisSV->fQv6x1[4] = pthisSV->fQv6x1[5] = ONEOVER12 * fQvBQd / pthisMagCal->fBSq + pthisSV->fAlphaSqQvYQwbOver12;
-
     // calculate the Kalman gain matrix K = Qw * C^T * inv(C * Qw * C^T + Qv)
-    // set fQwCT9x6 = Qw.C^T where Qw has size 9x9 and C^T has size 9x6
-    for (i = 0; i < 9; i++) { // loop over rows
-        for (j = 0; j < 6; j++) { // loop over columns
-            pthisSV->fQwCT9x6[i][j] = 0.0F;
-            // accumulate matrix sum
-            for (k = 0; k < 9; k++) {
-                // determine fC6x9[j][k] since the matrix is highly sparse
-                fC6x9jk = 0.0F;
-                // handle rows 0 to 2
-                if (j < 3) {
-                    if (k == j) fC6x9jk = 1.0F;
-                    if (k == (j + 6)) fC6x9jk = -pthisSV->fAlphaOver2;
-                } else if (j < 6) {
-                    // handle rows 3 to 5
-                    if (k == j) fC6x9jk = 1.0F;
-                    if (k == (j + 3)) fC6x9jk = -pthisSV->fAlphaOver2;
-                }
-
-                // accumulate fQwCT9x6[i][j] += Qw9x9[i][k] * C[j][k]
-                if ((pthisSV->fQw9x9[i][k] != 0.0F) && (fC6x9jk != 0.0F)) {
-                    if (fC6x9jk == 1.0F) pthisSV->fQwCT9x6[i][j] += pthisSV->fQw9x9[i][k];
-                    else pthisSV->fQwCT9x6[i][j] += pthisSV->fQw9x9[i][k] * fC6x9jk;
-                }
-            }
-        }
-    }
-
-    // set symmetric ftmpA6x6 = C.(Qw.C^T) + Qv = C.fQwCT9x6 + Qv
-    for (i = 0; i < 6; i++) { // loop over rows
-      for (j = i; j < 6; j++) { // loop over on and above diagonal columns
-          // zero off diagonal and set diagonal to Qv
-          if (i == j) ftmpA6x6[i][j] = pthisSV->fQv6x1[i];
-          else ftmpA6x6[i][j] = 0.0F;
-          // accumulate matrix sum
-          for (k = 0; k < 9; k++) {
-              // determine fC6x9[i][k]
-              fC6x9ik = 0.0F;
-              // handle rows 0 to 2
-              if (i < 3) {
-                  if (k == i) fC6x9ik = 1.0F;
-                  if (k == (i + 6)) fC6x9ik = -pthisSV->fAlphaOver2;
-              } else if (i < 6) {
-                  // handle rows 3 to 5
-                  if (k == i) fC6x9ik = 1.0F;
-                  if (k == (i + 3)) fC6x9ik = -pthisSV->fAlphaOver2;
-              }
-
-              // accumulate ftmpA6x6[i][j] += C[i][k] & fQwCT9x6[k][j]
-              if ((fC6x9ik != 0.0F) && (pthisSV->fQwCT9x6[k][j] != 0.0F)) {
-                  if (fC6x9ik == 1.0F) ftmpA6x6[i][j] += pthisSV->fQwCT9x6[k][j];
-                  else ftmpA6x6[i][j] += fC6x9ik * pthisSV->fQwCT9x6[k][j];
-              }
-          }
-      }
-    }
-    // set ftmpA6x6 below diagonal elements to above diagonal elements
-    for (i = 1; i < 6; i++) // loop over rows
-        for (j = 0; j < i; j++) // loop over below diagonal columns
-            ftmpA6x6[i][j] = ftmpA6x6[j][i];
-
-    // invert ftmpA6x6 in situ to give ftmpA6x6 = inv(C * Qw * C^T + Qv) = inv(ftmpA6x6)
-    for (i = 0; i < 6; i++)
-        pfRows[i] = ftmpA6x6[i];
-    fmatrixAeqInvA(pfRows, iColInd, iRowInd, iPivot, 6, &ierror);
-
-    // on successful inversion set Kalman gain matrix K9x6 = Qw * C^T * inv(C * Qw * C^T + Qv) = fQwCT9x6 * ftmpA6x6
-    if (!ierror) {
-    // normal case
-    for (i = 0; i < 9; i++) // loop over rows
-        for (j = 0; j < 6; j++) { // loop over columns
-            pthisSV->fK9x6[i][j] = 0.0F;
-            for (k = 0; k < 6; k++) {
-                if ((pthisSV->fQwCT9x6[i][k] != 0.0F) && (ftmpA6x6[k][j] != 0.0F))
-                    pthisSV->fK9x6[i][j] += pthisSV->fQwCT9x6[i][k] * ftmpA6x6[k][j];
-            }
-        }
-    } else {
-        // ftmpA6x6 was singular so set Kalman gain matrix to zero
-        for (i = 0; i < 9; i++) // loop over rows
-            for (j = 0; j < 6; j++) // loop over columns
-                pthisSV->fK9x6[i][j] = 0.0F;
-    }
+#if F_9DOF_GBY_BLOCK_GAIN
+    fKalmanGain_9DOF_GBY_Block(pthisSV);
+#else
+    fKalmanGain_9DOF_GBY_Generic(pthisSV);
+#endif
 
     // calculate the a posteriori gravity and geomagnetic tilt quaternion errors and gyro offset error vector
     // from the Kalman matrix fK9x6 and the measurement error vector fZErr.
+    fk9x1VeqAxU(ftmpA9x1, pthisSV->fK9x6, pthisSV->fZErr);
     for (i = CHX; i <= CHZ; i++) {
-        pthisSV->fqgErrPl[i] = pthisSV->fqmErrPl[i] = pthisSV->fbErrPl[i] = 0.0F;
-        for (j = 0; j < 6; j++) {
-            // calculate gravity tilt quaternion vector error component fqgErrPl
-            if (pthisSV->fK9x6[i][j] != 0.0F)
-                pthisSV->fqgErrPl[i] += pthisSV->fK9x6[i][j] * pthisSV->fZErr[j];
-
-            // calculate geomagnetic tilt quaternion vector error component fqmErrPl
-            if (pthisSV->fK9x6[i + 3][j] != 0.0F)
-                pthisSV->fqmErrPl[i] += pthisSV->fK9x6[i + 3][j] * pthisSV->fZErr[j];
-
-            // calculate gyro offset vector error component fbErrPl
-            if (pthisSV->fK9x6[i + 6][j] != 0.0F)
-                pthisSV->fbErrPl[i] += pthisSV->fK9x6[i + 6][j] * pthisSV->fZErr[j];
-        }
+        pthisSV->fqgErrPl[i] = ftmpA9x1[i];
+        pthisSV->fqmErrPl[i] = ftmpA9x1[i + 3];
+        pthisSV->fbErrPl[i] = ftmpA9x1[i + 6];
     }
 
     // set ftmpq to the a posteriori gravity tilt correction (conjugate) quaternion
@@ -1331,7 +1906,7 @@ void fRun_9DOF_GBY_KALMAN(struct SV_9DOF_GBY_KALMAN *pthisSV,
     // set ftmpA3x3 to the gravity tilt correction matrix and rotate the normalized a priori estimate of the
     // gravity vector fgMi to obtain the normalized a posteriori estimate of the gravity vector fgPl
     fRotationMatrixFromQuaternion(ftmpA3x3, &ftmpq);
-    fveqRu(fgPl, ftmpA3x3, fgMi, 0);
+    fk3x1VeqRu(fgPl, ftmpA3x3, fgMi);
 
     // set ftmpq to the a posteriori geomagnetic tilt correction (conjugate) quaternion
     ftmpq.q1 = -pthisSV->fqmErrPl[CHX];
@@ -1342,7 +1917,8 @@ void fRun_9DOF_GBY_KALMAN(struct SV_9DOF_GBY_KALMAN *pthisSV,
     // set ftmpA3x3 to the geomagnetic tilt correction matrix and rotate the normalized a priori estimate of the
     // geomagnetic vector fmMi to obtain the normalized a posteriori estimate of the geomagnetic vector fmPl
     fRotationMatrixFromQuaternion(ftmpA3x3, &ftmpq);
-    fveqRu(fmPl, ftmpA3x3, fmMi, 0);
+    fk3x1VeqRu(fmPl, ftmpA3x3, fmMi);
+#endif
 
     // compute the a posteriori orientation matrix fRPl from the vector product of the a posteriori gravity fgPl
     // and geomagnetic fmPl vectors both of which are normalized
@@ -1381,7 +1957,7 @@ void fRun_9DOF_GBY_KALMAN(struct SV_9DOF_GBY_KALMAN *pthisSV,
     // compute the linear acceleration fAccGl in the global frame
     // first de-rotate the accelerometer measurement fGc from the sensor to global frame
     // using the transpose (inverse) of the orientation matrix fRPl
-    fveqRu(pthisSV->fAccGl, pthisSV->fRPl, pthisAccel->fGc, 1);
+    fk3x1VeqRTu(pthisSV->fAccGl, pthisSV->fRPl, pthisAccel->fGc);
 
     // subtract the fixed gravity vector in the global frame leaving linear acceleration
 #if THISCOORDSYSTEM == NED
@@ -1418,6 +1994,65 @@ void fRun_9DOF_GBY_KALMAN(struct SV_9DOF_GBY_KALMAN *pthisSV,
     fWin8AnglesDegFromRotationMatrix(pthisSV->fRPl, &(pthisSV->fPhiPl), &(pthisSV->fThePl), &(pthisSV->fPsiPl), &(pthisSV->fRhoPl), &(pthisSV->fChiPl));
 #endif
 
+    // the gyro FIFO has now been fused, so predict onwards from the a posteriori orientation
+    fResetPrediction_9DOF_GBY_KALMAN(pthisSV);
+
     return;
 } // end fRun_9DOF_GBY_KALMAN
+
+// 9DOF gyro prediction between Kalman updates. Rotates the predicted orientation fqPr by the gyro FIFO
+// measurements read since the previous call, and updates its Euler angles and fOmegaPr, without any measurement
+// update. The FIFO is left untouched and still holds raw measurements, so the new ones are copied and passed
+// through ApplyGyroHAL() here: the next fRun_9DOF_GBY_KALMAN() integrates all of them again from fqPl at the
+// measured gyro sample interval (F_MEASURED_TIME_INTEGRATION), or else at the average interval between
+// measurements, and then restarts the prediction from its a posteriori orientation.
+// Calling this after each read between Kalman updates makes the orientation available at the read rate
+// for the cost of one quaternion product per gyro measurement.
+void fPredict_9DOF_GBY_KALMAN(struct SV_9DOF_GBY_KALMAN *pthisSV, struct GyroSensor *pthisGyro)
+{
+    struct GyroSensor   NewGyro;    // new gyro measurements, remapped
+    float       fRPr[3][3];         // predicted orientation matrix
+    int32_t     iSum[3];            // sum of the new gyro measurements (counts)
+    int8_t      i,
+                j;                  // loop counters
+
+    // nothing to predict from until the filter is initialized, or if no new measurements have arrived
+    if (pthisSV->resetflag || (pthisGyro->iFIFOCount <= pthisSV->iFIFOPredicted)) return;
+
+    // copy the new measurements and map them onto the coordinate system as processGyroData() will
+    NewGyro.iFIFOCount = (uint8_t) (pthisGyro->iFIFOCount - pthisSV->iFIFOPredicted);
+    NewGyro.fDegPerSecPerCount = pthisGyro->fDegPerSecPerCount;
+    for (j = 0; j < NewGyro.iFIFOCount; j++)
+        for (i = CHX; i <= CHZ; i++) NewGyro.iYsFIFO[j][i] = pthisGyro->iYsFIFO[pthisSV->iFIFOPredicted + j][i];
+    ApplyGyroHAL(&NewGyro);
+    pthisSV->iFIFOPredicted = pthisGyro->iFIFOCount;
+
+    // average angular velocity of the new measurements less the gyro offset
+    iSum[CHX] = iSum[CHY] = iSum[CHZ] = 0;
+    for (j = 0; j < NewGyro.iFIFOCount; j++)
+        for (i = CHX; i <= CHZ; i++) iSum[i] += NewGyro.iYsFIFO[j][i];
+    for (i = CHX; i <= CHZ; i++)
+        pthisSV->fOmegaPr[i] = (float) iSum[i] * NewGyro.fDegPerSecPerCount / (float) NewGyro.iFIFOCount -
+            pthisSV->fbPl[i];
+
+    // integrate the new measurements at the gyro sampling interval
+#if F_MEASURED_TIME_INTEGRATION
+    fIntegrateGyroFIFO(&(pthisSV->fqPr), &NewGyro, pthisSV->fbPl, pthisGyro->fSampleInterval);
+#else
+    fIntegrateGyroFIFO(&(pthisSV->fqPr), &NewGyro, pthisSV->fbPl, 1.0F / (float) GYRO_ODR_HZ);
+#endif
+    fqAeqNormqA(&(pthisSV->fqPr));
+
+    // compute the predicted Euler angles
+    fRotationMatrixFromQuaternion(fRPr, &(pthisSV->fqPr));
+#if THISCOORDSYSTEM == NED
+    fNEDAnglesDegFromRotationMatrix(fRPr, &(pthisSV->fPhiPr), &(pthisSV->fThePr), &(pthisSV->fPsiPr), &(pthisSV->fRhoPr), &(pthisSV->fChiPr));
+#elif THISCOORDSYSTEM == ANDROID
+    fAndroidAnglesDegFromRotationMatrix(fRPr, &(pthisSV->fPhiPr), &(pthisSV->fThePr), &(pthisSV->fPsiPr), &(pthisSV->fRhoPr), &(pthisSV->fChiPr));
+#else // WIN8
+    fWin8AnglesDegFromRotationMatrix(fRPr, &(pthisSV->fPhiPr), &(pthisSV->fThePr), &(pthisSV->fPsiPr), &(pthisSV->fRhoPr), &(pthisSV->fChiPr));
+#endif
+
+    return;
+} // end fPredict_9DOF_GBY_KALMAN
 #endif // #if F_9DOF_GBY_KALMAN
@@ -93,6 +93,13 @@ void fRun_3DOF_Y_BASIC(struct SV_3DOF_Y_BASIC *pthisSV, struct GyroSensor *pthis
 void fRun_6DOF_GB_BASIC(struct SV_6DOF_GB_BASIC *pthisSV, struct MagSensor *pthisMag, struct AccelSensor *pthisAccel);
 void fRun_6DOF_GY_KALMAN(struct SV_6DOF_GY_KALMAN *pthisSV, struct AccelSensor *pthisAccel, struct GyroSensor *pthisGyro);
 void fRun_9DOF_GBY_KALMAN(struct SV_9DOF_GBY_KALMAN *pthisSV, struct AccelSensor *pthisAccel, struct MagSensor *pthisMag, struct GyroSensor *pthisGyro, struct MagCalibration *pthisMagCal);
+void fPredict_9DOF_GBY_KALMAN(struct SV_9DOF_GBY_KALMAN *pthisSV, struct GyroSensor *pthisGyro);
+void fSetDeltat_9DOF_GBY_KALMAN(struct SV_9DOF_GBY_KALMAN *pthisSV, float fdeltat);
+void fResetPrediction_9DOF_GBY_KALMAN(struct SV_9DOF_GBY_KALMAN *pthisSV);
+void fKalmanGain_6DOF_GY_Generic(struct SV_6DOF_GY_KALMAN *pthisSV);
+void fKalmanGain_6DOF_GY_Block(struct SV_6DOF_GY_KALMAN *pthisSV);
+void fKalmanGain_9DOF_GBY_Generic(struct SV_9DOF_GBY_KALMAN *pthisSV);
+void fKalmanGain_9DOF_GBY_Block(struct SV_9DOF_GBY_KALMAN *pthisSV);
 ///@}
 
 
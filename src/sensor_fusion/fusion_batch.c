@@ -0,0 +1,689 @@
+/*
+ * Copyright (c) 2020-2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file fusion_batch.c
+    \brief Batched 9DOF Kalman filter, advancing many fusion instances per call.
+
+    See fusion_batch.h for how the batch is used. Each function below repeats one
+    step of fRun_9DOF_GBY_KALMAN() or of the orientation.c and approximations.c
+    functions it calls, with the same arithmetic in the same order, but written
+    for one lane with every branch replaced by a select so that the loops over
+    the lanes vectorize.
+*/
+
+#include <math.h>
+#include <string.h>
+
+#include "sensor_fusion.h"
+#include "fusion.h"
+#include "fusion_batch.h"   // Header for this .c file
+#include "orientation.h"
+
+#if F_9DOF_GBY_KALMAN && (THISCOORDSYSTEM == NED)
+
+// constants of approximations.c and orientation.c
+#define TAN15DEG    0.26794919243F      // tan(15 deg) = 2 - sqrt(3)
+#define TAN30DEG    0.57735026919F      // tan(30 deg) = 1/sqrt(3)
+#define PADE_A      96.644395816F
+#define PADE_B      25.086941612F
+#define PADE_C      1.6867633134F
+#define SMALLQ0     1E-4F               // limit of quaternion scalar component requiring special algorithm
+#define CORRUPTQUAT 0.001F              // threshold for deciding rotation quaternion is corrupt
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// one lane versions of the functions used by fRun_9DOF_GBY_KALMAN()
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+// as fatan_deg()
+static inline float fLaneAtanDeg(float x)
+{
+    float fax;                  // |x|, then mapped into -tan(15 deg) to tan(15 deg)
+    float fx2;                  // fax^2
+    float fangledeg;            // angle (deg)
+    int32_t ixexceeds1;         // |x| greater than 1.0
+    int32_t ixmapped;           // argument in range tan(15 deg) to tan(45 deg)=1.0
+
+    fax = fabsf(x);
+    ixexceeds1 = (fax > 1.0F);
+    fax = ixexceeds1 ? 1.0F / fax : fax;
+    ixmapped = (fax > TAN15DEG);
+    fax = ixmapped ? (fax - TAN30DEG) / (1.0F + TAN30DEG * fax) : fax;
+    fx2 = fax * fax;
+    fangledeg = fax * (PADE_A + fx2 * PADE_B) / (PADE_C + fx2);
+    fangledeg = ixmapped ? fangledeg + 30.0F : fangledeg;
+    fangledeg = ixexceeds1 ? 90.0F - fangledeg : fangledeg;
+    return (x < 0.0F) ? -fangledeg : fangledeg;
+} // end fLaneAtanDeg()
+
+// as fatan2_deg()
+static inline float fLaneAtan2Deg(float y, float x)
+{
+    float fangledeg = fLaneAtanDeg(y / x);
+    float fxzero = (y > 0.0F) ? 90.0F : ((y < 0.0F) ? -90.0F : 0.0F);
+
+    fangledeg = (x > 0.0F) ? fangledeg : ((y > 0.0F) ? 180.0F + fangledeg : -180.0F + fangledeg);
+    return (x == 0.0F) ? fxzero : fangledeg;
+} // end fLaneAtan2Deg()
+
+// as fasin_deg()
+static inline float fLaneAsinDeg(float x)
+{
+    float fangledeg = fLaneAtanDeg(x / sqrtf(fabsf(1.0F - x * x)));
+
+    fangledeg = (x >= 1.0F) ? 90.0F : fangledeg;
+    return (x <= -1.0F) ? -90.0F : fangledeg;
+} // end fLaneAsinDeg()
+
+// as facos_deg()
+static inline float fLaneAcosDeg(float x)
+{
+    float fangledeg = fLaneAtanDeg(sqrtf(fabsf(1.0F - x * x)) / x);
+
+    fangledeg = (x > 0.0F) ? fangledeg : 180.0F + fangledeg;
+    fangledeg = (x == 0.0F) ? 90.0F : fangledeg;
+    fangledeg = (x >= 1.0F) ? 0.0F : fangledeg;
+    return (x <= -1.0F) ? 180.0F : fangledeg;
+} // end fLaneAcosDeg()
+
+// as fRotationMatrixFromQuaternion()
+static inline void fLaneRotationMatrixFromQuaternion(float R[][3], float q0, float q1, float q2, float q3)
+{
+    float f2q;
+    float f2q0q0, f2q0q1, f2q0q2, f2q0q3;
+    float f2q1q1, f2q1q2, f2q1q3;
+    float f2q2q2, f2q2q3;
+    float f2q3q3;
+
+    f2q = 2.0F * q0;
+    f2q0q0 = f2q * q0;
+    f2q0q1 = f2q * q1;
+    f2q0q2 = f2q * q2;
+    f2q0q3 = f2q * q3;
+    f2q = 2.0F * q1;
+    f2q1q1 = f2q * q1;
+    f2q1q2 = f2q * q2;
+    f2q1q3 = f2q * q3;
+    f2q = 2.0F * q2;
+    f2q2q2 = f2q * q2;
+    f2q2q3 = f2q * q3;
+    f2q3q3 = 2.0F * q3 * q3;
+
+    R[CHX][CHX] = f2q0q0 + f2q1q1 - 1.0F;
+    R[CHX][CHY] = f2q1q2 + f2q0q3;
+    R[CHX][CHZ] = f2q1q3 - f2q0q2;
+    R[CHY][CHX] = f2q1q2 - f2q0q3;
+    R[CHY][CHY] = f2q0q0 + f2q2q2 - 1.0F;
+    R[CHY][CHZ] = f2q2q3 + f2q0q1;
+    R[CHZ][CHX] = f2q1q3 + f2q0q2;
+    R[CHZ][CHY] = f2q2q3 - f2q0q1;
+    R[CHZ][CHZ] = f2q0q0 + f2q3q3 - 1.0F;
+} // end fLaneRotationMatrixFromQuaternion()
+
+// as fQuaternionFromRotationMatrix() followed by fqAeqNormqA(), setting fq[0-3] to q0 to q3
+static inline void fLaneQuaternionFromRotationMatrix(float R[][3], float fq[])
+{
+    float fq0sq;                // q0^2
+    float recip4q0;             // 1/4q0
+    float fNorm;                // quaternion norm
+    float ftmp;                 // scratch
+    int32_t ismall;             // q0 too small to divide by
+    int32_t icorrupt;           // quaternion is corrupted
+
+    fq0sq = 0.25F * (1.0F + R[CHX][CHX] + R[CHY][CHY] + R[CHZ][CHZ]);
+    fq[0] = sqrtf(fabsf(fq0sq));
+    ismall = !(fq[0] > SMALLQ0);
+    recip4q0 = 0.25F / fq[0];
+    fq[1] = recip4q0 * (R[CHY][CHZ] - R[CHZ][CHY]);
+    fq[2] = recip4q0 * (R[CHZ][CHX] - R[CHX][CHZ]);
+    fq[3] = recip4q0 * (R[CHX][CHY] - R[CHY][CHX]);
+
+    // near 180 deg take the absolute values of q1 to q3 from the leading diagonal, with the signs of the
+    // differenced off-diagonal terms
+    ftmp = sqrtf(fabsf(0.5F + 0.5F * R[CHX][CHX] - fq0sq));
+    fq[1] = ismall ? (((R[CHY][CHZ] - R[CHZ][CHY]) < 0.0F) ? -ftmp : ftmp) : fq[1];
+    ftmp = sqrtf(fabsf(0.5F + 0.5F * R[CHY][CHY] - fq0sq));
+    fq[2] = ismall ? (((R[CHZ][CHX] - R[CHX][CHZ]) < 0.0F) ? -ftmp : ftmp) : fq[2];
+    ftmp = sqrtf(fabsf(0.5F + 0.5F * R[CHZ][CHZ] - fq0sq));
+    fq[3] = ismall ? (((R[CHX][CHY] - R[CHY][CHX]) < 0.0F) ? -ftmp : ftmp) : fq[3];
+
+    // normalize, or the identity quaternion if corrupted. q0 is already non-negative.
+    fNorm = sqrtf(fq[0] * fq[0] + fq[1] * fq[1] + fq[2] * fq[2] + fq[3] * fq[3]);
+    icorrupt = !(fNorm > CORRUPTQUAT);
+    fNorm = 1.0F / fNorm;
+    fq[0] = icorrupt ? 1.0F : fq[0] * fNorm;
+    fq[1] = icorrupt ? 0.0F : fq[1] * fNorm;
+    fq[2] = icorrupt ? 0.0F : fq[2] * fNorm;
+    fq[3] = icorrupt ? 0.0F : fq[3] * fNorm;
+} // end fLaneQuaternionFromRotationMatrix()
+
+// as feCompassNED()
+static inline void fLaneeCompassNED(float fR[][3], float *pfDelta, float *pfsinDelta, float *pfcosDelta,
+                                    const float fBc[], const float fGc[], float *pfmodBc, float *pfmodGc)
+{
+    float fmod[3];              // column moduli
+    float fGcdotBc;             // dot product of vectors G.Bc
+    float ftmp;                 // scratch
+    int32_t isingular;          // no solution is possible
+    int32_t inodelta;           // inclination angle cannot be computed
+    int8_t i, j;                // loop counters
+
+    for (i = CHX; i <= CHZ; i++) {
+        fR[i][CHZ] = fGc[i];
+        fR[i][CHX] = fBc[i];
+    }
+    fR[CHX][CHY] = fR[CHY][CHZ] * fR[CHZ][CHX] - fR[CHZ][CHZ] * fR[CHY][CHX];
+    fR[CHY][CHY] = fR[CHZ][CHZ] * fR[CHX][CHX] - fR[CHX][CHZ] * fR[CHZ][CHX];
+    fR[CHZ][CHY] = fR[CHX][CHZ] * fR[CHY][CHX] - fR[CHY][CHZ] * fR[CHX][CHX];
+    fR[CHX][CHX] = fR[CHY][CHY] * fR[CHZ][CHZ] - fR[CHZ][CHY] * fR[CHY][CHZ];
+    fR[CHY][CHX] = fR[CHZ][CHY] * fR[CHX][CHZ] - fR[CHX][CHY] * fR[CHZ][CHZ];
+    fR[CHZ][CHX] = fR[CHX][CHY] * fR[CHY][CHZ] - fR[CHY][CHY] * fR[CHX][CHZ];
+
+    fmod[CHX] = sqrtf(fR[CHX][CHX] * fR[CHX][CHX] + fR[CHY][CHX] * fR[CHY][CHX] + fR[CHZ][CHX] * fR[CHZ][CHX]);
+    fmod[CHY] = sqrtf(fR[CHX][CHY] * fR[CHX][CHY] + fR[CHY][CHY] * fR[CHY][CHY] + fR[CHZ][CHY] * fR[CHZ][CHY]);
+    fmod[CHZ] = sqrtf(fR[CHX][CHZ] * fR[CHX][CHZ] + fR[CHY][CHZ] * fR[CHY][CHZ] + fR[CHZ][CHZ] * fR[CHZ][CHZ]);
+
+    // normalize the columns, or set the identity matrix if no solution is possible
+    isingular = (fmod[CHX] == 0.0F) || (fmod[CHY] == 0.0F) || (fmod[CHZ] == 0.0F);
+    for (j = CHX; j <= CHZ; j++) {
+        ftmp = 1.0F / fmod[j];
+        for (i = CHX; i <= CHZ; i++)
+            fR[i][j] = isingular ? ((i == j) ? 1.0F : 0.0F) : fR[i][j] * ftmp;
+    }
+
+    // compute the geomagnetic inclination angle (deg)
+    *pfmodGc = fmod[CHZ];
+    *pfmodBc = sqrtf(fBc[CHX] * fBc[CHX] + fBc[CHY] * fBc[CHY] + fBc[CHZ] * fBc[CHZ]);
+    fGcdotBc = fGc[CHX] * fBc[CHX] + fGc[CHY] * fBc[CHY] + fGc[CHZ] * fBc[CHZ];
+    inodelta = isingular || (*pfmodGc == 0.0F) || (*pfmodBc == 0.0F);
+    ftmp = fGcdotBc / (*pfmodGc * *pfmodBc);
+    *pfsinDelta = inodelta ? 0.0F : ftmp;
+    *pfcosDelta = inodelta ? 1.0F : sqrtf(1.0F - ftmp * ftmp);
+    *pfDelta = inodelta ? 0.0F : fLaneAsinDeg(ftmp);
+} // end fLaneeCompassNED()
+
+// as fveqconjgquq(), setting fqv[0-2] to the vector components q1 to q3 only
+static inline void fLaneVeqconjgquq(float fqv[], const float fu[], const float fv[])
+{
+    float fuxv[3];              // vector product u x v
+    float fsqrt1plusudotv;      // sqrt(1 + u.v)
+    float fd[3];                // un-normalized vector component for anti-parallel u and v
+    float ftmp;                 // scratch
+    float fdmod;                // modulus of fd
+    int32_t iantiparallel;      // u.v = -1
+    int8_t i;                   // loop counter
+
+    fsqrt1plusudotv = sqrtf(fabsf(1.0F + fu[CHX] * fv[CHX] + fu[CHY] * fv[CHY] + fu[CHZ] * fv[CHZ]));
+    fuxv[CHX] = fu[CHY] * fv[CHZ] - fu[CHZ] * fv[CHY];
+    fuxv[CHY] = fu[CHZ] * fv[CHX] - fu[CHX] * fv[CHZ];
+    fuxv[CHZ] = fu[CHX] * fv[CHY] - fu[CHY] * fv[CHX];
+    iantiparallel = (fsqrt1plusudotv == 0.0F);
+
+    fd[CHX] = fu[CHY] - fu[CHZ];
+    fd[CHY] = fu[CHZ] - fu[CHX];
+    fd[CHZ] = fu[CHX] - fu[CHY];
+    fdmod = sqrtf(fabsf(fd[CHX] * fd[CHX] + fd[CHY] * fd[CHY] + fd[CHZ] * fd[CHZ]));
+    fd[CHX] = (fdmod != 0.0F) ? fd[CHX] * (1.0F / fdmod) : ONEOVERSQRT2;
+    fd[CHY] = (fdmod != 0.0F) ? fd[CHY] * (1.0F / fdmod) : -ONEOVERSQRT2;
+    fd[CHZ] = (fdmod != 0.0F) ? fd[CHZ] * (1.0F / fdmod) : 0.0F;
+
+    ftmp = ONEOVERSQRT2 / fsqrt1plusudotv;
+    for (i = CHX; i <= CHZ; i++)
+        fqv[i] = iantiparallel ? fd[i] : -fuxv[i] * ftmp;
+} // end fLaneVeqconjgquq()
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// the batch
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+void fBatchInit_9DOF_GBY_KALMAN(FusionBatch9DOF *pBatch, int16_t iLanes)
+{
+    memset(pBatch, 0, sizeof(*pBatch));
+    if (iLanes > FUSION_BATCH_LANES) iLanes = FUSION_BATCH_LANES;
+    pBatch->iLanes = (iLanes > 0) ? iLanes : 0;
+} // end fBatchInit_9DOF_GBY_KALMAN()
+
+void fBatchSetLane_9DOF_GBY_KALMAN(FusionBatch9DOF *pBatch, int16_t iLane, SensorFusionGlobals *sfg)
+{
+    struct SV_9DOF_GBY_KALMAN *pthisSV = &(sfg->SV_9DOF_GBY_KALMAN);
+    struct GyroSensor *pthisGyro = &(sfg->Gyro);
+    int16_t k = iLane;          // lane
+    int8_t i, j;                // loop counters
+
+    if ((iLane < 0) || (iLane >= pBatch->iLanes)) return;
+    pBatch->pSV[k] = pthisSV;
+    pBatch->iActive[k] = false;
+
+    // a reset initializes the filter with no further processing, as in fRun_9DOF_GBY_KALMAN()
+    if (pthisSV->resetflag) {
+        fInit_9DOF_GBY_KALMAN(pthisSV, &(sfg->Accel), &(sfg->Mag), pthisGyro, &(sfg->MagCal));
+        return;
+    }
+
+    // the gyro FIFO in deg/s, or with no new measurements a single one of the previous average angular velocity
+    for (i = CHX; i <= CHZ; i++) pBatch->fYAvg[i][k] = (float) pthisGyro->iYs[i] * pthisGyro->fDegPerSecPerCount;
+    if (pthisGyro->iFIFOCount > 0) {
+#if F_MEASURED_TIME_INTEGRATION
+        fSetDeltat_9DOF_GBY_KALMAN(pthisSV, (float) pthisGyro->iFIFOCount * pthisGyro->fSampleInterval);
+        pBatch->fYInterval[k] = pthisGyro->fSampleInterval;
+#else
+        pBatch->fYInterval[k] = pthisSV->fdeltat / (float) pthisGyro->iFIFOCount;
+#endif
+        pBatch->iYCount[k] = pthisGyro->iFIFOCount;
+        for (j = 0; j < pthisGyro->iFIFOCount; j++)
+            for (i = CHX; i <= CHZ; i++)
+                pBatch->fYs[j][i][k] = (float) pthisGyro->iYsFIFO[j][i] * pthisGyro->fDegPerSecPerCount;
+    } else {
+        pBatch->fYInterval[k] = pthisSV->fdeltat;
+        pBatch->iYCount[k] = 1;
+        for (i = CHX; i <= CHZ; i++) pBatch->fYs[0][i][k] = pBatch->fYAvg[i][k];
+    }
+
+    // the other sensor inputs
+    for (i = CHX; i <= CHZ; i++) {
+        pBatch->fGc[i][k] = sfg->Accel.fGc[i];
+        pBatch->fBc[i][k] = sfg->Mag.fBc[i];
+    }
+    pBatch->fB[k] = sfg->MagCal.fB;
+    pBatch->fBSq[k] = sfg->MagCal.fBSq;
+    pBatch->iValidMagCal[k] = sfg->MagCal.iValidMagCal;
+
+    // constants and the state carried from the previous iteration
+    pBatch->fdeltat[k] = pthisSV->fdeltat;
+    pBatch->fgdeltat[k] = pthisSV->fgdeltat;
+    pBatch->fAlphaOver2[k] = pthisSV->fAlphaOver2;
+    pBatch->fAlphaSqOver4[k] = pthisSV->fAlphaSqOver4;
+    pBatch->fAlphaSqQvYQwbOver12[k] = pthisSV->fAlphaSqQvYQwbOver12;
+    pBatch->fQwbOver3[k] = pthisSV->fQwbOver3;
+    pBatch->fMaxGyroOffsetChange[k] = pthisSV->fMaxGyroOffsetChange;
+    pBatch->fqPl[0][k] = pthisSV->fqPl.q0;
+    pBatch->fqPl[1][k] = pthisSV->fqPl.q1;
+    pBatch->fqPl[2][k] = pthisSV->fqPl.q2;
+    pBatch->fqPl[3][k] = pthisSV->fqPl.q3;
+    pBatch->fDeltaPl[k] = pthisSV->fDeltaPl;
+    pBatch->fsinDeltaPl[k] = pthisSV->fsinDeltaPl;
+    pBatch->fcosDeltaPl[k] = pthisSV->fcosDeltaPl;
+    for (i = CHX; i <= CHZ; i++) {
+        pBatch->fqgErrPl[i][k] = pthisSV->fqgErrPl[i];
+        pBatch->fqmErrPl[i][k] = pthisSV->fqmErrPl[i];
+        pBatch->fbPl[i][k] = pthisSV->fbPl[i];
+        pBatch->fbErrPl[i][k] = pthisSV->fbErrPl[i];
+        pBatch->fVelGl[i][k] = pthisSV->fVelGl[i];
+        pBatch->fDisGl[i][k] = pthisSV->fDisGl[i];
+    }
+    pBatch->iFirstAccelMagLock[k] = pthisSV->iFirstAccelMagLock;
+    pBatch->iActive[k] = true;
+} // end fBatchSetLane_9DOF_GBY_KALMAN()
+
+// rotates the a priori orientation fqMi of every lane by the gyro FIFO, as fIntegrateGyroFIFO()
+static void fBatchIntegrateGyroFIFO(FusionBatch9DOF *pBatch)
+{
+    Quaternion ftmpq;           // incremental rotation quaternion computed exactly
+    float frvec[3];             // angular velocity (deg/s)
+    float fetadeg;              // rotation angle (deg)
+    float fetarad;              // rotation angle (rad)
+    float fetarad2;             // eta (rad)^2
+    float fetarad4;             // eta (rad)^4
+    float sinhalfeta;           // sin(eta/2)
+    float fvecsq;               // q1^2+q2^2+q3^2
+    float ftmp;                 // scratch
+    float fq0, fq1, fq2, fq3;   // product fqMi * fdq
+    int32_t iMaxCount;          // largest gyro FIFO count of the lanes
+    int32_t iExact;             // lanes needing sinf() for this measurement
+    int32_t iuse;               // lane has this measurement
+    int16_t k;                  // lane
+    int8_t i, j;                // loop counters
+
+    iMaxCount = 0;
+    for (k = 0; k < pBatch->iLanes; k++)
+        iMaxCount = (pBatch->iYCount[k] > iMaxCount) ? pBatch->iYCount[k] : iMaxCount;
+
+    for (j = 0; j < iMaxCount; j++) {
+        // the incremental rotation quaternion of each lane, by the MacLaurin series of fQuaternionFromRotationVectorDeg()
+        iExact = 0;
+        for (k = 0; k < pBatch->iLanes; k++) {
+            iuse = (j < pBatch->iYCount[k]);
+            frvec[CHX] = pBatch->fYs[j][CHX][k] - pBatch->fbPl[CHX][k];
+            frvec[CHY] = pBatch->fYs[j][CHY][k] - pBatch->fbPl[CHY][k];
+            frvec[CHZ] = pBatch->fYs[j][CHZ][k] - pBatch->fbPl[CHZ][k];
+            fetadeg = pBatch->fYInterval[k] * sqrtf(frvec[CHX] * frvec[CHX] + frvec[CHY] * frvec[CHY] + frvec[CHZ] * frvec[CHZ]);
+            fetarad = fetadeg * FPIOVER180;
+            fetarad2 = fetarad * fetarad;
+            fetarad4 = fetarad2 * fetarad2;
+            sinhalfeta = (fetarad2 <= 0.02F) ? fetarad * (0.5F - ONEOVER48 * fetarad2) :
+                         fetarad * (0.5F - ONEOVER48 * fetarad2 + ONEOVER3840 * fetarad4);
+            pBatch->iExactSine[k] = iuse & (fetarad2 > 0.06F);
+            iExact += pBatch->iExactSine[k];
+            ftmp = pBatch->fYInterval[k] * sinhalfeta / fetadeg;
+            ftmp = (fetadeg != 0.0F) ? ftmp : 0.0F;
+            pBatch->fdq[1][k] = iuse ? frvec[CHX] * ftmp : 0.0F;
+            pBatch->fdq[2][k] = iuse ? frvec[CHY] * ftmp : 0.0F;
+            pBatch->fdq[3][k] = iuse ? frvec[CHZ] * ftmp : 0.0F;
+            fvecsq = pBatch->fdq[1][k] * pBatch->fdq[1][k] + pBatch->fdq[2][k] * pBatch->fdq[2][k] +
+                     pBatch->fdq[3][k] * pBatch->fdq[3][k];
+            pBatch->fdq[0][k] = (fvecsq <= 1.0F) ? sqrtf(fabsf(1.0F - fvecsq)) : 0.0F;
+        }
+
+        // the rare rotations too large for the series
+        for (k = 0; (k < pBatch->iLanes) && iExact; k++) {
+            if (!pBatch->iExactSine[k]) continue;
+            for (i = CHX; i <= CHZ; i++) frvec[i] = pBatch->fYs[j][i][k] - pBatch->fbPl[i][k];
+            fQuaternionFromRotationVectorDeg(&ftmpq, frvec, pBatch->fYInterval[k]);
+            pBatch->fdq[0][k] = ftmpq.q0;
+            pBatch->fdq[1][k] = ftmpq.q1;
+            pBatch->fdq[2][k] = ftmpq.q2;
+            pBatch->fdq[3][k] = ftmpq.q3;
+            iExact--;
+        }
+
+        // fqMi = fqMi * fdq
+        for (k = 0; k < pBatch->iLanes; k++) {
+            fq0 = pBatch->fqMi[0][k] * pBatch->fdq[0][k] - pBatch->fqMi[1][k] * pBatch->fdq[1][k] -
+                  pBatch->fqMi[2][k] * pBatch->fdq[2][k] - pBatch->fqMi[3][k] * pBatch->fdq[3][k];
+            fq1 = pBatch->fqMi[0][k] * pBatch->fdq[1][k] + pBatch->fqMi[1][k] * pBatch->fdq[0][k] +
+                  pBatch->fqMi[2][k] * pBatch->fdq[3][k] - pBatch->fqMi[3][k] * pBatch->fdq[2][k];
+            fq2 = pBatch->fqMi[0][k] * pBatch->fdq[2][k] - pBatch->fqMi[1][k] * pBatch->fdq[3][k] +
+                  pBatch->fqMi[2][k] * pBatch->fdq[0][k] + pBatch->fqMi[3][k] * pBatch->fdq[1][k];
+            fq3 = pBatch->fqMi[0][k] * pBatch->fdq[3][k] + pBatch->fqMi[1][k] * pBatch->fdq[2][k] -
+                  pBatch->fqMi[2][k] * pBatch->fdq[1][k] + pBatch->fqMi[3][k] * pBatch->fdq[0][k];
+            pBatch->fqMi[0][k] = fq0;
+            pBatch->fqMi[1][k] = fq1;
+            pBatch->fqMi[2][k] = fq2;
+            pBatch->fqMi[3][k] = fq3;
+        }
+    }
+
+    return;
+} // end fBatchIntegrateGyroFIFO()
+
+// a priori estimates and measurement errors of every lane
+static void fBatchAPriori(FusionBatch9DOF *pBatch)
+{
+    float fRMi[3][3];           // a priori orientation matrix
+    float fR6DOF[3][3];         // eCompass orientation matrix
+    float fq6DOF[4];            // eCompass orientation quaternion
+    float fGc[3], fBc[3];       // accelerometer and magnetometer measurements
+    float fu[3], fv[3];         // the 6DOF and a priori vectors compared
+    float fqv[3];               // vector component of the rotation between them
+    float fDelta6DOF, fsinDelta6DOF, fcosDelta6DOF;
+    float fmodGc, fmodBc;       // moduli of the accelerometer and magnetometer measurements
+    int32_t ilock;              // first orientation lock after the first magnetic calibration
+    int16_t k;                  // lane
+    int8_t i, j;                // loop counters
+
+    for (k = 0; k < pBatch->iLanes; k++) {
+        fLaneRotationMatrixFromQuaternion(fRMi, pBatch->fqMi[0][k], pBatch->fqMi[1][k], pBatch->fqMi[2][k],
+                                          pBatch->fqMi[3][k]);
+        for (i = CHX; i <= CHZ; i++) {
+            fGc[i] = pBatch->fGc[i][k];
+            fBc[i] = pBatch->fBc[i][k];
+        }
+        fLaneeCompassNED(fR6DOF, &fDelta6DOF, &fsinDelta6DOF, &fcosDelta6DOF, fBc, fGc, &fmodBc, &fmodGc);
+        pBatch->fmodGc[k] = fmodGc;
+        pBatch->fmodBc[k] = fmodBc;
+
+        // the once-only orientation lock to the eCompass after the first valid magnetic calibration
+        ilock = pBatch->iValidMagCal[k] && !pBatch->iFirstAccelMagLock[k];
+        fLaneQuaternionFromRotationMatrix(fR6DOF, fq6DOF);
+        for (i = 0; i < 4; i++) pBatch->fqMi[i][k] = ilock ? fq6DOF[i] : pBatch->fqMi[i][k];
+        for (i = CHX; i <= CHZ; i++)
+            for (j = CHX; j <= CHZ; j++)
+                fRMi[i][j] = ilock ? fR6DOF[i][j] : fRMi[i][j];
+        pBatch->fDeltaPl[k] = ilock ? fDelta6DOF : pBatch->fDeltaPl[k];
+        pBatch->fsinDeltaPl[k] = ilock ? fsinDelta6DOF : pBatch->fsinDeltaPl[k];
+        pBatch->fcosDeltaPl[k] = ilock ? fcosDelta6DOF : pBatch->fcosDeltaPl[k];
+        pBatch->iFirstAccelMagLock[k] = ilock ? true : pBatch->iFirstAccelMagLock[k];
+
+        // gravity measurement error
+        for (i = CHX; i <= CHZ; i++) {
+            fu[i] = fR6DOF[i][CHZ];
+            fv[i] = pBatch->fgMi[i][k] = fRMi[i][CHZ];
+        }
+        fLaneVeqconjgquq(fqv, fu, fv);
+        for (i = CHX; i <= CHZ; i++) pBatch->fZErr[i][k] = fqv[i];
+
+        // geomagnetic measurement error
+        for (i = CHX; i <= CHZ; i++) {
+            fu[i] = fR6DOF[i][CHX] * fcosDelta6DOF + fR6DOF[i][CHZ] * fsinDelta6DOF;
+            fv[i] = pBatch->fmMi[i][k] = fRMi[i][CHX] * pBatch->fcosDeltaPl[k] + fRMi[i][CHZ] * pBatch->fsinDeltaPl[k];
+        }
+        fLaneVeqconjgquq(fqv, fu, fv);
+        for (i = CHX; i <= CHZ; i++) pBatch->fZErr[i + 3][k] = fqv[i];
+    }
+
+    return;
+} // end fBatchAPriori()
+
+// Kalman gain and a posteriori errors of every lane, computed per axis as fKalmanGain_9DOF_GBY_Block()
+static void fBatchKalmanUpdate(FusionBatch9DOF *pBatch)
+{
+    float fQvGQa;               // accelerometer noise covariance to 1g sphere
+    float fQvBQd;               // magnetometer noise covariance to geomagnetic sphere
+    float fQvG, fQvB;           // diagonal elements of Qv for gravity and geomagnetic measurements
+    float fh;                   // alpha / 2, the gyro offset coefficient in C
+    float fbb;                  // square of the gyro offset error
+    float fQgg, fQmm, fQbb;     // diagonal elements of Qw for one axis
+    float fQgb, fQmb;           // off diagonal elements of Qw for one axis
+    float fCTgg, fCTmg, fCTbg, fCTgm, fCTmm, fCTbm; // non-zero elements of Qw * C^T for one axis
+    float fS00, fS01, fS11;     // C * Qw * C^T + Qv for one axis
+    float fdet;                 // determinant of the 2x2 matrix
+    float finv00, finv01, finv11; // its inverse
+    float fqgErr[3], fqmErr[3], fbErr[3]; // new a posteriori errors
+    float ftmp;                 // scratch
+    int32_t isingular;          // any axis singular, giving a zero gain
+    int16_t k;                  // lane
+    int8_t i;                   // axis
+
+    for (k = 0; k < pBatch->iLanes; k++) {
+        ftmp = pBatch->fmodGc[k] - 1.0F;
+        fQvGQa = 3.0F * ftmp * ftmp;
+        fQvGQa = (fQvGQa < (float) FQVG_9DOF_GBY_KALMAN) ? (float) FQVG_9DOF_GBY_KALMAN : fQvGQa;
+        ftmp = pBatch->fmodBc[k] - pBatch->fB[k];
+        fQvBQd = 3.0F * ftmp * ftmp;
+        fQvBQd = (fQvBQd < (float) FQVB_9DOF_GBY_KALMAN) ? (float) FQVB_9DOF_GBY_KALMAN : fQvBQd;
+        fQvG = ONEOVER12 * fQvGQa + pBatch->fAlphaSqQvYQwbOver12[k];
+        fQvB = ONEOVER12 * fQvBQd / pBatch->fBSq[k] + pBatch->fAlphaSqQvYQwbOver12[k];
+
+        fh = pBatch->fAlphaOver2[k];
+        isingular = false;
+        for (i = CHX; i <= CHZ; i++) {
+            // Qw from the previous iteration's a posteriori errors
+            fbb = pBatch->fbErrPl[i][k] * pBatch->fbErrPl[i][k];
+            ftmp = pBatch->fAlphaSqOver4[k] * fbb + pBatch->fAlphaSqQvYQwbOver12[k];
+            fQgg = pBatch->fqgErrPl[i][k] * pBatch->fqgErrPl[i][k] + ftmp;
+            fQmm = pBatch->fqmErrPl[i][k] * pBatch->fqmErrPl[i][k] + ftmp;
+            fQbb = fbb + pBatch->fQwbOver3[k];
+            ftmp = pBatch->fAlphaOver2[k] * fQbb;
+            fQgb = pBatch->fqgErrPl[i][k] * pBatch->fbErrPl[i][k] - ftmp;
+            fQmb = pBatch->fqmErrPl[i][k] * pBatch->fbErrPl[i][k] - ftmp;
+
+            fCTgg = fQgg - fh * fQgb;
+            fCTmg = -fh * fQmb;
+            fCTbg = fQgb - fh * fQbb;
+            fCTgm = -fh * fQgb;
+            fCTmm = fQmm - fh * fQmb;
+            fCTbm = fQmb - fh * fQbb;
+
+            fS00 = fQvG + fCTgg - fh * fCTbg;
+            fS01 = fCTgm - fh * fCTbm;
+            fS11 = fQvB + fCTmm - fh * fCTbm;
+            fdet = fS00 * fS11 - fS01 * fS01;
+            isingular |= (fdet == 0.0F);
+            finv00 = 1.0F / fdet;
+            finv01 = -fS01 * finv00;
+            finv11 = fS00 * finv00;
+            finv00 *= fS11;
+
+            // errors = K * fZErr, with the two non-zero gains of each state on this axis
+            fqgErr[i] = (fCTgg * finv00 + fCTgm * finv01) * pBatch->fZErr[i][k] +
+                        (fCTgg * finv01 + fCTgm * finv11) * pBatch->fZErr[i + 3][k];
+            fqmErr[i] = (fCTmg * finv00 + fCTmm * finv01) * pBatch->fZErr[i][k] +
+                        (fCTmg * finv01 + fCTmm * finv11) * pBatch->fZErr[i + 3][k];
+            fbErr[i] = (fCTbg * finv00 + fCTbm * finv01) * pBatch->fZErr[i][k] +
+                       (fCTbg * finv01 + fCTbm * finv11) * pBatch->fZErr[i + 3][k];
+        }
+        for (i = CHX; i <= CHZ; i++) {
+            pBatch->fqgErrPl[i][k] = isingular ? 0.0F : fqgErr[i];
+            pBatch->fqmErrPl[i][k] = isingular ? 0.0F : fqmErr[i];
+            pBatch->fbErrPl[i][k] = isingular ? 0.0F : fbErr[i];
+        }
+    }
+
+    return;
+} // end fBatchKalmanUpdate()
+
+// a posteriori orientation, gyro offset, inertial outputs and Euler angles of every lane
+static void fBatchAPosteriori(FusionBatch9DOF *pBatch)
+{
+    float ftmpA3x3[3][3];       // tilt correction matrix
+    float fR[3][3];             // a posteriori orientation matrix
+    float fq[4];                // a posteriori orientation quaternion
+    float fgPl[3], fmPl[3];     // a posteriori gravity and geomagnetic vectors (sensor frame)
+    float fq1, fq2, fq3;        // tilt correction (conjugate) quaternion vector component
+    float fDelta, fsinDelta, fcosDelta;
+    float fmodGc, fmodBc;       // unused moduli
+    float fb;                   // gyro offset
+    float fmax;                 // maximum gyro offset change
+    float fPhi, fThe, fPsi;     // Euler angles (deg)
+    float fPsiUp, fPsiDown;     // yaw in the vertical upwards and downwards gimbal lock cases
+    int16_t k;                  // lane
+    int8_t i, j;                // loop counters
+
+    for (k = 0; k < pBatch->iLanes; k++) {
+        // rotate the a priori gravity vector by the gravity tilt correction
+        fq1 = -pBatch->fqgErrPl[CHX][k];
+        fq2 = -pBatch->fqgErrPl[CHY][k];
+        fq3 = -pBatch->fqgErrPl[CHZ][k];
+        fLaneRotationMatrixFromQuaternion(ftmpA3x3, sqrtf(fabsf(1.0F - fq1 * fq1 - fq2 * fq2 - fq3 * fq3)), fq1, fq2, fq3);
+        for (i = CHX; i <= CHZ; i++)
+            fgPl[i] = ftmpA3x3[i][CHX] * pBatch->fgMi[CHX][k] + ftmpA3x3[i][CHY] * pBatch->fgMi[CHY][k] +
+                      ftmpA3x3[i][CHZ] * pBatch->fgMi[CHZ][k];
+
+        // rotate the a priori geomagnetic vector by the geomagnetic tilt correction
+        fq1 = -pBatch->fqmErrPl[CHX][k];
+        fq2 = -pBatch->fqmErrPl[CHY][k];
+        fq3 = -pBatch->fqmErrPl[CHZ][k];
+        fLaneRotationMatrixFromQuaternion(ftmpA3x3, sqrtf(fabsf(1.0F - fq1 * fq1 - fq2 * fq2 - fq3 * fq3)), fq1, fq2, fq3);
+        for (i = CHX; i <= CHZ; i++)
+            fmPl[i] = ftmpA3x3[i][CHX] * pBatch->fmMi[CHX][k] + ftmpA3x3[i][CHY] * pBatch->fmMi[CHY][k] +
+                      ftmpA3x3[i][CHZ] * pBatch->fmMi[CHZ][k];
+
+        // the a posteriori orientation
+        fLaneeCompassNED(fR, &fDelta, &fsinDelta, &fcosDelta, fmPl, fgPl, &fmodBc, &fmodGc);
+        fLaneQuaternionFromRotationMatrix(fR, fq);
+        pBatch->fDeltaPl[k] = fDelta;
+        pBatch->fsinDeltaPl[k] = fsinDelta;
+        pBatch->fcosDeltaPl[k] = fcosDelta;
+        for (i = 0; i < 4; i++) pBatch->fqPl[i][k] = fq[i];
+        for (i = CHX; i <= CHZ; i++)
+            for (j = CHX; j <= CHZ; j++)
+                pBatch->fRPl[i][j][k] = fR[i][j];
+
+        // gyro offset, restricted to the random walk model and the specified limits
+        fmax = pBatch->fMaxGyroOffsetChange[k];
+        for (i = CHX; i <= CHZ; i++) {
+            fb = pBatch->fbPl[i][k];
+            fb = (pBatch->fbErrPl[i][k] > fmax) ? fb - fmax :
+                 ((pBatch->fbErrPl[i][k] < -fmax) ? fb + fmax : fb - pBatch->fbErrPl[i][k]);
+            fb = (fb > FMAX_9DOF_GBY_BPL) ? FMAX_9DOF_GBY_BPL : fb;
+            pBatch->fbPl[i][k] = (fb < FMIN_9DOF_GBY_BPL) ? FMIN_9DOF_GBY_BPL : fb;
+        }
+
+        // linear acceleration, velocity and displacement in the global frame (gravity positive NED)
+        for (i = CHX; i <= CHZ; i++)
+            pBatch->fAccGl[i][k] = fR[CHX][i] * pBatch->fGc[CHX][k] + fR[CHY][i] * pBatch->fGc[CHY][k] +
+                                   fR[CHZ][i] * pBatch->fGc[CHZ][k];
+        pBatch->fAccGl[CHX][k] = -pBatch->fAccGl[CHX][k];
+        pBatch->fAccGl[CHY][k] = -pBatch->fAccGl[CHY][k];
+        pBatch->fAccGl[CHZ][k] = -(pBatch->fAccGl[CHZ][k] - 1.0F);
+        for (i = CHX; i <= CHZ; i++) {
+            pBatch->fVelGl[i][k] += pBatch->fAccGl[i][k] * pBatch->fgdeltat[k];
+            pBatch->fDisGl[i][k] += pBatch->fVelGl[i][k] * pBatch->fdeltat[k];
+        }
+
+        // Euler angles, as fNEDAnglesDegFromRotationMatrix()
+        fThe = fLaneAsinDeg(-fR[CHX][CHZ]);
+        fPhi = fLaneAtan2Deg(fR[CHY][CHZ], fR[CHZ][CHZ]);
+        fPhi = (fPhi == 180.0F) ? -180.0F : fPhi;
+        fPsiUp = fLaneAtan2Deg(fR[CHZ][CHY], fR[CHY][CHY]) + fPhi;
+        fPsiDown = fLaneAtan2Deg(-fR[CHZ][CHY], fR[CHY][CHY]) - fPhi;
+        fPsi = fLaneAtan2Deg(fR[CHX][CHY], fR[CHX][CHX]);
+        fPsi = (fThe == 90.0F) ? fPsiUp : ((fThe == -90.0F) ? fPsiDown : fPsi);
+        fPsi = (fPsi < 0.0F) ? fPsi + 360.0F : fPsi;
+        pBatch->fPsiPl[k] = (fPsi >= 360.0F) ? 0.0F : fPsi;
+        pBatch->fPhiPl[k] = fPhi;
+        pBatch->fThePl[k] = fThe;
+        pBatch->fChiPl[k] = fLaneAcosDeg(fR[CHZ][CHZ]);
+    }
+
+    return;
+} // end fBatchAPosteriori()
+
+// writes the results of every lane that ran back to its state vector
+static void fBatchScatter(FusionBatch9DOF *pBatch)
+{
+    struct SV_9DOF_GBY_KALMAN *pthisSV;
+    int16_t k;                  // lane
+    int8_t i, j;                // loop counters
+
+    for (k = 0; k < pBatch->iLanes; k++) {
+        pBatch->iYCount[k] = 0;
+        if (!pBatch->iActive[k]) continue;
+        pthisSV = pBatch->pSV[k];
+        pthisSV->fqPl.q0 = pBatch->fqPl[0][k];
+        pthisSV->fqPl.q1 = pBatch->fqPl[1][k];
+        pthisSV->fqPl.q2 = pBatch->fqPl[2][k];
+        pthisSV->fqPl.q3 = pBatch->fqPl[3][k];
+        for (i = CHX; i <= CHZ; i++)
+            for (j = CHX; j <= CHZ; j++)
+                pthisSV->fRPl[i][j] = pBatch->fRPl[i][j][k];
+        pthisSV->fPhiPl = pBatch->fPhiPl[k];
+        pthisSV->fThePl = pBatch->fThePl[k];
+        pthisSV->fPsiPl = pthisSV->fRhoPl = pBatch->fPsiPl[k];
+        pthisSV->fChiPl = pBatch->fChiPl[k];
+        for (i = 0; i < 6; i++) pthisSV->fZErr[i] = pBatch->fZErr[i][k];
+        pthisSV->fDeltaPl = pBatch->fDeltaPl[k];
+        pthisSV->fsinDeltaPl = pBatch->fsinDeltaPl[k];
+        pthisSV->fcosDeltaPl = pBatch->fcosDeltaPl[k];
+        for (i = CHX; i <= CHZ; i++) {
+            pthisSV->fOmega[i] = pBatch->fOmega[i][k];
+            pthisSV->fqgErrPl[i] = pBatch->fqgErrPl[i][k];
+            pthisSV->fqmErrPl[i] = pBatch->fqmErrPl[i][k];
+            pthisSV->fbPl[i] = pBatch->fbPl[i][k];
+            pthisSV->fbErrPl[i] = pBatch->fbErrPl[i][k];
+            pthisSV->fAccGl[i] = pBatch->fAccGl[i][k];
+            pthisSV->fVelGl[i] = pBatch->fVelGl[i][k];
+            pthisSV->fDisGl[i] = pBatch->fDisGl[i][k];
+        }
+        pthisSV->iFirstAccelMagLock = pBatch->iFirstAccelMagLock[k];
+        fRotationVectorDegFromQuaternion(&(pthisSV->fqPl), pthisSV->fRVecPl);
+        fResetPrediction_9DOF_GBY_KALMAN(pthisSV);
+        pBatch->iActive[k] = false;
+    }
+
+    return;
+} // end fBatchScatter()
+
+void fBatchRun_9DOF_GBY_KALMAN(FusionBatch9DOF *pBatch)
+{
+    int16_t k;                  // lane
+    int8_t i;                   // loop counter
+
+    // average angular velocity from the gyro offset before this update, and the a priori orientation
+    for (k = 0; k < pBatch->iLanes; k++) {
+        for (i = CHX; i <= CHZ; i++) pBatch->fOmega[i][k] = pBatch->fYAvg[i][k] - pBatch->fbPl[i][k];
+        for (i = 0; i < 4; i++) pBatch->fqMi[i][k] = pBatch->fqPl[i][k];
+    }
+    fBatchIntegrateGyroFIFO(pBatch);
+    fBatchAPriori(pBatch);
+    fBatchKalmanUpdate(pBatch);
+    fBatchAPosteriori(pBatch);
+    fBatchScatter(pBatch);
+
+    return;
+} // end fBatchRun_9DOF_GBY_KALMAN()
+
+#endif // F_9DOF_GBY_KALMAN && (THISCOORDSYSTEM == NED)
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2020-2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file fusion_batch.h
+    \brief Batched 9DOF Kalman filter, advancing many fusion instances per call.
+
+    Reprocessing many sensor logs runs one SensorFusionGlobals per log, and
+    fRun_9DOF_GBY_KALMAN() works on one instance at a time. The batch holds the
+    inputs and filter state of up to FUSION_BATCH_LANES instances in
+    structure-of-arrays layout, one lane per instance, so that each step of the
+    filter is a loop over the lanes with the same arithmetic in every lane.
+    Branches are written as selects, and the compiler turns these loops into
+    SIMD instructions (SSE/AVX on a host built with -O3 and -march=native);
+    the rare lanes needing sinf() for a large gyro step are finished
+    separately. The same source builds without vectorization anywhere else.
+
+    Each instance keeps its own state in its SV_9DOF_GBY_KALMAN, exactly as
+    without the batch. Per fusion cycle, for every instance call
+    conditionSensorReadings() as usual, then fBatchSetLane_9DOF_GBY_KALMAN()
+    to gather its inputs and state into a lane, then
+    fBatchRun_9DOF_GBY_KALMAN() once for the whole batch, which scatters the
+    results back into each SV_9DOF_GBY_KALMAN in place of
+    fRun_9DOF_GBY_KALMAN(), and finally clearFIFOs() for every instance. The
+    results match fRun_9DOF_GBY_KALMAN() to within float rounding; the Kalman
+    gain is always computed per axis as with F_9DOF_GBY_BLOCK_GAIN, the gyro is
+    always integrated in float, and fQw9x9, fK9x6, fQwCT9x6 and fQv6x1 are not
+    written back.
+
+    Only the NED coordinate system is supported. A FusionBatch9DOF is large
+    (about 200 bytes per lane plus the gyro FIFOs), so allocate it on the heap.
+*/
+
+#ifndef FUSION_BATCH_H
+#define FUSION_BATCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "sensor_fusion.h"
+
+#if F_9DOF_GBY_KALMAN && (THISCOORDSYSTEM == NED)
+
+#ifndef FUSION_BATCH_LANES
+#define FUSION_BATCH_LANES      64      ///< maximum instances per batch, a multiple of the SIMD width
+#endif
+
+/// Inputs, state and working values of up to FUSION_BATCH_LANES 9DOF Kalman filters, each array indexed
+/// last by lane. Set up with fBatchInit_9DOF_GBY_KALMAN().
+typedef struct FusionBatch9DOF
+{
+	int16_t iLanes;                                 ///< lanes in use
+	struct SV_9DOF_GBY_KALMAN *pSV[FUSION_BATCH_LANES]; ///< instance in each lane, results written back here
+	int32_t iActive[FUSION_BATCH_LANES];            ///< lane runs this step (false if its filter was just reset)
+	// inputs
+	float fGc[3][FUSION_BATCH_LANES];               ///< calibrated accelerometer measurement (g)
+	float fBc[3][FUSION_BATCH_LANES];               ///< calibrated magnetometer measurement (uT)
+	float fB[FUSION_BATCH_LANES];                   ///< geomagnetic field magnitude (uT)
+	float fBSq[FUSION_BATCH_LANES];                 ///< square of fB (uT^2)
+	int32_t iValidMagCal[FUSION_BATCH_LANES];       ///< a magnetic calibration is in use
+	float fYs[GYRO_FIFO_SIZE][3][FUSION_BATCH_LANES]; ///< gyro FIFO measurements (deg/s)
+	int32_t iYCount[FUSION_BATCH_LANES];            ///< gyro FIFO measurements to integrate
+	float fYInterval[FUSION_BATCH_LANES];           ///< interval between gyro FIFO measurements (s)
+	float fYAvg[3][FUSION_BATCH_LANES];             ///< average gyro measurement (deg/s)
+	// per instance constants, see SV_9DOF_GBY_KALMAN
+	float fdeltat[FUSION_BATCH_LANES];
+	float fgdeltat[FUSION_BATCH_LANES];
+	float fAlphaOver2[FUSION_BATCH_LANES];
+	float fAlphaSqOver4[FUSION_BATCH_LANES];
+	float fAlphaSqQvYQwbOver12[FUSION_BATCH_LANES];
+	float fQwbOver3[FUSION_BATCH_LANES];
+	float fMaxGyroOffsetChange[FUSION_BATCH_LANES];
+	// filter state and results, see SV_9DOF_GBY_KALMAN
+	float fqPl[4][FUSION_BATCH_LANES];              ///< a posteriori orientation quaternion q0 to q3
+	float fRPl[3][3][FUSION_BATCH_LANES];
+	float fPhiPl[FUSION_BATCH_LANES];
+	float fThePl[FUSION_BATCH_LANES];
+	float fPsiPl[FUSION_BATCH_LANES];
+	float fChiPl[FUSION_BATCH_LANES];
+	float fOmega[3][FUSION_BATCH_LANES];
+	float fZErr[6][FUSION_BATCH_LANES];
+	float fDeltaPl[FUSION_BATCH_LANES];
+	float fsinDeltaPl[FUSION_BATCH_LANES];
+	float fcosDeltaPl[FUSION_BATCH_LANES];
+	float fqgErrPl[3][FUSION_BATCH_LANES];
+	float fqmErrPl[3][FUSION_BATCH_LANES];
+	float fbPl[3][FUSION_BATCH_LANES];
+	float fbErrPl[3][FUSION_BATCH_LANES];
+	float fAccGl[3][FUSION_BATCH_LANES];
+	float fVelGl[3][FUSION_BATCH_LANES];
+	float fDisGl[3][FUSION_BATCH_LANES];
+	int32_t iFirstAccelMagLock[FUSION_BATCH_LANES];
+	// working values of one step
+	float fqMi[4][FUSION_BATCH_LANES];              ///< a priori orientation quaternion
+	float fdq[4][FUSION_BATCH_LANES];               ///< incremental rotation quaternion
+	int32_t iExactSine[FUSION_BATCH_LANES];         ///< fdq needs sinf() for a large rotation
+	float fgMi[3][FUSION_BATCH_LANES];              ///< a priori gravity vector (sensor frame)
+	float fmMi[3][FUSION_BATCH_LANES];              ///< a priori geomagnetic vector (sensor frame)
+	float fmodGc[FUSION_BATCH_LANES];               ///< modulus of the accelerometer measurement (g)
+	float fmodBc[FUSION_BATCH_LANES];               ///< modulus of the magnetometer measurement (uT)
+} FusionBatch9DOF;
+
+/// Empties the batch and sets the number of lanes in use, at most FUSION_BATCH_LANES.
+void fBatchInit_9DOF_GBY_KALMAN(FusionBatch9DOF *pBatch, int16_t iLanes);
+/// Gathers the conditioned sensor readings and filter state of instance sfg into lane iLane. Call after
+/// conditionSensorReadings(). If the filter is due a reset, it is initialized here as by
+/// fRun_9DOF_GBY_KALMAN() and the lane does not run this step.
+void fBatchSetLane_9DOF_GBY_KALMAN(FusionBatch9DOF *pBatch, int16_t iLane, SensorFusionGlobals *sfg);
+/// Advances every lane set since the previous call by one step of the 9DOF Kalman filter, and writes the
+/// results back to their SV_9DOF_GBY_KALMAN as fRun_9DOF_GBY_KALMAN() would. Lanes not set are skipped.
+void fBatchRun_9DOF_GBY_KALMAN(FusionBatch9DOF *pBatch);
+
+#endif // F_9DOF_GBY_KALMAN && (THISCOORDSYSTEM == NED)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FUSION_BATCH_H
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2020-2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file fusion_snapshot.c
+    \brief Consistent snapshot of the fusion results for readers on other tasks.
+
+    See fusion_snapshot.h for a description of the publication scheme.
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "fusion_snapshot.h"    // Header for this .c file
+
+// stores one copy of the snapshot, word by word
+static void fSnapshotStoreCopy(uint32_t *pDst, const uint32_t *pSrc)
+{
+    uint16_t i;
+
+    for (i = 0; i < FUSION_SNAPSHOT_WORDS; i++)
+    {
+        __atomic_store_n(&pDst[i], pSrc[i], __ATOMIC_RELAXED);
+    }
+} // end fSnapshotStoreCopy()
+
+void FusionSnapshotReset(FusionSnapshotLatch *pLatch)
+{
+    memset(pLatch, 0, sizeof(FusionSnapshotLatch));
+} // end FusionSnapshotReset()
+
+void FusionSnapshotPublish(FusionSnapshotLatch *pLatch, const FusionSnapshot *pSnapshot)
+{
+    uint32_t iWords[FUSION_SNAPSHOT_WORDS] = {0};
+    uint32_t iSequence;
+
+    memcpy(iWords, pSnapshot, sizeof(FusionSnapshot));
+    iSequence = __atomic_load_n(&pLatch->iSequence, __ATOMIC_RELAXED);
+
+    // an odd sequence sends readers to copy 1 while copy 0 is written. the release store orders it after the
+    // writes of the previous publication to copy 1...
+    __atomic_store_n(&pLatch->iSequence, iSequence + 1, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    fSnapshotStoreCopy(pLatch->iCopy[0], iWords);
+
+    // ...and an even one sends them to the new copy 0 while copy 1 is brought up to date
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&pLatch->iSequence, iSequence + 2, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    fSnapshotStoreCopy(pLatch->iCopy[1], iWords);
+} // end FusionSnapshotPublish()
+
+uint32_t FusionSnapshotRead(const FusionSnapshotLatch *pLatch, FusionSnapshot *pSnapshot)
+{
+    uint32_t iWords[FUSION_SNAPSHOT_WORDS];
+    uint32_t iSequence;
+    const uint32_t *pCopy;
+    uint16_t i;
+
+    do
+    {
+        iSequence = __atomic_load_n(&pLatch->iSequence, __ATOMIC_ACQUIRE);
+        pCopy = pLatch->iCopy[iSequence & 1];
+        for (i = 0; i < FUSION_SNAPSHOT_WORDS; i++)
+        {
+            iWords[i] = __atomic_load_n(&pCopy[i], __ATOMIC_RELAXED);
+        }
+        // the copy is consistent if the writer did not move on to overwrite it meanwhile
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (iSequence != __atomic_load_n(&pLatch->iSequence, __ATOMIC_RELAXED));
+
+    memcpy(pSnapshot, iWords, sizeof(FusionSnapshot));
+    return iSequence >> 1;
+} // end FusionSnapshotRead()
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2020-2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file fusion_snapshot.h
+    \brief Consistent snapshot of the fusion results for readers on other tasks.
+
+    The fusion loop rewrites the SV_9DOF_GBY_KALMAN fields one at a time, so a
+    task on the other ESP32 core that reads heading, pitch and roll while
+    RunFusion() executes may combine values from two different cycles. Instead,
+    once per cycle the fusion loop publishes a FusionSnapshot, and readers take
+    a copy of the latest complete one.
+
+    Publication uses a sequence counter and two copies of the snapshot (a
+    "latched" seqlock). While the writer updates one copy, readers are directed
+    to the other, so neither side ever waits: the writer never blocks, and a
+    reader only repeats its copy if a whole half of a publication completed
+    while it was reading, i.e. if it was preempted for about a fusion period.
+    This also holds when a higher priority reader preempts the writer on the
+    same core, where an ordinary seqlock reader would spin forever.
+
+    There may be any number of readers but only one writer. All fields are
+    copied as 32 bit words with atomic loads and stores, so the scheme is free
+    of data races under the C11 memory model.
+*/
+
+#ifndef FUSION_SNAPSHOT_H
+#define FUSION_SNAPSHOT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "orientation.h"
+
+/// Fusion results of one cycle, in the conventions of the SensorFusion Get___() methods:
+/// heading 0 at magnetic north and increasing clockwise, pitch positive bow up, roll positive
+/// to starboard, X to the bow, Y to port and Z up.
+typedef struct FusionSnapshot
+{
+	Quaternion fqPl;                ///< orientation quaternion
+	float fHeadingDeg;              ///< compass heading (deg)
+	float fPitchDeg;                ///< pitch (deg)
+	float fRollDeg;                 ///< roll (deg)
+	float fTurnRateDegPerS;         ///< turn rate, positive to starboard (deg/s)
+	float fPitchRateDegPerS;        ///< pitch rate, positive bow moving up (deg/s)
+	float fRollRateDegPerS;         ///< roll rate, positive with increasing starboard heel (deg/s)
+	float fAccelGees[3];            ///< X, Y, Z acceleration (g)
+	uint32_t iTimestamp;            ///< systick (us) at the read of the newest gyro measurement fused
+	int32_t iLoopcounter;           ///< sfg->loopcounter of this cycle
+	int32_t iStatus;                ///< fusion_status_t at the end of this cycle
+	int32_t iValid;                 ///< non-zero if iStatus was NORMAL
+} FusionSnapshot;
+
+/// number of 32 bit words in a FusionSnapshot
+#define FUSION_SNAPSHOT_WORDS   ((sizeof(FusionSnapshot) + 3) / 4)
+
+/// The published snapshot. Only access through the functions below.
+typedef struct FusionSnapshotLatch
+{
+	uint32_t iSequence;                             ///< incremented before writing each copy
+	uint32_t iCopy[2][FUSION_SNAPSHOT_WORDS];       ///< copy[iSequence & 1] is complete
+} FusionSnapshotLatch;
+
+/// Clears the latch, so that FusionSnapshotRead() returns 0 until the first publication.
+void FusionSnapshotReset(FusionSnapshotLatch *pLatch);
+/// Publishes *pSnapshot. Must only be called from one task, but never waits for readers.
+void FusionSnapshotPublish(FusionSnapshotLatch *pLatch, const FusionSnapshot *pSnapshot);
+/// Copies the latest complete publication into *pSnapshot and returns the number of
+/// publications made so far (0, with *pSnapshot zeroed, if none). May be called from any task.
+uint32_t FusionSnapshotRead(const FusionSnapshotLatch *pLatch, FusionSnapshot *pSnapshot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FUSION_SNAPSHOT_H
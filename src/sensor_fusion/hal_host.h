@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2020 Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file hal_host.h
+    \brief Hardware Abstraction Layer (HAL) for running on a host computer
+
+    When SENSOR_FUSION_HOST is defined (see the [env:native] section of
+    platformio.ini), the Arduino-specific HAL files are replaced by host
+    equivalents so that the unchanged fusion, magnetic calibration and matrix
+    code can be built and profiled on a workstation. This file declares the
+    additional hooks that the host backends provide:
+    - a virtual clock, which can be injected in place of the wall clock so that
+      SystickStartCount() and friends return deterministic times;
+    - pluggable I2C endpoints, which stand in for physical sensor ICs on the bus;
+    - a file-backed replacement for the EEPROM used by calibration_storage.cc;
+    - a minimal Stream class, used by the control subsystem for serial I/O.
+*/
+
+#ifndef HAL_HOST_H
+#define HAL_HOST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @name Host Clock
+/// By default the host timer functions use the monotonic wall clock. Installing
+/// a different clock function (e.g. HostVirtualClockMicros) makes all HAL timing
+/// follow that clock instead. SystickDelayMillis() advances the virtual clock
+/// rather than sleeping when the virtual clock is installed. HostThreadClock*
+/// is a virtual clock of which each thread has its own, for fusion instances
+/// replaying or simulating independently in parallel threads.
+///@{
+typedef uint32_t (hostClock_t) (void);      ///< returns current time in microseconds
+void HostTimerInstallClock(hostClock_t *clock);    ///< pass NULL to restore the wall clock
+uint32_t HostWallClockMicros(void);
+uint32_t HostVirtualClockMicros(void);
+void HostVirtualClockSet(uint32_t micros);
+void HostVirtualClockAdvance(uint32_t micros);
+uint32_t HostThreadClockMicros(void);
+void HostThreadClockSet(uint32_t micros);
+void HostThreadClockAdvance(uint32_t micros);
+///@}
+
+/// @name Host I2C Bus
+/// Each simulated I2C device is described by a HostI2CEndpoint and attached to
+/// the bus. Transfers to an address with no endpoint attached fail, just as
+/// they would on a real bus with nothing connected.
+///@{
+typedef bool (hostI2CRead_t) (void *context, uint8_t reg, uint8_t *destination, int num_bytes);
+typedef bool (hostI2CWrite_t) (void *context, uint8_t reg, const uint8_t *value, unsigned int num_bytes);
+
+typedef struct HostI2CEndpoint {
+    uint8_t address;                    ///< 7 bit I2C address the endpoint responds to
+    void *context;                      ///< passed unchanged to read() and write()
+    hostI2CRead_t *read;                ///< called for register reads (auto-increment is up to the endpoint)
+    hostI2CWrite_t *write;              ///< called for register writes
+    struct HostI2CEndpoint *next;       ///< pointer to next endpoint on the bus
+} HostI2CEndpoint;
+
+bool HostI2CAttachEndpoint(HostI2CEndpoint *endpoint);
+void HostI2CDetachEndpoint(HostI2CEndpoint *endpoint);
+///@}
+
+/// @name Host Non-Volatile Memory
+/// Calibrations are kept in a file. With no file set, NVM contents live only
+/// in RAM for the life of the process.
+///@{
+void HostNvmSetFile(const char *path);
+///@}
+
+#ifdef __cplusplus
+}
+
+/// Replacement for the subset of the ESP32 EEPROM library that is used by
+/// calibration_storage.cc. Erased bytes read as 0xFF, as on real flash.
+class HostEeprom {
+ public:
+  bool begin(size_t size);
+  uint8_t read(int address);
+  size_t readBytes(int address, void *value, size_t max_len);
+  uint8_t *getDataPtr(void);
+  bool commit(void);
+  void end(void);
+};
+extern HostEeprom EEPROM;
+
+/// Replacement for the Arduino Stream class, writing to and reading from
+/// stdio FILE streams. Either stream may be NULL.
+class Stream {
+ public:
+  explicit Stream(FILE *out = NULL, FILE *in = NULL) : out_(out), in_(in) {}
+  int available(void);
+  int availableForWrite(void);
+  int read(void);
+  size_t write(const uint8_t *buffer, size_t size);
+ private:
+  FILE *out_;
+  FILE *in_;
+};
+#endif  // __cplusplus
+
+#endif  // HAL_HOST_H
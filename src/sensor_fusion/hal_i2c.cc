@@ -19,12 +19,16 @@
  *  for reading and writing data from/to sensor using I2C.
  */
 
+#ifndef SENSOR_FUSION_HOST
 #include "Arduino.h"
 #include <Wire.h>
+#endif
+#include <stddef.h>
 #include "driver_sensors_types.h"
 #include "hal_i2c.h"
 
 
+#ifndef SENSOR_FUSION_HOST  // host versions of the I2C*() functions are in hal_i2c_host.cc
 /**************************************************************************/
 /*!
     @brief  Initialize the I2C system at max clock rate supported by sensors.
@@ -132,6 +136,7 @@ bool I2CWriteBytes(byte address, byte reg, const byte *value,
     return false;
   }
 } // end I2CWriteBytes()
+#endif  // SENSOR_FUSION_HOST
 
 /*
 Call sequence is:
@@ -207,7 +212,7 @@ int32_t Sensor_I2C_Read_Register(registerDeviceInfo_t *devInfo,
                           uint8_t length,
                           uint8_t *pOutBuffer) {
   //TODO - can toss the devInfo parameter, or use it for peripheralAddr
-  if(I2CReadBytes((byte)peripheralAddress, (byte)offset, pOutBuffer,
+  if(I2CReadBytes((uint8_t)peripheralAddress, offset, pOutBuffer,
                       (int)length) )
   { return SENSOR_ERROR_NONE;
   } else
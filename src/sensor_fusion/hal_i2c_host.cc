@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2020 Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/**
+ * @file hal_i2c_host.cc
+ * @brief Host replacement for the Wire-based I2C*() functions in hal_i2c.cc
+ *
+ * The host has no I2C bus, so transfers are routed to whichever
+ * HostI2CEndpoint has been attached at the requested address. The
+ * register-list functions (Sensor_I2C_Read() etc.) in hal_i2c.cc are
+ * shared with the Arduino build and sit on top of these.
+ */
+#ifdef SENSOR_FUSION_HOST
+
+#include <stddef.h>
+
+#include "driver_sensors_types.h"
+#include "hal_host.h"
+#include "hal_i2c.h"
+
+static HostI2CEndpoint *endpoint_list = NULL;  // head of list of attached endpoints
+
+// find the endpoint responding to address. Returns NULL if none attached.
+static HostI2CEndpoint *FindEndpoint(uint8_t address) {
+  for (HostI2CEndpoint *pEndpoint = endpoint_list; pEndpoint != NULL;
+       pEndpoint = pEndpoint->next) {
+    if (pEndpoint->address == address) {
+      return pEndpoint;
+    }
+  }
+  return NULL;
+}  // end FindEndpoint()
+
+/**************************************************************************/
+/*!
+    @brief  Attach a simulated device to the host I2C bus.
+    Returns false if endpoint is invalid or its address is already in use.
+*/
+/**************************************************************************/
+bool HostI2CAttachEndpoint(HostI2CEndpoint *endpoint) {
+  if ((NULL == endpoint) || (NULL != FindEndpoint(endpoint->address))) {
+    return false;
+  }
+  endpoint->next = endpoint_list;
+  endpoint_list = endpoint;
+  return true;
+}  // end HostI2CAttachEndpoint()
+
+/**************************************************************************/
+/*!
+    @brief  Remove a simulated device from the host I2C bus.
+*/
+/**************************************************************************/
+void HostI2CDetachEndpoint(HostI2CEndpoint *endpoint) {
+  for (HostI2CEndpoint **ppEndpoint = &endpoint_list; *ppEndpoint != NULL;
+       ppEndpoint = &((*ppEndpoint)->next)) {
+    if (*ppEndpoint == endpoint) {
+      *ppEndpoint = endpoint->next;
+      endpoint->next = NULL;
+      return;
+    }
+  }
+}  // end HostI2CDetachEndpoint()
+
+/**************************************************************************/
+/*!
+    @brief  Initialize the host I2C bus. Pin numbers are ignored.
+    Always succeeds; a missing device shows up later as a failed transfer.
+*/
+/**************************************************************************/
+bool I2CInitialize(int pin_sda, int pin_scl) {
+  (void)pin_sda;
+  (void)pin_scl;
+  return true;
+}  // end I2CInitialize()
+
+bool I2CReadByte(uint8_t address, uint8_t reg, uint8_t *destination) {
+  return I2CReadBytes(address, reg, destination, 1);
+}  // end I2CReadByte()
+
+bool I2CReadBytes(uint8_t address, uint8_t reg, uint8_t *destination,
+                  int num_bytes) {
+  if (NULL == destination) {
+    return false;
+  }
+  HostI2CEndpoint *pEndpoint = FindEndpoint(address);
+  if ((NULL == pEndpoint) || (NULL == pEndpoint->read)) {
+    return false;
+  }
+  return pEndpoint->read(pEndpoint->context, reg, destination, num_bytes);
+}  // end I2CReadBytes()
+
+bool I2CWriteByte(uint8_t address, uint8_t reg, uint8_t value) {
+  return I2CWriteBytes(address, reg, &value, 1);
+}  // end I2CWriteByte()
+
+bool I2CWriteBytes(uint8_t address, uint8_t reg, const uint8_t *value,
+                   unsigned int num_bytes) {
+  HostI2CEndpoint *pEndpoint = FindEndpoint(address);
+  if ((NULL == pEndpoint) || (NULL == pEndpoint->write)) {
+    return false;
+  }
+  return pEndpoint->write(pEndpoint->context, reg, value, num_bytes);
+}  // end I2CWriteBytes()
+
+#endif  // SENSOR_FUSION_HOST
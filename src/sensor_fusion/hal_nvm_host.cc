@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2020 Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file hal_nvm_host.cc
+    \brief Host replacements for the Arduino EEPROM and Stream classes
+
+    EEPROM contents are held in RAM between begin() and end(), and are
+    written to the file set by HostNvmSetFile() on commit(). The file is
+    re-read on each begin(), so separate processes (or a simulated reboot)
+    see previously committed calibrations. As the flash of a board, the
+    EEPROM is shared by all fusion instances; begin() and commit() are
+    serialized so that instances in parallel threads may call them.
+*/
+#ifdef SENSOR_FUSION_HOST
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <mutex>
+
+#include "hal_host.h"
+
+#define HOST_NVM_MAX_PATH 256
+
+HostEeprom EEPROM;
+
+static char nvm_path[HOST_NVM_MAX_PATH] = "";
+static uint8_t *nvm_data = NULL;
+static size_t nvm_size = 0;
+static std::mutex nvm_mutex;
+
+void HostNvmSetFile(const char *path) {
+  if (NULL == path) {
+    nvm_path[0] = '\0';
+  } else {
+    strncpy(nvm_path, path, HOST_NVM_MAX_PATH - 1);
+    nvm_path[HOST_NVM_MAX_PATH - 1] = '\0';
+  }
+}  // end HostNvmSetFile()
+
+bool HostEeprom::begin(size_t size) {
+  std::lock_guard<std::mutex> lock(nvm_mutex);
+  if (size != nvm_size) {
+    uint8_t *resized = (uint8_t *)realloc(nvm_data, size);
+    if (NULL == resized) {
+      return false;
+    }
+    if (size > nvm_size) {
+      memset(resized + nvm_size, 0xFF, size - nvm_size);  // erased flash
+    }
+    nvm_data = resized;
+    nvm_size = size;
+  }
+  if ('\0' != nvm_path[0]) {
+    FILE *fp = fopen(nvm_path, "rb");
+    if (NULL != fp) {
+      size_t bytes_read = fread(nvm_data, 1, nvm_size, fp);
+      if (bytes_read < nvm_size) {
+        memset(nvm_data + bytes_read, 0xFF, nvm_size - bytes_read);
+      }
+      fclose(fp);
+    }
+  }
+  return true;
+}  // end begin()
+
+uint8_t HostEeprom::read(int address) {
+  if ((address < 0) || ((size_t)address >= nvm_size)) {
+    return 0;
+  }
+  return nvm_data[address];
+}  // end read()
+
+size_t HostEeprom::readBytes(int address, void *value, size_t max_len) {
+  if ((NULL == value) || (address < 0) || ((size_t)address + max_len > nvm_size)) {
+    return 0;
+  }
+  memcpy(value, nvm_data + address, max_len);
+  return max_len;
+}  // end readBytes()
+
+uint8_t *HostEeprom::getDataPtr(void) {
+  return nvm_data;
+}  // end getDataPtr()
+
+bool HostEeprom::commit(void) {
+  std::lock_guard<std::mutex> lock(nvm_mutex);
+  if ('\0' == nvm_path[0]) {
+    return true;  // RAM-only NVM
+  }
+  FILE *fp = fopen(nvm_path, "wb");
+  if (NULL == fp) {
+    return false;
+  }
+  bool success = (fwrite(nvm_data, 1, nvm_size, fp) == nvm_size);
+  if (0 != fclose(fp)) {
+    success = false;
+  }
+  return success;
+}  // end commit()
+
+void HostEeprom::end(void) {
+  // contents are retained in RAM so that a file-less NVM survives end()
+}  // end end()
+
+int Stream::available(void) {
+  if (NULL == in_) {
+    return 0;
+  }
+  int c = fgetc(in_);
+  if (EOF == c) {
+    clearerr(in_);
+    return 0;
+  }
+  ungetc(c, in_);
+  return 1;
+}  // end available()
+
+int Stream::availableForWrite(void) {
+  return (NULL == out_) ? 0 : 0x7f;  // same as the ESP32 UART FIFO
+}  // end availableForWrite()
+
+int Stream::read(void) {
+  if (NULL == in_) {
+    return -1;
+  }
+  int c = fgetc(in_);
+  return (EOF == c) ? -1 : c;
+}  // end read()
+
+size_t Stream::write(const uint8_t *buffer, size_t size) {
+  if (NULL == out_) {
+    return size;  // discard, like a serial port with nothing attached
+  }
+  return fwrite(buffer, 1, size, out_);
+}  // end write()
+
+#endif  // SENSOR_FUSION_HOST
@@ -1,3 +1,4 @@
+#ifndef SENSOR_FUSION_HOST  // host version is in hal_timer_host.c
 #include <Arduino.h>
 #include <stdint.h>
 
@@ -25,3 +26,5 @@ int32_t SystickElapsedMicros(int32_t start_ticks) {
 void SystickDelayMillis(uint32_t delay_ms) {
   delay(delay_ms);
 }  // end SystickDelayMillis()
+
+#endif  // SENSOR_FUSION_HOST
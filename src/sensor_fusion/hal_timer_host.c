@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2020 Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file hal_timer_host.c
+    \brief Host (Linux/macOS) replacement for hal_timer.c
+
+    Timing is taken from an installable clock function so that benchmarks can
+    use the real monotonic clock while simulations and replays use a virtual
+    clock that only moves when told to. The virtual clock may be advanced by
+    one thread while others read it, as in the pipelined sensor reads. The
+    thread clock is a virtual clock of which each thread has its own copy, for
+    independent simulations or replays running in parallel threads.
+*/
+#ifdef SENSOR_FUSION_HOST
+
+#include <stdint.h>
+#include <time.h>
+
+#include "hal_host.h"
+#include "hal_timer.h"
+
+static hostClock_t *host_clock = HostWallClockMicros;
+static uint32_t virtual_micros = 0;
+static _Thread_local uint32_t thread_micros = 0;
+
+void HostTimerInstallClock(hostClock_t *clock) {
+  host_clock = (NULL == clock) ? HostWallClockMicros : clock;
+}  // end HostTimerInstallClock()
+
+uint32_t HostWallClockMicros(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  // wraps every ~71 minutes, exactly as micros() does on the ESP devices
+  return (uint32_t)((uint64_t)now.tv_sec * 1000000U + (uint64_t)now.tv_nsec / 1000U);
+}  // end HostWallClockMicros()
+
+uint32_t HostVirtualClockMicros(void) {
+  return __atomic_load_n(&virtual_micros, __ATOMIC_RELAXED);
+}  // end HostVirtualClockMicros()
+
+void HostVirtualClockSet(uint32_t micros) {
+  __atomic_store_n(&virtual_micros, micros, __ATOMIC_RELAXED);
+}  // end HostVirtualClockSet()
+
+void HostVirtualClockAdvance(uint32_t micros) {
+  __atomic_fetch_add(&virtual_micros, micros, __ATOMIC_RELAXED);
+}  // end HostVirtualClockAdvance()
+
+uint32_t HostThreadClockMicros(void) {
+  return thread_micros;
+}  // end HostThreadClockMicros()
+
+void HostThreadClockSet(uint32_t micros) {
+  thread_micros = micros;
+}  // end HostThreadClockSet()
+
+void HostThreadClockAdvance(uint32_t micros) {
+  thread_micros += micros;
+}  // end HostThreadClockAdvance()
+
+void SystickStartCount(int32_t *pstart) {
+  // same signed/unsigned convention as the Arduino version in hal_timer.c
+  *pstart = (int32_t)host_clock();
+}  // end SystickStartCount()
+
+int32_t SystickElapsedMicros(int32_t start_ticks) {
+  return (int32_t)(host_clock() - (uint32_t)start_ticks);
+}  // end SystickElapsedMicros()
+
+void SystickDelayMillis(uint32_t delay_ms) {
+  if (host_clock == HostVirtualClockMicros) {
+    HostVirtualClockAdvance(delay_ms * 1000U);
+  } else if (host_clock == HostThreadClockMicros) {
+    HostThreadClockAdvance(delay_ms * 1000U);
+  } else {
+    struct timespec delay;
+    delay.tv_sec = delay_ms / 1000U;
+    delay.tv_nsec = (long)(delay_ms % 1000U) * 1000000L;
+    nanosleep(&delay, NULL);
+  }
+}  // end SystickDelayMillis()
+
+#endif  // SENSOR_FUSION_HOST
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2020-2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file mag_cal_worker.c
+    \brief Magnetic calibration solved by a background task, off the fusion loop.
+
+    See mag_cal_worker.h for a description of the worker.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sensor_fusion.h"
+#include "magnetic.h"
+#include "mag_cal_worker.h"     // Header for this .c file
+
+// copies the results of a solved calibration, and the state it carries to the next calibration, from the
+// worker's copy of the calibration to the fusion task's
+static void fMagCalWorkerCollect(struct MagCalibration *pthisMagCal, const struct MagCalibration *pSolved)
+{
+    int8_t i, j;
+
+    for (i = CHX; i <= CHZ; i++)
+    {
+        pthisMagCal->ftrV[i] = pSolved->ftrV[i];
+        for (j = CHX; j <= CHZ; j++)
+        {
+            pthisMagCal->ftrinvW[i][j] = pSolved->ftrinvW[i][j];
+            pthisMagCal->fA[i][j] = pSolved->fA[i][j];
+            pthisMagCal->finvA[i][j] = pSolved->finvA[i][j];
+        }
+    }
+    pthisMagCal->ftrB = pSolved->ftrB;
+    pthisMagCal->ftrFitErrorpc = pSolved->ftrFitErrorpc;
+#if F_WARM_START_EIGEN
+    for (i = 0; i < 10; i++)
+        for (j = 0; j < 10; j++)
+            pthisMagCal->fmatV[i][j] = pSolved->fmatV[i][j];
+    pthisMagCal->iWarmStartSize = pSolved->iWarmStartSize;
+#endif
+    pthisMagCal->iEigenSweeps = pSolved->iEigenSweeps;
+    pthisMagCal->iCalSlices = pSolved->iCalSlices;
+    pthisMagCal->iNewCalibrationAvailable = pSolved->iNewCalibrationAvailable;
+} // end fMagCalWorkerCollect()
+
+void MagCalWorkerInit(MagCalWorker *pWorker)
+{
+    fInitializeCalibrationScratch(&(pWorker->CalScratch));
+    pWorker->MagCal.pScratch = &(pWorker->CalScratch);
+    pWorker->MagCal.pWorker = NULL;
+    pWorker->MagCal.iCalInProgress = 0;
+    pWorker->iRequested = 0;
+    pWorker->iCompleted = 0;
+    pWorker->iSubmitted = 0;
+} // end MagCalWorkerInit()
+
+void MagCalWorkerExchange(MagCalWorker *pWorker, struct MagCalibration *pthisMagCal,
+                          struct MagBuffer *pthisMagBuffer, struct MagSensor *pthisMag)
+{
+    // collect the job once solved, unless it has been cancelled since it was submitted
+    if (pWorker->iSubmitted &&
+        (__atomic_load_n(&pWorker->iCompleted, __ATOMIC_ACQUIRE) == pWorker->iRequested))
+    {
+        if (pWorker->iSubmitted == pthisMagCal->iCalInProgress)
+        {
+            fMagCalWorkerCollect(pthisMagCal, &(pWorker->MagCal));
+            pthisMagCal->iCalInProgress = 0;
+        }
+        pWorker->iSubmitted = 0;
+    }
+
+    // submit the calibration in progress once the worker is free. the worker solves its own copies, and the
+    // calibration starts at its first time slice there
+    if (pthisMagCal->iCalInProgress && !pWorker->iSubmitted)
+    {
+        pWorker->MagCal = *pthisMagCal;
+        pWorker->MagCal.pScratch = &(pWorker->CalScratch);
+        pWorker->MagCal.pWorker = NULL;
+        pWorker->MagCal.iScratchLease = 0;
+        pWorker->MagCal.iInitiateMagCal = pthisMagCal->iCalInProgress;
+        pWorker->MagBuffer = *pthisMagBuffer;
+        pWorker->Mag = *pthisMag;
+        pWorker->iSubmitted = pthisMagCal->iCalInProgress;
+        __atomic_store_n(&pWorker->iRequested, pWorker->iRequested + 1, __ATOMIC_RELEASE);
+    }
+} // end MagCalWorkerExchange()
+
+void MagCalWorkerCancel(MagCalWorker *pWorker)
+{
+    if (pWorker->iSubmitted) pWorker->iSubmitted = MAGCALWORKER_CANCELLED;
+} // end MagCalWorkerCancel()
+
+bool MagCalWorkerRun(MagCalWorker *pWorker)
+{
+    struct MagCalibration *pMagCal = &(pWorker->MagCal);
+    uint32_t iCompleted = pWorker->iCompleted;
+
+    if (__atomic_load_n(&pWorker->iRequested, __ATOMIC_ACQUIRE) == iCompleted)
+        return false;
+
+    // run the time slices of the solver back to back. each solver clears iCalInProgress on completion
+    pMagCal->iCalSlices = 0;
+    while (pMagCal->iCalInProgress)
+    {
+        (pMagCal->iCalSlices)++;
+        switch (pMagCal->iCalInProgress)
+        {
+            case 4:
+                fUpdateMagCalibration4Slice(pMagCal, &(pWorker->MagBuffer), &(pWorker->Mag));
+                break;
+
+            case 7:
+                fUpdateMagCalibration7Slice(pMagCal, &(pWorker->MagBuffer), &(pWorker->Mag));
+                break;
+
+            case 10:
+                fUpdateMagCalibration10Slice(pMagCal, &(pWorker->MagBuffer), &(pWorker->Mag));
+                break;
+
+            default:
+                pMagCal->iCalInProgress = 0;
+                break;
+        }
+    }
+
+    __atomic_store_n(&pWorker->iCompleted, iCompleted + 1, __ATOMIC_RELEASE);
+    return true;
+} // end MagCalWorkerRun()
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2020-2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file mag_cal_worker.h
+    \brief Magnetic calibration solved by a background task, off the fusion loop.
+
+    Normally fRunMagCalibration() spreads each calibration over many fusion
+    cycles, one or more time slices per cycle, and the magnetic buffer is read
+    only while the solver sums it. With a MagCalWorker attached to the
+    MagCalibration, fRunMagCalibration() instead copies the magnetic buffer,
+    the magnetometer and the calibration state into the worker when a
+    calibration starts, and a low priority worker task calling
+    MagCalWorkerRun() solves the copy from start to finish. The worker runs
+    the same 4, 7 and 10 element solvers, back to back rather than one slice
+    per cycle, so it computes exactly the calibration that the time slices
+    would have for the same buffer. It has its own calibration scratch
+    matrices, so never waits for the precision accelerometer calibration.
+
+    At the start of a later cycle fRunMagCalibration() collects the trial
+    calibration and accepts or rejects it as usual, so fV, finvW and fB only
+    ever change between the fusion cycles of the fusion task. Meanwhile the
+    magnetic buffer keeps taking new readings, and calibrations are started
+    every BACKGROUND_CAL_INTERVAL_SECS rather than CAL_INTERVAL_SECS.
+
+    There is one job at a time, one submitter (the fusion task) and one
+    solver (the worker task), and no locks: each side only writes its own
+    counter, with release/acquire ordering, and the worker only touches the
+    copies while a job is outstanding. On a dual core ESP32 put the worker
+    task on the other core from the fusion.
+*/
+
+#ifndef MAG_CAL_WORKER_H
+#define MAG_CAL_WORKER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "sensor_fusion.h"
+
+#define MAGCALWORKER_CANCELLED  -1      ///< iSubmitted of a job whose result is to be discarded
+
+/// State of the background magnetic calibration. Set up with MagCalWorkerInit().
+typedef struct MagCalWorker
+{
+	struct MagCalibration MagCal;           ///< calibration solved by the worker task
+	struct MagBuffer MagBuffer;             ///< copy of the magnetic buffer it is solved from
+	struct MagSensor Mag;                   ///< copy of the magnetometer state
+	struct CalibrationScratch CalScratch;   ///< scratch matrices of the worker's solvers
+	uint32_t iRequested;                    ///< jobs submitted; written only by the fusion task
+	uint32_t iCompleted;                    ///< jobs solved; written only by the worker task
+	int8_t iSubmitted;                      ///< solver of the job not yet collected, 0 if none; fusion task only
+} MagCalWorker;
+
+/// Prepares the worker. Attach it by setting the pWorker of a MagCalibration, from the fusion task.
+void MagCalWorkerInit(MagCalWorker *pWorker);
+/// Fusion task, from fRunMagCalibration(): collects a solved job into pthisMagCal, then submits the
+/// calibration in progress in pthisMagCal, if it has not been yet, once the worker is free.
+void MagCalWorkerExchange(MagCalWorker *pWorker, struct MagCalibration *pthisMagCal,
+                          struct MagBuffer *pthisMagBuffer, struct MagSensor *pthisMag);
+/// Fusion task: discards the result of the job outstanding, if any, when it is collected.
+void MagCalWorkerCancel(MagCalWorker *pWorker);
+/// Worker task: solves the job submitted, if any. Returns false at once if there is none.
+bool MagCalWorkerRun(MagCalWorker *pWorker);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MAG_CAL_WORKER_H
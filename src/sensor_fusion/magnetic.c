@@ -21,8 +21,503 @@
 #include "sensor_fusion.h"
 #include "calibration_storage.h"
 #include "magnetic.h"
+#include "mag_cal_worker.h"
+#include "matrix_kernels.h"
 
 #if F_USING_MAG
+#if F_COMPACT_MAG_BUFFER
+// 100 * tan(-PI/2 + i * PI/MAGBUFFSIZEX) for i = 1 to MAGBUFFSIZEX - 1, truncated as fInitializeMagCalibration()
+// computes them for the NXP layout. one constant table, in flash on the ESP32, serves every buffer.
+#if MAGBUFFSIZEX != 14
+#error "the tangent table of the compact magnetic buffer is for MAGBUFFSIZEX 14"
+#endif
+static const int16_t iMagTanArray[MAGBUFFSIZEX - 1] = {
+    -438, -207, -125, -79, -48, -22, 0, 22, 48, 79, 125, 207, 438};
+#define MAGBUFFER_TAN(pthisMagBuffer, i) (iMagTanArray[i])
+#else
+#define MAGBUFFER_TAN(pthisMagBuffer, i) ((pthisMagBuffer)->tanarray[i])
+#endif
+
+#if F_INCREMENTAL_MAG_SUMS
+// returns the position in iMoments of the sum of u^a.v^b.w^c where u, v, w are the x, y, z components of the
+// magnetic buffer entries relative to iMomentCenter. the moments are stored with a, then b, then c ascending.
+static int8_t iMomentIndex(int8_t a, int8_t b, int8_t c)
+{
+    // number of moments with a lower power of u, then with the same power of u and a lower power of v
+    static const int8_t iFirstOfA[5] = {0, 15, 25, 31, 34};
+
+    return (int8_t) (iFirstOfA[a] + b * (5 - a) - (b * (b - 1)) / 2 + c);
+} // end iMomentIndex()
+
+// adds (iSign = 1) or subtracts (iSign = -1) the reading iBs[] to or from the running moments.
+// returns false, leaving the moments untouched, if the reading is too far from iMomentCenter for exact sums.
+static int8_t iAccumulateMagBufferMoments(struct MagBuffer *pthisMagBuffer, const int16_t iBs[], int8_t iSign)
+{
+    int64_t   iPow[3][5];       // powers 0 to 4 of the reading relative to iMomentCenter
+    int64_t   iPowXY[15];       // products of the powers of u and v with a + b <= 4
+    int32_t   iu;               // reading component relative to iMomentCenter (counts)
+    int8_t    a,
+            b,
+            c,
+            m = 0,
+            n = 0;              // loop counters
+
+    for (a = CHX; a <= CHZ; a++)
+    {
+        iu = (int32_t) iBs[a] - (int32_t) pthisMagBuffer->iMomentCenter[a];
+        if ((iu > FIXEDCALMAXCOUNTS) || (iu < -FIXEDCALMAXCOUNTS)) return false;
+        iPow[a][0] = 1;
+        for (b = 1; b < 5; b++) iPow[a][b] = iPow[a][b - 1] * iu;
+    }
+
+    // the sign is applied to the x powers so that each moment costs no extra multiply, and the products of the
+    // x and y powers are shared by every power of z
+    for (a = 0; a < 5; a++) iPow[CHX][a] *= iSign;
+    for (a = 0; a <= 4; a++)
+        for (b = 0; (a + b) <= 4; b++) iPowXY[m++] = iPow[CHX][a] * iPow[CHY][b];
+    for (m = 0, a = 0; a <= 4; a++)
+        for (b = 0; (a + b) <= 4; b++, m++)
+            for (c = 0; (a + b + c) <= 4; c++)
+                pthisMagBuffer->iMoments[n++] += iPowXY[m] * iPow[CHZ][c];
+
+    return true;
+} // end iAccumulateMagBufferMoments()
+
+// recomputes the running moments from every active magnetic buffer entry other than the pending one about the
+// nearest integer to their mean. the moments are flagged invalid if any entry is too far from that mean for exact
+// sums.
+static void iResumMagBufferMoments(struct MagBuffer *pthisMagBuffer)
+{
+    int32_t   iSum[3];          // sum of the active entries (counts)
+    int16_t   iBs[3];           // reading of one entry
+    int16_t   iM = 0;           // number of active entries
+    int8_t    i,
+            j,
+            k;                  // loop counters
+
+    for (i = CHX; i <= CHZ; i++) iSum[i] = 0;
+    for (j = 0; j < MAGBUFFSIZEX; j++)
+    {
+        for (k = 0; k < MAGBUFFSIZEY; k++)
+        {
+            if (iMagBufferBinActive(pthisMagBuffer, j, k) && (j * MAGBUFFSIZEY + k != pthisMagBuffer->iPendingBin))
+            {
+                iM++;
+                for (i = CHX; i <= CHZ; i++) iSum[i] += (int32_t) MAGBUFFER_BS(pthisMagBuffer, i, j, k);
+            }
+        }
+    }
+
+    for (i = CHX; i <= CHZ; i++)
+    {
+        if (iM == 0)
+            pthisMagBuffer->iMomentCenter[i] = 0;
+        else if (iSum[i] >= 0)
+            pthisMagBuffer->iMomentCenter[i] = (int16_t) ((iSum[i] + (iM >> 1)) / iM);
+        else
+            pthisMagBuffer->iMomentCenter[i] = (int16_t) ((iSum[i] - (iM >> 1)) / iM);
+    }
+    for (i = 0; i < MAGMOMENTS; i++) pthisMagBuffer->iMoments[i] = 0;
+
+    pthisMagBuffer->iMomentsValid = true;
+    pthisMagBuffer->iPendingHeld = false;
+    for (j = 0; j < MAGBUFFSIZEX; j++)
+    {
+        for (k = 0; k < MAGBUFFSIZEY; k++)
+        {
+            if (iMagBufferBinActive(pthisMagBuffer, j, k) && (j * MAGBUFFSIZEY + k != pthisMagBuffer->iPendingBin))
+            {
+                for (i = CHX; i <= CHZ; i++) iBs[i] = MAGBUFFER_BS(pthisMagBuffer, i, j, k);
+                if (!iAccumulateMagBufferMoments(pthisMagBuffer, iBs, 1)) pthisMagBuffer->iMomentsValid = false;
+            }
+        }
+    }
+
+    return;
+} // end iResumMagBufferMoments()
+
+// adds the reading of magnetic buffer entry j, k to the running moments. the moments are recomputed about a new
+// center when the entry is too far from the current one or once the buffer mean has drifted MOMENTRECENTERCOUNTS
+// from it, which keeps every term small enough for exact 64 bit sums.
+static void iAddMagBufferMoments(struct MagBuffer *pthisMagBuffer, int8_t j, int8_t k)
+{
+    int64_t   iLimit;           // largest first moment before recentering
+    int16_t   iBs[3];           // reading of the entry
+    int8_t    i;                // loop counter
+
+    if (!pthisMagBuffer->iMomentsValid) return;
+
+    for (i = CHX; i <= CHZ; i++) iBs[i] = MAGBUFFER_BS(pthisMagBuffer, i, j, k);
+
+    // the first entry of an empty buffer is the center
+    if (pthisMagBuffer->iMoments[0] == 0)
+        for (i = CHX; i <= CHZ; i++) pthisMagBuffer->iMomentCenter[i] = iBs[i];
+
+    if (!iAccumulateMagBufferMoments(pthisMagBuffer, iBs, 1))
+    {
+        iResumMagBufferMoments(pthisMagBuffer);
+        return;
+    }
+
+    iLimit = (int64_t) MOMENTRECENTERCOUNTS * pthisMagBuffer->iMoments[0];
+    if ((pthisMagBuffer->iMoments[iMomentIndex(1, 0, 0)] > iLimit) ||
+        (pthisMagBuffer->iMoments[iMomentIndex(1, 0, 0)] < -iLimit) ||
+        (pthisMagBuffer->iMoments[iMomentIndex(0, 1, 0)] > iLimit) ||
+        (pthisMagBuffer->iMoments[iMomentIndex(0, 1, 0)] < -iLimit) ||
+        (pthisMagBuffer->iMoments[iMomentIndex(0, 0, 1)] > iLimit) ||
+        (pthisMagBuffer->iMoments[iMomentIndex(0, 0, 1)] < -iLimit))
+        iResumMagBufferMoments(pthisMagBuffer);
+
+    return;
+} // end iAddMagBufferMoments()
+
+// removes the reading iBs[], which the running moments hold, from them
+static void iSubtractMagBufferMoments(struct MagBuffer *pthisMagBuffer, const int16_t iBs[])
+{
+    // a reading held by a valid set of moments is always within range of the center so this cannot fail
+    if (pthisMagBuffer->iMomentsValid) iAccumulateMagBufferMoments(pthisMagBuffer, iBs, -1);
+
+    return;
+} // end iSubtractMagBufferMoments()
+
+// makes bin n the pending bin of the running moments, with iHeld true if they hold its current reading, and
+// brings them up to date for the bin that was pending before.
+// at run time most readings fall into the bin of the reading before them, so the moments are only updated, by
+// the earlier reading out and the latest one in, once the readings move on to another bin.
+static void iSetPendingMagBufferBin(struct MagBuffer *pthisMagBuffer, int16_t n, int8_t iHeld)
+{
+    int16_t   iBs[3];           // reading of the previous pending bin that the moments hold
+    int16_t   iprevious = pthisMagBuffer->iPendingBin;  // previous pending bin
+    int8_t    iprevheld = pthisMagBuffer->iPendingHeld; // the moments hold iBs[]
+    int8_t    i,
+            j,
+            k;                  // loop counter and buffer bin
+
+    for (i = CHX; i <= CHZ; i++) iBs[i] = pthisMagBuffer->iPendingBs[i];
+    if (iHeld)
+    {
+        j = (int8_t) (n / MAGBUFFSIZEY);
+        k = (int8_t) (n % MAGBUFFSIZEY);
+        for (i = CHX; i <= CHZ; i++) pthisMagBuffer->iPendingBs[i] = MAGBUFFER_BS(pthisMagBuffer, i, j, k);
+    }
+    // the new pending bin is set first so that a resum of the moments below leaves it out
+    pthisMagBuffer->iPendingBin = n;
+    pthisMagBuffer->iPendingHeld = iHeld;
+
+    if (iprevious == -1) return;
+    if (iprevheld) iSubtractMagBufferMoments(pthisMagBuffer, iBs);
+    j = (int8_t) (iprevious / MAGBUFFSIZEY);
+    k = (int8_t) (iprevious % MAGBUFFSIZEY);
+    if (iMagBufferBinActive(pthisMagBuffer, j, k)) iAddMagBufferMoments(pthisMagBuffer, j, k);
+
+    return;
+} // end iSetPendingMagBufferBin()
+#endif
+
+#if F_MAG_BUFFER_INDEX
+// returns the mesh cell, of side MESHDELTACOUNTS counts, of one component of a measurement
+static int16_t iMeshCell(int16_t iB)
+{
+    return (int16_t) (((int32_t) iB + 32768) / MESHDELTACOUNTS);
+} // end iMeshCell()
+
+// returns the spatial hash bucket of the mesh cell icx, icy, icz
+static int16_t iMeshBucket(int16_t icx, int16_t icy, int16_t icz)
+{
+    return (int16_t) ((((uint32_t) icx * 73856093U) ^ ((uint32_t) icy * 19349663U) ^ ((uint32_t) icz * 83492791U)) &
+                      (MESHHASHSIZE - 1));
+} // end iMeshBucket()
+
+// returns the spatial hash bucket of the measurement in buffer entry j, k
+static int16_t iMeshBucketOfBin(struct MagBuffer *pthisMagBuffer, int8_t j, int8_t k)
+{
+    return iMeshBucket(iMeshCell(MAGBUFFER_BS(pthisMagBuffer, CHX, j, k)),
+                       iMeshCell(MAGBUFFER_BS(pthisMagBuffer, CHY, j, k)),
+                       iMeshCell(MAGBUFFER_BS(pthisMagBuffer, CHZ, j, k)));
+} // end iMeshBucketOfBin()
+
+// adds the newly stored buffer entry j, k to its spatial hash bucket and as the newest entry of the age list
+static void iLinkMagBufferBin(struct MagBuffer *pthisMagBuffer, int8_t j, int8_t k)
+{
+    int16_t   n = (int16_t) (j * MAGBUFFSIZEY + k);     // bin number
+    int16_t   ibucket = iMeshBucketOfBin(pthisMagBuffer, j, k);
+
+    pthisMagBuffer->iMeshNext[n] = pthisMagBuffer->iMeshHead[ibucket];
+    pthisMagBuffer->iMeshHead[ibucket] = n;
+
+    pthisMagBuffer->iOlder[n] = pthisMagBuffer->iNewest;
+    pthisMagBuffer->iNewer[n] = -1;
+    if (pthisMagBuffer->iNewest == -1)
+        pthisMagBuffer->iOldest = n;
+    else
+        pthisMagBuffer->iNewer[pthisMagBuffer->iNewest] = n;
+    pthisMagBuffer->iNewest = n;
+
+    return;
+} // end iLinkMagBufferBin()
+
+// removes the buffer entry j, k, before it is overwritten or retired, from its spatial hash bucket and the age list
+static void iUnlinkMagBufferBin(struct MagBuffer *pthisMagBuffer, int8_t j, int8_t k)
+{
+    int16_t   n = (int16_t) (j * MAGBUFFSIZEY + k);     // bin number
+    int16_t   *pn;              // link to bin n in its spatial hash bucket
+
+    // the buckets hold a few bins each so the walk to bin n is short
+    pn = &(pthisMagBuffer->iMeshHead[iMeshBucketOfBin(pthisMagBuffer, j, k)]);
+    while ((*pn != n) && (*pn != -1))
+        pn = &(pthisMagBuffer->iMeshNext[*pn]);
+    if (*pn == n) *pn = pthisMagBuffer->iMeshNext[n];
+
+    if (pthisMagBuffer->iOlder[n] == -1)
+        pthisMagBuffer->iOldest = pthisMagBuffer->iNewer[n];
+    else
+        pthisMagBuffer->iNewer[pthisMagBuffer->iOlder[n]] = pthisMagBuffer->iNewer[n];
+    if (pthisMagBuffer->iNewer[n] == -1)
+        pthisMagBuffer->iNewest = pthisMagBuffer->iOlder[n];
+    else
+        pthisMagBuffer->iOlder[pthisMagBuffer->iNewer[n]] = pthisMagBuffer->iOlder[n];
+
+    return;
+} // end iUnlinkMagBufferBin()
+
+// returns true if any measurement in the buffer is closer than MESHDELTACOUNTS (sum of absolute differences) to
+// iBs[]. such a measurement differs by less than one mesh cell in each component so only the spatial hash buckets
+// of the 27 cells around iBs[] need be searched.
+static int8_t iMagBufferHasClose(struct MagBuffer *pthisMagBuffer, const int16_t iBs[])
+{
+    int32_t   idelta;           // absolute vector distance
+    int16_t   icell[3];         // mesh cell of iBs[]
+    int16_t   n;                // bin number
+    int8_t    dx,
+            dy,
+            dz,
+            i,
+            j,
+            k;                  // loop counters
+
+    for (i = CHX; i <= CHZ; i++) icell[i] = iMeshCell(iBs[i]);
+    for (dx = -1; dx <= 1; dx++)
+    {
+        for (dy = -1; dy <= 1; dy++)
+        {
+            for (dz = -1; dz <= 1; dz++)
+            {
+                n = pthisMagBuffer->iMeshHead[iMeshBucket(icell[CHX] + dx, icell[CHY] + dy, icell[CHZ] + dz)];
+                while (n != -1)
+                {
+                    j = (int8_t) (n / MAGBUFFSIZEY);
+                    k = (int8_t) (n % MAGBUFFSIZEY);
+                    idelta = 0;
+                    for (i = CHX; i <= CHZ; i++)
+                        idelta += abs((int32_t) iBs[i] - (int32_t) MAGBUFFER_BS(pthisMagBuffer, i, j, k));
+                    if (idelta < MESHDELTACOUNTS) return true;
+                    n = pthisMagBuffer->iMeshNext[n];
+                }
+            }
+        }
+    }
+
+    return false;
+} // end iMagBufferHasClose()
+
+// returns the last empty bin of the buffer in the order j then k, as the scan of the buffer finds it, or 0 if
+// there is none
+static int16_t iLastEmptyMagBufferBin(struct MagBuffer *pthisMagBuffer)
+{
+    uint32_t  iempty;           // bits set for the empty bins of one word of iActive
+    int8_t    w;                // word counter
+
+    for (w = MAGACTIVEWORDS - 1; w >= 0; w--)
+    {
+        iempty = ~pthisMagBuffer->iActive[w];
+        if (w == (MAGACTIVEWORDS - 1) && ((MAGBUFFSIZEX * MAGBUFFSIZEY) & 31))
+            iempty &= ((uint32_t) 1 << ((MAGBUFFSIZEX * MAGBUFFSIZEY) & 31)) - 1;
+        if (iempty) return (int16_t) (w * 32 + 31 - __builtin_clz(iempty));
+    }
+
+    return 0;
+} // end iLastEmptyMagBufferBin()
+
+// returns the bin j of the tangent ratio itan, the number of entries of the ascending tanarray not above it,
+// by bisection
+static int8_t iMagBufferBin(struct MagBuffer *pthisMagBuffer, int16_t itan)
+{
+    int8_t    ilow = 0,
+            ihigh = MAGBUFFSIZEX - 1,
+            imid;               // bisection limits and midpoint
+
+    while (ilow < ihigh)
+    {
+        imid = (int8_t) ((ilow + ihigh) >> 1);
+        if (itan >= MAGBUFFER_TAN(pthisMagBuffer, imid))
+            ilow = (int8_t) (imid + 1);
+        else
+            ihigh = imid;
+    }
+
+    return ilow;
+} // end iMagBufferBin()
+#endif
+
+// updates the running sums and the indexes of the magnetic buffer after entry j, k has been stored
+static void iMagBufferEntryStored(struct MagBuffer *pthisMagBuffer, int8_t j, int8_t k)
+{
+#if F_INCREMENTAL_MAG_SUMS
+    // an entry that was empty is pending until the readings move on. an overwritten one is pending already.
+    if (j * MAGBUFFSIZEY + k != pthisMagBuffer->iPendingBin)
+        iSetPendingMagBufferBin(pthisMagBuffer, (int16_t) (j * MAGBUFFSIZEY + k), false);
+#endif
+#if F_MAG_BUFFER_INDEX
+    iLinkMagBufferBin(pthisMagBuffer, j, k);
+#endif
+
+    return;
+} // end iMagBufferEntryStored()
+
+// updates the running sums and the indexes of the magnetic buffer before entry j, k is overwritten
+static void iMagBufferEntryOverwritten(struct MagBuffer *pthisMagBuffer, int8_t j, int8_t k)
+{
+#if F_INCREMENTAL_MAG_SUMS
+    if (j * MAGBUFFSIZEY + k != pthisMagBuffer->iPendingBin)
+        iSetPendingMagBufferBin(pthisMagBuffer, (int16_t) (j * MAGBUFFSIZEY + k), true);
+#endif
+#if F_MAG_BUFFER_INDEX
+    iUnlinkMagBufferBin(pthisMagBuffer, j, k);
+#endif
+
+    return;
+} // end iMagBufferEntryOverwritten()
+
+// updates the running sums and the indexes of the magnetic buffer before entry j, k is retired
+static void iMagBufferEntryRemoved(struct MagBuffer *pthisMagBuffer, int8_t j, int8_t k)
+{
+#if F_INCREMENTAL_MAG_SUMS
+    int16_t   iBs[3];           // reading of the entry
+    int8_t    i;                // loop counter
+
+    if (j * MAGBUFFSIZEY + k == pthisMagBuffer->iPendingBin)
+    {
+        if (pthisMagBuffer->iPendingHeld) iSubtractMagBufferMoments(pthisMagBuffer, pthisMagBuffer->iPendingBs);
+        pthisMagBuffer->iPendingBin = -1;
+    }
+    else
+    {
+        for (i = CHX; i <= CHZ; i++) iBs[i] = MAGBUFFER_BS(pthisMagBuffer, i, j, k);
+        iSubtractMagBufferMoments(pthisMagBuffer, iBs);
+    }
+#endif
+#if F_MAG_BUFFER_INDEX
+    iUnlinkMagBufferBin(pthisMagBuffer, j, k);
+#endif
+
+    return;
+} // end iMagBufferEntryRemoved()
+
+// function rebuilds the running sums and the indexes of the magnetic buffer from its measurements and time
+// indices, with loopcounter the current time index. it is called after the buffer is cleared and must be called by
+// any code that writes the buffer other than through iUpdateMagBuffer().
+void iReindexMagBuffer(struct MagBuffer *pthisMagBuffer, int32_t loopcounter)
+{
+#if F_MAG_BUFFER_INDEX
+    int32_t   iage;             // age of the bin being linked
+    int16_t   n,
+            iolder;             // bin numbers
+    int8_t    j,
+            k;                  // loop counters
+
+#if !F_COMPACT_MAG_BUFFER
+    // the NXP layout marks empty bins by their time index so the bitmap follows from it
+    for (n = 0; n < MAGACTIVEWORDS; n++) pthisMagBuffer->iActive[n] = 0;
+    for (j = 0; j < MAGBUFFSIZEX; j++)
+        for (k = 0; k < MAGBUFFSIZEY; k++)
+            if (pthisMagBuffer->index[j][k] != -1)
+                iMagBufferSetBin(pthisMagBuffer, j, k, pthisMagBuffer->index[j][k]);
+#endif
+    pthisMagBuffer->iNewest = pthisMagBuffer->iOldest = -1;
+    for (n = 0; n < MESHHASHSIZE; n++) pthisMagBuffer->iMeshHead[n] = -1;
+    for (j = 0; j < MAGBUFFSIZEX; j++)
+    {
+        for (k = 0; k < MAGBUFFSIZEY; k++)
+        {
+            if (iMagBufferBinActive(pthisMagBuffer, j, k))
+            {
+                // link the bin as the newest then move it older past every younger bin. equal ages keep the scan
+                // order so that the oldest is the one the scan of the buffer would retire.
+                iLinkMagBufferBin(pthisMagBuffer, j, k);
+                n = (int16_t) (j * MAGBUFFSIZEY + k);
+                iage = iMagBufferBinAge(pthisMagBuffer, j, k, loopcounter);
+                while (((iolder = pthisMagBuffer->iOlder[n]) != -1) &&
+                       (iMagBufferBinAge(pthisMagBuffer, (int8_t) (iolder / MAGBUFFSIZEY),
+                                         (int8_t) (iolder % MAGBUFFSIZEY), loopcounter) < iage))
+                {
+                    // swap bin n with the older bin iolder
+                    pthisMagBuffer->iOlder[n] = pthisMagBuffer->iOlder[iolder];
+                    if (pthisMagBuffer->iOlder[iolder] == -1)
+                        pthisMagBuffer->iOldest = n;
+                    else
+                        pthisMagBuffer->iNewer[pthisMagBuffer->iOlder[iolder]] = n;
+                    pthisMagBuffer->iNewer[iolder] = pthisMagBuffer->iNewer[n];
+                    if (pthisMagBuffer->iNewer[n] == -1)
+                        pthisMagBuffer->iNewest = iolder;
+                    else
+                        pthisMagBuffer->iOlder[pthisMagBuffer->iNewer[n]] = iolder;
+                    pthisMagBuffer->iOlder[iolder] = n;
+                    pthisMagBuffer->iNewer[n] = iolder;
+                }
+            }
+        }
+    }
+#else
+    (void) loopcounter;
+#endif
+#if F_INCREMENTAL_MAG_SUMS
+    pthisMagBuffer->iPendingBin = -1;
+    iResumMagBufferMoments(pthisMagBuffer);
+#endif
+
+    return;
+} // end iReindexMagBuffer()
+
+// function empties the magnetic buffer, with loopcounter the current time index
+void iClearMagBuffer(struct MagBuffer *pthisMagBuffer, int32_t loopcounter)
+{
+    int8_t    j,
+            k;          // loop counters
+
+    // set magnetic buffer index to invalid value -1 to denote no measurement present
+    pthisMagBuffer->iMagBufferCount = 0;
+    for (j = 0; j < MAGBUFFSIZEX; j++)
+        for (k = 0; k < MAGBUFFSIZEY; k++) iMagBufferClearBin(pthisMagBuffer, j, k);
+    iReindexMagBuffer(pthisMagBuffer, loopcounter);
+
+    return;
+} // end iClearMagBuffer()
+
+// function ends any calibration in progress and resets the calibration attempts, to start again from the readings
+// in the magnetic buffer. the calibration in use is kept.
+static void fRestartMagCalibration(struct MagCalibration *pthisMagCal)
+{
+    if (pthisMagCal->pScratch) fReleaseCalibrationScratch(pthisMagCal->pScratch, pthisMagCal->iScratchLease);
+    if (pthisMagCal->pWorker) MagCalWorkerCancel(pthisMagCal->pWorker);
+    pthisMagCal->iScratchLease = 0;
+    pthisMagCal->iCalInProgress = 0;
+    pthisMagCal->iInitiateMagCal = 0;
+    pthisMagCal->iNewCalibrationAvailable = 0;
+    pthisMagCal->iMagBufferReadOnly = false;
+    pthisMagCal->i4ElementSolverTried = false;
+    pthisMagCal->i7ElementSolverTried = false;
+    pthisMagCal->i10ElementSolverTried = false;
+    pthisMagCal->iCalStatsReady = 0;
+#if F_WARM_START_EIGEN
+    pthisMagCal->iWarmStartSize = 0;
+#endif
+#if F_MAG_BUFFER_SNAPSHOT
+    pthisMagCal->iSnapshotChecks = 0;
+#endif
+
+    return;
+} // end fRestartMagCalibration()
+
 // function resets the magnetometer buffer and magnetic calibration
 void fInitializeMagCalibration(struct MagCalibration *pthisMagCal,
                                struct MagBuffer *pthisMagBuffer)
@@ -30,17 +525,18 @@ void fInitializeMagCalibration(struct MagCalibration *pthisMagCal,
     int8_t    i,
             j;          // loop counters
 
-    // set magnetic buffer index to invalid value -1 to denote no measurement present
-    pthisMagBuffer->iMagBufferCount = 0;
-    for (i = 0; i < MAGBUFFSIZEX; i++)
-        for (j = 0; j < MAGBUFFSIZEY; j++) pthisMagBuffer->index[i][j] = -1;
+    iClearMagBuffer(pthisMagBuffer, 0);
 
+#if F_COMPACT_MAG_BUFFER
+    pthisMagBuffer->iAgeCursor = 0;
+#else
     // initialize the array of (MAGBUFFSIZEX - 1) elements of 100 * tangents used for buffer indexing
     // entries cover the range 100 * tan(-PI/2 + PI/MAGBUFFSIZEX), 100 * tan(-PI/2 + 2*PI/MAGBUFFSIZEX) to
     // 100 * tan(-PI/2 + (MAGBUFFSIZEX - 1) * PI/MAGBUFFSIZEX).
     // for MAGBUFFSIZEX=12, the entries range in value from -373 to +373
     for (i = 0; i < (MAGBUFFSIZEX - 1); i++)
         pthisMagBuffer->tanarray[i] = (int16_t) (100.0F * tanf(PI * (-0.5F + (float) (i + 1) / MAGBUFFSIZEX)));
+#endif
 
     // check to see if the stored magnetic calibration has been erased
 #ifndef SIMULATION
@@ -66,7 +562,7 @@ void fInitializeMagCalibration(struct MagCalibration *pthisMagCal,
         // flash has been erased and no magnetic calibration is present
         // initialize the magnetic calibration in RAM to null default
         pthisMagCal->fV[CHX] = pthisMagCal->fV[CHY] = pthisMagCal->fV[CHZ] = 0.0F;
-        f3x3matrixAeqI(pthisMagCal->finvW);
+        fk3x3AeqI(pthisMagCal->finvW);
         pthisMagCal->fB = DEFAULTB;
         pthisMagCal->fBSq = DEFAULTB * DEFAULTB;
         pthisMagCal->fFitErrorpc = 100.0F;
@@ -75,18 +571,41 @@ void fInitializeMagCalibration(struct MagCalibration *pthisMagCal,
     }
 #endif
 
-    // initialize remaining elements of the magnetic calibration structure
-    pthisMagCal->iCalInProgress = 0;
-    pthisMagCal->iInitiateMagCal = 0;
-    pthisMagCal->iNewCalibrationAvailable = 0;
-    pthisMagCal->iMagBufferReadOnly = false;
-    pthisMagCal->i4ElementSolverTried = false;
-    pthisMagCal->i7ElementSolverTried = false;
-    pthisMagCal->i10ElementSolverTried = false;
+    // initialize remaining elements of the magnetic calibration structure, ending any calibration in progress
+    pthisMagCal->iCalsSolved = 0;
+    fRestartMagCalibration(pthisMagCal);
 
     return;
 } // end fInitializeMagCalibration()
 
+#if F_MAG_BUFFER_SNAPSHOT
+// function checks each reading for MAGSNAPSHOTCHECKSECS after a snapshot of the magnetic buffer was restored (see
+// calibration_storage.cc) against the calibration saved with it. if their rms error from the field strength fB then
+// exceeds its fit error by more than MAGSNAPSHOTMARGINPC, the iron or the field has changed since the snapshot was
+// saved. the buffer is then cleared to be refilled from new readings, and the calibration given that error as its
+// fit error so that a calibration from the new readings replaces it.
+void fCheckMagBufferSnapshot(struct MagCalibration *pthisMagCal, struct MagBuffer *pthisMagBuffer,
+                             struct MagSensor *pthisMag, int32_t loopcounter)
+{
+    float   ferror;     // relative error of the calibrated reading from fB, then rms error (%)
+
+    ferror = sqrtf(pthisMag->fBc[CHX] * pthisMag->fBc[CHX] + pthisMag->fBc[CHY] * pthisMag->fBc[CHY] +
+                   pthisMag->fBc[CHZ] * pthisMag->fBc[CHZ]) / pthisMagCal->fB - 1.0F;
+    pthisMagCal->fSnapshotErrorSq += ferror * ferror;
+    if (--(pthisMagCal->iSnapshotChecks)) return;
+
+    ferror = 100.0F * sqrtf(pthisMagCal->fSnapshotErrorSq / (float) (MAGSNAPSHOTCHECKSECS * FUSION_HZ));
+    if (ferror > pthisMagCal->fFitErrorpc + MAGSNAPSHOTMARGINPC)
+    {
+        iClearMagBuffer(pthisMagBuffer, loopcounter);
+        fRestartMagCalibration(pthisMagCal);
+        pthisMagCal->fFitErrorpc = ferror;
+    }
+
+    return;
+} // end fCheckMagBufferSnapshot()
+#endif
+
 // function updates the magnetic measurement buffer with most recent magnetic data
 // the uncalibrated measurements iBs are stored in the buffer but the calibrated measurements iBc are used for indexing.
 void iUpdateMagBuffer(struct MagBuffer *pthisMagBuffer, struct MagSensor *pthisMag,
@@ -103,6 +622,18 @@ void iUpdateMagBuffer(struct MagBuffer *pthisMagBuffer, struct MagSensor *pthisM
             m;          // counters
     int8_t    itooclose;  // flag denoting measurement is too close to existing ones
 
+#if F_COMPACT_MAG_BUFFER
+    // hold the age of one bin per call to MAGAGELIMIT so that no 16 bit time stamp wraps. each bin is visited every
+    // MAGBUFFSIZEX * MAGBUFFSIZEY calls, long before an age of MAGAGELIMIT can reach 65536. the age list of
+    // F_MAG_BUFFER_INDEX keeps the true order of the oldest readings regardless.
+    j = (int8_t) (pthisMagBuffer->iAgeCursor / MAGBUFFSIZEY);
+    k = (int8_t) (pthisMagBuffer->iAgeCursor % MAGBUFFSIZEY);
+    if (iMagBufferBinActive(pthisMagBuffer, j, k) &&
+        (iMagBufferBinAge(pthisMagBuffer, j, k, loopcounter) > MAGAGELIMIT))
+        pthisMagBuffer->iStamp[j][k] = (uint16_t) (loopcounter - MAGAGELIMIT);
+    if (++(pthisMagBuffer->iAgeCursor) == MAGBUFFSIZEX * MAGBUFFSIZEY) pthisMagBuffer->iAgeCursor = 0;
+#endif
+
     // calculate the magnetometer buffer bins from the tangent ratios
     if (pthisMag->iBc[CHZ] == 0) return;
     itanj = (100 * (int32_t) pthisMag->iBc[CHX]) / ((int32_t) pthisMag->iBc[CHZ]);
@@ -111,81 +642,97 @@ void iUpdateMagBuffer(struct MagBuffer *pthisMagBuffer, struct MagSensor *pthisM
     // map tangent ratios to bins j and k using equal angle bins: C guarantees left to right execution of the test
     // and add an offset of MAGBUFFSIZEX bins to k to mimic atan2 on this ratio
     // j will vary from 0 to MAGBUFFSIZEX - 1 and k from 0 to 2 * MAGBUFFSIZEX - 1
+#if F_MAG_BUFFER_INDEX
+    j = iMagBufferBin(pthisMagBuffer, itanj);
+    k = iMagBufferBin(pthisMagBuffer, itank);
+#else
     j = k = 0;
-    while ((j < (MAGBUFFSIZEX - 1) && (itanj >= pthisMagBuffer->tanarray[j])))
+    while ((j < (MAGBUFFSIZEX - 1) && (itanj >= MAGBUFFER_TAN(pthisMagBuffer, j))))
         j++;
-    while ((k < (MAGBUFFSIZEX - 1) && (itank >= pthisMagBuffer->tanarray[k])))
+    while ((k < (MAGBUFFSIZEX - 1) && (itank >= MAGBUFFER_TAN(pthisMagBuffer, k))))
         k++;
+#endif
     if (pthisMag->iBc[CHX] < 0) k += MAGBUFFSIZEX;
 
     // case 1: buffer is full and this bin has a measurement: over-write without increasing number of measurements
     // this is the most common option at run time
     if ((pthisMagBuffer->iMagBufferCount == MAXMEASUREMENTS) &&
-        (pthisMagBuffer->index[j][k] != -1))
+        iMagBufferBinActive(pthisMagBuffer, j, k))
     {
+        iMagBufferEntryOverwritten(pthisMagBuffer, j, k);
         // store the fast (unaveraged at typically 200Hz) integer magnetometer reading into the buffer bin j, k
         for (i = CHX; i <= CHZ; i++)
         {
-            pthisMagBuffer->iBs[i][j][k] = pthisMag->iBs[i];
+            MAGBUFFER_BS(pthisMagBuffer, i, j, k) = pthisMag->iBs[i];
         }
 
-        pthisMagBuffer->index[j][k] = loopcounter;
+        iMagBufferSetBin(pthisMagBuffer, j, k, loopcounter);
+        iMagBufferEntryStored(pthisMagBuffer, j, k);
         return;
     }                   // end case 1
 
     // case 2: the buffer is full and this bin does not have a measurement: store and retire the oldest
     // this is the second most common option at run time
     if ((pthisMagBuffer->iMagBufferCount == MAXMEASUREMENTS) &&
-        (pthisMagBuffer->index[j][k] == -1))
+        !iMagBufferBinActive(pthisMagBuffer, j, k))
     {
         // store the fast (unaveraged at typically 200Hz) integer magnetometer reading into the buffer bin j, k
         for (i = CHX; i <= CHZ; i++)
         {
-            pthisMagBuffer->iBs[i][j][k] = pthisMag->iBs[i];
+            MAGBUFFER_BS(pthisMagBuffer, i, j, k) = pthisMag->iBs[i];
         }
 
-        pthisMagBuffer->index[j][k] = loopcounter;
+        iMagBufferSetBin(pthisMagBuffer, j, k, loopcounter);
+        iMagBufferEntryStored(pthisMagBuffer, j, k);
 
         // set l and m to the oldest active entry and disable it
-        i = loopcounter;
+#if F_MAG_BUFFER_INDEX
+        // the oldest is the first entry of the age list
+        l = (int8_t) (pthisMagBuffer->iOldest / MAGBUFFSIZEY);
+        m = (int8_t) (pthisMagBuffer->iOldest % MAGBUFFSIZEY);
+#else
+        i = 0;
         l = m = 0;      // to avoid compiler complaint
         for (j = 0; j < MAGBUFFSIZEX; j++)
         {
             for (k = 0; k < MAGBUFFSIZEY; k++)
             {
-                // check if the time stamp is older than the oldest found so far (normally fails this test)
-                if (pthisMagBuffer->index[j][k] < i)
+                // check if the age is older than the oldest found so far (normally fails this test)
+                if (iMagBufferBinAge(pthisMagBuffer, j, k, loopcounter) > i)
                 {
                     // check if this bin is active (normally passes this test)
-                    if (pthisMagBuffer->index[j][k] != -1)
+                    if (iMagBufferBinActive(pthisMagBuffer, j, k))
                     {
                         // set l and m to the indices of the oldest entry found so far
                         l = j;
                         m = k;
 
-                        // set i to the time stamp of the oldest entry found so far
-                        i = pthisMagBuffer->index[l][m];
+                        // set i to the age of the oldest entry found so far
+                        i = iMagBufferBinAge(pthisMagBuffer, l, m, loopcounter);
                     }   // end of test for active
                 }       // end of test for older
             }           // end of loop over k
         }               // end of loop over j
+#endif
 
         // deactivate the oldest measurement (no need to zero the measurement data)
-        pthisMagBuffer->index[l][m] = -1;
+        iMagBufferEntryRemoved(pthisMagBuffer, l, m);
+        iMagBufferClearBin(pthisMagBuffer, l, m);
         return;
     }                   // end case 2
 
     // case 3: buffer is not full and this bin is empty: store and increment number of measurements
     if ((pthisMagBuffer->iMagBufferCount < MAXMEASUREMENTS) &&
-        (pthisMagBuffer->index[j][k] == -1))
+        !iMagBufferBinActive(pthisMagBuffer, j, k))
     {
         // store the fast (unaveraged at typically 200Hz) integer magnetometer reading into the buffer bin j, k
         for (i = CHX; i <= CHZ; i++)
         {
-            pthisMagBuffer->iBs[i][j][k] = pthisMag->iBs[i];
+            MAGBUFFER_BS(pthisMagBuffer, i, j, k) = pthisMag->iBs[i];
         }
 
-        pthisMagBuffer->index[j][k] = loopcounter;
+        iMagBufferSetBin(pthisMagBuffer, j, k, loopcounter);
+        iMagBufferEntryStored(pthisMagBuffer, j, k);
         (pthisMagBuffer->iMagBufferCount)++;
         return;
     }                   // end case 3
@@ -193,29 +740,38 @@ void iUpdateMagBuffer(struct MagBuffer *pthisMagBuffer, struct MagSensor *pthisM
     // case 4: buffer is not full and this bin has a measurement: over-write if close or try to slot in
     // elsewhere if not close to the other measurements so as to create a mesh
     if ((pthisMagBuffer->iMagBufferCount < MAXMEASUREMENTS) &&
-        (pthisMagBuffer->index[j][k] != -1))
+        iMagBufferBinActive(pthisMagBuffer, j, k))
     {
         // calculate the vector difference between current measurement and the buffer entry
         idelta = 0;
         for (i = CHX; i <= CHZ; i++)
         {
             idelta += abs((int32_t) pthisMag->iBs[i] -
-                          (int32_t) pthisMagBuffer->iBs[i][j][k]);
+                          (int32_t) MAGBUFFER_BS(pthisMagBuffer, i, j, k));
         }
 
         // check to see if the current reading is close to this existing magnetic buffer entry
         if (idelta < MESHDELTACOUNTS)
         {
             // simply over-write the measurement and return
+            iMagBufferEntryOverwritten(pthisMagBuffer, j, k);
             for (i = CHX; i <= CHZ; i++)
             {
-                pthisMagBuffer->iBs[i][j][k] = pthisMag->iBs[i];
+                MAGBUFFER_BS(pthisMagBuffer, i, j, k) = pthisMag->iBs[i];
             }
 
-            pthisMagBuffer->index[j][k] = loopcounter;
+            iMagBufferSetBin(pthisMagBuffer, j, k, loopcounter);
+            iMagBufferEntryStored(pthisMagBuffer, j, k);
         }
         else
         {
+#if F_MAG_BUFFER_INDEX
+            // search the spatial hash for a measurement close to the current one and take the last empty bin
+            itooclose = iMagBufferHasClose(pthisMagBuffer, pthisMag->iBs);
+            i = iLastEmptyMagBufferBin(pthisMagBuffer);
+            l = (int8_t) (i / MAGBUFFSIZEY);
+            m = (int8_t) (i % MAGBUFFSIZEY);
+#else
             // reset the flag denoting that the current measurement is close to any measurement in the buffer
             itooclose = 0;
 
@@ -231,14 +787,14 @@ void iUpdateMagBuffer(struct MagBuffer *pthisMagBuffer, struct MagSensor *pthisM
                 while (!itooclose && (k < MAGBUFFSIZEY))
                 {
                     // check whether this buffer entry already has a measurement or not
-                    if (pthisMagBuffer->index[j][k] != -1)
+                    if (iMagBufferBinActive(pthisMagBuffer, j, k))
                     {
                         // calculate the vector difference between current measurement and the buffer entry
                         idelta = 0;
                         for (i = CHX; i <= CHZ; i++)
                         {
                             idelta += abs((int32_t) pthisMag->iBs[i] -
-                                          (int32_t) pthisMagBuffer->iBs[i][j][k]);
+                                          (int32_t) MAGBUFFER_BS(pthisMagBuffer, i, j, k));
                         }
 
                         // check to see if the current reading is close to this existing magnetic buffer entry
@@ -260,6 +816,7 @@ void iUpdateMagBuffer(struct MagBuffer *pthisMagBuffer, struct MagSensor *pthisM
 
                 j++;
             }           // end of j loop
+#endif
 
             // if none too close, store the measurement in the last empty bin found and return
             // l and m are guaranteed to be set if no entries too close are detected
@@ -267,10 +824,11 @@ void iUpdateMagBuffer(struct MagBuffer *pthisMagBuffer, struct MagSensor *pthisM
             {
                 for (i = CHX; i <= CHZ; i++)
                 {
-                    pthisMagBuffer->iBs[i][l][m] = pthisMag->iBs[i];
+                    MAGBUFFER_BS(pthisMagBuffer, i, l, m) = pthisMag->iBs[i];
                 }
 
-                pthisMagBuffer->index[l][m] = loopcounter;
+                iMagBufferSetBin(pthisMagBuffer, l, m, loopcounter);
+                iMagBufferEntryStored(pthisMagBuffer, l, m);
                 (pthisMagBuffer->iMagBufferCount)++;
             }
         }               // end of test for closeness to current buffer entry
@@ -282,6 +840,204 @@ void iUpdateMagBuffer(struct MagBuffer *pthisMagBuffer, struct MagSensor *pthisM
     return;
 } // end iUpdateMagBuffer()
 
+#if F_FIXED_POINT_FUSION
+// returns true if every measurement in the magnetic buffer lies within FIXEDCALMAXCOUNTS of the mean iMeanBs.
+// The calibration sums over such a buffer, of products of up to four zero mean measurements, then fit in 64 bit
+// integers and are accumulated exactly in iSumA instead of in float.
+static int8_t iMagBufferFitsFixedSums(struct MagCalibration *pthisMagCal, struct MagBuffer *pthisMagBuffer)
+{
+    int32_t iBsZeroMean;        // zero mean magnetic buffer measurement (counts)
+    int8_t    i,
+            j,
+            k;                  // loop counters
+
+    for (i = 0; i < MAGBUFFSIZEX; i++)
+    {
+        for (j = 0; j < MAGBUFFSIZEY; j++)
+        {
+            if (iMagBufferBinActive(pthisMagBuffer, i, j))
+            {
+                for (k = 0; k < 3; k++)
+                {
+                    iBsZeroMean = (int32_t) MAGBUFFER_BS(pthisMagBuffer, k, i, j) - pthisMagCal->iMeanBs[k];
+                    if ((iBsZeroMean > FIXEDCALMAXCOUNTS) || (iBsZeroMean < -FIXEDCALMAXCOUNTS)) return false;
+                }
+            }
+        }
+    }
+
+    return true;
+} // end iMagBufferFitsFixedSums()
+
+// accumulates into iSumA the first iSquares elements of iVec, then the on and above diagonal elements of the
+// outer product of the first iSize - 1 elements of iVec. These are the sums that the 7 and 10 element
+// calibrations accumulate in float in the last column and the upper triangle of fmatA.
+static void iAccumulateFixedSums(int64_t iSumA[], const int32_t iVec[], int8_t iSize, int8_t iSquares)
+{
+    int8_t    k,
+            l,
+            n = 0;              // loop counters
+
+    for (k = 0; k < iSquares; k++)
+        iSumA[n++] += iVec[k];
+    for (k = 0; k < (iSize - 1); k++)
+        for (l = k; l < (iSize - 1); l++)
+            iSumA[n++] += (int64_t) iVec[k] * iVec[l];
+
+    return;
+} // end iAccumulateFixedSums()
+
+// sets the elements of fmatA accumulated by iAccumulateFixedSums() from the integer sums iSumA
+static void fMatrixFromFixedSums(float fmatA[][10], const int64_t iSumA[], int8_t iSize, int8_t iSquares)
+{
+    int8_t    k,
+            l,
+            n = 0;              // loop counters
+
+    for (k = 0; k < iSquares; k++)
+        fmatA[k][iSize - 1] = (float) iSumA[n++];
+    for (k = 0; k < (iSize - 1); k++)
+        for (l = k; l < (iSize - 1); l++)
+            fmatA[k][l] = (float) iSumA[n++];
+
+    return;
+} // end fMatrixFromFixedSums()
+#endif
+
+#if F_INCREMENTAL_MAG_SUMS
+// exponents of x, y, z and the integer factor of each element of fvecA as accumulated by the 10 and 7 element
+// calibrations, ending with the constant element
+static const int8_t iVec10Terms[10][4] = {
+    {2, 0, 0, 1}, {1, 1, 0, 2}, {1, 0, 1, 2}, {0, 2, 0, 1}, {0, 1, 1, 2},
+    {0, 0, 2, 1}, {1, 0, 0, 1}, {0, 1, 0, 1}, {0, 0, 1, 1}, {0, 0, 0, 1}};
+static const int8_t iVec7Terms[7][4] = {
+    {2, 0, 0, 1}, {0, 2, 0, 1}, {0, 0, 2, 1}, {1, 0, 0, 1}, {0, 1, 0, 1}, {0, 0, 1, 1}, {0, 0, 0, 1}};
+
+// sets the buffer mean and the on and above diagonal elements of fmatA that time slices 0 to
+// MAGBUFFSIZEX * MAGBUFFSIZEY of the 7 (iSize = 7) or 10 (iSize = 10) element calibration would accumulate, from the
+// running moments of the magnetic buffer. returns false, leaving fmatA untouched, if the moments are not valid.
+static int8_t iMatrixFromMagBufferMoments(struct MagCalibration *pthisMagCal, struct MagBuffer *pthisMagBuffer,
+                                          int8_t iSize)
+{
+    const int8_t (*iTerms)[4] = (iSize == 10) ? iVec10Terms : iVec7Terms;
+    int64_t   iCentral[MAGMOMENTS];     // moments about the buffer mean iMeanBs
+    int64_t   iShift;                   // iMomentCenter - iMeanBs for one component
+    int32_t   iM;                       // number of measurements in the magnetic buffer
+    int8_t    iExp[MAGMOMENTS][3];      // powers of u, v, w of each moment
+    int8_t    iLower[MAGMOMENTS][3];    // index of the moment with one lower power of u, v, w
+    int8_t    a,
+            b,
+            c,
+            i,
+            j,
+            n;                          // loop counters
+
+    // bring the moments up to date with the pending bin. a failed re-sum falls back to accumulating the buffer one
+    // bin per time slice.
+    iSetPendingMagBufferBin(pthisMagBuffer, -1, false);
+    if (!pthisMagBuffer->iMomentsValid) iResumMagBufferMoments(pthisMagBuffer);
+    if (!pthisMagBuffer->iMomentsValid) return false;
+    iM = (int32_t) pthisMagBuffer->iMoments[0];
+    if (iM == 0) return false;
+
+    // compute the sum and the nearest integer mean of the measurements exactly as time slice 0 does
+    pthisMagCal->iSumBs[CHX] = iM * pthisMagBuffer->iMomentCenter[CHX] +
+        (int32_t) pthisMagBuffer->iMoments[iMomentIndex(1, 0, 0)];
+    pthisMagCal->iSumBs[CHY] = iM * pthisMagBuffer->iMomentCenter[CHY] +
+        (int32_t) pthisMagBuffer->iMoments[iMomentIndex(0, 1, 0)];
+    pthisMagCal->iSumBs[CHZ] = iM * pthisMagBuffer->iMomentCenter[CHZ] +
+        (int32_t) pthisMagBuffer->iMoments[iMomentIndex(0, 0, 1)];
+    for (i = CHX; i <= CHZ; i++)
+    {
+        if (pthisMagCal->iSumBs[i] >= 0)
+            pthisMagCal->iMeanBs[i] = (pthisMagCal->iSumBs[i] + (iM >> 1)) / iM;
+        else
+            pthisMagCal->iMeanBs[i] = (pthisMagCal->iSumBs[i] - (iM >> 1)) / iM;
+    }
+    pthisMagBuffer->iMagBufferCount = (int16_t) iM;
+
+    // shift the moments from iMomentCenter to iMeanBs one component at a time. pass j adds d times the moment
+    // with one lower power of the component to every moment with at least j powers, visiting the moments from the
+    // highest index down, so that after four passes the sum of u^a is the sum of (u + d)^a for d = center - mean.
+    n = 0;
+    for (a = 0; a <= 4; a++)
+    {
+        for (b = 0; (a + b) <= 4; b++)
+        {
+            for (c = 0; (a + b + c) <= 4; c++)
+            {
+                iExp[n][CHX] = a;
+                iExp[n][CHY] = b;
+                iExp[n][CHZ] = c;
+                iLower[n][CHX] = (a > 0) ? iMomentIndex(a - 1, b, c) : -1;
+                iLower[n][CHY] = (b > 0) ? iMomentIndex(a, b - 1, c) : -1;
+                iLower[n][CHZ] = (c > 0) ? iMomentIndex(a, b, c - 1) : -1;
+                iCentral[n] = pthisMagBuffer->iMoments[n];
+                n++;
+            }
+        }
+    }
+    for (i = CHX; i <= CHZ; i++)
+    {
+        iShift = (int64_t) pthisMagBuffer->iMomentCenter[i] - pthisMagCal->iMeanBs[i];
+        if (iShift == 0) continue;
+        for (j = 1; j <= 4; j++)
+            for (n = MAGMOMENTS - 1; n >= 0; n--)
+                if (iExp[n][i] >= j) iCentral[n] += iShift * iCentral[iLower[n][i]];
+    }
+
+    // zero the on and above diagonal elements of fmatA, set the squares terms of its last column and the
+    // products of every pair of non-constant elements of fvecA
+    for (i = 0; i < iSize; i++)
+        for (j = i; j < iSize; j++)
+            pthisMagCal->pScratch->fmatA[i][j] = 0.0F;
+    for (i = 0; i < (iSize - 1); i++)
+    {
+        if (iTerms[i][CHX] + iTerms[i][CHY] + iTerms[i][CHZ] == 2)
+            pthisMagCal->pScratch->fmatA[i][iSize - 1] = (float) (iTerms[i][3] *
+                iCentral[iMomentIndex(iTerms[i][CHX], iTerms[i][CHY], iTerms[i][CHZ])]);
+        for (j = i; j < (iSize - 1); j++)
+            pthisMagCal->pScratch->fmatA[i][j] = (float) (iTerms[i][3] * iTerms[j][3] *
+                iCentral[iMomentIndex(iTerms[i][CHX] + iTerms[j][CHX], iTerms[i][CHY] + iTerms[j][CHY],
+                                      iTerms[i][CHZ] + iTerms[j][CHZ])]);
+    }
+
+    return true;
+} // end iMatrixFromMagBufferMoments()
+#endif
+
+#if F_WARM_START_EIGEN
+// returns the first above diagonal element of the iMatrixSize square matrix fmatA, counting along the rows from
+// element k, that is not negligible against its diagonal elements (held in fvecA during the eigen-decomposition)
+// and sets *pi and *pj to its row and column. Returns the number of above diagonal elements, with *pi and *pj
+// set to 0, if there is none.
+// Negligible elements have already reached the accuracy the ellipsoid fit can use, so are not rotated.
+int8_t iNextEigElement(float fmatA[][10], const float fvecA[], int8_t iMatrixSize, int8_t k,
+                       int8_t *pi, int8_t *pj)
+{
+    int8_t    i,
+            j,
+            l = 0;              // loop counters
+
+    for (i = 0; i < iMatrixSize - 1; i++)
+    {
+        for (j = i + 1; j < iMatrixSize; j++, l++)
+        {
+            if ((l >= k) &&
+                (fabsf(fmatA[i][j]) > EIGENTOLERANCE * sqrtf(fabsf(fvecA[i])) * sqrtf(fabsf(fvecA[j]))))
+            {
+                *pi = i;
+                *pj = j;
+                return l;
+            }
+        }
+    }
+
+    *pi = *pj = 0;
+    return l;
+} // end iNextEigElement()
+#endif
+
 // function maps the uncalibrated magnetometer data fBs (uT) onto calibrated averaged data fBc (uT), iBc (counts)
 void fInvertMagCal(struct MagSensor *pthisMag, struct MagCalibration *pthisMagCal)
 {
@@ -296,20 +1052,70 @@ void fInvertMagCal(struct MagSensor *pthisMag, struct MagCalibration *pthisMagCa
     }
 
     // remove the computed soft iron offsets (uT and counts): fBc=inv(W)*(fBs[]-fV[])
+    fk3x1VeqRu(pthisMag->fBc, pthisMagCal->finvW, ftmp);
     for (i = CHX; i <= CHZ; i++)
     {
-        pthisMag->fBc[i] = pthisMagCal->finvW[i][CHX] *
-            ftmp[CHX] +
-            pthisMagCal->finvW[i][CHY] *
-            ftmp[CHY] +
-            pthisMagCal->finvW[i][CHZ] *
-            ftmp[CHZ];
         pthisMag->iBc[i] = (int16_t) (pthisMag->fBc[i] * pthisMag->fCountsPeruT);
     }
 
     return;
 } // end fInvertMagCal()
 
+// runs one time slice of the calibration in progress
+static void fRunMagCalibrationSlice(struct MagCalibration *pthisMagCal, struct MagBuffer *pthisMagBuffer,
+                                    struct MagSensor *pthisMag)
+{
+    // a calibration uses the calibration scratch from its first slice to its last, so leases it when it starts.
+    // if a precision accelerometer calibration has taken the scratch since, the calibration in progress is
+    // abandoned, to be tried again with the same solver
+    if (pthisMagCal->iCalInProgress)
+    {
+        if (!pthisMagCal->iScratchLease)
+            pthisMagCal->iScratchLease = iLeaseCalibrationScratch(pthisMagCal->pScratch, CALSCRATCH_MAG);
+        if (!iHoldsCalibrationScratch(pthisMagCal->pScratch, pthisMagCal->iScratchLease))
+        {
+            if (pthisMagCal->iCalInProgress == 10) pthisMagCal->i10ElementSolverTried = false;
+            else if (pthisMagCal->iCalInProgress == 7) pthisMagCal->i7ElementSolverTried = false;
+            else pthisMagCal->i4ElementSolverTried = false;
+            pthisMagCal->iCalInProgress = 0;
+            pthisMagCal->iScratchLease = 0;
+        }
+    }
+
+    // on entry each of the calibration functions resets iInitiateMagCal and on completion sets
+    // iCalInProgress=0 and iNewCalibrationAvailable=4,7,10 according to the solver used
+    if (pthisMagCal->iCalInProgress) (pthisMagCal->iCalSlices)++;
+    switch (pthisMagCal->iCalInProgress)
+    {
+        case 0:
+            break;
+
+        case 4:
+            fUpdateMagCalibration4Slice(pthisMagCal, pthisMagBuffer, pthisMag);
+            break;
+
+        case 7:
+            fUpdateMagCalibration7Slice(pthisMagCal, pthisMagBuffer, pthisMag);
+            break;
+
+        case 10:
+            fUpdateMagCalibration10Slice(pthisMagCal, pthisMagBuffer, pthisMag);
+            break;
+
+        default:
+            break;
+    }
+
+    // release the calibration scratch once the calibration has finished with it
+    if (!pthisMagCal->iCalInProgress && pthisMagCal->iScratchLease)
+    {
+        fReleaseCalibrationScratch(pthisMagCal->pScratch, pthisMagCal->iScratchLease);
+        pthisMagCal->iScratchLease = 0;
+    }
+
+    return;
+} // end fRunMagCalibrationSlice()
+
 /**
  * @brief Run the magnetic calibration.
  * Calibration is done in time-slices, to avoid excessive CPU load during
@@ -337,8 +1143,8 @@ void fInvertMagCal(struct MagSensor *pthisMag, struct MagCalibration *pthisMagCa
  * readings were corrupted so the buffer is cleared and the cal process
  * restarts from the top.
  * 
- * The fit error of the existing calibration is 'aged' slowly, 
- * increasing by 1% every 24 hours. This causes a new calibration 
+ * The fit error of the existing calibration is 'aged' slowly by
+ * fAgeMagCalibration(), increasing by 1% every 24 hours. This causes a new calibration 
  * to be favoured over the old one after sufficient time elapses.
  * I am unsure whether this is desirable in a nautical application
  * where it is conceivable for the vessel to be on a consistent
@@ -381,9 +1187,11 @@ void fRunMagCalibration(struct MagCalibration *pthisMagCal, struct MagBuffer *pt
             pthisMagCal->iInitiateMagCal = 4;
         }
 
-        // otherwise start a calibration at regular interval defined by CAL_INTERVAL_SECS
+        // otherwise start a calibration at regular interval defined by CAL_INTERVAL_SECS, or the shorter
+        // BACKGROUND_CAL_INTERVAL_SECS when a worker task solves the calibrations
         else if (!pthisMagCal->iInitiateMagCal &&
-                 !(loopcounter % (CAL_INTERVAL_SECS * FUSION_HZ)))
+                 !(loopcounter % ((pthisMagCal->pWorker ? BACKGROUND_CAL_INTERVAL_SECS : CAL_INTERVAL_SECS) *
+                                  FUSION_HZ)))
         {
             if (pthisMagBuffer->iMagBufferCount >= MINMEASUREMENTS10CAL)
             {
@@ -404,34 +1212,24 @@ void fRunMagCalibration(struct MagCalibration *pthisMagCal, struct MagBuffer *pt
 
         // store the selected calibration model (if any) to be run
         pthisMagCal->iCalInProgress = pthisMagCal->iInitiateMagCal;
+        pthisMagCal->iEigenSweeps = 0;
+        pthisMagCal->iCalSlices = 0;
     }
 
-    // on entry each of the calibration functions resets iInitiateMagCal and on completion sets
-    // iCalInProgress=0 and iNewCalibrationAvailable=4,7,10 according to the solver used
-    switch (pthisMagCal->iCalInProgress)
-    {
-        case 0:
-            break;
-
-        case 4:
-            fUpdateMagCalibration4Slice(pthisMagCal, pthisMagBuffer, pthisMag);
-            break;
-
-        case 7:
-            fUpdateMagCalibration7Slice(pthisMagCal, pthisMagBuffer, pthisMag);
-            break;
-
-        case 10:
-            fUpdateMagCalibration10Slice(pthisMagCal, pthisMagBuffer, pthisMag);
-            break;
-
-        default:
-            break;
-    }
+    // run the calibration in progress: one time slice of it here, or in the background by a worker task,
+    // which solves it from copies and with its own scratch matrices (see mag_cal_worker.h)
+    if (pthisMagCal->pWorker)
+        MagCalWorkerExchange(pthisMagCal->pWorker, pthisMagCal, pthisMagBuffer, pthisMag);
+    else
+        fRunMagCalibrationSlice(pthisMagCal, pthisMagBuffer, pthisMag);
 
     // evaluate the new calibration to determine whether to accept it
     if (pthisMagCal->iNewCalibrationAvailable)
     {
+        // flag the sweep and slice counts of the completed calibration for the timing statistics
+        pthisMagCal->iCalStatsReady = pthisMagCal->iNewCalibrationAvailable;
+        pthisMagCal->iCalsSolved++;
+
         // the geomagnetic field strength must be in range (earth is 22uT to 67uT) with reasonable fit error
         if ((pthisMagCal->ftrB >= MINBFITUT) && (pthisMagCal->ftrB <= MAXBFITUT) &&
             (pthisMagCal->ftrFitErrorpc <= 15.0F))
@@ -457,27 +1255,31 @@ void fRunMagCalibration(struct MagCalibration *pthisMagCal, struct MagBuffer *pt
         else if(pthisMagCal->i10ElementSolverTried)
         {
             // the magnetic buffer is presumed corrupted so clear out all measurements and restart calibration attempts
-            pthisMagBuffer->iMagBufferCount = 0;
-            for (i = 0; i < MAGBUFFSIZEX; i++)
-                for (j = 0; j < MAGBUFFSIZEY; j++)
-                    pthisMagBuffer->index[i][j] = -1;
+            iClearMagBuffer(pthisMagBuffer, loopcounter);
             pthisMagCal->i4ElementSolverTried = false;
             pthisMagCal->i7ElementSolverTried = false;
             pthisMagCal->i10ElementSolverTried = false;
+#if F_WARM_START_EIGEN
+            pthisMagCal->iWarmStartSize = 0;
+#endif
         }       // end of test for new calibration within field strength and fit error limits
 
         // reset the new calibration flag
         pthisMagCal->iNewCalibrationAvailable = 0;
     }           // end of test for new calibration available
 
-    // age the existing fit error very slowly to avoid one good calibration locking out future updates.
-    // this prevents a calibration remaining for ever if a unit is never powered down
-    if (pthisMagCal->iValidMagCal)
-        pthisMagCal->fFitErrorpc += 1.0F / ((float) FUSION_HZ * FITERRORAGINGSECS);
-
     return;
 } // end fRunMagCalibration()
 
+// age the existing fit error very slowly to avoid one good calibration locking out future updates.
+// this prevents a calibration remaining for ever if a unit is never powered down. Called once per fusion,
+// however many times fRunMagCalibration() was called in it
+void fAgeMagCalibration(struct MagCalibration *pthisMagCal)
+{
+    if (pthisMagCal->iValidMagCal)
+        pthisMagCal->fFitErrorpc += 1.0F / ((float) FUSION_HZ * FITERRORAGINGSECS);
+} // end fAgeMagCalibration()
+
 // 4 element calibration using 4x4 matrix inverse
 void fUpdateMagCalibration4Slice(struct MagCalibration *pthisMagCal,
                                  struct MagBuffer *pthisMagBuffer, struct MagSensor *pthisMag)
@@ -487,11 +1289,8 @@ void fUpdateMagCalibration4Slice(struct MagCalibration *pthisMagCal,
             j,
             k;                  // loop counters
 
-    // working arrays for 4x4 matrix inversion
+    // row pointers for 4x4 matrix inversion
     float   *pfRows[4];
-    int8_t    iColInd[4];
-    int8_t    iRowInd[4];
-    int8_t    iPivot[4];
 
     // reset the time slice to zero if iInitiateMagCal is set and then clear iInitiateMagCal
     if (pthisMagCal->iInitiateMagCal)
@@ -511,8 +1310,8 @@ void fUpdateMagCalibration4Slice(struct MagCalibration *pthisMagCal,
         pthisMagCal->fYTY = 0.0F;
         for (i = 0; i < 4; i++)
         {
-            pthisMagCal->fvecA[i] = 0.0F;
-            for (j = i; j < 4; j++) pthisMagCal->fmatA[i][j] = 0.0F;
+            pthisMagCal->pScratch->fvecA[i] = 0.0F;
+            for (j = i; j < 4; j++) pthisMagCal->pScratch->fmatA[i][j] = 0.0F;
         }
 
         // zero total number of measurements and measurement sums
@@ -524,11 +1323,11 @@ void fUpdateMagCalibration4Slice(struct MagCalibration *pthisMagCal,
         {
             for (j = 0; j < MAGBUFFSIZEY; j++)
             {
-                if (pthisMagBuffer->index[i][j] != -1)
+                if (iMagBufferBinActive(pthisMagBuffer, i, j))
                 {
                     iM++;
                     for (k = 0; k < 3; k++)
-                        pthisMagCal->iSumBs[k] += (int32_t) pthisMagBuffer->iBs[k][i][j];
+                        pthisMagCal->iSumBs[k] += (int32_t) MAGBUFFER_BS(pthisMagBuffer, k, i, j);
                 }
             }
         }
@@ -555,6 +1354,12 @@ void fUpdateMagCalibration4Slice(struct MagCalibration *pthisMagCal,
         // for defensive programming, re-store the number of active measurements in the buffer
         pthisMagBuffer->iMagBufferCount = iM;
 
+#if F_FIXED_POINT_FUSION
+        // accumulate exact integer sums if the measurements are close enough to their mean
+        pthisMagCal->iFixedSums = iMagBufferFitsFixedSums(pthisMagCal, pthisMagBuffer);
+        for (i = 0; i < FIXEDCALSUMS; i++) pthisMagCal->iSumA[i] = 0;
+#endif
+
         // increment the time slice
         (pthisMagCal->itimeslice)++;
     }                           // end of time slice 0
@@ -569,21 +1374,53 @@ void fUpdateMagCalibration4Slice(struct MagCalibration *pthisMagCal,
 
         // accumulate the measurement matrix elements XTX (in fmatA), XTY (in fvecA) and YTY on the zero mean measurements
         i = pthisMagCal->itimeslice - 1;
+#if F_FIXED_POINT_FUSION
+        if (pthisMagCal->iFixedSums)
+        {
+            int32_t  iBsZeroMeanSq; // squared magnetic measurement (counts^2)
+            int8_t   l,
+                     n;             // loop counter and index into iSumA
+
+            // accumulate XTX in iSumA[0-5], XTY in iSumA[6-9] and YTY in iSumA[10]
+            for (j = 0; j < MAGBUFFSIZEY; j++)
+            {
+                if (iMagBufferBinActive(pthisMagBuffer, i, j))
+                {
+                    for (k = 0; k < 3; k++)
+                        iBsZeroMean[k] = (int32_t) MAGBUFFER_BS(pthisMagBuffer, k, i, j) -
+                            (int32_t) pthisMagCal->iMeanBs[k];
+                    n = 0;
+                    for (k = 0; k < 3; k++)
+                        for (l = k; l < 3; l++)
+                            pthisMagCal->iSumA[n++] += iBsZeroMean[k] * iBsZeroMean[l];
+                    iBsZeroMeanSq = iBsZeroMean[CHX] * iBsZeroMean[CHX] +
+                        iBsZeroMean[CHY] * iBsZeroMean[CHY] +
+                        iBsZeroMean[CHZ] * iBsZeroMean[CHZ];
+                    for (k = 0; k < 3; k++)
+                        pthisMagCal->iSumA[6 + k] += (int64_t) iBsZeroMean[k] * iBsZeroMeanSq;
+                    pthisMagCal->iSumA[9] += iBsZeroMeanSq;
+                    pthisMagCal->iSumA[10] += (int64_t) iBsZeroMeanSq * iBsZeroMeanSq;
+                }
+            }
+        }
+        else
+#endif
         for (j = 0; j < MAGBUFFSIZEY; j++)
         {
-            if (pthisMagBuffer->index[i][j] != -1)
+            if (iMagBufferBinActive(pthisMagBuffer, i, j))
             {
                 // compute zero mean measurements
                 for (k = 0; k < 3; k++)
-                    iBsZeroMean[k] = (int32_t) pthisMagBuffer->iBs[k][i][j] - (int32_t) pthisMagCal->iMeanBs[k];
+                    iBsZeroMean[k] = (int32_t) MAGBUFFER_BS(pthisMagBuffer, k, i, j) -
+                        (int32_t) pthisMagCal->iMeanBs[k];
 
                 // accumulate the non-zero elements of zero mean XTX (in fmatA)
-                pthisMagCal->fmatA[0][0] += (float) (iBsZeroMean[0] * iBsZeroMean[0]);
-                pthisMagCal->fmatA[0][1] += (float) (iBsZeroMean[0] * iBsZeroMean[1]);
-                pthisMagCal->fmatA[0][2] += (float) (iBsZeroMean[0] * iBsZeroMean[2]);
-                pthisMagCal->fmatA[1][1] += (float) (iBsZeroMean[1] * iBsZeroMean[1]);
-                pthisMagCal->fmatA[1][2] += (float) (iBsZeroMean[1] * iBsZeroMean[2]);
-                pthisMagCal->fmatA[2][2] += (float) (iBsZeroMean[2] * iBsZeroMean[2]);
+                pthisMagCal->pScratch->fmatA[0][0] += (float) (iBsZeroMean[0] * iBsZeroMean[0]);
+                pthisMagCal->pScratch->fmatA[0][1] += (float) (iBsZeroMean[0] * iBsZeroMean[1]);
+                pthisMagCal->pScratch->fmatA[0][2] += (float) (iBsZeroMean[0] * iBsZeroMean[2]);
+                pthisMagCal->pScratch->fmatA[1][1] += (float) (iBsZeroMean[1] * iBsZeroMean[1]);
+                pthisMagCal->pScratch->fmatA[1][2] += (float) (iBsZeroMean[1] * iBsZeroMean[2]);
+                pthisMagCal->pScratch->fmatA[2][2] += (float) (iBsZeroMean[2] * iBsZeroMean[2]);
 
                 // accumulate XTY (in fvecA)
                 fBsZeroMeanSq = (float)
@@ -596,8 +1433,8 @@ void fUpdateMagCalibration4Slice(struct MagCalibration *pthisMagCal,
                         iBsZeroMean[CHZ]
                     );
                 for (k = 0; k < 3; k++)
-                    pthisMagCal->fvecA[k] += (float) iBsZeroMean[k] * fBsZeroMeanSq;
-                pthisMagCal->fvecA[3] += fBsZeroMeanSq;
+                    pthisMagCal->pScratch->fvecA[k] += (float) iBsZeroMean[k] * fBsZeroMeanSq;
+                pthisMagCal->pScratch->fvecA[3] += fBsZeroMeanSq;
 
                 // accumulate fYTY
                 pthisMagCal->fYTY += fBsZeroMeanSq * fBsZeroMeanSq;
@@ -614,8 +1451,22 @@ void fUpdateMagCalibration4Slice(struct MagCalibration *pthisMagCal,
     {
         int8_t    ierror; // matrix inversion error flag
 
+#if F_FIXED_POINT_FUSION
+        if (pthisMagCal->iFixedSums)
+        {
+            // set fmatA, fvecA and fYTY from the integer sums
+            k = 0;
+            for (i = 0; i < 3; i++)
+                for (j = i; j < 3; j++)
+                    pthisMagCal->pScratch->fmatA[i][j] = (float) pthisMagCal->iSumA[k++];
+            for (i = 0; i < 4; i++)
+                pthisMagCal->pScratch->fvecA[i] = (float) pthisMagCal->iSumA[6 + i];
+            pthisMagCal->fYTY = (float) pthisMagCal->iSumA[10];
+        }
+#endif
+
         // set fmatA[3][3] = X^T.X[3][3] to number of measurements found
-        pthisMagCal->fmatA[3][3] = (float) pthisMagBuffer->iMagBufferCount;
+        pthisMagCal->pScratch->fmatA[3][3] = (float) pthisMagBuffer->iMagBufferCount;
 
         // enable the magnetic buffer for writing now that the matrices have been computed
         pthisMagCal->iMagBufferReadOnly = false;
@@ -624,12 +1475,12 @@ void fUpdateMagCalibration4Slice(struct MagCalibration *pthisMagCal,
         for (i = 0; i < 4; i++)
         {
             for (j = 0; j <= i; j++)
-                pthisMagCal->fmatB[i][j] = pthisMagCal->fmatB[j][i] = pthisMagCal->fmatA[i][j] = pthisMagCal->fmatA[j][i];
+                pthisMagCal->pScratch->fmatB[i][j] = pthisMagCal->pScratch->fmatB[j][i] = pthisMagCal->pScratch->fmatA[i][j] = pthisMagCal->pScratch->fmatA[j][i];
         }
 
-        // set fmatB = inv(fmatB) = inv(X^T.X)
-        for (i = 0; i < 4; i++) pfRows[i] = pthisMagCal->fmatB[i];
-        fmatrixAeqInvA(pfRows, iColInd, iRowInd, iPivot, 4, &ierror);
+        // set fmatB = inv(fmatB) = inv(X^T.X) which is symmetric positive definite
+        for (i = 0; i < 4; i++) pfRows[i] = pthisMagCal->pScratch->fmatB[i];
+        fmatrixAeqInvSymA(pfRows, 4, &ierror);
 
         // increment the time slice
         (pthisMagCal->itimeslice)++;
@@ -643,23 +1494,23 @@ void fUpdateMagCalibration4Slice(struct MagCalibration *pthisMagCal,
         float   ftmp;   // scratch
 
         // the trial inverse soft iron matrix invW always equals the identity matrix for 4 element calibration
-        f3x3matrixAeqI(pthisMagCal->ftrinvW);
+        fk3x3AeqI(pthisMagCal->ftrinvW);
 
         // calculate solution vector fvecB = beta (4x1) = inv(X^T.X).X^T.Y = fmatB * fvecA (counts)
         for (i = 0; i < 4; i++)
         {
-            pthisMagCal->fvecB[i] = pthisMagCal->fmatB[i][0] * pthisMagCal->fvecA[0];
+            pthisMagCal->pScratch->fvecB[i] = pthisMagCal->pScratch->fmatB[i][0] * pthisMagCal->pScratch->fvecA[0];
             for (j = 1; j < 4; j++)
-                pthisMagCal->fvecB[i] += pthisMagCal->fmatB[i][j] * pthisMagCal->fvecA[j];
+                pthisMagCal->pScratch->fvecB[i] += pthisMagCal->pScratch->fmatB[i][j] * pthisMagCal->pScratch->fvecA[j];
         }
 
         // compute the hard iron vector (uT) correction for zero mean data
         ftmp = 0.5F * pthisMag->fuTPerCount;
         for (i = CHX; i <= CHZ; i++)
-            pthisMagCal->ftrV[i] = ftmp * pthisMagCal->fvecB[i];
+            pthisMagCal->ftrV[i] = ftmp * pthisMagCal->pScratch->fvecB[i];
 
         // compute the geomagnetic field strength B (uT)
-        pthisMagCal->ftrB = pthisMagCal->fvecB[3] *
+        pthisMagCal->ftrB = pthisMagCal->pScratch->fvecB[3] *
             pthisMag->fuTPerCount *
             pthisMag->fuTPerCount;
         for (i = CHX; i <= CHZ; i++)
@@ -673,9 +1524,9 @@ void fUpdateMagCalibration4Slice(struct MagCalibration *pthisMagCal,
 
         // calculate E = r^T.r = Y^T.Y - 2 * beta^T.(X^T.Y) + beta^T.(X^T.X).beta
         // set E = beta^T.(X^T.Y) = fvecB^T.fvecA
-        fE = pthisMagCal->fvecB[0] * pthisMagCal->fvecA[0];
+        fE = pthisMagCal->pScratch->fvecB[0] * pthisMagCal->pScratch->fvecA[0];
         for (i = 1; i < 4; i++)
-            fE += pthisMagCal->fvecB[i] * pthisMagCal->fvecA[i];
+            fE += pthisMagCal->pScratch->fvecB[i] * pthisMagCal->pScratch->fvecA[i];
 
         // set E = YTY - 2 * beta^T.(X^T.Y) = YTY - 2 * E;
         fE = pthisMagCal->fYTY - 2.0F * fE;
@@ -683,14 +1534,14 @@ void fUpdateMagCalibration4Slice(struct MagCalibration *pthisMagCal,
         // set fvecA = (X^T.X).beta = fmatA.fvecB
         for (i = 0; i < 4; i++)
         {
-            pthisMagCal->fvecA[i] = pthisMagCal->fmatA[i][0] * pthisMagCal->fvecB[0];
+            pthisMagCal->pScratch->fvecA[i] = pthisMagCal->pScratch->fmatA[i][0] * pthisMagCal->pScratch->fvecB[0];
             for (j = 1; j < 4; j++)
-                pthisMagCal->fvecA[i] += pthisMagCal->fmatA[i][j] * pthisMagCal->fvecB[j];
+                pthisMagCal->pScratch->fvecA[i] += pthisMagCal->pScratch->fmatA[i][j] * pthisMagCal->pScratch->fvecB[j];
         }
 
         // add beta^T.(X^T.X).beta = fvecB^T * fvecA to give fit error E (un-normalized counts^4)
         for (i = 0; i < 4; i++)
-            fE += pthisMagCal->fvecB[i] * pthisMagCal->fvecA[i];
+            fE += pthisMagCal->pScratch->fvecB[i] * pthisMagCal->pScratch->fvecA[i];
 
         // normalize fit error to the number of measurements and take square root to get error in uT^2
         fE = sqrtf(fabs(fE) / (float) pthisMagBuffer->iMagBufferCount) *
@@ -714,12 +1565,13 @@ void fUpdateMagCalibration7Slice(struct MagCalibration *pthisMagCal,
                                  struct MagBuffer *pthisMagBuffer, struct MagSensor *pthisMag)
 {
     // local variables
+#if !F_WARM_START_EIGEN
     float   fresidue;   // eigen-decomposition residual sum
+#endif
     float   ftmp;       // scratch variable
     int8_t    i,
             j,
-            k,
-            l;          // loop counters
+            k;          // loop counters
 #define MATRIX_7_SIZE   7
     // reset the time slice to zero if iInitiateMagCal is set and then clear iInitiateMagCal
     if (pthisMagCal->iInitiateMagCal)
@@ -729,6 +1581,18 @@ void fUpdateMagCalibration7Slice(struct MagCalibration *pthisMagCal,
         pthisMagCal->iMagBufferReadOnly = true;
     }
 
+#if F_INCREMENTAL_MAG_SUMS
+    // time slice 0 with running moments: set the mean and fmatA directly from the moments that iUpdateMagBuffer()
+    // maintains and skip the accumulation time slices
+    if ((pthisMagCal->itimeslice == 0) && iMatrixFromMagBufferMoments(pthisMagCal, pthisMagBuffer, MATRIX_7_SIZE))
+    {
+#if F_FIXED_POINT_FUSION
+        pthisMagCal->iFixedSums = false;
+#endif
+        pthisMagCal->itimeslice = MAGBUFFSIZEX * MAGBUFFSIZEY + 1;
+    }
+    else
+#endif
     // time slice 0: 18.1K KL25Z ticks for 300 measurements = 0.38ms on KL25Z (variable) stored in systick[0]
     // zero measurement matrix and calculate the mean values in the magnetic buffer
     if (pthisMagCal->itimeslice == 0)
@@ -738,7 +1602,7 @@ void fUpdateMagCalibration7Slice(struct MagCalibration *pthisMagCal,
         // zero the on and above diagonal elements of the 7x7 symmetric measurement matrix fmatA
         for (i = 0; i < MATRIX_7_SIZE; i++)
             for (j = i; j < MATRIX_7_SIZE; j++)
-                pthisMagCal->fmatA[i][j] = 0.0F;
+                pthisMagCal->pScratch->fmatA[i][j] = 0.0F;
 
         // compute the sum of measurements in the magnetic buffer
         iM = 0;
@@ -747,11 +1611,11 @@ void fUpdateMagCalibration7Slice(struct MagCalibration *pthisMagCal,
         {
             for (j = 0; j < MAGBUFFSIZEY; j++)
             {
-                if (pthisMagBuffer->index[i][j] != -1)
+                if (iMagBufferBinActive(pthisMagBuffer, i, j))
                 {
                     iM++;
                     for (k = 0; k < 3; k++)
-                        pthisMagCal->iSumBs[k] += (int32_t) pthisMagBuffer->iBs[k][i][j];
+                        pthisMagCal->iSumBs[k] += (int32_t) MAGBUFFER_BS(pthisMagBuffer, k, i, j);
                 }
             }
         }
@@ -778,6 +1642,12 @@ void fUpdateMagCalibration7Slice(struct MagCalibration *pthisMagCal,
         // as defensive programming also ensure the number of measurements found is re-stored
         pthisMagBuffer->iMagBufferCount = iM;
 
+#if F_FIXED_POINT_FUSION
+        // accumulate exact integer sums if the measurements are close enough to their mean
+        pthisMagCal->iFixedSums = iMagBufferFitsFixedSums(pthisMagCal, pthisMagBuffer);
+        for (i = 0; i < FIXEDCALSUMS; i++) pthisMagCal->iSumA[i] = 0;
+#endif
+
         // increment the time slice for the next iteration
         (pthisMagCal->itimeslice)++;
     }                   // end of time slice 0
@@ -789,30 +1659,40 @@ void fUpdateMagCalibration7Slice(struct MagCalibration *pthisMagCal,
         // accumulate the symmetric matrix fmatA on the zero mean measurements
         i = (pthisMagCal->itimeslice - 1) / MAGBUFFSIZEY;   // matrix row i ranges 0 to MAGBUFFSIZEX-1
         j = (pthisMagCal->itimeslice - 1) % MAGBUFFSIZEY;   // matrix column j ranges 0 to MAGBUFFSIZEY-1
-        if (pthisMagBuffer->index[i][j] != -1)
+#if F_FIXED_POINT_FUSION
+        if (iMagBufferBinActive(pthisMagBuffer, i, j) && pthisMagCal->iFixedSums)
+        {
+            int32_t iVec[MATRIX_7_SIZE - 1];    // squares of the zero mean measurements then the measurements
+
+            for (k = 0; k < 3; k++)
+            {
+                iVec[k + 3] = (int32_t) MAGBUFFER_BS(pthisMagBuffer, k, i, j) - (int32_t) pthisMagCal->iMeanBs[k];
+                iVec[k] = iVec[k + 3] * iVec[k + 3];
+            }
+            iAccumulateFixedSums(pthisMagCal->iSumA, iVec, MATRIX_7_SIZE, 3);
+        }
+        else
+#endif
+        if (iMagBufferBinActive(pthisMagBuffer, i, j))
         {
             // set fvecA to be vector of zero mean measurements and their squares
             for (k = 0; k < 3; k++)
             {
-                pthisMagCal->fvecA[k + 3] = (float)
+                pthisMagCal->pScratch->fvecA[k + 3] = (float)
                     (
-                        (int32_t) pthisMagBuffer->iBs[k][i][j] -
+                        (int32_t) MAGBUFFER_BS(pthisMagBuffer, k, i, j) -
                         (int32_t) pthisMagCal->iMeanBs[k]
                     );
-                pthisMagCal->fvecA[k] = pthisMagCal->fvecA[k + 3] * pthisMagCal->fvecA[k + 3];
+                pthisMagCal->pScratch->fvecA[k] = pthisMagCal->pScratch->fvecA[k + 3] * pthisMagCal->pScratch->fvecA[k + 3];
             }
 
             // update non-zero elements fmatA[0-2][6] of fmatA ignoring fmatA[6][6] which is set later.
             // elements fmatA[3-5][6] are zero as a result of subtracting the mean value
             for (k = 0; k < 3; k++)
-                pthisMagCal->fmatA[k][6] += pthisMagCal->fvecA[k];
+                pthisMagCal->pScratch->fmatA[k][6] += pthisMagCal->pScratch->fvecA[k];
 
             // update the remaining on and above diagonal elements fmatA[0-5][0-5]
-            for (k = 0; k < (MATRIX_7_SIZE - 1); k++)
-            {
-                for (l = k; l < (MATRIX_7_SIZE - 1); l++)
-                    pthisMagCal->fmatA[k][l] += pthisMagCal->fvecA[k] * pthisMagCal->fvecA[l];
-            }
+            fk10x10AaddxxT6(pthisMagCal->pScratch->fmatA, pthisMagCal->pScratch->fvecA);
         }
 
         // increment the time slice for the next iteration
@@ -823,8 +1703,14 @@ void fUpdateMagCalibration7Slice(struct MagCalibration *pthisMagCal,
     // re-enable magnetic buffer for writing and prepare fmatA, fmatB, fvecA for eigendecomposition
     else if (pthisMagCal->itimeslice == (MAGBUFFSIZEX * MAGBUFFSIZEY + 1))
     {
+#if F_FIXED_POINT_FUSION
+        // set the accumulated elements of fmatA from the integer sums
+        if (pthisMagCal->iFixedSums)
+            fMatrixFromFixedSums(pthisMagCal->pScratch->fmatA, pthisMagCal->iSumA, MATRIX_7_SIZE, 3);
+#endif
+
         // set fmatA[6][6] to the number of magnetic measurements found
-        pthisMagCal->fmatA[MATRIX_7_SIZE - 1][MATRIX_7_SIZE - 1] = (float) pthisMagBuffer->iMagBufferCount;
+        pthisMagCal->pScratch->fmatA[MATRIX_7_SIZE - 1][MATRIX_7_SIZE - 1] = (float) pthisMagBuffer->iMagBufferCount;
 
         // clear the magnetic buffer read only flag now that the matrices have been computed
         pthisMagCal->iMagBufferReadOnly = false;
@@ -832,19 +1718,32 @@ void fUpdateMagCalibration7Slice(struct MagCalibration *pthisMagCal,
         // set below diagonal elements of 7x7 matrix fmatA to above diagonal elements
         for (i = 1; i < MATRIX_7_SIZE; i++)
             for (j = 0; j < i; j++)
-                pthisMagCal->fmatA[i][j] = pthisMagCal->fmatA[j][i];
+                pthisMagCal->pScratch->fmatA[i][j] = pthisMagCal->pScratch->fmatA[j][i];
 
-        // set matrix of eigenvectors fmatB to identity matrix and eigenvalues vector fvecA to diagonal elements of fmatA
-        for (i = 0; i < MATRIX_7_SIZE; i++)
+#if F_WARM_START_EIGEN
+        if (pthisMagCal->iWarmStartSize == MATRIX_7_SIZE)
         {
-            for (j = 0; j < MATRIX_7_SIZE; j++)
-                pthisMagCal->fmatB[i][j] = 0.0F;
-            pthisMagCal->fmatB[i][i] = 1.0F;
-            pthisMagCal->fvecA[i] = pthisMagCal->fmatA[i][i];
+            // resume from the eigenvectors of the previous 7 element calibration and go straight to the exit
+            // test since a similar constellation needs few, if any, further rotations
+            fEigenWarmStart10(pthisMagCal->pScratch->fmatA, pthisMagCal->pScratch->fvecA, pthisMagCal->pScratch->fmatB,
+                              pthisMagCal->fmatV, MATRIX_7_SIZE);
+            pthisMagCal->itimeslice = MAGBUFFSIZEX * MAGBUFFSIZEY + 23;
         }
+        else
+#endif
+        {
+            // set matrix of eigenvectors fmatB to identity matrix and eigenvalues vector fvecA to diagonal elements of fmatA
+            for (i = 0; i < MATRIX_7_SIZE; i++)
+            {
+                for (j = 0; j < MATRIX_7_SIZE; j++)
+                    pthisMagCal->pScratch->fmatB[i][j] = 0.0F;
+                pthisMagCal->pScratch->fmatB[i][i] = 1.0F;
+                pthisMagCal->pScratch->fvecA[i] = pthisMagCal->pScratch->fmatA[i][i];
+            }
 
-        // increment the time slice for the next iteration
-        (pthisMagCal->itimeslice)++;
+            // increment the time slice for the next iteration
+            (pthisMagCal->itimeslice)++;
+        }
     }                   // end of time slice MAGBUFFSIZEX * MAGBUFFSIZEY + 1
 
     // repeating 21 time slices MAGBUFFSIZEX * MAGBUFFSIZEY + 2 to MAGBUFFSIZEX * MAGBUFFSIZEY + 22 inclusive
@@ -854,8 +1753,24 @@ void fUpdateMagCalibration7Slice(struct MagCalibration *pthisMagCal,
     else if ((pthisMagCal->itimeslice >= (MAGBUFFSIZEX * MAGBUFFSIZEY + 2)) &&
              (pthisMagCal->itimeslice <= (MAGBUFFSIZEX * MAGBUFFSIZEY + 22)))
     {
+        // count the sweeps of the eigen-decomposition for the timing statistics
+        if (pthisMagCal->itimeslice == (MAGBUFFSIZEX * MAGBUFFSIZEY + 2)) (pthisMagCal->iEigenSweeps)++;
+
         // set k to the matrix element in range 0 to 20 to be zeroed and used it to set row i and column j
         k = pthisMagCal->itimeslice - (MAGBUFFSIZEX * MAGBUFFSIZEY + 2);
+#if F_WARM_START_EIGEN
+        // rotate the next element that is not yet negligible, skipping the others without using up a time slice,
+        // and go to the exit test once none remain in this sweep
+        k = iNextEigElement(pthisMagCal->pScratch->fmatA, pthisMagCal->pScratch->fvecA, MATRIX_7_SIZE, k, &i, &j);
+        if (k < 21)
+        {
+            fComputeEigSlice(pthisMagCal->pScratch->fmatA, pthisMagCal->pScratch->fmatB,
+                             pthisMagCal->pScratch->fvecA, i, j, MATRIX_7_SIZE);
+            pthisMagCal->itimeslice = MAGBUFFSIZEX * MAGBUFFSIZEY + 3 + k;
+        }
+        else
+            pthisMagCal->itimeslice = MAGBUFFSIZEX * MAGBUFFSIZEY + 23;
+#else
         if (k < 6)
         {
             i = 0;
@@ -888,23 +1803,42 @@ void fUpdateMagCalibration7Slice(struct MagCalibration *pthisMagCal,
         }
 
         // only continue if matrix element i, j has not already been zeroed
-        if (fabsf(pthisMagCal->fmatA[i][j]) > 0.0F)
-            fComputeEigSlice(pthisMagCal->fmatA, pthisMagCal->fmatB,
-                             pthisMagCal->fvecA, i, j, MATRIX_7_SIZE);
+        if (fabsf(pthisMagCal->pScratch->fmatA[i][j]) > 0.0F)
+            fComputeEigSlice(pthisMagCal->pScratch->fmatA, pthisMagCal->pScratch->fmatB,
+                             pthisMagCal->pScratch->fvecA, i, j, MATRIX_7_SIZE);
 
         // increment the time slice for the next iteration
         (pthisMagCal->itimeslice)++;
+#endif
     }                   // end of time slice MAGBUFFSIZEX * MAGBUFFSIZEY + 2 to MAGBUFFSIZEX * MAGBUFFSIZEY + 22 inclusive
 
     // time slice MAGBUFFSIZEX * MAGBUFFSIZEY + 23: 2.6k ticks on KL25Z = 0.05ms on KL25Z (constant) (stored in systick[4])
     // compute the sum of the absolute values of above diagonal elements in fmatA as eigen-decomposition exit criterion
     else if (pthisMagCal->itimeslice == (MAGBUFFSIZEX * MAGBUFFSIZEY + 23))
     {
+#if F_WARM_START_EIGEN
+        // the eigen-decomposition is complete once every above diagonal element is negligible, or after
+        // EIGENMAXSWEEPS sweeps. its eigenvectors are kept as the start of the next 7 element calibration.
+        if ((iNextEigElement(pthisMagCal->pScratch->fmatA, pthisMagCal->pScratch->fvecA, MATRIX_7_SIZE, 0, &i, &j) < 21) &&
+            (pthisMagCal->iEigenSweeps < EIGENMAXSWEEPS))
+            // continue the eigen-decomposition
+            (pthisMagCal->itimeslice) = MAGBUFFSIZEX * MAGBUFFSIZEY + 2;
+        else
+        {
+            for (i = 0; i < MATRIX_7_SIZE; i++)
+                for (j = 0; j < MATRIX_7_SIZE; j++)
+                    pthisMagCal->fmatV[i][j] = pthisMagCal->pScratch->fmatB[i][j];
+            pthisMagCal->iWarmStartSize = MATRIX_7_SIZE;
+
+            // continue to compute the calibration coefficients since the eigen-decomposition is complete
+            (pthisMagCal->itimeslice)++;
+        }
+#else
         // sum residue of all above-diagonal elements
         fresidue = 0.0F;
         for (i = 0; i < MATRIX_7_SIZE; i++)
             for (j = i + 1; j < MATRIX_7_SIZE; j++)
-                fresidue += fabsf(pthisMagCal->fmatA[i][j]);
+                fresidue += fabsf(pthisMagCal->pScratch->fmatA[i][j]);
 
         // determine whether to re-enter the eigen-decomposition or skip to calculation of the calibration coefficients
         if (fresidue > 0.0F)
@@ -913,6 +1847,7 @@ void fUpdateMagCalibration7Slice(struct MagCalibration *pthisMagCal,
         else
             // continue to compute the calibration coefficients since the eigen-decomposition is complete
             (pthisMagCal->itimeslice)++;
+#endif
     }                   // end of time slice MAGBUFFSIZEX * MAGBUFFSIZEY + 23
 
     // time slice MAGBUFFSIZEX * MAGBUFFSIZEY + 24: 27.8k ticks = 0.58ms on KL25Z (constant) (stored in systick[5])
@@ -925,19 +1860,19 @@ void fUpdateMagCalibration7Slice(struct MagCalibration *pthisMagCal,
         // set imin to the index of the smallest eigenvalue in fvecA
         imin = 0;
         for (i = 1; i < MATRIX_7_SIZE; i++)
-            if (pthisMagCal->fvecA[i] < pthisMagCal->fvecA[imin]) imin = i;
+            if (pthisMagCal->pScratch->fvecA[i] < pthisMagCal->pScratch->fvecA[imin]) imin = i;
 
         // the ellipsoid fA must have positive determinant but the eigensolver can equally easily return a negated
         // normalized eigenvector without changing the eigenvalue. compute the determinant of ellipsoid matrix A
         // from first three elements of eigenvector and negate the eigenvector if negative.
-        fdetA = pthisMagCal->fmatB[CHX][imin] *
-            pthisMagCal->fmatB[CHY][imin] *
-            pthisMagCal->fmatB[CHZ][imin];
+        fdetA = pthisMagCal->pScratch->fmatB[CHX][imin] *
+            pthisMagCal->pScratch->fmatB[CHY][imin] *
+            pthisMagCal->pScratch->fmatB[CHZ][imin];
         if (fdetA < 0.0F)
         {
             fdetA = fabs(fdetA);
             for (i = 0; i < MATRIX_7_SIZE; i++)
-                pthisMagCal->fmatB[i][imin] = -pthisMagCal->fmatB[i][imin];
+                pthisMagCal->pScratch->fmatB[i][imin] = -pthisMagCal->pScratch->fmatB[i][imin];
         }
 
         // set diagonal elements of ellipsoid matrix A to the solution vector imin with smallest eigenvalue and
@@ -945,18 +1880,18 @@ void fUpdateMagCalibration7Slice(struct MagCalibration *pthisMagCal,
         // compute the hard iron offset fV for zero mean data (counts)
         for (i = CHX; i <= CHZ; i++)
             pthisMagCal->ftrV[i] = -0.5F *
-                pthisMagCal->fmatB[i + 3][imin] /
-                pthisMagCal->fmatB[i][imin];
+                pthisMagCal->pScratch->fmatB[i + 3][imin] /
+                pthisMagCal->pScratch->fmatB[i][imin];
 
         // set ftmp to the square of the geomagnetic field strength fB (counts) corresponding to current value of fdetA
-        ftmp = -pthisMagCal->fmatB[6][imin];
+        ftmp = -pthisMagCal->pScratch->fmatB[6][imin];
         for (i = CHX; i <= CHZ; i++)
-            ftmp += pthisMagCal->fmatB[i][imin] *
+            ftmp += pthisMagCal->pScratch->fmatB[i][imin] *
                 pthisMagCal->ftrV[i] *
                 pthisMagCal->ftrV[i];
 
         // calculate the trial normalized fit error as a percentage normalized by the geomagnetic field strength squared
-        pthisMagCal->ftrFitErrorpc = 50.0F * sqrtf(fabsf(pthisMagCal->fvecA[imin]) /
+        pthisMagCal->ftrFitErrorpc = 50.0F * sqrtf(fabsf(pthisMagCal->pScratch->fvecA[imin]) /
                                                            (float) pthisMagBuffer->iMagBufferCount) / fabsf(ftmp);
 
         // compute the geomagnetic field strength (uT) for current value of fdetA
@@ -966,7 +1901,7 @@ void fUpdateMagCalibration7Slice(struct MagCalibration *pthisMagCal,
         ftmp = powf(fabs(fdetA), -(ONETHIRD));
         for (i = CHX; i <= CHZ; i++)
         {
-            pthisMagCal->fA[i][i] = pthisMagCal->fmatB[i][imin] * ftmp;
+            pthisMagCal->fA[i][i] = pthisMagCal->pScratch->fmatB[i][imin] * ftmp;
             pthisMagCal->ftrinvW[i][i] = sqrtf(fabsf(pthisMagCal->fA[i][i]));
         }
 
@@ -1005,8 +1940,7 @@ void fUpdateMagCalibration10Slice(struct MagCalibration *pthisMagCal,
     float   ftmp;       // scratch variable
     int8_t    i,
             j,
-            k,
-            l;          // loop counters
+            k;          // loop counters
 #define MATRIX_10_SIZE  10
     // reset the time slice to zero if iInitiateMagCal is set and then clear iInitiateMagCal
     if (pthisMagCal->iInitiateMagCal)
@@ -1016,6 +1950,18 @@ void fUpdateMagCalibration10Slice(struct MagCalibration *pthisMagCal,
         pthisMagCal->iMagBufferReadOnly = true;
     }
 
+#if F_INCREMENTAL_MAG_SUMS
+    // time slice 0 with running moments: set the mean and fmatA directly from the moments that iUpdateMagBuffer()
+    // maintains and skip the accumulation time slices
+    if ((pthisMagCal->itimeslice == 0) && iMatrixFromMagBufferMoments(pthisMagCal, pthisMagBuffer, MATRIX_10_SIZE))
+    {
+#if F_FIXED_POINT_FUSION
+        pthisMagCal->iFixedSums = false;
+#endif
+        pthisMagCal->itimeslice = MAGBUFFSIZEX * MAGBUFFSIZEY + 1;
+    }
+    else
+#endif
     // time slice 0: 18.7k KL25Z ticks for 300 measurements = 0.39ms on KL25Z (variable) stored in systick[0]
     // zero measurement matrix fmatA and calculate the mean values in the magnetic buffer
     if (pthisMagCal->itimeslice == 0)
@@ -1025,7 +1971,7 @@ void fUpdateMagCalibration10Slice(struct MagCalibration *pthisMagCal,
         // zero the on and above diagonal elements of the 10x10 symmetric measurement matrix fmatA
         for (i = 0; i < MATRIX_10_SIZE; i++)
             for (j = i; j < MATRIX_10_SIZE; j++)
-                pthisMagCal->fmatA[i][j] = 0.0F;
+                pthisMagCal->pScratch->fmatA[i][j] = 0.0F;
 
         // compute the sum of measurements in the magnetic buffer
         iM = 0;
@@ -1034,11 +1980,11 @@ void fUpdateMagCalibration10Slice(struct MagCalibration *pthisMagCal,
         {
             for (j = 0; j < MAGBUFFSIZEY; j++)
             {
-                if (pthisMagBuffer->index[i][j] != -1)
+                if (iMagBufferBinActive(pthisMagBuffer, i, j))
                 {
                     iM++;
                     for (k = 0; k < 3; k++)
-                        pthisMagCal->iSumBs[k] += (int32_t) pthisMagBuffer->iBs[k][i][j];
+                        pthisMagCal->iSumBs[k] += (int32_t) MAGBUFFER_BS(pthisMagBuffer, k, i, j);
                 }
             }
         }
@@ -1065,6 +2011,12 @@ void fUpdateMagCalibration10Slice(struct MagCalibration *pthisMagCal,
         // as defensive programming also ensure the number of measurements found is re-stored
         pthisMagBuffer->iMagBufferCount = iM;
 
+#if F_FIXED_POINT_FUSION
+        // accumulate exact integer sums if the measurements are close enough to their mean
+        pthisMagCal->iFixedSums = iMagBufferFitsFixedSums(pthisMagCal, pthisMagBuffer);
+        for (i = 0; i < FIXEDCALSUMS; i++) pthisMagCal->iSumA[i] = 0;
+#endif
+
         // increment the time slice for the next iteration
         (pthisMagCal->itimeslice)++;
     }                   // end of time slice 0
@@ -1077,41 +2029,54 @@ void fUpdateMagCalibration10Slice(struct MagCalibration *pthisMagCal,
         // accumulate the symmetric matrix fmatA on the zero mean measurements
         i = (pthisMagCal->itimeslice - 1) / MAGBUFFSIZEY;   // matrix row i ranges 0 to MAGBUFFSIZEX-1
         j = (pthisMagCal->itimeslice - 1) % MAGBUFFSIZEY;   // matrix column j ranges 0 to MAGBUFFSIZEY-1
-        if (pthisMagBuffer->index[i][j] != -1)
+#if F_FIXED_POINT_FUSION
+        if (iMagBufferBinActive(pthisMagBuffer, i, j) && pthisMagCal->iFixedSums)
+        {
+            int32_t iVec[MATRIX_10_SIZE - 1];   // the integer equivalent of fvecA[0-8] below
+
+            for (k = 0; k < 3; k++)
+                iVec[k + 6] = (int32_t) MAGBUFFER_BS(pthisMagBuffer, k, i, j) - (int32_t) pthisMagCal->iMeanBs[k];
+            iVec[0] = iVec[6] * iVec[6];
+            iVec[1] = 2 * iVec[6] * iVec[7];
+            iVec[2] = 2 * iVec[6] * iVec[8];
+            iVec[3] = iVec[7] * iVec[7];
+            iVec[4] = 2 * iVec[7] * iVec[8];
+            iVec[5] = iVec[8] * iVec[8];
+            iAccumulateFixedSums(pthisMagCal->iSumA, iVec, MATRIX_10_SIZE, 6);
+        }
+        else
+#endif
+        if (iMagBufferBinActive(pthisMagBuffer, i, j))
         {
             // set fvecA[6-8] to the zero mean measurements
             for (k = 0; k < 3; k++)
-                pthisMagCal->fvecA[k + 6] = (float)
+                pthisMagCal->pScratch->fvecA[k + 6] = (float)
                     (
-                        (int32_t) pthisMagBuffer->iBs[k][i][j] -
+                        (int32_t) MAGBUFFER_BS(pthisMagBuffer, k, i, j) -
                         (int32_t) pthisMagCal->iMeanBs[k]
                     );
 
             // compute fvecA[0-5] from fvecA[6-8]
-            pthisMagCal->fvecA[0] = pthisMagCal->fvecA[6] * pthisMagCal->fvecA[6];
-            pthisMagCal->fvecA[1] = 2.0F *
-                pthisMagCal->fvecA[6] *
-                pthisMagCal->fvecA[7];
-            pthisMagCal->fvecA[2] = 2.0F *
-                pthisMagCal->fvecA[6] *
-                pthisMagCal->fvecA[8];
-            pthisMagCal->fvecA[3] = pthisMagCal->fvecA[7] * pthisMagCal->fvecA[7];
-            pthisMagCal->fvecA[4] = 2.0F *
-                pthisMagCal->fvecA[7] *
-                pthisMagCal->fvecA[8];
-            pthisMagCal->fvecA[5] = pthisMagCal->fvecA[8] * pthisMagCal->fvecA[8];
+            pthisMagCal->pScratch->fvecA[0] = pthisMagCal->pScratch->fvecA[6] * pthisMagCal->pScratch->fvecA[6];
+            pthisMagCal->pScratch->fvecA[1] = 2.0F *
+                pthisMagCal->pScratch->fvecA[6] *
+                pthisMagCal->pScratch->fvecA[7];
+            pthisMagCal->pScratch->fvecA[2] = 2.0F *
+                pthisMagCal->pScratch->fvecA[6] *
+                pthisMagCal->pScratch->fvecA[8];
+            pthisMagCal->pScratch->fvecA[3] = pthisMagCal->pScratch->fvecA[7] * pthisMagCal->pScratch->fvecA[7];
+            pthisMagCal->pScratch->fvecA[4] = 2.0F *
+                pthisMagCal->pScratch->fvecA[7] *
+                pthisMagCal->pScratch->fvecA[8];
+            pthisMagCal->pScratch->fvecA[5] = pthisMagCal->pScratch->fvecA[8] * pthisMagCal->pScratch->fvecA[8];
 
             // update non-zero elements fmatA[0-5][9] of fmatA ignoring fmatA[9][9] which is set later.
             // elements fmatA[6-8][9] are zero as a result of subtracting the mean value
             for (k = 0; k < 6; k++)
-                pthisMagCal->fmatA[k][9] += pthisMagCal->fvecA[k];
+                pthisMagCal->pScratch->fmatA[k][9] += pthisMagCal->pScratch->fvecA[k];
 
             // update the remaining on and above diagonal elements fmatA[0-8][0-8]
-            for (k = 0; k < (MATRIX_10_SIZE - 1); k++)
-            {
-                for (l = k; l < (MATRIX_10_SIZE - 1); l++)
-                    pthisMagCal->fmatA[k][l] += pthisMagCal->fvecA[k] * pthisMagCal->fvecA[l];
-            }
+            fk10x10AaddxxT9(pthisMagCal->pScratch->fmatA, pthisMagCal->pScratch->fvecA);
         }
 
         // increment the time slice for the next iteration
@@ -1122,8 +2087,14 @@ void fUpdateMagCalibration10Slice(struct MagCalibration *pthisMagCal,
     // re-enable magnetic buffer for writing and prepare fmatA, fmatB, fvecA for eigendecomposition
     else if (pthisMagCal->itimeslice == (MAGBUFFSIZEX * MAGBUFFSIZEY + 1))
     {
+#if F_FIXED_POINT_FUSION
+        // set the accumulated elements of fmatA from the integer sums
+        if (pthisMagCal->iFixedSums)
+            fMatrixFromFixedSums(pthisMagCal->pScratch->fmatA, pthisMagCal->iSumA, MATRIX_10_SIZE, 6);
+#endif
+
         // set fmatA[9][9] to the number of magnetic measurements found
-        pthisMagCal->fmatA[MATRIX_10_SIZE - 1][MATRIX_10_SIZE - 1] = (float) pthisMagBuffer->iMagBufferCount;
+        pthisMagCal->pScratch->fmatA[MATRIX_10_SIZE - 1][MATRIX_10_SIZE - 1] = (float) pthisMagBuffer->iMagBufferCount;
 
         // clear the magnetic buffer read only flag now that the matrices have been computed
         pthisMagCal->iMagBufferReadOnly = false;
@@ -1131,19 +2102,32 @@ void fUpdateMagCalibration10Slice(struct MagCalibration *pthisMagCal,
         // set below diagonal elements of 10x10 matrix fmatA to above diagonal elements
         for (i = 1; i < MATRIX_10_SIZE; i++)
             for (j = 0; j < i; j++)
-                pthisMagCal->fmatA[i][j] = pthisMagCal->fmatA[j][i];
+                pthisMagCal->pScratch->fmatA[i][j] = pthisMagCal->pScratch->fmatA[j][i];
 
-        // set matrix of eigenvectors fmatB to identity matrix and eigenvalues vector fvecA to diagonal elements of fmatA
-        for (i = 0; i < MATRIX_10_SIZE; i++)
+#if F_WARM_START_EIGEN
+        if (pthisMagCal->iWarmStartSize == MATRIX_10_SIZE)
         {
-            for (j = 0; j < MATRIX_10_SIZE; j++)
-                pthisMagCal->fmatB[i][j] = 0.0F;
-            pthisMagCal->fmatB[i][i] = 1.0F;
-            pthisMagCal->fvecA[i] = pthisMagCal->fmatA[i][i];
+            // resume from the eigenvectors of the previous 10 element calibration and go straight to the exit
+            // test since a similar constellation needs few, if any, further rotations
+            fEigenWarmStart10(pthisMagCal->pScratch->fmatA, pthisMagCal->pScratch->fvecA, pthisMagCal->pScratch->fmatB,
+                              pthisMagCal->fmatV, MATRIX_10_SIZE);
+            pthisMagCal->itimeslice = MAGBUFFSIZEX * MAGBUFFSIZEY + 47;
         }
+        else
+#endif
+        {
+            // set matrix of eigenvectors fmatB to identity matrix and eigenvalues vector fvecA to diagonal elements of fmatA
+            for (i = 0; i < MATRIX_10_SIZE; i++)
+            {
+                for (j = 0; j < MATRIX_10_SIZE; j++)
+                    pthisMagCal->pScratch->fmatB[i][j] = 0.0F;
+                pthisMagCal->pScratch->fmatB[i][i] = 1.0F;
+                pthisMagCal->pScratch->fvecA[i] = pthisMagCal->pScratch->fmatA[i][i];
+            }
 
-        // increment the time slice for the next iteration
-        (pthisMagCal->itimeslice)++;
+            // increment the time slice for the next iteration
+            (pthisMagCal->itimeslice)++;
+        }
     }                   // end of time slice MAGBUFFSIZEX * MAGBUFFSIZEY + 1
 
     // repeating 45 time slices MAGBUFFSIZEX * MAGBUFFSIZEY + 2 to MAGBUFFSIZEX * MAGBUFFSIZEY + 46 inclusive
@@ -1153,8 +2137,24 @@ void fUpdateMagCalibration10Slice(struct MagCalibration *pthisMagCal,
     else if ((pthisMagCal->itimeslice >= (MAGBUFFSIZEX * MAGBUFFSIZEY + 2)) &&
              (pthisMagCal->itimeslice <= (MAGBUFFSIZEX * MAGBUFFSIZEY + 46)))
     {
+        // count the sweeps of the eigen-decomposition for the timing statistics
+        if (pthisMagCal->itimeslice == (MAGBUFFSIZEX * MAGBUFFSIZEY + 2)) (pthisMagCal->iEigenSweeps)++;
+
         // set k to the matrix element of interest in range 0 to 44 to be zeroed and set row i and column j
         k = pthisMagCal->itimeslice - (MAGBUFFSIZEX * MAGBUFFSIZEY + 2);
+#if F_WARM_START_EIGEN
+        // rotate the next element that is not yet negligible, skipping the others without using up a time slice,
+        // and go to the exit test once none remain in this sweep
+        k = iNextEigElement(pthisMagCal->pScratch->fmatA, pthisMagCal->pScratch->fvecA, MATRIX_10_SIZE, k, &i, &j);
+        if (k < 45)
+        {
+            fComputeEigSlice(pthisMagCal->pScratch->fmatA, pthisMagCal->pScratch->fmatB,
+                             pthisMagCal->pScratch->fvecA, i, j, MATRIX_10_SIZE);
+            pthisMagCal->itimeslice = MAGBUFFSIZEX * MAGBUFFSIZEY + 3 + k;
+        }
+        else
+            pthisMagCal->itimeslice = MAGBUFFSIZEX * MAGBUFFSIZEY + 47;
+#else
         if (k < 9)
         {
             i = 0;
@@ -1202,23 +2202,42 @@ void fUpdateMagCalibration10Slice(struct MagCalibration *pthisMagCal,
         }
 
         // only continue if matrix element i, j has not already been zeroed
-        if (fabsf(pthisMagCal->fmatA[i][j]) > 0.0F)
-            fComputeEigSlice(pthisMagCal->fmatA, pthisMagCal->fmatB,
-                             pthisMagCal->fvecA, i, j, MATRIX_10_SIZE);
+        if (fabsf(pthisMagCal->pScratch->fmatA[i][j]) > 0.0F)
+            fComputeEigSlice(pthisMagCal->pScratch->fmatA, pthisMagCal->pScratch->fmatB,
+                             pthisMagCal->pScratch->fvecA, i, j, MATRIX_10_SIZE);
 
         // increment the time slice for the next iteration
         (pthisMagCal->itimeslice)++;
+#endif
     }                   // end of time slice MAGBUFFSIZEX * MAGBUFFSIZEY + 2 to MAGBUFFSIZEX * MAGBUFFSIZEY + 46 inclusive
 
     // time slice MAGBUFFSIZEX * MAGBUFFSIZEY + 47: 5.6k ticks on KL25Z = 0.12ms on KL25Z (constant) (stored in systick[4])
     // compute the sum of the absolute values of above diagonal elements in fmatA as eigen-decomposition exit criterion
     else if (pthisMagCal->itimeslice == (MAGBUFFSIZEX * MAGBUFFSIZEY + 47))
     {
+#if F_WARM_START_EIGEN
+        // the eigen-decomposition is complete once every above diagonal element is negligible, or after
+        // EIGENMAXSWEEPS sweeps. its eigenvectors are kept as the start of the next 10 element calibration.
+        if ((iNextEigElement(pthisMagCal->pScratch->fmatA, pthisMagCal->pScratch->fvecA, MATRIX_10_SIZE, 0, &i, &j) < 45) &&
+            (pthisMagCal->iEigenSweeps < EIGENMAXSWEEPS))
+            // continue the eigen-decomposition
+            (pthisMagCal->itimeslice) = MAGBUFFSIZEX * MAGBUFFSIZEY + 2;
+        else
+        {
+            for (i = 0; i < MATRIX_10_SIZE; i++)
+                for (j = 0; j < MATRIX_10_SIZE; j++)
+                    pthisMagCal->fmatV[i][j] = pthisMagCal->pScratch->fmatB[i][j];
+            pthisMagCal->iWarmStartSize = MATRIX_10_SIZE;
+
+            // continue to compute the calibration coefficients since the eigen-decomposition is complete
+            (pthisMagCal->itimeslice)++;
+        }
+#else
         // sum residue of all above-diagonal elements
         fresidue = 0.0F;
         for (i = 0; i < MATRIX_10_SIZE; i++)
             for (j = i + 1; j < MATRIX_10_SIZE; j++)
-                fresidue += fabsf(pthisMagCal->fmatA[i][j]);
+                fresidue += fabsf(pthisMagCal->pScratch->fmatA[i][j]);
 
         // determine whether to re-enter the eigen-decomposition or skip to calculation of the calibration coefficients
         if (fresidue > 0.0F)
@@ -1227,6 +2246,7 @@ void fUpdateMagCalibration10Slice(struct MagCalibration *pthisMagCal,
         else
             // continue to compute the calibration coefficients since the eigen-decomposition is complete
             (pthisMagCal->itimeslice)++;
+#endif
     }                   // end of time slice MAGBUFFSIZEX * MAGBUFFSIZEY + 47
 
     // time slice MAGBUFFSIZEX * MAGBUFFSIZEY + 48: 38.5k ticks = 0.80ms on KL25Z (constant) (stored in systick[5])
@@ -1239,15 +2259,15 @@ void fUpdateMagCalibration10Slice(struct MagCalibration *pthisMagCal,
         // set imin to the index of the smallest eigenvalue in fvecA
         imin = 0;
         for (i = 1; i < MATRIX_10_SIZE; i++)
-            if (pthisMagCal->fvecA[i] < pthisMagCal->fvecA[imin]) imin = i;
+            if (pthisMagCal->pScratch->fvecA[i] < pthisMagCal->pScratch->fvecA[imin]) imin = i;
 
         // set the ellipsoid matrix A from elements 0 to 5 of the solution eigenvector.
-        pthisMagCal->fA[CHX][CHX] = pthisMagCal->fmatB[0][imin];
-        pthisMagCal->fA[CHX][CHY] = pthisMagCal->fA[CHY][CHX] = pthisMagCal->fmatB[1][imin];
-        pthisMagCal->fA[CHX][CHZ] = pthisMagCal->fA[CHZ][CHX] = pthisMagCal->fmatB[2][imin];
-        pthisMagCal->fA[CHY][CHY] = pthisMagCal->fmatB[3][imin];
-        pthisMagCal->fA[CHY][CHZ] = pthisMagCal->fA[CHZ][CHY] = pthisMagCal->fmatB[4][imin];
-        pthisMagCal->fA[CHZ][CHZ] = pthisMagCal->fmatB[5][imin];
+        pthisMagCal->fA[CHX][CHX] = pthisMagCal->pScratch->fmatB[0][imin];
+        pthisMagCal->fA[CHX][CHY] = pthisMagCal->fA[CHY][CHX] = pthisMagCal->pScratch->fmatB[1][imin];
+        pthisMagCal->fA[CHX][CHZ] = pthisMagCal->fA[CHZ][CHX] = pthisMagCal->pScratch->fmatB[2][imin];
+        pthisMagCal->fA[CHY][CHY] = pthisMagCal->pScratch->fmatB[3][imin];
+        pthisMagCal->fA[CHY][CHZ] = pthisMagCal->fA[CHZ][CHY] = pthisMagCal->pScratch->fmatB[4][imin];
+        pthisMagCal->fA[CHZ][CHZ] = pthisMagCal->pScratch->fmatB[5][imin];
 
         // negate A and the entire solution vector A has negative determinant
         fdetA = f3x3matrixDetA(pthisMagCal->fA);
@@ -1256,7 +2276,7 @@ void fUpdateMagCalibration10Slice(struct MagCalibration *pthisMagCal,
             f3x3matrixAeqMinusA(pthisMagCal->fA);
             fdetA = fabs(fdetA);
             for (i = 0; i < MATRIX_10_SIZE; i++)
-                pthisMagCal->fmatB[i][imin] = -pthisMagCal->fmatB[i][imin];
+                pthisMagCal->pScratch->fmatB[i][imin] = -pthisMagCal->pScratch->fmatB[i][imin];
         }
 
         // set finvA to the inverse of the ellipsoid matrix fA
@@ -1266,11 +2286,11 @@ void fUpdateMagCalibration10Slice(struct MagCalibration *pthisMagCal,
         for (i = CHX; i <= CHZ; i++)
         {
             pthisMagCal->ftrV[i] = pthisMagCal->finvA[i][0] *
-                pthisMagCal->fmatB[6][imin] +
+                pthisMagCal->pScratch->fmatB[6][imin] +
                 pthisMagCal->finvA[i][1] *
-                pthisMagCal->fmatB[7][imin] +
+                pthisMagCal->pScratch->fmatB[7][imin] +
                 pthisMagCal->finvA[i][2] *
-                pthisMagCal->fmatB[8][imin];
+                pthisMagCal->pScratch->fmatB[8][imin];
             pthisMagCal->ftrV[i] *= -0.5F;
         }
 
@@ -1285,7 +2305,7 @@ void fUpdateMagCalibration10Slice(struct MagCalibration *pthisMagCal,
             pthisMagCal->ftrV[CHY] *
             pthisMagCal->ftrV[CHZ];
         ftmp *= 2.0F;
-        ftmp -= pthisMagCal->fmatB[9][imin];
+        ftmp -= pthisMagCal->pScratch->fmatB[9][imin];
         ftmp += pthisMagCal->fA[CHX][CHX] *
             pthisMagCal->ftrV[CHX] *
             pthisMagCal->ftrV[CHX];
@@ -1299,7 +2319,7 @@ void fUpdateMagCalibration10Slice(struct MagCalibration *pthisMagCal,
 
         // calculate the normalized fit error as a percentage
         pthisMagCal->ftrFitErrorpc = 50.0F * sqrtf(fabsf(
-                                                       pthisMagCal->fvecA[imin] /
+                                                       pthisMagCal->pScratch->fvecA[imin] /
                                                    (float) pthisMagBuffer->iMagBufferCount
                                                    )) / (pthisMagCal->ftrB * pthisMagCal->ftrB);
 
@@ -1331,12 +2351,12 @@ void fUpdateMagCalibration10Slice(struct MagCalibration *pthisMagCal,
         {
             for (j = 0; j < 3; j++)
             {
-                pthisMagCal->fmatA[i][j] = pthisMagCal->fA[i][j];
-                pthisMagCal->fmatB[i][j] = 0.0F;
+                pthisMagCal->pScratch->fmatA[i][j] = pthisMagCal->fA[i][j];
+                pthisMagCal->pScratch->fmatB[i][j] = 0.0F;
             }
 
-            pthisMagCal->fmatB[i][i] = 1.0F;
-            pthisMagCal->fvecA[i] = pthisMagCal->fmatA[i][i];
+            pthisMagCal->pScratch->fmatB[i][i] = 1.0F;
+            pthisMagCal->pScratch->fvecA[i] = pthisMagCal->pScratch->fmatA[i][i];
         }
 
         // increment the time slice for the next iteration
@@ -1368,9 +2388,9 @@ void fUpdateMagCalibration10Slice(struct MagCalibration *pthisMagCal,
         }
 
         // only continue with eigen-decomposition if matrix element i, j has not already been zeroed
-        if (fabsf(pthisMagCal->fmatA[i][j]) > 0.0F)
-            fComputeEigSlice(pthisMagCal->fmatA, pthisMagCal->fmatB,
-                             pthisMagCal->fvecA, i, j, 3);
+        if (fabsf(pthisMagCal->pScratch->fmatA[i][j]) > 0.0F)
+            fComputeEigSlice(pthisMagCal->pScratch->fmatA, pthisMagCal->pScratch->fmatB,
+                             pthisMagCal->pScratch->fvecA, i, j, 3);
 
         // increment the time slice for the next iteration
         (pthisMagCal->itimeslice)++;
@@ -1382,7 +2402,7 @@ void fUpdateMagCalibration10Slice(struct MagCalibration *pthisMagCal,
     {
         // sum residue of all above-diagonal elements and use to determine whether
         // to re-enter the eigen-decomposition or skip to calculation of the calibration coefficients
-        fresidue = fabsf(pthisMagCal->fmatA[0][1]) + fabsf(pthisMagCal->fmatA[0][2]) + fabsf(pthisMagCal->fmatA[1][2]);
+        fresidue = fabsf(pthisMagCal->pScratch->fmatA[0][1]) + fabsf(pthisMagCal->pScratch->fmatA[0][2]) + fabsf(pthisMagCal->pScratch->fmatA[1][2]);
         if (fresidue > 0.0F)
             // continue the eigen-decomposition
             (pthisMagCal->itimeslice) = MAGBUFFSIZEX * MAGBUFFSIZEY + 49;
@@ -1395,12 +2415,12 @@ void fUpdateMagCalibration10Slice(struct MagCalibration *pthisMagCal,
     // compute the inverse gain matrix invW from the eigendecomposition of the ellipsoid matrix A
     else if (pthisMagCal->itimeslice == (MAGBUFFSIZEX * MAGBUFFSIZEY + 53))
     {
-        // set pthisMagCal->fmatB to be eigenvectors . diag(sqrt(sqrt(eigenvalues))) = fmatB . diag(sqrt(sqrt(fvecA))
+        // set pthisMagCal->pScratch->fmatB to be eigenvectors . diag(sqrt(sqrt(eigenvalues))) = fmatB . diag(sqrt(sqrt(fvecA))
         for (j = 0; j < 3; j++)     // loop over columns j
         {
-            ftmp = sqrtf(sqrtf(fabsf(pthisMagCal->fvecA[j])));
+            ftmp = sqrtf(sqrtf(fabsf(pthisMagCal->pScratch->fvecA[j])));
             for (i = 0; i < 3; i++) // loop over rows i
-                pthisMagCal->fmatB[i][j] *= ftmp;
+                pthisMagCal->pScratch->fmatB[i][j] *= ftmp;
         }
 
         // set ftrinvW to eigenvectors * diag(sqrt(eigenvalues)) * eigenvectors^T
@@ -1411,12 +2431,12 @@ void fUpdateMagCalibration10Slice(struct MagCalibration *pthisMagCal,
             for (j = i; j < 3; j++)
             {
                 pthisMagCal->ftrinvW[i][j] = pthisMagCal->ftrinvW[j][i] =
-                        pthisMagCal->fmatB[i][0] *
-                    pthisMagCal->fmatB[j][0] +
-                    pthisMagCal->fmatB[i][1] *
-                    pthisMagCal->fmatB[j][1] +
-                    pthisMagCal->fmatB[i][2] *
-                    pthisMagCal->fmatB[j][2];
+                        pthisMagCal->pScratch->fmatB[i][0] *
+                    pthisMagCal->pScratch->fmatB[j][0] +
+                    pthisMagCal->pScratch->fmatB[i][1] *
+                    pthisMagCal->pScratch->fmatB[j][1] +
+                    pthisMagCal->pScratch->fmatB[i][2] *
+                    pthisMagCal->pScratch->fmatB[j][2];
             }
         }
 
@@ -1446,26 +2466,23 @@ void fComputeMagCalibration4(struct MagCalibration *pthisMagCal,
             k,
             l;          // loop counters
 
-    // working arrays for 4x4 matrix inversion
+    // row pointers for 4x4 matrix inversion
     float   *pfRows[4];
-    int8_t    iColInd[4];
-    int8_t    iRowInd[4];
-    int8_t    iPivot[4];
 
     // compute fscaling to reduce multiplications later
     fscaling = pthisMag->fuTPerCount / DEFAULTB;
 
     // the trial inverse soft iron matrix invW always equals the identity matrix for 4 element calibration
-    f3x3matrixAeqI(pthisMagCal->ftrinvW);
+    fk3x3AeqI(pthisMagCal->ftrinvW);
 
     // zero fSumBs4=Y^T.Y, fvecB=X^T.Y (4x1) and on and above diagonal elements of fmatA=X^T*X (4x4)
     fSumBs4 = 0.0F;
     for (i = 0; i < 4; i++)
     {
-        pthisMagCal->fvecB[i] = 0.0F;
+        pthisMagCal->pScratch->fvecB[i] = 0.0F;
         for (j = i; j < 4; j++)
         {
-            pthisMagCal->fmatA[i][j] = 0.0F;
+            pthisMagCal->pScratch->fmatA[i][j] = 0.0F;
         }
     }
 
@@ -1478,32 +2495,32 @@ void fComputeMagCalibration4(struct MagCalibration *pthisMagCal,
     {
         for (k = 0; k < MAGBUFFSIZEY; k++)
         {
-            if (pthisMagBuffer->index[j][k] != -1)
+            if (iMagBufferBinActive(pthisMagBuffer, j, k))
             {
                 // use first valid magnetic buffer entry as estimate (in counts) for offset
                 if (iCount == 0)
                 {
                     for (l = CHX; l <= CHZ; l++)
                     {
-                        iOffset[l] = pthisMagBuffer->iBs[l][j][k];
+                        iOffset[l] = MAGBUFFER_BS(pthisMagBuffer, l, j, k);
                     }
                 }
 
                 // store scaled and offset fBs[XYZ] in fvecA[0-2] and fBs[XYZ]^2 in fvecA[3-5]
                 for (l = CHX; l <= CHZ; l++)
                 {
-                    pthisMagCal->fvecA[l] = (float)
+                    pthisMagCal->pScratch->fvecA[l] = (float)
                         (
-                            (int32_t) pthisMagBuffer->iBs[l][j][k] -
+                            (int32_t) MAGBUFFER_BS(pthisMagBuffer, l, j, k) -
                             (int32_t) iOffset[l]
                         ) * fscaling;
-                    pthisMagCal->fvecA[l + 3] = pthisMagCal->fvecA[l] * pthisMagCal->fvecA[l];
+                    pthisMagCal->pScratch->fvecA[l + 3] = pthisMagCal->pScratch->fvecA[l] * pthisMagCal->pScratch->fvecA[l];
                 }
 
                 // calculate fBs2 = fBs[CHX]^2 + fBs[CHY]^2 + fBs[CHZ]^2 (scaled uT^2)
-                fBs2 = pthisMagCal->fvecA[3] +
-                    pthisMagCal->fvecA[4] +
-                    pthisMagCal->fvecA[5];
+                fBs2 = pthisMagCal->pScratch->fvecA[3] +
+                    pthisMagCal->pScratch->fvecA[4] +
+                    pthisMagCal->pScratch->fvecA[5];
 
                 // accumulate fBs^4 over all measurements into fSumBs4=Y^T.Y
                 fSumBs4 += fBs2 * fBs2;
@@ -1511,22 +2528,22 @@ void fComputeMagCalibration4(struct MagCalibration *pthisMagCal,
                 // now we have fBs2, accumulate fvecB[0-2] = X^T.Y =sum(fBs2.fBs[XYZ])
                 for (l = CHX; l <= CHZ; l++)
                 {
-                    pthisMagCal->fvecB[l] += pthisMagCal->fvecA[l] * fBs2;
+                    pthisMagCal->pScratch->fvecB[l] += pthisMagCal->pScratch->fvecA[l] * fBs2;
                 }
 
                 //accumulate fvecB[3] = X^T.Y =sum(fBs2)
-                pthisMagCal->fvecB[3] += fBs2;
+                pthisMagCal->pScratch->fvecB[3] += fBs2;
 
                 // accumulate on and above-diagonal terms of fmatA = X^T.X ignoring fmatA[3][3]
-                pthisMagCal->fmatA[0][0] += pthisMagCal->fvecA[CHX + 3];
-                pthisMagCal->fmatA[0][1] += pthisMagCal->fvecA[CHX] * pthisMagCal->fvecA[CHY];
-                pthisMagCal->fmatA[0][2] += pthisMagCal->fvecA[CHX] * pthisMagCal->fvecA[CHZ];
-                pthisMagCal->fmatA[0][3] += pthisMagCal->fvecA[CHX];
-                pthisMagCal->fmatA[1][1] += pthisMagCal->fvecA[CHY + 3];
-                pthisMagCal->fmatA[1][2] += pthisMagCal->fvecA[CHY] * pthisMagCal->fvecA[CHZ];
-                pthisMagCal->fmatA[1][3] += pthisMagCal->fvecA[CHY];
-                pthisMagCal->fmatA[2][2] += pthisMagCal->fvecA[CHZ + 3];
-                pthisMagCal->fmatA[2][3] += pthisMagCal->fvecA[CHZ];
+                pthisMagCal->pScratch->fmatA[0][0] += pthisMagCal->pScratch->fvecA[CHX + 3];
+                pthisMagCal->pScratch->fmatA[0][1] += pthisMagCal->pScratch->fvecA[CHX] * pthisMagCal->pScratch->fvecA[CHY];
+                pthisMagCal->pScratch->fmatA[0][2] += pthisMagCal->pScratch->fvecA[CHX] * pthisMagCal->pScratch->fvecA[CHZ];
+                pthisMagCal->pScratch->fmatA[0][3] += pthisMagCal->pScratch->fvecA[CHX];
+                pthisMagCal->pScratch->fmatA[1][1] += pthisMagCal->pScratch->fvecA[CHY + 3];
+                pthisMagCal->pScratch->fmatA[1][2] += pthisMagCal->pScratch->fvecA[CHY] * pthisMagCal->pScratch->fvecA[CHZ];
+                pthisMagCal->pScratch->fmatA[1][3] += pthisMagCal->pScratch->fvecA[CHY];
+                pthisMagCal->pScratch->fmatA[2][2] += pthisMagCal->pScratch->fvecA[CHZ + 3];
+                pthisMagCal->pScratch->fmatA[2][3] += pthisMagCal->pScratch->fvecA[CHZ];
 
                 // increment the counter for next iteration
                 iCount++;
@@ -1535,7 +2552,7 @@ void fComputeMagCalibration4(struct MagCalibration *pthisMagCal,
     }
 
     // set the last element of the measurement matrix to the number of buffer elements used
-    pthisMagCal->fmatA[3][3] = (float) iCount;
+    pthisMagCal->pScratch->fmatA[3][3] = (float) iCount;
 
     // store the number of measurements accumulated (defensive programming, should never be needed)
     pthisMagBuffer->iMagBufferCount = iCount;
@@ -1545,25 +2562,26 @@ void fComputeMagCalibration4(struct MagCalibration *pthisMagCal,
     {
         for (j = i; j < 4; j++)
         {
-            pthisMagCal->fmatB[i][j] = pthisMagCal->fmatB[j][i] = pthisMagCal->fmatA[j][i] = pthisMagCal->fmatA[i][j];
+            pthisMagCal->pScratch->fmatB[i][j] = pthisMagCal->pScratch->fmatB[j][i] = pthisMagCal->pScratch->fmatA[j][i] = pthisMagCal->pScratch->fmatA[i][j];
         }
     }
 
-    // calculate in situ inverse of fmatB = inv(X^T.X) (4x4) while fmatA still holds X^T.X
+    // calculate in situ inverse of the symmetric positive definite fmatB = inv(X^T.X) (4x4) while fmatA
+    // still holds X^T.X
     for (i = 0; i < 4; i++)
     {
-        pfRows[i] = pthisMagCal->fmatB[i];
+        pfRows[i] = pthisMagCal->pScratch->fmatB[i];
     }
 
-    fmatrixAeqInvA(pfRows, iColInd, iRowInd, iPivot, 4, &ierror);
+    fmatrixAeqInvSymA(pfRows, 4, &ierror);
 
     // calculate fvecA = solution beta (4x1) = inv(X^T.X).X^T.Y = fmatB * fvecB
     for (i = 0; i < 4; i++)
     {
-        pthisMagCal->fvecA[i] = 0.0F;
+        pthisMagCal->pScratch->fvecA[i] = 0.0F;
         for (k = 0; k < 4; k++)
         {
-            pthisMagCal->fvecA[i] += pthisMagCal->fmatB[i][k] * pthisMagCal->fvecB[k];
+            pthisMagCal->pScratch->fvecA[i] += pthisMagCal->pScratch->fmatB[i][k] * pthisMagCal->pScratch->fvecB[k];
         }
     }
 
@@ -1573,7 +2591,7 @@ void fComputeMagCalibration4(struct MagCalibration *pthisMagCal,
     fE = 0.0F;
     for (i = 0; i < 4; i++)
     {
-        fE += pthisMagCal->fvecA[i] * pthisMagCal->fvecB[i];
+        fE += pthisMagCal->pScratch->fvecA[i] * pthisMagCal->pScratch->fvecB[i];
     }
 
     fE = fSumBs4 - 2.0F * fE;
@@ -1581,27 +2599,27 @@ void fComputeMagCalibration4(struct MagCalibration *pthisMagCal,
     // set fvecB = (X^T.X).beta = fmatA.fvecA
     for (i = 0; i < 4; i++)
     {
-        pthisMagCal->fvecB[i] = 0.0F;
+        pthisMagCal->pScratch->fvecB[i] = 0.0F;
         for (k = 0; k < 4; k++)
         {
-            pthisMagCal->fvecB[i] += pthisMagCal->fmatA[i][k] * pthisMagCal->fvecA[k];
+            pthisMagCal->pScratch->fvecB[i] += pthisMagCal->pScratch->fmatA[i][k] * pthisMagCal->pScratch->fvecA[k];
         }
     }
 
     // complete calculation of E by adding beta^T.(X^T.X).beta = fvecA^T * fvecB
     for (i = 0; i < 4; i++)
     {
-        fE += pthisMagCal->fvecB[i] * pthisMagCal->fvecA[i];
+        fE += pthisMagCal->pScratch->fvecB[i] * pthisMagCal->pScratch->fvecA[i];
     }
 
     // compute the hard iron vector (in uT but offset and scaled by FMATRIXSCALING)
     for (l = CHX; l <= CHZ; l++)
     {
-        pthisMagCal->ftrV[l] = 0.5F * pthisMagCal->fvecA[l];
+        pthisMagCal->ftrV[l] = 0.5F * pthisMagCal->pScratch->fvecA[l];
     }
 
     // compute the scaled geomagnetic field strength B (in uT but scaled by FMATRIXSCALING)
-    pthisMagCal->ftrB = sqrtf(pthisMagCal->fvecA[3] + pthisMagCal->ftrV[CHX] *
+    pthisMagCal->ftrB = sqrtf(pthisMagCal->pScratch->fvecA[3] + pthisMagCal->ftrV[CHX] *
                               pthisMagCal->ftrV[CHX] + pthisMagCal->ftrV[CHY] *
                               pthisMagCal->ftrV[CHY] + pthisMagCal->ftrV[CHZ] *
                               pthisMagCal->ftrV[CHZ]);
@@ -1652,7 +2670,7 @@ void fComputeMagCalibration7(struct MagCalibration *pthisMagCal,
     {
         for (n = m; n < 7; n++)
         {
-            pthisMagCal->fmatA[m][n] = 0.0F;
+            pthisMagCal->pScratch->fmatA[m][n] = 0.0F;
         }
     }
 
@@ -1662,45 +2680,39 @@ void fComputeMagCalibration7(struct MagCalibration *pthisMagCal,
     {
         for (k = 0; k < MAGBUFFSIZEY; k++)
         {
-            if (pthisMagBuffer->index[j][k] != -1)
+            if (iMagBufferBinActive(pthisMagBuffer, j, k))
             {
                 // use first valid magnetic buffer entry as offset estimate (bit counts)
                 if (iCount == 0)
                 {
                     for (l = CHX; l <= CHZ; l++)
                     {
-                        iOffset[l] = pthisMagBuffer->iBs[l][j][k];
+                        iOffset[l] = MAGBUFFER_BS(pthisMagBuffer, l, j, k);
                     }
                 }
 
                 // apply the offset and scaling and store in fvecA
                 for (l = CHX; l <= CHZ; l++)
                 {
-                    pthisMagCal->fvecA[l + 3] = (float)
+                    pthisMagCal->pScratch->fvecA[l + 3] = (float)
                         (
-                            (int32_t) pthisMagBuffer->iBs[l][j][k] -
+                            (int32_t) MAGBUFFER_BS(pthisMagBuffer, l, j, k) -
                             (int32_t) iOffset[l]
                         ) * fscaling;
-                    pthisMagCal->fvecA[l] = pthisMagCal->fvecA[l + 3] * pthisMagCal->fvecA[l + 3];
+                    pthisMagCal->pScratch->fvecA[l] = pthisMagCal->pScratch->fvecA[l + 3] * pthisMagCal->pScratch->fvecA[l + 3];
                 }
 
-                // accumulate the on-and above-diagonal terms of pthisMagCal->fmatA=Sigma{fvecA^T * fvecA}
+                // accumulate the on-and above-diagonal terms of pthisMagCal->pScratch->fmatA=Sigma{fvecA^T * fvecA}
                 // with the exception of fmatA[6][6] which will sum to the number of measurements
                 // and remembering that fvecA[6] equals 1.0F
                 // update the right hand column [6] of fmatA except for fmatA[6][6]
                 for (m = 0; m < 6; m++)
                 {
-                    pthisMagCal->fmatA[m][6] += pthisMagCal->fvecA[m];
+                    pthisMagCal->pScratch->fmatA[m][6] += pthisMagCal->pScratch->fvecA[m];
                 }
 
                 // update the on and above diagonal terms except for right hand column 6
-                for (m = 0; m < 6; m++)
-                {
-                    for (n = m; n < 6; n++)
-                    {
-                        pthisMagCal->fmatA[m][n] += pthisMagCal->fvecA[m] * pthisMagCal->fvecA[n];
-                    }
-                }
+                fk10x10AaddxxT6(pthisMagCal->pScratch->fmatA, pthisMagCal->pScratch->fvecA);
 
                 // increment the measurement counter for the next iteration
                 iCount++;
@@ -1709,7 +2721,7 @@ void fComputeMagCalibration7(struct MagCalibration *pthisMagCal,
     }
 
     // finally set the last element fmatA[6][6] to the number of measurements
-    pthisMagCal->fmatA[6][6] = (float) iCount;
+    pthisMagCal->pScratch->fmatA[6][6] = (float) iCount;
 
     // store the number of measurements accumulated (defensive programming, should never be needed)
     pthisMagBuffer->iMagBufferCount = iCount;
@@ -1719,19 +2731,19 @@ void fComputeMagCalibration7(struct MagCalibration *pthisMagCal,
     {
         for (n = 0; n < m; n++)
         {
-            pthisMagCal->fmatA[m][n] = pthisMagCal->fmatA[n][m];
+            pthisMagCal->pScratch->fmatA[m][n] = pthisMagCal->pScratch->fmatA[n][m];
         }
     }
 
     // set tmpA7x1 to the unsorted eigenvalues and fmatB to the unsorted eigenvectors of fmatA
-    fEigenCompute10(pthisMagCal->fmatA, pthisMagCal->fvecA, pthisMagCal->fmatB,
+    fEigenCompute10(pthisMagCal->pScratch->fmatA, pthisMagCal->pScratch->fvecA, pthisMagCal->pScratch->fmatB,
                     7);
 
     // find the smallest eigenvalue
     j = 0;
     for (i = 1; i < 7; i++)
     {
-        if (pthisMagCal->fvecA[i] < pthisMagCal->fvecA[j])
+        if (pthisMagCal->pScratch->fvecA[i] < pthisMagCal->pScratch->fvecA[j])
         {
             j = i;
         }
@@ -1743,10 +2755,10 @@ void fComputeMagCalibration7(struct MagCalibration *pthisMagCal,
     det = 1.0F;
     for (l = CHX; l <= CHZ; l++)
     {
-        pthisMagCal->fA[l][l] = pthisMagCal->fmatB[l][j];
+        pthisMagCal->fA[l][l] = pthisMagCal->pScratch->fmatB[l][j];
         det *= pthisMagCal->fA[l][l];
         pthisMagCal->ftrV[l] = -0.5F *
-            pthisMagCal->fmatB[l + 3][j] /
+            pthisMagCal->pScratch->fmatB[l + 3][j] /
             pthisMagCal->fA[l][l];
     }
 
@@ -1754,12 +2766,12 @@ void fComputeMagCalibration7(struct MagCalibration *pthisMagCal,
     if (det < 0.0F)
     {
         f3x3matrixAeqMinusA(pthisMagCal->fA);
-        pthisMagCal->fmatB[6][j] = -pthisMagCal->fmatB[6][j];
+        pthisMagCal->pScratch->fmatB[6][j] = -pthisMagCal->pScratch->fmatB[6][j];
         det = -det;
     }
 
     // set ftmp to the square of the trial geomagnetic field strength B (counts times FMATRIXSCALING)
-    ftmp = -pthisMagCal->fmatB[6][j];
+    ftmp = -pthisMagCal->pScratch->fmatB[6][j];
     for (l = CHX; l <= CHZ; l++)
     {
         ftmp += pthisMagCal->fA[l][l] *
@@ -1774,7 +2786,7 @@ void fComputeMagCalibration7(struct MagCalibration *pthisMagCal,
     pthisMagCal->ftrB = sqrtf(fabsf(ftmp)) * DEFAULTB * powf(det, -(ONESIXTH));
 
     // compute trial invW from the square root of A also with normalized determinant and hard iron offset in uT
-    f3x3matrixAeqI(pthisMagCal->ftrinvW);
+    fk3x3AeqI(pthisMagCal->ftrinvW);
     for (l = CHX; l <= CHZ; l++)
     {
         pthisMagCal->ftrinvW[l][l] = sqrtf(fabsf(pthisMagCal->fA[l][l]));
@@ -1815,7 +2827,7 @@ void fComputeMagCalibration10(struct MagCalibration *pthisMagCal,
     {
         for (n = m; n < 10; n++)
         {
-            pthisMagCal->fmatA[m][n] = 0.0F;
+            pthisMagCal->pScratch->fmatA[m][n] = 0.0F;
         }
     }
 
@@ -1825,57 +2837,51 @@ void fComputeMagCalibration10(struct MagCalibration *pthisMagCal,
     {
         for (k = 0; k < MAGBUFFSIZEY; k++)
         {
-            if (pthisMagBuffer->index[j][k] != -1)
+            if (iMagBufferBinActive(pthisMagBuffer, j, k))
             {
                 // use first valid magnetic buffer entry as estimate for offset to help solution (bit counts)
                 if (iCount == 0)
                 {
                     for (l = CHX; l <= CHZ; l++)
                     {
-                        iOffset[l] = pthisMagBuffer->iBs[l][j][k];
+                        iOffset[l] = MAGBUFFER_BS(pthisMagBuffer, l, j, k);
                     }
                 }
 
                 // apply the fixed offset and scaling and enter into fvecA[6-8]
                 for (l = CHX; l <= CHZ; l++)
                 {
-                    pthisMagCal->fvecA[l + 6] = (float)
+                    pthisMagCal->pScratch->fvecA[l + 6] = (float)
                         (
-                            (int32_t) pthisMagBuffer->iBs[l][j][k] -
+                            (int32_t) MAGBUFFER_BS(pthisMagBuffer, l, j, k) -
                             (int32_t) iOffset[l]
                         ) * fscaling;
                 }
 
                 // compute measurement vector elements fvecA[0-5] from fvecA[6-8]
-                pthisMagCal->fvecA[0] = pthisMagCal->fvecA[6] * pthisMagCal->fvecA[6];
-                pthisMagCal->fvecA[1] = 2.0F *
-                    pthisMagCal->fvecA[6] *
-                    pthisMagCal->fvecA[7];
-                pthisMagCal->fvecA[2] = 2.0F *
-                    pthisMagCal->fvecA[6] *
-                    pthisMagCal->fvecA[8];
-                pthisMagCal->fvecA[3] = pthisMagCal->fvecA[7] * pthisMagCal->fvecA[7];
-                pthisMagCal->fvecA[4] = 2.0F *
-                    pthisMagCal->fvecA[7] *
-                    pthisMagCal->fvecA[8];
-                pthisMagCal->fvecA[5] = pthisMagCal->fvecA[8] * pthisMagCal->fvecA[8];
+                pthisMagCal->pScratch->fvecA[0] = pthisMagCal->pScratch->fvecA[6] * pthisMagCal->pScratch->fvecA[6];
+                pthisMagCal->pScratch->fvecA[1] = 2.0F *
+                    pthisMagCal->pScratch->fvecA[6] *
+                    pthisMagCal->pScratch->fvecA[7];
+                pthisMagCal->pScratch->fvecA[2] = 2.0F *
+                    pthisMagCal->pScratch->fvecA[6] *
+                    pthisMagCal->pScratch->fvecA[8];
+                pthisMagCal->pScratch->fvecA[3] = pthisMagCal->pScratch->fvecA[7] * pthisMagCal->pScratch->fvecA[7];
+                pthisMagCal->pScratch->fvecA[4] = 2.0F *
+                    pthisMagCal->pScratch->fvecA[7] *
+                    pthisMagCal->pScratch->fvecA[8];
+                pthisMagCal->pScratch->fvecA[5] = pthisMagCal->pScratch->fvecA[8] * pthisMagCal->pScratch->fvecA[8];
 
                 // accumulate the on-and above-diagonal terms of fmatA=Sigma{fvecA^T * fvecA}
                 // with the exception of fmatA[9][9] which equals the number of measurements
                 // update the right hand column [9] of fmatA[0-8][9] ignoring fmatA[9][9]
                 for (m = 0; m < 9; m++)
                 {
-                    pthisMagCal->fmatA[m][9] += pthisMagCal->fvecA[m];
+                    pthisMagCal->pScratch->fmatA[m][9] += pthisMagCal->pScratch->fvecA[m];
                 }
 
                 // update the on and above diagonal terms of fmatA ignoring right hand column 9
-                for (m = 0; m < 9; m++)
-                {
-                    for (n = m; n < 9; n++)
-                    {
-                        pthisMagCal->fmatA[m][n] += pthisMagCal->fvecA[m] * pthisMagCal->fvecA[n];
-                    }
-                }
+                fk10x10AaddxxT9(pthisMagCal->pScratch->fmatA, pthisMagCal->pScratch->fvecA);
 
                 // increment the measurement counter for the next iteration
                 iCount++;
@@ -1884,7 +2890,7 @@ void fComputeMagCalibration10(struct MagCalibration *pthisMagCal,
     }
 
     // set the last element fmatA[9][9] to the number of measurements
-    pthisMagCal->fmatA[9][9] = (float) iCount;
+    pthisMagCal->pScratch->fmatA[9][9] = (float) iCount;
 
     // store the number of measurements accumulated (defensive programming, should never be needed)
     pthisMagBuffer->iMagBufferCount = iCount;
@@ -1894,40 +2900,40 @@ void fComputeMagCalibration10(struct MagCalibration *pthisMagCal,
     {
         for (n = 0; n < m; n++)
         {
-            pthisMagCal->fmatA[m][n] = pthisMagCal->fmatA[n][m];
+            pthisMagCal->pScratch->fmatA[m][n] = pthisMagCal->pScratch->fmatA[n][m];
         }
     }
 
-    // set pthisMagCal->fvecA to the unsorted eigenvalues and fmatB to the unsorted normalized eigenvectors of fmatA
-    fEigenCompute10(pthisMagCal->fmatA, pthisMagCal->fvecA, pthisMagCal->fmatB,
+    // set pthisMagCal->pScratch->fvecA to the unsorted eigenvalues and fmatB to the unsorted normalized eigenvectors of fmatA
+    fEigenCompute10(pthisMagCal->pScratch->fmatA, pthisMagCal->pScratch->fvecA, pthisMagCal->pScratch->fmatB,
                     10);
 
     // set ellipsoid matrix A from elements of the solution vector column j with smallest eigenvalue
     j = 0;
     for (i = 1; i < 10; i++)
     {
-        if (pthisMagCal->fvecA[i] < pthisMagCal->fvecA[j])
+        if (pthisMagCal->pScratch->fvecA[i] < pthisMagCal->pScratch->fvecA[j])
         {
             j = i;
         }
     }
 
-    pthisMagCal->fA[0][0] = pthisMagCal->fmatB[0][j];
-    pthisMagCal->fA[0][1] = pthisMagCal->fA[1][0] = pthisMagCal->fmatB[1][j];
-    pthisMagCal->fA[0][2] = pthisMagCal->fA[2][0] = pthisMagCal->fmatB[2][j];
-    pthisMagCal->fA[1][1] = pthisMagCal->fmatB[3][j];
-    pthisMagCal->fA[1][2] = pthisMagCal->fA[2][1] = pthisMagCal->fmatB[4][j];
-    pthisMagCal->fA[2][2] = pthisMagCal->fmatB[5][j];
+    pthisMagCal->fA[0][0] = pthisMagCal->pScratch->fmatB[0][j];
+    pthisMagCal->fA[0][1] = pthisMagCal->fA[1][0] = pthisMagCal->pScratch->fmatB[1][j];
+    pthisMagCal->fA[0][2] = pthisMagCal->fA[2][0] = pthisMagCal->pScratch->fmatB[2][j];
+    pthisMagCal->fA[1][1] = pthisMagCal->pScratch->fmatB[3][j];
+    pthisMagCal->fA[1][2] = pthisMagCal->fA[2][1] = pthisMagCal->pScratch->fmatB[4][j];
+    pthisMagCal->fA[2][2] = pthisMagCal->pScratch->fmatB[5][j];
 
     // negate entire solution if A has negative determinant
     det = f3x3matrixDetA(pthisMagCal->fA);
     if (det < 0.0F)
     {
         f3x3matrixAeqMinusA(pthisMagCal->fA);
-        pthisMagCal->fmatB[6][j] = -pthisMagCal->fmatB[6][j];
-        pthisMagCal->fmatB[7][j] = -pthisMagCal->fmatB[7][j];
-        pthisMagCal->fmatB[8][j] = -pthisMagCal->fmatB[8][j];
-        pthisMagCal->fmatB[9][j] = -pthisMagCal->fmatB[9][j];
+        pthisMagCal->pScratch->fmatB[6][j] = -pthisMagCal->pScratch->fmatB[6][j];
+        pthisMagCal->pScratch->fmatB[7][j] = -pthisMagCal->pScratch->fmatB[7][j];
+        pthisMagCal->pScratch->fmatB[8][j] = -pthisMagCal->pScratch->fmatB[8][j];
+        pthisMagCal->pScratch->fmatB[9][j] = -pthisMagCal->pScratch->fmatB[9][j];
         det = -det;
     }
 
@@ -1940,7 +2946,7 @@ void fComputeMagCalibration10(struct MagCalibration *pthisMagCal,
         pthisMagCal->ftrV[l] = 0.0F;
         for (m = CHX; m <= CHZ; m++)
         {
-            pthisMagCal->ftrV[l] += pthisMagCal->finvA[l][m] * pthisMagCal->fmatB[m + 6][j];
+            pthisMagCal->ftrV[l] += pthisMagCal->finvA[l][m] * pthisMagCal->pScratch->fmatB[m + 6][j];
         }
 
         pthisMagCal->ftrV[l] *= -0.5F;
@@ -1958,10 +2964,10 @@ void fComputeMagCalibration10(struct MagCalibration *pthisMagCal,
                               pthisMagCal->fA[1][2] * pthisMagCal->ftrV[CHY] *
                               pthisMagCal->ftrV[CHZ] + pthisMagCal->fA[2][2] *
                               pthisMagCal->ftrV[CHZ] * pthisMagCal->ftrV[CHZ] -
-                              pthisMagCal->fmatB[9][j]));
+                              pthisMagCal->pScratch->fmatB[9][j]));
 
     // calculate the trial normalized fit error as a percentage
-    pthisMagCal->ftrFitErrorpc = 50.0F * sqrtf(fabsf(pthisMagCal->fvecA[j]) /
+    pthisMagCal->ftrFitErrorpc = 50.0F * sqrtf(fabsf(pthisMagCal->pScratch->fvecA[j]) /
                                                    (float) pthisMagBuffer->iMagBufferCount) / (pthisMagCal->ftrB * pthisMagCal->ftrB);
 
     // correct for the measurement matrix offset and scaling and get the computed hard iron offset in uT
@@ -1987,20 +2993,20 @@ void fComputeMagCalibration10(struct MagCalibration *pthisMagCal,
     {
         for (j = 0; j < 3; j++)
         {
-            pthisMagCal->fmatA[i][j] = pthisMagCal->fA[i][j];
+            pthisMagCal->pScratch->fmatA[i][j] = pthisMagCal->fA[i][j];
         }
     }
 
-    fEigenCompute10(pthisMagCal->fmatA, pthisMagCal->fvecA, pthisMagCal->fmatB,
+    fEigenCompute10(pthisMagCal->pScratch->fmatA, pthisMagCal->pScratch->fvecA, pthisMagCal->pScratch->fmatB,
                     3);
 
-    // set pthisMagCal->fmatB to be eigenvectors . diag(sqrt(sqrt(eigenvalues))) = fmatB . diag(sqrt(sqrt(fvecA))
+    // set pthisMagCal->pScratch->fmatB to be eigenvectors . diag(sqrt(sqrt(eigenvalues))) = fmatB . diag(sqrt(sqrt(fvecA))
     for (j = 0; j < 3; j++) // loop over columns j
     {
-        ftmp = sqrtf(sqrtf(fabsf(pthisMagCal->fvecA[j])));
+        ftmp = sqrtf(sqrtf(fabsf(pthisMagCal->pScratch->fvecA[j])));
         for (i = 0; i < 3; i++) // loop over rows i
         {
-            pthisMagCal->fmatB[i][j] *= ftmp;
+            pthisMagCal->pScratch->fmatB[i][j] *= ftmp;
         }
     }
 
@@ -2017,7 +3023,7 @@ void fComputeMagCalibration10(struct MagCalibration *pthisMagCal,
             // accumulate the matrix product
             for (k = 0; k < 3; k++)
             {
-                pthisMagCal->ftrinvW[i][j] += pthisMagCal->fmatB[i][k] * pthisMagCal->fmatB[j][k];
+                pthisMagCal->ftrinvW[i][j] += pthisMagCal->pScratch->fmatB[i][k] * pthisMagCal->pScratch->fmatB[j][k];
             }
 
             // copy to below diagonal element
@@ -22,6 +22,9 @@
 extern "C" {
 #endif
 
+#include "build.h"
+#include "calibration_scratch.h"
+
 #ifndef F_USING_MAG
 #define F_USING_MAG 0x0002  // normally should be defined in build.h
 #endif
@@ -36,11 +39,23 @@ extern "C" {
 #define MINMEASUREMENTS10CAL 330		///< minimum number of measurements for 10 element calibration
 #define MAXMEASUREMENTS 360			///< maximum number of measurements used for calibration
 #define CAL_INTERVAL_SECS 300			///< 300s or 5min interval for regular calibration checks
+#define BACKGROUND_CAL_INTERVAL_SECS 10		///< interval for regular calibration checks when solved in the background
 #define MINBFITUT 10.0F				///< minimum acceptable geomagnetic field B (uT) for valid calibration
 #define MAXBFITUT 90.0F				///< maximum acceptable geomagnetic field B (uT) for valid calibration
 #define FITERRORAGINGSECS 86400.0F		///< 24 hours: time (s) for fit error to increase (age) by e=2.718
 #define MESHDELTACOUNTS 50			///< magnetic buffer mesh spacing in counts (here 5uT)
 #define DEFAULTB 50.0F				///< default geomagnetic field (uT)
+#define FIXEDCALMAXCOUNTS 4095			///< largest deviation from the buffer mean (counts) for integer calibration sums
+#define FIXEDCALSUMS 51				///< number of integer calibration sums (10 element calibration)
+#define EIGENTOLERANCE 1.0E-6F			///< eigen-decomposition off-diagonal element limit, relative to its diagonal elements
+#define EIGENMAXSWEEPS 15			///< most sweeps of an eigen-decomposition with EIGENTOLERANCE
+#define MAGMOMENTS 35				///< number of running moments of the magnetic buffer, all products of up to four components
+#define MOMENTRECENTERCOUNTS 512		///< largest distance (counts) of the buffer mean from the moment center before resumming
+#define MESHHASHSIZE 128			///< number of buckets of the spatial hash of the magnetic buffer (power of 2)
+#define MAGACTIVEWORDS ((MAGBUFFSIZEX * MAGBUFFSIZEY + 31) / 32)	///< number of 32 bit words of one bit per buffer bin
+#define MAGAGELIMIT 0xC000			///< oldest age (fusion cycles) held in the 16 bit time stamps of the compact buffer
+#define MAGSNAPSHOTCHECKSECS 30		///< time (s) for which the readings after a buffer snapshot is restored are checked
+#define MAGSNAPSHOTMARGINPC 3.5F		///< rms error (%) of those readings allowed above the fit error of the saved calibration
 ///@}
 
 /// The Magnetometer Measurement Buffer holds a 3-dimensional "constellation"
@@ -50,12 +65,99 @@ extern "C" {
 /// The contents of this buffer are updated on a continuing basis.
 struct MagBuffer
 {
+#if F_COMPACT_MAG_BUFFER
+	int16_t iBs[MAGBUFFSIZEX][MAGBUFFSIZEY][3];		///< uncalibrated magnetometer readings, x, y, z of each bin together
+	uint16_t iStamp[MAGBUFFSIZEX][MAGBUFFSIZEY];		///< low 16 bits of the time index of each reading
+	int16_t iAgeCursor;					///< next bin whose age iUpdateMagBuffer() holds to MAGAGELIMIT
+#else
 	int16_t iBs[3][MAGBUFFSIZEX][MAGBUFFSIZEY];		///< uncalibrated magnetometer readings
 	int32_t index[MAGBUFFSIZEX][MAGBUFFSIZEY];		///< array of time indices
 	int16_t tanarray[MAGBUFFSIZEX - 1];			///< array of tangents of (100 * angle)
+#endif
+#if F_COMPACT_MAG_BUFFER || F_MAG_BUFFER_INDEX
+	uint32_t iActive[MAGACTIVEWORDS];			///< one bit per bin (j * MAGBUFFSIZEY + k), set while the bin holds a reading
+#endif
 	int16_t iMagBufferCount;				///< number of magnetometer readings
+#if F_INCREMENTAL_MAG_SUMS
+	int64_t iMoments[MAGMOMENTS];				///< sums over the buffer of products of up to four components relative to iMomentCenter
+	int16_t iMomentCenter[3];				///< reference point of iMoments (counts)
+	int8_t iMomentsValid;					///< iMoments holds the sums over the buffer
+	int16_t iPendingBin;					///< bin whose current reading iMoments does not yet hold, -1 if none
+	int16_t iPendingBs[3];					///< earlier reading of iPendingBin that iMoments holds in its place
+	int8_t iPendingHeld;					///< iMoments holds iPendingBs (false if iPendingBin was empty)
+#endif
+#if F_MAG_BUFFER_INDEX
+	int16_t iNewer[MAGBUFFSIZEX * MAGBUFFSIZEY];		///< next newer active bin (j * MAGBUFFSIZEY + k), -1 for the newest
+	int16_t iOlder[MAGBUFFSIZEX * MAGBUFFSIZEY];		///< next older active bin, -1 for the oldest
+	int16_t iNewest;					///< newest active bin, -1 if the buffer is empty
+	int16_t iOldest;					///< oldest active bin, -1 if the buffer is empty
+	int16_t iMeshNext[MAGBUFFSIZEX * MAGBUFFSIZEY];	///< next active bin in the same spatial hash bucket, -1 for the last
+	int16_t iMeshHead[MESHHASHSIZE];			///< first active bin in each spatial hash bucket, -1 if none
+#endif
 };
 
+/// @name Magnetic Buffer Access
+/// The layout of struct MagBuffer depends on F_COMPACT_MAG_BUFFER, so its readings and time indices are read and
+/// written through these rather than directly.
+///@{
+/// component i of the reading in bin j, k of the magnetic buffer
+#if F_COMPACT_MAG_BUFFER
+#define MAGBUFFER_BS(pthisMagBuffer, i, j, k) ((pthisMagBuffer)->iBs[j][k][i])
+#else
+#define MAGBUFFER_BS(pthisMagBuffer, i, j, k) ((pthisMagBuffer)->iBs[i][j][k])
+#endif
+
+/// returns true if bin j, k of the magnetic buffer holds a reading
+static inline int8_t iMagBufferBinActive(const struct MagBuffer *pthisMagBuffer, int8_t j, int8_t k)
+{
+#if F_COMPACT_MAG_BUFFER
+	int16_t n = (int16_t) (j * MAGBUFFSIZEY + k);
+	return (int8_t) ((pthisMagBuffer->iActive[n >> 5] >> (n & 31)) & 1);
+#else
+	return (int8_t) (pthisMagBuffer->index[j][k] != -1);
+#endif
+}
+
+/// marks bin j, k of the magnetic buffer as holding a reading stored at time index loopcounter
+static inline void iMagBufferSetBin(struct MagBuffer *pthisMagBuffer, int8_t j, int8_t k, int32_t loopcounter)
+{
+#if F_COMPACT_MAG_BUFFER || F_MAG_BUFFER_INDEX
+	int16_t n = (int16_t) (j * MAGBUFFSIZEY + k);
+	pthisMagBuffer->iActive[n >> 5] |= (uint32_t) 1 << (n & 31);
+#endif
+#if F_COMPACT_MAG_BUFFER
+	pthisMagBuffer->iStamp[j][k] = (uint16_t) loopcounter;
+#else
+	pthisMagBuffer->index[j][k] = loopcounter;
+#endif
+}
+
+/// marks bin j, k of the magnetic buffer as empty
+static inline void iMagBufferClearBin(struct MagBuffer *pthisMagBuffer, int8_t j, int8_t k)
+{
+#if F_COMPACT_MAG_BUFFER || F_MAG_BUFFER_INDEX
+	int16_t n = (int16_t) (j * MAGBUFFSIZEY + k);
+	pthisMagBuffer->iActive[n >> 5] &= ~((uint32_t) 1 << (n & 31));
+#endif
+#if !F_COMPACT_MAG_BUFFER
+	pthisMagBuffer->index[j][k] = -1;
+#endif
+}
+
+/// returns the number of fusion cycles, at time index loopcounter, since the reading in bin j, k was stored. The
+/// compact buffer holds the ages of its readings to MAGAGELIMIT (see iUpdateMagBuffer()).
+static inline int32_t iMagBufferBinAge(const struct MagBuffer *pthisMagBuffer, int8_t j, int8_t k, int32_t loopcounter)
+{
+#if F_COMPACT_MAG_BUFFER
+	return (int32_t) (uint16_t) ((uint16_t) loopcounter - pthisMagBuffer->iStamp[j][k]);
+#else
+	return loopcounter - pthisMagBuffer->index[j][k];
+#endif
+}
+///@}
+
+struct MagCalWorker;  // actual typedef is located in mag_cal_worker.h
+
 /// Magnetic Calibration Structure
 struct MagCalibration
 {
@@ -74,11 +176,18 @@ struct MagCalibration
 	float ftrFitErrorpc;			        ///< trial value of fit error %
 	float fA[3][3];					///< ellipsoid matrix A
 	float finvA[3][3];				///< inverse of ellipsoid matrix A
-	float fmatA[10][10];			        ///< scratch 10x10 float matrix used by calibration algorithms
-	float fmatB[10][10];			        ///< scratch 10x10 float matrix used by calibration algorithms
-	float fvecA[10];				///< scratch 10x1 vector used by calibration algorithms
-	float fvecB[4];					///< scratch 4x1 vector used by calibration algorithms
+	struct CalibrationScratch *pScratch;		///< scratch matrices of the fusion instance, leased while a calibration is in progress
+	uint16_t iScratchLease;				///< lease of pScratch held by the calibration in progress, 0 if none
+	struct MagCalWorker *pWorker;			///< background solver of the calibrations (see mag_cal_worker.h), NULL to time slice
 	float fYTY;					///< Y^T.Y for 4 element calibration = (iB^2)^2
+#if F_FIXED_POINT_FUSION
+	int64_t iSumA[FIXEDCALSUMS];			///< exact sums accumulated in place of fmatA, fvecA and fYTY (counts^n)
+	int8_t iFixedSums;				///< flag denoting that this calibration is accumulating iSumA
+#endif
+#if F_WARM_START_EIGEN
+	float fmatV[10][10];				///< eigenvectors of the last 7 or 10 element eigen-decomposition
+	int8_t iWarmStartSize;				///< size of fmatV: 7 or 10, or 0 if there is none
+#endif
 	int32_t iSumBs[3];				///< sum of measurements in buffer (counts)
 	int32_t iMeanBs[3];				///< average magnetic measurement (counts)
 	int32_t itimeslice;				///< counter for tine slicing magnetic calibration calculations
@@ -89,6 +198,14 @@ struct MagCalibration
 	int8_t i4ElementSolverTried;		        ///< flag to denote at least one attempt made with 4 element calibration
 	int8_t i7ElementSolverTried;		        ///< flag to denote at least one attempt made with 7 element calibration
 	int8_t i10ElementSolverTried;		        ///< flag to denote at least one attempt made with 10 element calibration
+	int16_t iEigenSweeps;				///< sweeps of the eigen-decomposition of the last calibration
+	int16_t iCalSlices;				///< time slices of the last calibration
+	int8_t iCalStatsReady;				///< solver (4, 7, 10) whose iEigenSweeps and iCalSlices are not yet reported
+	uint32_t iCalsSolved;				///< calibrations solved since initialization, whether accepted or not
+#if F_MAG_BUFFER_SNAPSHOT
+	int16_t iSnapshotChecks;			///< readings still to check against a restored buffer snapshot, 0 if none
+	float fSnapshotErrorSq;				///< sum of the squared relative errors from fB of those checked so far
+#endif
 };
 
 
@@ -101,14 +218,24 @@ struct MagSensor;  // actual typedef is located in sensor_fusion_types.h
 ///@{
 void fInitializeMagCalibration(struct MagCalibration *pthisMagCal, struct MagBuffer *pthisMagBuffer);
 void iUpdateMagBuffer(struct MagBuffer *pthisMagBuffer, struct MagSensor *pthisMag, int32_t loopcounter);
+void iReindexMagBuffer(struct MagBuffer *pthisMagBuffer, int32_t loopcounter);
+void iClearMagBuffer(struct MagBuffer *pthisMagBuffer, int32_t loopcounter);
+#if F_MAG_BUFFER_SNAPSHOT
+void fCheckMagBufferSnapshot(struct MagCalibration *pthisMagCal, struct MagBuffer *pthisMagBuffer,
+                             struct MagSensor *pthisMag, int32_t loopcounter);
+#endif
 void fInvertMagCal(struct MagSensor *pthisMag, struct MagCalibration *pthisMagCal);
 void fRunMagCalibration(struct MagCalibration *pthisMagCal, struct MagBuffer *pthisMagBuffer, struct MagSensor* pthisMag, int32_t loopcounter);
+void fAgeMagCalibration(struct MagCalibration *pthisMagCal);
 void fUpdateMagCalibration4(struct MagCalibration *pthisMagCal, struct MagBuffer *pthisMagBuffer, struct MagSensor *pthisMag);
 void fUpdateMagCalibration7(struct MagCalibration *pthisMagCal, struct MagBuffer *pthisMagBuffer, struct MagSensor *pthisMag);
 void fUpdateMagCalibration10(struct MagCalibration *pthisMagCal, struct MagBuffer *pthisMagBuffer, struct MagSensor *pthisMag);
 void fUpdateMagCalibration4Slice(struct MagCalibration *pthisMagCal, struct MagBuffer *pthisMagBuffer, struct MagSensor *pthisMag);
 void fUpdateMagCalibration7Slice(struct MagCalibration *pthisMagCal, struct MagBuffer *pthisMagBuffer, struct MagSensor *pthisMag);
 void fUpdateMagCalibration10Slice(struct MagCalibration *pthisMagCal, struct MagBuffer *pthisMagBuffer, struct MagSensor *pthisMag);
+#if F_WARM_START_EIGEN
+int8_t iNextEigElement(float fmatA[][10], const float fvecA[], int8_t iMatrixSize, int8_t k, int8_t *pi, int8_t *pj);
+#endif
 ///@}
 #else    // if F_USING_MAG
 struct MagBuffer
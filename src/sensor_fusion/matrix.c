@@ -641,6 +641,53 @@ void fComputeEigSlice(float fmatA[10][10], float fmatB[10][10], float fvecA[10],
     return;
 }
 
+// function prepares the Jacobi eigen-decomposition of the real symmetric matrix A[0..n-1][0..n-1] (stored
+// in the top left of a 10x10 array) to resume from the eigenvectors V[0..n-1][0..n-1] of an earlier, similar
+// matrix rather than from the identity matrix. A[][] is replaced by V^T.A.V, eigvec[][] is set to V and
+// eigval[] to the diagonal of V^T.A.V. The off-diagonal elements of V^T.A.V are small if A is close to
+// the earlier matrix, so few rotations are needed. V and eigvec must be different arrays.
+void fEigenWarmStart10(float A[][10], float eigval[], float eigvec[][10], float V[][10], int8_t n)
+{
+    float   ftmp;   // scratch
+    int8_t    i,
+            j,
+            k;      // loop counters
+
+    // set eigvec to A.V using the full symmetric matrix A
+    for (i = 0; i < n; i++)
+    {
+        for (j = 0; j < n; j++)
+        {
+            ftmp = 0.0F;
+            for (k = 0; k < n; k++)
+                ftmp += A[i][k] * V[k][j];
+            eigvec[i][j] = ftmp;
+        }
+    }
+
+    // set the on and above diagonal elements of A to V^T.(A.V) and copy to below diagonal
+    for (i = 0; i < n; i++)
+    {
+        for (j = i; j < n; j++)
+        {
+            ftmp = 0.0F;
+            for (k = 0; k < n; k++)
+                ftmp += V[k][i] * eigvec[k][j];
+            A[i][j] = A[j][i] = ftmp;
+        }
+    }
+
+    // set the eigenvectors to V and the eigenvalues to the diagonal elements of A
+    for (i = 0; i < n; i++)
+    {
+        for (j = 0; j < n; j++)
+            eigvec[i][j] = V[i][j];
+        eigval[i] = A[i][i];
+    }
+
+    return;
+}
+
 // function uses Gauss-Jordan elimination to compute the inverse of matrix A in situ
 
 // on exit, A is replaced with its inverse
@@ -795,6 +842,135 @@ void fmatrixAeqInvA(float *A[], int8_t iColInd[], int8_t iRowInd[], int8_t iPivo
     return;
 }
 
+// function computes the LDL^T factorization of the symmetric positive definite matrix A in situ.
+// only the on and below diagonal elements of A are read. on exit the below diagonal elements hold the unit
+// lower triangular matrix L, the diagonal elements hold the diagonal matrix D and the above diagonal
+// elements are unchanged. no square roots and no pivot search are needed.
+// if A is not positive definite, A is set to the identity matrix and *pierror is set to true
+void fmatrixLDLTFactor(float *A[], int8_t isize, int8_t *pierror)
+{
+    float   fsum;       // accumulator
+    float   frecipD;    // reciprocal of the current diagonal element of D
+    int8_t    i,
+            j,
+            k;          // loop counters
+
+    // default to successful factorization
+    *pierror = false;
+
+    // loop over the columns j of L
+    for (j = 0; j < isize; j++)
+    {
+        // D[j] = A[j][j] - sum over k < j of L[j][k]^2 * D[k]
+        fsum = A[j][j];
+        for (k = 0; k < j; k++)
+            fsum -= A[j][k] * A[j][k] * A[k][k];
+
+        // a zero or negative pivot means A is singular or not positive definite
+        if (!(fsum > 0.0F))
+        {
+            fmatrixAeqI(A, isize);
+            *pierror = true;
+            return;
+        }
+        A[j][j] = fsum;
+        frecipD = 1.0F / fsum;
+
+        // L[i][j] = (A[i][j] - sum over k < j of L[i][k] * L[j][k] * D[k]) / D[j] for rows i below j
+        for (i = j + 1; i < isize; i++)
+        {
+            fsum = A[i][j];
+            for (k = 0; k < j; k++)
+                fsum -= A[i][k] * A[j][k] * A[k][k];
+            A[i][j] = fsum * frecipD;
+        }
+    }
+
+    return;
+}
+
+// function solves A.x = b in situ using the LDL^T factorization of A computed by fmatrixLDLTFactor().
+// on entry fx holds b and on exit holds the solution x.
+void fmatrixLDLTSolve(float *A[], float fx[], int8_t isize)
+{
+    int8_t    i,
+            k;          // loop counters
+
+    // forward substitution to solve L.y = b
+    for (i = 1; i < isize; i++)
+        for (k = 0; k < i; k++)
+            fx[i] -= A[i][k] * fx[k];
+
+    // divide by the diagonal to solve D.z = y
+    for (i = 0; i < isize; i++)
+        fx[i] /= A[i][i];
+
+    // back substitution to solve L^T.x = z
+    for (i = isize - 2; i >= 0; i--)
+        for (k = i + 1; k < isize; k++)
+            fx[i] -= A[k][i] * fx[k];
+
+    return;
+}
+
+// function uses LDL^T factorization to compute the inverse of the symmetric positive definite matrix A in situ.
+// only the on and below diagonal elements of A are read. on exit, A is replaced with its (symmetric) inverse.
+// if A is not positive definite, A is set to the identity matrix and *pierror is set to true,
+// as fmatrixAeqInvA() does for a singular matrix.
+void fmatrixAeqInvSymA(float *A[], int8_t isize, int8_t *pierror)
+{
+    float   fsum;       // accumulator
+    int8_t    i,
+            j,
+            k;          // loop counters
+
+    // factorize A = L.D.L^T leaving L below the diagonal and D on the diagonal
+    fmatrixLDLTFactor(A, isize, pierror);
+    if (*pierror) return;
+
+    // replace L below the diagonal with inv(L), column by column. inv(L) is also unit lower triangular and
+    // inv(L)[i][j] = -(L[i][j] + sum over j < k < i of L[i][k] * inv(L)[k][j])
+    for (j = 0; j < isize - 1; j++)
+    {
+        for (i = j + 1; i < isize; i++)
+        {
+            fsum = A[i][j];
+            for (k = j + 1; k < i; k++)
+                fsum += A[i][k] * A[k][j];
+            A[i][j] = -fsum;
+        }
+    }
+
+    // replace D on the diagonal with inv(D)
+    for (i = 0; i < isize; i++)
+        A[i][i] = 1.0F / A[i][i];
+
+    // set the on and above diagonal elements to inv(A) = inv(L)^T.inv(D).inv(L):
+    // inv(A)[i][j] = sum over k >= j of inv(L)[k][i] * inv(D)[k] * inv(L)[k][j] for i <= j.
+    // row i only reads inv(D)[k] for k >= i so can overwrite inv(D)[i]
+    for (i = 0; i < isize; i++)
+    {
+        for (j = i; j < isize; j++)
+        {
+            // the k = j term where inv(L)[j][j] = 1
+            if (j == i)
+                fsum = A[j][j];
+            else
+                fsum = A[j][i] * A[j][j];
+            for (k = j + 1; k < isize; k++)
+                fsum += A[k][i] * A[k][k] * A[k][j];
+            A[i][j] = fsum;
+        }
+    }
+
+    // copy the above diagonal elements to below the diagonal
+    for (i = 1; i < isize; i++)
+        for (j = 0; j < i; j++)
+            A[i][j] = A[j][i];
+
+    return;
+}
+
 // function rotates 3x1 vector u onto 3x1 vector using 3x3 rotation matrix fR.
 
 // the rotation is applied in the inverse direction if itranpose is true
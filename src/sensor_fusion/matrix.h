@@ -87,6 +87,16 @@ void fComputeEigSlice(
     int8_t j, 
     int8_t iMatrixSize
 );
+/// function prepares the eigen-decomposition of a real symmetric matrix A[0..n-1][0..n-1] stored in the
+/// top left of a 10x10 array to resume from the eigenvectors V of an earlier, similar matrix:
+/// A[][] is replaced by V^T.A.V, eigvec[][] is set to V and eigval[] to the diagonal of V^T.A.V.
+void fEigenWarmStart10(
+    float A[][10],              ///< real symmetric matrix A[0..n-1][0..n-1], including below diagonal elements
+    float eigval[],             ///< eigval[0..n-1] returns the diagonal elements of V^T.A.V
+    float eigvec[][10],         ///< eigvec[0..n-1][0..n-1] returns a copy of V
+    float V[][10],              ///< V[0..n-1][0..n-1] orthonormal eigenvectors of the earlier matrix
+    int8_t n                      ///< n can vary up to and including 10
+);
 /// function uses Gauss-Jordan elimination to compute the inverse of matrix A in situ
 /// on exit, A is replaced with its inverse
 void fmatrixAeqInvA(
@@ -97,6 +107,26 @@ void fmatrixAeqInvA(
     int8_t isize, 
     int8_t* pierror
 );
+/// function computes the LDL^T factorization of a symmetric positive definite matrix A in situ,
+/// leaving the unit lower triangular L below the diagonal and D on the diagonal
+void fmatrixLDLTFactor(
+    float *A[],                 ///< symmetric positive definite matrix, only on and below diagonal elements read
+    int8_t isize,               ///< size of A
+    int8_t* pierror             ///< set true, and A to the identity matrix, if A is not positive definite
+);
+/// function solves A.x = b using the LDL^T factorization of A from fmatrixLDLTFactor()
+void fmatrixLDLTSolve(
+    float *A[],                 ///< LDL^T factorization of A
+    float fx[],                 ///< b on entry, x on exit
+    int8_t isize                ///< size of A
+);
+/// function uses LDL^T factorization to compute the inverse of a symmetric positive definite matrix A in situ
+/// on exit, A is replaced with its inverse
+void fmatrixAeqInvSymA(
+    float *A[],                 ///< symmetric positive definite matrix, only on and below diagonal elements read
+    int8_t isize,               ///< size of A
+    int8_t* pierror             ///< set true, and A to the identity matrix, if A is not positive definite
+);
 /// function rotates 3x1 vector u onto 3x1 vector using 3x3 rotation matrix fR.
 /// the rotation is applied in the inverse direction if itranpose is true
 void fveqRu(
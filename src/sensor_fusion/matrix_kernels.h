@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2020-2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file matrix_kernels.h
+    \brief Fixed size matrix kernels, inlined at the call site.
+
+    The functions in matrix.c take runtime sizes and are called through
+    pointers, so each 3x3 product in the Kalman filters costs a call and a
+    loop. Each kernel here has its size in its name and in its loop bounds,
+    so the compiler inlines it and unrolls the loops completely. The kernels
+    keep the order of the arithmetic of the loops they replace, so they give
+    the same results unless the compiler contracts a multiply and add into a
+    single fused instruction in one but not the other (as GCC does by default
+    with -march=native on a host with FMA). The results then agree to within
+    float rounding. Build with -ffp-contract=off for identical results.
+
+    With F_MATRIX_KERNEL_SIMD set in build.h, the 9x6 product and the
+    symmetric rank one updates of the magnetic calibration use SSE or NEON
+    on a host with either. These kernels work element by element along a row,
+    without any horizontal sums, so they keep the same order of arithmetic
+    and agree with the scalar kernels in the same way. The 3x3
+    and 3x1 kernels are too short to gain from SIMD and are always scalar, as
+    is everything on the ESP32 and ESP8266.
+*/
+
+#ifndef MATRIX_KERNELS_H
+#define MATRIX_KERNELS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "build.h"
+
+#if F_MATRIX_KERNEL_SIMD && defined(SENSOR_FUSION_HOST) && (defined(__SSE__) || defined(_M_X64))
+#include <xmmintrin.h>
+#define MATRIX_KERNEL_SSE   1   ///< kernels use SSE
+#elif F_MATRIX_KERNEL_SIMD && defined(SENSOR_FUSION_HOST) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define MATRIX_KERNEL_NEON  1   ///< kernels use NEON
+#endif
+
+/// @name 3x3 and 3x1 Kernels
+///@{
+/// sets the 3x3 matrix A to the identity matrix
+static inline void fk3x3AeqI(float A[][3])
+{
+	A[0][0] = A[1][1] = A[2][2] = 1.0F;
+	A[0][1] = A[0][2] = A[1][0] = A[1][2] = A[2][0] = A[2][1] = 0.0F;
+}
+
+/// sets the 3x3 matrix A to the 3x3 matrix B
+static inline void fk3x3AeqB(float A[][3], float B[][3])
+{
+	int8_t i, j;
+	for (i = 0; i < 3; i++)
+		for (j = 0; j < 3; j++)
+			A[i][j] = B[i][j];
+}
+
+/// sets the 3x1 vector fv to the 3x1 vector fu rotated by the 3x3 matrix fR, fv = fR.fu. fv and fu must differ.
+static inline void fk3x1VeqRu(float fv[], float fR[][3], const float fu[])
+{
+	int8_t i;
+	for (i = 0; i < 3; i++)
+		fv[i] = fR[i][0] * fu[0] + fR[i][1] * fu[1] + fR[i][2] * fu[2];
+}
+
+/// sets the 3x1 vector fv to the 3x1 vector fu rotated by the transpose (inverse) of the 3x3 matrix fR,
+/// fv = fR^T.fu. fv and fu must differ.
+static inline void fk3x1VeqRTu(float fv[], float fR[][3], const float fu[])
+{
+	int8_t i;
+	for (i = 0; i < 3; i++)
+		fv[i] = fR[0][i] * fu[0] + fR[1][i] * fu[1] + fR[2][i] * fu[2];
+}
+///@}
+
+/// @name 6x6 and 9x6 Kernels
+///@{
+/// sets the below diagonal elements of the symmetric 6x6 matrix A to its above diagonal elements
+static inline void fk6x6AeqSymUpper(float A[][6])
+{
+	int8_t i, j;
+	for (i = 1; i < 6; i++)
+		for (j = 0; j < i; j++)
+			A[i][j] = A[j][i];
+}
+
+/// sets the 9x6 matrix A to the product of the 9x6 matrix B and the 6x6 matrix C, A = B.C
+static inline void fk9x6AeqBxC(float A[][6], float B[][6], float C[][6])
+{
+	int8_t i, k;
+#if defined(MATRIX_KERNEL_SSE) || defined(MATRIX_KERNEL_NEON)
+	// each row of A is accumulated as columns 0-3 and 2-5, and stored high half first so that the
+	// overlapping columns 2-3, which hold the same sums in both, are written last from columns 0-3
+	for (i = 0; i < 9; i++)
+	{
+#if defined(MATRIX_KERNEL_SSE)
+		__m128 fLo = _mm_setzero_ps(), fHi = _mm_setzero_ps();
+		for (k = 0; k < 6; k++)
+		{
+			__m128 fBik = _mm_set1_ps(B[i][k]);
+			fLo = _mm_add_ps(fLo, _mm_mul_ps(fBik, _mm_loadu_ps(&C[k][0])));
+			fHi = _mm_add_ps(fHi, _mm_mul_ps(fBik, _mm_loadu_ps(&C[k][2])));
+		}
+		_mm_storeu_ps(&A[i][2], fHi);
+		_mm_storeu_ps(&A[i][0], fLo);
+#else
+		float32x4_t fLo = vdupq_n_f32(0.0F), fHi = vdupq_n_f32(0.0F);
+		for (k = 0; k < 6; k++)
+		{
+			fLo = vmlaq_n_f32(fLo, vld1q_f32(&C[k][0]), B[i][k]);
+			fHi = vmlaq_n_f32(fHi, vld1q_f32(&C[k][2]), B[i][k]);
+		}
+		vst1q_f32(&A[i][2], fHi);
+		vst1q_f32(&A[i][0], fLo);
+#endif
+	}
+#else
+	int8_t j;
+	for (i = 0; i < 9; i++)
+	{
+		for (j = 0; j < 6; j++)
+		{
+			A[i][j] = 0.0F;
+			for (k = 0; k < 6; k++)
+				A[i][j] += B[i][k] * C[k][j];
+		}
+	}
+#endif
+}
+
+/// sets the 9x1 vector fv to the product of the 9x6 matrix A and the 6x1 vector fu, fv = A.fu
+static inline void fk9x1VeqAxU(float fv[], float A[][6], const float fu[])
+{
+	int8_t i, k;
+	for (i = 0; i < 9; i++)
+	{
+		fv[i] = 0.0F;
+		for (k = 0; k < 6; k++)
+			fv[i] += A[i][k] * fu[k];
+	}
+}
+///@}
+
+/// @name 10x10 Kernels
+/// Rank one updates A += x.x^T of the on and above diagonal elements of the top left of a 10x10 matrix, as
+/// accumulated by the 7 and 10 element magnetic calibrations. Elements below the diagonal are untouched.
+///@{
+/// adds the symmetric rank one update of the 6x1 vector fx to the top left 6x6 block of A
+static inline void fk10x10AaddxxT6(float A[][10], const float fx[])
+{
+	int8_t i, j;
+	for (i = 0; i < 6; i++)
+	{
+		j = i;
+#if defined(MATRIX_KERNEL_SSE)
+		__m128 fxi = _mm_set1_ps(fx[i]);
+		for (; j + 4 <= 6; j += 4)
+			_mm_storeu_ps(&A[i][j], _mm_add_ps(_mm_loadu_ps(&A[i][j]), _mm_mul_ps(fxi, _mm_loadu_ps(&fx[j]))));
+#elif defined(MATRIX_KERNEL_NEON)
+		for (; j + 4 <= 6; j += 4)
+			vst1q_f32(&A[i][j], vmlaq_n_f32(vld1q_f32(&A[i][j]), vld1q_f32(&fx[j]), fx[i]));
+#endif
+		for (; j < 6; j++)
+			A[i][j] += fx[i] * fx[j];
+	}
+}
+
+/// adds the symmetric rank one update of the 9x1 vector fx to the top left 9x9 block of A
+static inline void fk10x10AaddxxT9(float A[][10], const float fx[])
+{
+	int8_t i, j;
+	for (i = 0; i < 9; i++)
+	{
+		j = i;
+#if defined(MATRIX_KERNEL_SSE)
+		__m128 fxi = _mm_set1_ps(fx[i]);
+		for (; j + 4 <= 9; j += 4)
+			_mm_storeu_ps(&A[i][j], _mm_add_ps(_mm_loadu_ps(&A[i][j]), _mm_mul_ps(fxi, _mm_loadu_ps(&fx[j]))));
+#elif defined(MATRIX_KERNEL_NEON)
+		for (; j + 4 <= 9; j += 4)
+			vst1q_f32(&A[i][j], vmlaq_n_f32(vld1q_f32(&A[i][j]), vld1q_f32(&fx[j]), fx[i]));
+#endif
+		for (; j < 9; j++)
+			A[i][j] += fx[i] * fx[j];
+	}
+}
+///@}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MATRIX_KERNELS_H
@@ -1018,6 +1018,39 @@ void fqAeq1(Quaternion *pqA)
 	return;
 }
 
+// function computes the spherical linear interpolation qA = qB (ft = 0) ... qC (ft = 1) along the shorter arc.
+// the result is normalized with non-negative q0. qA may be the same quaternion as qB or qC.
+void fqAeqSlerpqBqC(Quaternion *pqA, const Quaternion *pqB, const Quaternion *pqC, float ft)
+{
+	float fcosOmega;			// cosine of the angle Omega between qB and qC in 4D
+	float fOmega;				// angle between qB and qC (rad)
+	float frecipsinOmega;		// 1 / sin(Omega)
+	float fwB, fwC;				// weights of qB and qC
+
+	// q and -q are the same rotation so take whichever of qC and -qC is nearer to qB
+	fcosOmega = pqB->q0 * pqC->q0 + pqB->q1 * pqC->q1 + pqB->q2 * pqC->q2 + pqB->q3 * pqC->q3;
+	fwB = 1.0F - ft;
+	fwC = (fcosOmega < 0.0F) ? -ft : ft;
+	fcosOmega = fabsf(fcosOmega);
+
+	// use the exact weights unless qB and qC are so close that linear interpolation is as accurate
+	if (fcosOmega < 0.9995F)
+	{
+		fOmega = acosf(fcosOmega);
+		frecipsinOmega = 1.0F / sinf(fOmega);
+		fwB = sinf(fwB * fOmega) * frecipsinOmega;
+		fwC = ((fwC < 0.0F) ? -sinf(ft * fOmega) : sinf(ft * fOmega)) * frecipsinOmega;
+	}
+
+	pqA->q0 = fwB * pqB->q0 + fwC * pqC->q0;
+	pqA->q1 = fwB * pqB->q1 + fwC * pqC->q1;
+	pqA->q2 = fwB * pqB->q2 + fwC * pqC->q2;
+	pqA->q3 = fwB * pqB->q3 + fwC * pqC->q3;
+	fqAeqNormqA(pqA);
+
+	return;
+}
+
 // function computes the rotation quaternion that rotates unit vector u onto unit vector v as v=q*.u.q
 // using q = 1/sqrt(2) * {sqrt(1 + u.v) - u x v / sqrt(1 + u.v)}
 void fveqconjgquq(Quaternion *pfq, float fu[], float fv[])
@@ -154,6 +154,13 @@ void fqAeqNormqA(
 void fqAeq1(
     Quaternion *pqA
 );
+/// spherical linear interpolation between two orientation quaternions
+void fqAeqSlerpqBqC(
+    Quaternion *pqA,            ///< interpolated quaternion (output)
+    const Quaternion *pqB,      ///< quaternion at ft = 0
+    const Quaternion *pqC,      ///< quaternion at ft = 1
+    float ft                    ///< interpolation fraction, normally 0 to 1
+);
 /// computes normalized rotation quaternion from a rotation vector (deg)
 void fQuaternionFromRotationVectorDeg(
     Quaternion *pq,             ///< quaternion (output)
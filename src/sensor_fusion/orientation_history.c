@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2020-2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file orientation_history.c
+    \brief Timestamped history of the fused orientation, queried at any time.
+
+    See orientation_history.h for a description of the history.
+*/
+
+#include <stdint.h>
+
+#include "sensor_fusion.h"
+#include "orientation_history.h"    // Header for this .c file
+
+// rotates *pq at the angular velocity fOmega (deg/s) for iMicros (us)
+static void fHistoryExtrapolate(Quaternion *pq, const float fOmega[], uint32_t iMicros)
+{
+    Quaternion ftmpq;               // incremental rotation quaternion
+
+    fQuaternionFromRotationVectorDeg(&ftmpq, fOmega, (float) iMicros * 1E-6F);
+    qAeqAxB(pq, &ftmpq);
+    fqAeqNormqA(pq);
+} // end fHistoryExtrapolate()
+
+void OrientationHistoryReset(OrientationHistory *pHistory, uint32_t iMaxExtrapolationMicros)
+{
+    pHistory->iNewest = 0;
+    pHistory->iCount = 0;
+    pHistory->iMaxExtrapolationMicros = iMaxExtrapolationMicros;
+} // end OrientationHistoryReset()
+
+void OrientationHistoryAdd(OrientationHistory *pHistory, uint32_t iTimestamp, const Quaternion *pq,
+                           const float fOmega[])
+{
+    OrientationSample *pSample;
+
+    if ((pHistory->iCount > 0) &&
+        ((int32_t) (iTimestamp - pHistory->sample[pHistory->iNewest].iTimestamp) <= 0))
+    {
+        pHistory->iCount = 0;
+    }
+
+    pHistory->iNewest = (uint8_t) ((pHistory->iNewest + 1) % ORIENTATION_HISTORY_SIZE);
+    if (pHistory->iCount < ORIENTATION_HISTORY_SIZE) pHistory->iCount++;
+
+    pSample = &(pHistory->sample[pHistory->iNewest]);
+    pSample->iTimestamp = iTimestamp;
+    pSample->fq = *pq;
+    pSample->fOmega[CHX] = fOmega[CHX];
+    pSample->fOmega[CHY] = fOmega[CHY];
+    pSample->fOmega[CHZ] = fOmega[CHZ];
+} // end OrientationHistoryAdd()
+
+int8_t OrientationHistoryQuery(const OrientationHistory *pHistory, uint32_t iTimestamp, Quaternion *pq)
+{
+    const OrientationSample *pNewer;        // entry at or after iTimestamp
+    const OrientationSample *pOlder;        // entry before iTimestamp
+    int32_t iAge;                           // iTimestamp - pNewer->iTimestamp (us)
+    uint8_t iIndex;
+    uint8_t i;
+
+    if (pHistory->iCount == 0)
+    {
+        fqAeq1(pq);
+        return ORIENTATION_HISTORY_EMPTY;
+    }
+
+    // after the newest entry: rotate on at the newest angular velocity, up to the limit
+    pNewer = &(pHistory->sample[pHistory->iNewest]);
+    iAge = (int32_t) (iTimestamp - pNewer->iTimestamp);
+    if (iAge >= 0)
+    {
+        *pq = pNewer->fq;
+        if ((uint32_t) iAge <= pHistory->iMaxExtrapolationMicros)
+        {
+            fHistoryExtrapolate(pq, pNewer->fOmega, (uint32_t) iAge);
+            return ORIENTATION_HISTORY_EXTRAPOLATED;
+        }
+        fHistoryExtrapolate(pq, pNewer->fOmega, pHistory->iMaxExtrapolationMicros);
+        return ORIENTATION_HISTORY_TOO_NEW;
+    }
+
+    // otherwise search back from the newest entry for the pair either side of iTimestamp
+    iIndex = pHistory->iNewest;
+    for (i = 1; i < pHistory->iCount; i++)
+    {
+        iIndex = (uint8_t) ((iIndex + ORIENTATION_HISTORY_SIZE - 1) % ORIENTATION_HISTORY_SIZE);
+        pOlder = &(pHistory->sample[iIndex]);
+        if ((int32_t) (iTimestamp - pOlder->iTimestamp) >= 0)
+        {
+            fqAeqSlerpqBqC(pq, &(pOlder->fq), &(pNewer->fq),
+                           (float) (iTimestamp - pOlder->iTimestamp) /
+                           (float) (pNewer->iTimestamp - pOlder->iTimestamp));
+            return ORIENTATION_HISTORY_INTERPOLATED;
+        }
+        pNewer = pOlder;
+    }
+
+    // before the oldest entry
+    *pq = pNewer->fq;
+    return ORIENTATION_HISTORY_TOO_OLD;
+} // end OrientationHistoryQuery()
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2020-2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file orientation_history.h
+    \brief Timestamped history of the fused orientation, queried at any time.
+
+    The fusion results describe the orientation at the time of the latest
+    sensor read, so a consumer that needs the orientation at the moment of a
+    GPS fix or a camera frame would otherwise see an error of up to one fusion
+    period. OrientationHistoryAdd() keeps the last ORIENTATION_HISTORY_SIZE
+    orientations with their timestamps and angular velocities, and
+    OrientationHistoryQuery() returns the orientation at an arbitrary time:
+    interpolated (SLERP) between the two entries either side of it, or, for a
+    time after the newest entry, extrapolated from the newest entry by
+    rotating it at its angular velocity.
+
+    Timestamps are systick microseconds and may wrap around; only differences
+    between them are used. The history is not synchronized, so it must be
+    written and read from the same task.
+*/
+
+#ifndef ORIENTATION_HISTORY_H
+#define ORIENTATION_HISTORY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "orientation.h"
+
+#define ORIENTATION_HISTORY_SIZE        32      ///< entries kept, e.g. 0.8 s at 40 Hz
+
+// results of OrientationHistoryQuery()
+#define ORIENTATION_HISTORY_INTERPOLATED    0   ///< time within the history
+#define ORIENTATION_HISTORY_EXTRAPOLATED    1   ///< time after the newest entry, within the extrapolation limit
+#define ORIENTATION_HISTORY_EMPTY           -1  ///< no entries yet, identity returned
+#define ORIENTATION_HISTORY_TOO_OLD         -2  ///< time before the oldest entry, which is returned
+#define ORIENTATION_HISTORY_TOO_NEW         -3  ///< time beyond the extrapolation limit, extrapolated to the limit
+
+/// One fusion result.
+typedef struct OrientationSample
+{
+	uint32_t iTimestamp;                    ///< systick (us) the orientation applies to
+	Quaternion fq;                          ///< orientation quaternion
+	float fOmega[3];                        ///< angular velocity in the sensor frame (deg/s)
+} OrientationSample;
+
+/// The history. Set up with OrientationHistoryReset().
+typedef struct OrientationHistory
+{
+	OrientationSample sample[ORIENTATION_HISTORY_SIZE];     ///< ring of entries
+	uint8_t iNewest;                        ///< index of the newest entry
+	uint8_t iCount;                         ///< number of entries in the ring
+	uint32_t iMaxExtrapolationMicros;       ///< how far past the newest entry to extrapolate
+} OrientationHistory;
+
+/// Empties the history. Queries up to iMaxExtrapolationMicros past the newest entry are extrapolated.
+void OrientationHistoryReset(OrientationHistory *pHistory, uint32_t iMaxExtrapolationMicros);
+/// Adds the orientation *pq and angular velocity fOmega (deg/s) at iTimestamp, replacing the oldest
+/// entry if the ring is full. A timestamp not after the newest entry's means the clock was reset,
+/// and the history is emptied first.
+void OrientationHistoryAdd(OrientationHistory *pHistory, uint32_t iTimestamp, const Quaternion *pq,
+                           const float fOmega[]);
+/// Sets *pq to the orientation at iTimestamp. Returns ORIENTATION_HISTORY_INTERPOLATED or
+/// ORIENTATION_HISTORY_EXTRAPOLATED, or one of the negative codes above if *pq is only the nearest
+/// available estimate.
+int8_t OrientationHistoryQuery(const OrientationHistory *pHistory, uint32_t iTimestamp, Quaternion *pq);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ORIENTATION_HISTORY_H
@@ -13,6 +13,7 @@
 #include "sensor_fusion.h"
 #include "precisionAccelerometer.h"
 #include "calibration_storage.h"
+#include "matrix_kernels.h"
 
 // function resets the accelerometer buffer and accelerometer calibration
 void fInitializeAccelCalibration(AccelCalibration *pthisAccelCal,
@@ -51,8 +52,8 @@ void fInitializeAccelCalibration(AccelCalibration *pthisAccelCal,
         // flash has been erased and no accelerometer calibration is present
         // initialize the precision accelerometer calibration in RAM to null default
         pthisAccelCal->fV[CHX] = pthisAccelCal->fV[CHY] = pthisAccelCal->fV[CHZ] = 0.0F;
-        f3x3matrixAeqI(pthisAccelCal->finvW);
-        f3x3matrixAeqI(pthisAccelCal->fR0);
+        fk3x3AeqI(pthisAccelCal->finvW);
+        fk3x3AeqI(pthisAccelCal->fR0);
 #ifndef SIMULATION
     }
 #endif
@@ -127,28 +128,13 @@ void fInvertAccelCal(struct AccelSensor *pthisAccel,
         ftmp[i] = pthisAccel->fGs[i] - pthisAccelCal->fV[i];
 
     // apply the inverse rotation correction matrix finvW: fGc=inv(W)*(fGs[]-V[])
-    for (i = CHX; i <= CHZ; i++)
-    {
-        pthisAccel->fGc[i] = pthisAccelCal->finvW[i][CHX] *
-            ftmp[CHX] +
-            pthisAccelCal->finvW[i][CHY] *
-            ftmp[CHY] +
-            pthisAccelCal->finvW[i][CHZ] *
-            ftmp[CHZ];
-    }
+    fk3x1VeqRu(pthisAccel->fGc, pthisAccelCal->finvW, ftmp);
 
     // apply the inverse of the forward rotation matrix fR0: fGc=inv(R).inv(W)*(fGs[]-V[])
     for (i = CHX; i <= CHZ; i++) ftmp[i] = pthisAccel->fGc[i];
+    fk3x1VeqRTu(pthisAccel->fGc, pthisAccelCal->fR0, ftmp);
     for (i = CHX; i <= CHZ; i++)
-    {
-        pthisAccel->fGc[i] = pthisAccelCal->fR0[CHX][i] *
-            ftmp[CHX] +
-            pthisAccelCal->fR0[CHY][i] *
-            ftmp[CHY] +
-            pthisAccelCal->fR0[CHZ][i] *
-            ftmp[CHZ];
         pthisAccel->iGc[i] = (int16_t) (pthisAccel->fGc[i] * pthisAccel->iCountsPerg);
-    }
 
     return;
 }
@@ -160,6 +146,7 @@ void fRunAccelCalibration(AccelCalibration *pthisAccelCal,
 {
     float   fGc0[3];        // calibrated but not de-rotated measurement 0
     uint8_t iMeasurements;  // number of stored measurements
+    uint16_t iLease;        // lease of the calibration scratch
     int8_t  i;              // loop counters
 
     // calculate how many measurements are present in the accelerometer measurement buffer
@@ -169,6 +156,11 @@ void fRunAccelCalibration(AccelCalibration *pthisAccelCal,
         if (pthisAccelBuffer->iStoreFlags & (1 << i)) iMeasurements++;
     }
 
+    // the solvers run to completion here, so take the calibration scratch even from a magnetic calibration in
+    // progress, which then starts again
+    iLease = 0;
+    if (iMeasurements >= 4) iLease = iTakeCalibrationScratch(pthisAccelCal->pScratch, CALSCRATCH_ACCEL);
+
     // perform the highest quality calibration possible given this number
     if (iMeasurements >= 9)
     {
@@ -185,6 +177,7 @@ void fRunAccelCalibration(AccelCalibration *pthisAccelCal,
         // perform the 4 element calibration
         fComputeAccelCalibration4(pthisAccelBuffer, pthisAccelCal, pthisAccel);
     }
+    fReleaseCalibrationScratch(pthisAccelCal->pScratch, iLease);
 
     // calculate the rotation correction matrix to rotate calibrated measurement 0 to flat
     if (pthisAccelBuffer->iStoreFlags & 1)
@@ -221,19 +214,16 @@ void fComputeAccelCalibration4(AccelBuffer *pthisAccelBuffer,
     float   ftmp;   // scratch
     int8_t  ierror; // flag from matrix inversion
 
-    // working arrays for 4x4 matrix inversion
+    // row pointers for 4x4 matrix inversion
     float   *pfRows[4];
-    int8_t  iColInd[4];
-    int8_t  iRowInd[4];
-    int8_t  iPivot[4];
 
     // zero the 4x4 matrix XTX (in upper left of fmatA) and 4x1 vector XTY (in upper fvecA)
     for (i = 0; i < 4; i++)
     {
-        pthisAccelCal->fvecA[i] = 0.0F;
+        pthisAccelCal->pScratch->fvecA[i] = 0.0F;
         for (j = 0; j < 4; j++)
         {
-            pthisAccelCal->fmatA[i][j] = 0.0F;
+            pthisAccelCal->pScratch->fmatA[i][j] = 0.0F;
         }
     }
 
@@ -249,70 +239,70 @@ void fComputeAccelCalibration4(AccelBuffer *pthisAccelBuffer,
                 pthisAccelBuffer->fGsStored[i][CHY] +
                 pthisAccelBuffer->fGsStored[i][CHZ] *
                 pthisAccelBuffer->fGsStored[i][CHZ];
-            pthisAccelCal->fvecA[0] += pthisAccelBuffer->fGsStored[i][CHX] * ftmp;
-            pthisAccelCal->fvecA[1] += pthisAccelBuffer->fGsStored[i][CHY] * ftmp;
-            pthisAccelCal->fvecA[2] += pthisAccelBuffer->fGsStored[i][CHZ] * ftmp;
-            pthisAccelCal->fvecA[3] += ftmp;
+            pthisAccelCal->pScratch->fvecA[0] += pthisAccelBuffer->fGsStored[i][CHX] * ftmp;
+            pthisAccelCal->pScratch->fvecA[1] += pthisAccelBuffer->fGsStored[i][CHY] * ftmp;
+            pthisAccelCal->pScratch->fvecA[2] += pthisAccelBuffer->fGsStored[i][CHZ] * ftmp;
+            pthisAccelCal->pScratch->fvecA[3] += ftmp;
 
             // accumulate above diagonal terms of matrix X^T.X
-            pthisAccelCal->fmatA[CHX][CHX] += pthisAccelBuffer->fGsStored[i][
+            pthisAccelCal->pScratch->fmatA[CHX][CHX] += pthisAccelBuffer->fGsStored[i][
                     CHX] *
                 pthisAccelBuffer->fGsStored[i][CHX];
-            pthisAccelCal->fmatA[CHX][CHY] += pthisAccelBuffer->fGsStored[i][
+            pthisAccelCal->pScratch->fmatA[CHX][CHY] += pthisAccelBuffer->fGsStored[i][
                     CHX] *
                 pthisAccelBuffer->fGsStored[i][CHY];
-            pthisAccelCal->fmatA[CHX][CHZ] += pthisAccelBuffer->fGsStored[i][
+            pthisAccelCal->pScratch->fmatA[CHX][CHZ] += pthisAccelBuffer->fGsStored[i][
                     CHX] *
                 pthisAccelBuffer->fGsStored[i][CHZ];
-            pthisAccelCal->fmatA[CHX][3] += pthisAccelBuffer->fGsStored[i][CHX];
-            pthisAccelCal->fmatA[CHY][CHY] += pthisAccelBuffer->fGsStored[i][
+            pthisAccelCal->pScratch->fmatA[CHX][3] += pthisAccelBuffer->fGsStored[i][CHX];
+            pthisAccelCal->pScratch->fmatA[CHY][CHY] += pthisAccelBuffer->fGsStored[i][
                     CHY] *
                 pthisAccelBuffer->fGsStored[i][CHY];
-            pthisAccelCal->fmatA[CHY][CHZ] += pthisAccelBuffer->fGsStored[i][
+            pthisAccelCal->pScratch->fmatA[CHY][CHZ] += pthisAccelBuffer->fGsStored[i][
                     CHY] *
                 pthisAccelBuffer->fGsStored[i][CHZ];;
-            pthisAccelCal->fmatA[CHY][3] += pthisAccelBuffer->fGsStored[i][CHY];
-            pthisAccelCal->fmatA[CHZ][CHZ] += pthisAccelBuffer->fGsStored[i][
+            pthisAccelCal->pScratch->fmatA[CHY][3] += pthisAccelBuffer->fGsStored[i][CHY];
+            pthisAccelCal->pScratch->fmatA[CHZ][CHZ] += pthisAccelBuffer->fGsStored[i][
                     CHZ] *
                 pthisAccelBuffer->fGsStored[i][CHZ];;
-            pthisAccelCal->fmatA[CHZ][3] += pthisAccelBuffer->fGsStored[i][CHZ];
-            pthisAccelCal->fmatA[3][3] += 1.0F;
+            pthisAccelCal->pScratch->fmatA[CHZ][3] += pthisAccelBuffer->fGsStored[i][CHZ];
+            pthisAccelCal->pScratch->fmatA[3][3] += 1.0F;
         }
     }
 
     // copy above diagonal elements of fXTX4x4 = X^T.X to below diagonal elements
-    pthisAccelCal->fmatA[CHY][CHX] = pthisAccelCal->fmatA[CHX][CHY];
-    pthisAccelCal->fmatA[CHZ][CHX] = pthisAccelCal->fmatA[CHX][CHZ];
-    pthisAccelCal->fmatA[CHZ][CHY] = pthisAccelCal->fmatA[CHY][CHZ];
-    pthisAccelCal->fmatA[3][CHX] = pthisAccelCal->fmatA[CHX][3];
-    pthisAccelCal->fmatA[3][CHY] = pthisAccelCal->fmatA[CHY][3];
-    pthisAccelCal->fmatA[3][CHZ] = pthisAccelCal->fmatA[CHZ][3];
-
-    // calculate in situ inverse of X^T.X
+    pthisAccelCal->pScratch->fmatA[CHY][CHX] = pthisAccelCal->pScratch->fmatA[CHX][CHY];
+    pthisAccelCal->pScratch->fmatA[CHZ][CHX] = pthisAccelCal->pScratch->fmatA[CHX][CHZ];
+    pthisAccelCal->pScratch->fmatA[CHZ][CHY] = pthisAccelCal->pScratch->fmatA[CHY][CHZ];
+    pthisAccelCal->pScratch->fmatA[3][CHX] = pthisAccelCal->pScratch->fmatA[CHX][3];
+    pthisAccelCal->pScratch->fmatA[3][CHY] = pthisAccelCal->pScratch->fmatA[CHY][3];
+    pthisAccelCal->pScratch->fmatA[3][CHZ] = pthisAccelCal->pScratch->fmatA[CHZ][3];
+
+    // calculate in situ inverse of the symmetric positive definite X^T.X
     for (i = 0; i < 4; i++)
     {
-        pfRows[i] = pthisAccelCal->fmatA[i];
+        pfRows[i] = pthisAccelCal->pScratch->fmatA[i];
     }
 
-    fmatrixAeqInvA(pfRows, iColInd, iRowInd, iPivot, 4, &ierror);
+    fmatrixAeqInvSymA(pfRows, 4, &ierror);
 
     // calculate the solution vector fvecB = inv(X^T.X).X^T.Y
     for (i = 0; i < 4; i++)
     {
-        pthisAccelCal->fvecB[i] = 0.0F;
+        pthisAccelCal->pScratch->fvecB[i] = 0.0F;
         for (j = 0; j < 4; j++)
         {
-            pthisAccelCal->fvecB[i] += pthisAccelCal->fmatA[i][j] * pthisAccelCal->fvecA[j];
+            pthisAccelCal->pScratch->fvecB[i] += pthisAccelCal->pScratch->fmatA[i][j] * pthisAccelCal->pScratch->fvecA[j];
         }
     }
 
     // extract the offset vector
-    pthisAccelCal->fV[CHX] = 0.5F * pthisAccelCal->fvecB[CHX];
-    pthisAccelCal->fV[CHY] = 0.5F * pthisAccelCal->fvecB[CHY];
-    pthisAccelCal->fV[CHZ] = 0.5F * pthisAccelCal->fvecB[CHZ];
+    pthisAccelCal->fV[CHX] = 0.5F * pthisAccelCal->pScratch->fvecB[CHX];
+    pthisAccelCal->fV[CHY] = 0.5F * pthisAccelCal->pScratch->fvecB[CHY];
+    pthisAccelCal->fV[CHZ] = 0.5F * pthisAccelCal->pScratch->fvecB[CHZ];
 
     // set ftmp to 1/W where W is the forward gain to fit the 1g sphere
-    ftmp = 1.0F / sqrtf(fabsf(pthisAccelCal->fvecB[3] + pthisAccelCal->fV[CHX] *
+    ftmp = 1.0F / sqrtf(fabsf(pthisAccelCal->pScratch->fvecB[3] + pthisAccelCal->fV[CHX] *
                         pthisAccelCal->fV[CHX] + pthisAccelCal->fV[CHY] *
                         pthisAccelCal->fV[CHY] + pthisAccelCal->fV[CHZ] *
                         pthisAccelCal->fV[CHZ]));
@@ -340,10 +330,10 @@ void fComputeAccelCalibration7(AccelBuffer *pthisAccelBuffer,
 
     // zero the on and above diagonal elements of the 7x7 symmetric measurement matrix fmatA
     for (i = 0; i < 7; i++)
-        for (j = i; j < 7; j++) pthisAccelCal->fmatA[i][j] = 0.0F;
+        for (j = i; j < 7; j++) pthisAccelCal->pScratch->fmatA[i][j] = 0.0F;
 
     // last entry of vector fvecA is always 1.0 so move assignment outside the loop
-    pthisAccelCal->fvecA[6] = 1.0F;
+    pthisAccelCal->pScratch->fvecA[6] = 1.0F;
 
     // loop over all orientations
     for (i = 0; i < MAX_ACCEL_CAL_ORIENTATIONS; i++)
@@ -352,65 +342,65 @@ void fComputeAccelCalibration7(AccelBuffer *pthisAccelBuffer,
         if ((pthisAccelBuffer->iStoreFlags) & (1 << i))
         {
             // compute the remaining members of the measurement vector fvecA
-            pthisAccelCal->fvecA[0] = pthisAccelBuffer->fGsStored[i][CHX] * pthisAccelBuffer->fGsStored[i][CHX];
-            pthisAccelCal->fvecA[1] = pthisAccelBuffer->fGsStored[i][CHY] * pthisAccelBuffer->fGsStored[i][CHY];
-            pthisAccelCal->fvecA[2] = pthisAccelBuffer->fGsStored[i][CHZ] * pthisAccelBuffer->fGsStored[i][CHZ];
-            pthisAccelCal->fvecA[3] = pthisAccelBuffer->fGsStored[i][CHX];
-            pthisAccelCal->fvecA[4] = pthisAccelBuffer->fGsStored[i][CHY];
-            pthisAccelCal->fvecA[5] = pthisAccelBuffer->fGsStored[i][CHZ];
+            pthisAccelCal->pScratch->fvecA[0] = pthisAccelBuffer->fGsStored[i][CHX] * pthisAccelBuffer->fGsStored[i][CHX];
+            pthisAccelCal->pScratch->fvecA[1] = pthisAccelBuffer->fGsStored[i][CHY] * pthisAccelBuffer->fGsStored[i][CHY];
+            pthisAccelCal->pScratch->fvecA[2] = pthisAccelBuffer->fGsStored[i][CHZ] * pthisAccelBuffer->fGsStored[i][CHZ];
+            pthisAccelCal->pScratch->fvecA[3] = pthisAccelBuffer->fGsStored[i][CHX];
+            pthisAccelCal->pScratch->fvecA[4] = pthisAccelBuffer->fGsStored[i][CHY];
+            pthisAccelCal->pScratch->fvecA[5] = pthisAccelBuffer->fGsStored[i][CHZ];
 
             // accumulate the on-and above-diagonal terms of fmatA=Sigma{fvecA^T * fvecA}
             for (m = 0; m < 7; m++)
                 for (n = m; n < 7; n++)
-                    pthisAccelCal->fmatA[m][n] += pthisAccelCal->fvecA[m] * pthisAccelCal->fvecA[n];
+                    pthisAccelCal->pScratch->fmatA[m][n] += pthisAccelCal->pScratch->fvecA[m] * pthisAccelCal->pScratch->fvecA[n];
         }           // end of test for stored data
     }               // end of loop over orientations
 
     // copy the above diagonal elements of symmetric product matrix fmatA to below the diagonal
     for (m = 1; m < 7; m++)
         for (n = 0; n < m; n++)
-            pthisAccelCal->fmatA[m][n] = pthisAccelCal->fmatA[n][m];
+            pthisAccelCal->pScratch->fmatA[m][n] = pthisAccelCal->pScratch->fmatA[n][m];
 
     // set fvecA to the unsorted eigenvalues and fmatB to the unsorted normalized eigenvectors of fmatA
-    fEigenCompute10(pthisAccelCal->fmatA, pthisAccelCal->fvecA,
-                    pthisAccelCal->fmatB, 7);
+    fEigenCompute10(pthisAccelCal->pScratch->fmatA, pthisAccelCal->pScratch->fvecA,
+                    pthisAccelCal->pScratch->fmatB, 7);
 
     // set ellipsoid matrix A from elements of the solution vector column j with smallest eigenvalue
     j = 0;
     for (i = 1; i < 7; i++)
-        if (pthisAccelCal->fvecA[i] < pthisAccelCal->fvecA[j]) j = i;
+        if (pthisAccelCal->pScratch->fvecA[i] < pthisAccelCal->pScratch->fvecA[j]) j = i;
 
     // negate the entire solution vector if ellipsoid matrix has negative determinant
-    det = pthisAccelCal->fmatB[0][j] *
-        pthisAccelCal->fmatB[1][j] *
-        pthisAccelCal->fmatB[2][j];
+    det = pthisAccelCal->pScratch->fmatB[0][j] *
+        pthisAccelCal->pScratch->fmatB[1][j] *
+        pthisAccelCal->pScratch->fmatB[2][j];
     if (det < 0.0F)
     {
         for (i = 0; i < 7; i++)
         {
-            pthisAccelCal->fmatB[i][j] = -pthisAccelCal->fmatB[i][j];
+            pthisAccelCal->pScratch->fmatB[i][j] = -pthisAccelCal->pScratch->fmatB[i][j];
         }
     }
 
     // compute invW and V and fitted gravity g0 from solution vector j
     f3x3matrixAeqScalar(pthisAccelCal->finvW, 0.0F);
-    pthisAccelCal->finvW[CHX][CHX] = sqrtf(fabsf(pthisAccelCal->fmatB[0][j]));
-    pthisAccelCal->finvW[CHY][CHY] = sqrtf(fabsf(pthisAccelCal->fmatB[1][j]));
-    pthisAccelCal->finvW[CHZ][CHZ] = sqrtf(fabsf(pthisAccelCal->fmatB[2][j]));
+    pthisAccelCal->finvW[CHX][CHX] = sqrtf(fabsf(pthisAccelCal->pScratch->fmatB[0][j]));
+    pthisAccelCal->finvW[CHY][CHY] = sqrtf(fabsf(pthisAccelCal->pScratch->fmatB[1][j]));
+    pthisAccelCal->finvW[CHZ][CHZ] = sqrtf(fabsf(pthisAccelCal->pScratch->fmatB[2][j]));
     pthisAccelCal->fV[CHX] = -0.5F *
-        pthisAccelCal->fmatB[3][j] /
-        pthisAccelCal->fmatB[0][j];
+        pthisAccelCal->pScratch->fmatB[3][j] /
+        pthisAccelCal->pScratch->fmatB[0][j];
     pthisAccelCal->fV[CHY] = -0.5F *
-        pthisAccelCal->fmatB[4][j] /
-        pthisAccelCal->fmatB[1][j];
+        pthisAccelCal->pScratch->fmatB[4][j] /
+        pthisAccelCal->pScratch->fmatB[1][j];
     pthisAccelCal->fV[CHZ] = -0.5F *
-        pthisAccelCal->fmatB[5][j] /
-        pthisAccelCal->fmatB[2][j];
-    fg0 = sqrtf(fabsf(pthisAccelCal->fmatB[0][j] * pthisAccelCal->fV[CHX] *
-                pthisAccelCal->fV[CHX] + pthisAccelCal->fmatB[1][j] *
+        pthisAccelCal->pScratch->fmatB[5][j] /
+        pthisAccelCal->pScratch->fmatB[2][j];
+    fg0 = sqrtf(fabsf(pthisAccelCal->pScratch->fmatB[0][j] * pthisAccelCal->fV[CHX] *
+                pthisAccelCal->fV[CHX] + pthisAccelCal->pScratch->fmatB[1][j] *
                 pthisAccelCal->fV[CHY] * pthisAccelCal->fV[CHY] +
-                pthisAccelCal->fmatB[2][j] * pthisAccelCal->fV[CHZ] *
-                pthisAccelCal->fV[CHZ] - pthisAccelCal->fmatB[6][j]));
+                pthisAccelCal->pScratch->fmatB[2][j] * pthisAccelCal->fV[CHZ] *
+                pthisAccelCal->fV[CHZ] - pthisAccelCal->pScratch->fmatB[6][j]));
 
     // normalize invW to fit the 1g sphere
     pthisAccelCal->finvW[CHX][CHX] /= fg0;
@@ -437,10 +427,10 @@ void fComputeAccelCalibration10(AccelBuffer *pthisAccelBuffer,
 
     // zero the on and above diagonal elements of the 10x10 symmetric measurement matrix fmatA
     for (i = 0; i < 10; i++)
-        for (j = i; j < 10; j++) pthisAccelCal->fmatA[i][j] = 0.0F;
+        for (j = i; j < 10; j++) pthisAccelCal->pScratch->fmatA[i][j] = 0.0F;
 
     // last entry of vector fvecA is always 1.0 so move assignment outside the loop
-    pthisAccelCal->fvecA[9] = 1.0F;
+    pthisAccelCal->pScratch->fvecA[9] = 1.0F;
 
     // loop over all orientations
     for (i = 0; i < MAX_ACCEL_CAL_ORIENTATIONS; i++)
@@ -449,28 +439,28 @@ void fComputeAccelCalibration10(AccelBuffer *pthisAccelBuffer,
         if ((pthisAccelBuffer->iStoreFlags) & (1 << i))
         {
             // compute the remaining members of the measurement vector fvecA
-            pthisAccelCal->fvecA[6] = pthisAccelBuffer->fGsStored[i][CHX];
-            pthisAccelCal->fvecA[7] = pthisAccelBuffer->fGsStored[i][CHY];
-            pthisAccelCal->fvecA[8] = pthisAccelBuffer->fGsStored[i][CHZ];
-            pthisAccelCal->fvecA[0] = pthisAccelCal->fvecA[6] * pthisAccelCal->fvecA[6];
-            pthisAccelCal->fvecA[1] = 2.0F *
-                pthisAccelCal->fvecA[6] *
-                pthisAccelCal->fvecA[7];
-            pthisAccelCal->fvecA[2] = 2.0F *
-                pthisAccelCal->fvecA[6] *
-                pthisAccelCal->fvecA[8];
-            pthisAccelCal->fvecA[3] = pthisAccelCal->fvecA[7] * pthisAccelCal->fvecA[7];
-            pthisAccelCal->fvecA[4] = 2.0F *
-                pthisAccelCal->fvecA[7] *
-                pthisAccelCal->fvecA[8];
-            pthisAccelCal->fvecA[5] = pthisAccelCal->fvecA[8] * pthisAccelCal->fvecA[8];
+            pthisAccelCal->pScratch->fvecA[6] = pthisAccelBuffer->fGsStored[i][CHX];
+            pthisAccelCal->pScratch->fvecA[7] = pthisAccelBuffer->fGsStored[i][CHY];
+            pthisAccelCal->pScratch->fvecA[8] = pthisAccelBuffer->fGsStored[i][CHZ];
+            pthisAccelCal->pScratch->fvecA[0] = pthisAccelCal->pScratch->fvecA[6] * pthisAccelCal->pScratch->fvecA[6];
+            pthisAccelCal->pScratch->fvecA[1] = 2.0F *
+                pthisAccelCal->pScratch->fvecA[6] *
+                pthisAccelCal->pScratch->fvecA[7];
+            pthisAccelCal->pScratch->fvecA[2] = 2.0F *
+                pthisAccelCal->pScratch->fvecA[6] *
+                pthisAccelCal->pScratch->fvecA[8];
+            pthisAccelCal->pScratch->fvecA[3] = pthisAccelCal->pScratch->fvecA[7] * pthisAccelCal->pScratch->fvecA[7];
+            pthisAccelCal->pScratch->fvecA[4] = 2.0F *
+                pthisAccelCal->pScratch->fvecA[7] *
+                pthisAccelCal->pScratch->fvecA[8];
+            pthisAccelCal->pScratch->fvecA[5] = pthisAccelCal->pScratch->fvecA[8] * pthisAccelCal->pScratch->fvecA[8];
 
             // accumulate the on-and above-diagonal terms of fmatA=Sigma{fvecA^T * fvecA}
             for (m = 0; m < 10; m++)
             {
                 for (n = m; n < 10; n++)
                 {
-                    pthisAccelCal->fmatA[m][n] += pthisAccelCal->fvecA[m] * pthisAccelCal->fvecA[n];
+                    pthisAccelCal->pScratch->fmatA[m][n] += pthisAccelCal->pScratch->fvecA[m] * pthisAccelCal->pScratch->fvecA[n];
                 }
             }
         }                       // end of test for stored data
@@ -479,38 +469,38 @@ void fComputeAccelCalibration10(AccelBuffer *pthisAccelBuffer,
     // copy the above diagonal elements of symmetric product matrix fmatA to below the diagonal
     for (m = 1; m < 10; m++)
         for (n = 0; n < m; n++)
-            pthisAccelCal->fmatA[m][n] = pthisAccelCal->fmatA[n][m];
+            pthisAccelCal->pScratch->fmatA[m][n] = pthisAccelCal->pScratch->fmatA[n][m];
 
     // set fvecA to the unsorted eigenvalues and fmatB to the unsorted normalized eigenvectors of fmatA
-    fEigenCompute10(pthisAccelCal->fmatA, pthisAccelCal->fvecA,
-                    pthisAccelCal->fmatB, 10);
+    fEigenCompute10(pthisAccelCal->pScratch->fmatA, pthisAccelCal->pScratch->fvecA,
+                    pthisAccelCal->pScratch->fmatB, 10);
 
     // set ellipsoid matrix A from elements of the solution vector column j with smallest eigenvalue
     j = 0;
     for (i = 1; i < 10; i++)
     {
-        if (pthisAccelCal->fvecA[i] < pthisAccelCal->fvecA[j])
+        if (pthisAccelCal->pScratch->fvecA[i] < pthisAccelCal->pScratch->fvecA[j])
         {
             j = i;
         }
     }
 
-    pthisAccelCal->fA[0][0] = pthisAccelCal->fmatB[0][j];
-    pthisAccelCal->fA[0][1] = pthisAccelCal->fA[1][0] = pthisAccelCal->fmatB[1][j];
-    pthisAccelCal->fA[0][2] = pthisAccelCal->fA[2][0] = pthisAccelCal->fmatB[2][j];
-    pthisAccelCal->fA[1][1] = pthisAccelCal->fmatB[3][j];
-    pthisAccelCal->fA[1][2] = pthisAccelCal->fA[2][1] = pthisAccelCal->fmatB[4][j];
-    pthisAccelCal->fA[2][2] = pthisAccelCal->fmatB[5][j];
+    pthisAccelCal->fA[0][0] = pthisAccelCal->pScratch->fmatB[0][j];
+    pthisAccelCal->fA[0][1] = pthisAccelCal->fA[1][0] = pthisAccelCal->pScratch->fmatB[1][j];
+    pthisAccelCal->fA[0][2] = pthisAccelCal->fA[2][0] = pthisAccelCal->pScratch->fmatB[2][j];
+    pthisAccelCal->fA[1][1] = pthisAccelCal->pScratch->fmatB[3][j];
+    pthisAccelCal->fA[1][2] = pthisAccelCal->fA[2][1] = pthisAccelCal->pScratch->fmatB[4][j];
+    pthisAccelCal->fA[2][2] = pthisAccelCal->pScratch->fmatB[5][j];
 
     // negate entire solution if A has negative determinant
     det = f3x3matrixDetA(pthisAccelCal->fA);
     if (det < 0.0F)
     {
         f3x3matrixAeqMinusA(pthisAccelCal->fA);
-        pthisAccelCal->fmatB[6][j] = -pthisAccelCal->fmatB[6][j];
-        pthisAccelCal->fmatB[7][j] = -pthisAccelCal->fmatB[7][j];
-        pthisAccelCal->fmatB[8][j] = -pthisAccelCal->fmatB[8][j];
-        pthisAccelCal->fmatB[9][j] = -pthisAccelCal->fmatB[9][j];
+        pthisAccelCal->pScratch->fmatB[6][j] = -pthisAccelCal->pScratch->fmatB[6][j];
+        pthisAccelCal->pScratch->fmatB[7][j] = -pthisAccelCal->pScratch->fmatB[7][j];
+        pthisAccelCal->pScratch->fmatB[8][j] = -pthisAccelCal->pScratch->fmatB[8][j];
+        pthisAccelCal->pScratch->fmatB[9][j] = -pthisAccelCal->pScratch->fmatB[9][j];
         det = -det;
     }
 
@@ -523,7 +513,7 @@ void fComputeAccelCalibration10(AccelBuffer *pthisAccelBuffer,
         pthisAccelCal->fV[l] = 0.0F;
         for (m = CHX; m <= CHZ; m++)
         {
-            pthisAccelCal->fV[l] += pthisAccelCal->finvA[l][m] * pthisAccelCal->fmatB[m + 6][j];
+            pthisAccelCal->fV[l] += pthisAccelCal->finvA[l][m] * pthisAccelCal->pScratch->fmatB[m + 6][j];
         }
 
         pthisAccelCal->fV[l] *= -0.5F;
@@ -539,24 +529,24 @@ void fComputeAccelCalibration10(AccelBuffer *pthisAccelBuffer,
                 pthisAccelCal->fA[1][2] * pthisAccelCal->fV[CHY] *
                 pthisAccelCal->fV[CHZ] + pthisAccelCal->fA[2][2] *
                 pthisAccelCal->fV[CHZ] * pthisAccelCal->fV[CHZ] -
-                pthisAccelCal->fmatB[9][j]));
+                pthisAccelCal->pScratch->fmatB[9][j]));
 
     // compute trial invW from the square root of fA	
     // set fvecA to the unsorted eigenvalues and fmatB to the unsorted eigenvectors of fmatA
     // where fmatA holds the 3x3 matrix fA in its top left elements
     for (i = 0; i < 3; i++)
         for (j = 0; j < 3; j++)
-            pthisAccelCal->fmatA[i][j] = pthisAccelCal->fA[i][j];
-    fEigenCompute10(pthisAccelCal->fmatA, pthisAccelCal->fvecA,
-                    pthisAccelCal->fmatB, 3);
+            pthisAccelCal->pScratch->fmatA[i][j] = pthisAccelCal->fA[i][j];
+    fEigenCompute10(pthisAccelCal->pScratch->fmatA, pthisAccelCal->pScratch->fvecA,
+                    pthisAccelCal->pScratch->fmatB, 3);
 
     // set fmatB to be eigenvectors . diag(sqrt(sqrt(eigenvalues))) = fmatB . diag(sqrt(sqrt(fvecA))
     for (j = 0; j < 3; j++)     // loop over columns j
     {
-        ftmp = sqrtf(sqrtf(fabsf(pthisAccelCal->fvecA[j])));
+        ftmp = sqrtf(sqrtf(fabsf(pthisAccelCal->pScratch->fvecA[j])));
         for (i = 0; i < 3; i++) // loop over rows i
         {
-            pthisAccelCal->fmatB[i][j] *= ftmp;
+            pthisAccelCal->pScratch->fmatB[i][j] *= ftmp;
         }
     }
 
@@ -573,7 +563,7 @@ void fComputeAccelCalibration10(AccelBuffer *pthisAccelBuffer,
             // accumulate the matrix product
             for (k = 0; k < 3; k++)
             {
-                pthisAccelCal->finvW[i][j] += pthisAccelCal->fmatB[i][k] * pthisAccelCal->fmatB[j][k];
+                pthisAccelCal->finvW[i][j] += pthisAccelCal->pScratch->fmatB[i][k] * pthisAccelCal->pScratch->fmatB[j][k];
             }
 
             // copy to below diagonal element
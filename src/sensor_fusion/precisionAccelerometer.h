@@ -19,6 +19,8 @@ extern "C" {
 
 #include <stdint.h>
 
+#include "calibration_scratch.h"
+
 /// calibration constants
 #define ACCEL_CAL_AVERAGING_SECS	2		///< calibration measurement averaging period (s)
 #define MAX_ACCEL_CAL_ORIENTATIONS	12		///< number of stored precision accelerometer measurements
@@ -41,10 +43,7 @@ typedef struct
 	float finvW[3][3];				///< inverse gain matrix
 	float fR0[3][3];				///< forward rotation matrix for measurement 0
 	// end of elements stored in flash memory
-	float fmatA[10][10];			        ///< scratch 10x10 matrix used by calibration algorithms
-	float fmatB[10][10];			        ///< scratch 10x10 matrix used by calibration algorithms
-	float fvecA[10];				///< scratch 10x1 vector used by calibration algorithms
-	float fvecB[4];					///< scratch 4x1 vector used by calibration algorithms
+	struct CalibrationScratch *pScratch;		///< scratch matrices of the fusion instance, leased while calibrating
 	float fA[3][3];					///< ellipsoid matrix A
 	float finvA[3][3];				///< inverse of the ellipsoid matrix A
 } AccelCalibration;
@@ -13,12 +13,17 @@
 
 #include "sensor_fusion.h"
 
+#include "calibration_storage.h"
 #include "control.h"
 #include "fusion.h"
 #include "hal_i2c.h"
 #include "hal_timer.h"
 #include "status.h"
 
+#define GYRO_RATE_WINDOW_MICROS 1000000 ///< time over which the gyro sample interval is measured (us)
+#define GYRO_RATE_TOLERANCE     0.1F    ///< largest credible deviation of the measured from the nominal ODR
+#define GYRO_RATE_LPF           0.25F   ///< low pass filter coefficient of the measured sample interval
+
 /// Poor man's inheritance for status subsystem setStatus command
 /// This function is normally invoked via the "sfg." global pointer.
 void setStatus(SensorFusionGlobals *sfg, fusion_status_t status)
@@ -77,6 +82,12 @@ void initSensorFusionGlobals(SensorFusionGlobals *sfg,
     sfg->loopcounter = 0;                     // counter incrementing each iteration of sensor fusion (typically 25Hz)
     sfg->systick_I2C = 0;                     // systick counter to benchmark I2C reads
     sfg->systick_Spare = 0;                   // systick counter for counts spare waiting for timing interrupt
+#if F_USING_MAG
+    sfg->iMagCalBudgetMicros = MAG_CAL_BUDGET_MICROS;   // time per fusion for magnetic calibration slices
+#endif
+#if F_TIMING_STATS
+    TimingStatsReset(&(sfg->Timing), 1000000 / FUSION_HZ);  // a stage overruns if it alone takes a whole cycle
+#endif
     sfg->iPerturbation = 0;                   // no perturbation to be applied
     sfg->installSensor = installSensor;       // function for installing a new sensor into the structures
     sfg->initializeFusionEngine = initializeFusionEngine;   // initializes fusion variables
@@ -98,8 +109,21 @@ void initSensorFusionGlobals(SensorFusionGlobals *sfg,
 #if F_USING_MAG
     sfg->Mag.iWhoAmI = 0;
 #endif
+#if F_USING_ACCEL || F_USING_MAG
+    // one set of calibration scratch matrices, leased by whichever calibration is solving
+    fInitializeCalibrationScratch(&(sfg->CalScratch));
+#endif
+#if F_USING_ACCEL
+    sfg->AccelCal.pScratch = &(sfg->CalScratch);
+#endif
+#if F_USING_MAG
+    sfg->MagCal.pScratch = &(sfg->CalScratch);
+    sfg->MagCal.pWorker = NULL;               // calibrations are time sliced until a worker is attached
+#endif
 #if F_USING_GYRO
     sfg->Gyro.iWhoAmI = 0;
+    sfg->Gyro.isRateTimed = false;
+    sfg->Gyro.fSampleInterval = 1.0F / (float) GYRO_ODR_HZ;
 #endif
 #if F_USING_PRESSURE
     sfg->Pressure.iWhoAmI = 0;
@@ -205,6 +229,10 @@ void processMagData(SensorFusionGlobals *sfg)
 {
     int32_t iSum[3];		        // channel sums
     int16_t i, j;			        // counters
+    int32_t iStart;                         // systick at start of the calibration slice
+    int32_t iCalStart;                      // systick at start of the first calibration slice
+    int32_t iSlice;                         // duration of a calibration slice (us)
+    int32_t iSlowest = 0;                   // longest calibration slice in this call (us)
 
     if (sfg->Mag.iFIFOExceeded > 0) {
       sfg->setStatus(sfg, SOFT_FAULT);
@@ -227,18 +255,84 @@ void processMagData(SensorFusionGlobals *sfg)
 
     // remove hard and soft iron terms from fBs (uT) to get calibrated data fBc (uT), iBc (counts) and
     // update magnetic buffer avoiding a write while a magnetic calibration is in progress.
-    // run one iteration of the time sliced magnetic calibration
     fInvertMagCal(&(sfg->Mag), &(sfg->MagCal));
     if (!sfg->MagCal.iMagBufferReadOnly)
         iUpdateMagBuffer(&(sfg->MagBuffer), &(sfg->Mag), sfg->loopcounter);
-    fRunMagCalibration(&(sfg->MagCal), &(sfg->MagBuffer), &(sfg->Mag),
+#if F_MAG_BUFFER_SNAPSHOT
+    // check the readings after a snapshot of the buffer was restored against the calibration saved with it
+    if (sfg->MagCal.iSnapshotChecks)
+        fCheckMagBufferSnapshot(&(sfg->MagCal), &(sfg->MagBuffer), &(sfg->Mag), sfg->loopcounter);
+#endif
+
+    // run the time sliced magnetic calibration: always one slice, then further slices of the calibration in
+    // progress while one more slice, assumed to take as long as the slowest so far, fits in iMagCalBudgetMicros.
+    // Slices differ in cost from one phase of a calibration to the next, hence the slowest rather than the last.
+    // A completed calibration ends the loop, so the next one starts on the following fusion. A calibration solved
+    // by a worker task takes no slices here, only its hand over.
+    SystickStartCount(&iCalStart);
+    do
+    {
+        SystickStartCount(&iStart);
+        fRunMagCalibration(&(sfg->MagCal), &(sfg->MagBuffer), &(sfg->Mag),
                            sfg->loopcounter);
+        iSlice = SystickElapsedMicros(iStart);
+        TIMING_ADD(sfg, TIMING_MAG_CAL, iSlice);
+        if (iSlice > iSlowest) iSlowest = iSlice;
+#if F_TIMING_STATS
+        // count the sweeps and slices of a calibration that completed in this slice
+        if (sfg->MagCal.iCalStatsReady)
+        {
+            if (sfg->MagCal.iCalStatsReady != 4)
+                TIMING_ADD(sfg, TIMING_MAG_CAL_SWEEPS, sfg->MagCal.iEigenSweeps);
+            TIMING_ADD(sfg, TIMING_MAG_CAL_SLICES, sfg->MagCal.iCalSlices);
+            sfg->MagCal.iCalStatsReady = 0;
+        }
+#endif
+    } while (sfg->MagCal.iCalInProgress && !sfg->MagCal.pWorker &&
+             (SystickElapsedMicros(iCalStart) + iSlowest <= sfg->iMagCalBudgetMicros));
+    fAgeMagCalibration(&(sfg->MagCal));
 
     return;
 } // end processMagData()
 #endif
 
 #if F_USING_GYRO
+#if F_MEASURED_TIME_INTEGRATION
+/// updateGyroSampleInterval() measures the actual interval between gyro measurements, which differs
+/// from 1/GYRO_ODR_HZ by the tolerance of the sensor's clock. Over each GYRO_RATE_WINDOW_MICROS the
+/// time between the reads is divided by the number of measurements they returned; loop jitter only
+/// shifts measurements between fusions and cancels out. The result is low pass filtered into
+/// fSampleInterval. Called once per fusion, before the FIFO is cleared.
+static void updateGyroSampleInterval(struct GyroSensor *pGyro)
+{
+    float fNominal = 1.0F / (float) GYRO_ODR_HZ;
+    float fInterval;                        // sample interval measured over the window (s)
+    uint32_t iElapsed;                      // length of the window (us)
+
+    // start again from this read if measurements may have been lost, as when the software FIFO or
+    // (since it was read full) the hardware FIFO overflowed
+    if (!pGyro->isRateTimed || (pGyro->iFIFOExceeded > 0) || (pGyro->iFIFOCount >= GYRO_FIFO_SIZE))
+    {
+        pGyro->iRateTimestamp = pGyro->iReadTimestamp;
+        pGyro->iRateSamples = 0;
+        pGyro->isRateTimed = true;
+        return;
+    }
+
+    pGyro->iRateSamples += pGyro->iFIFOCount;
+    iElapsed = pGyro->iReadTimestamp - pGyro->iRateTimestamp;
+    if (iElapsed < GYRO_RATE_WINDOW_MICROS) return;
+    if (pGyro->iRateSamples > 0)
+    {
+        fInterval = (float) iElapsed * 1E-6F / (float) pGyro->iRateSamples;
+        if (fabsf(fInterval - fNominal) < GYRO_RATE_TOLERANCE * fNominal)
+            pGyro->fSampleInterval += GYRO_RATE_LPF * (fInterval - pGyro->fSampleInterval);
+    }
+    pGyro->iRateTimestamp = pGyro->iReadTimestamp;
+    pGyro->iRateSamples = 0;
+} // end updateGyroSampleInterval()
+#endif
+
 void processGyroData(SensorFusionGlobals *sfg)
 {
     int32_t iSum[3];		        // channel sums
@@ -247,6 +341,10 @@ void processGyroData(SensorFusionGlobals *sfg)
       sfg->setStatus(sfg, SOFT_FAULT);
     }
 
+#if F_MEASURED_TIME_INTEGRATION
+    updateGyroSampleInterval(&(sfg->Gyro));
+#endif
+
     ApplyGyroHAL(&(sfg->Gyro));       // This function is board-dependent
 
     // calculate the average HAL-corrected measurement.  This is used for offset
@@ -282,14 +380,34 @@ int8_t readSensors(
     struct PhysicalSensor  *pSensor;
     int8_t          s;
     int8_t          status = SENSOR_ERROR_NONE;
+    int32_t         iStart;             // systick at start of all reads
+    int32_t         iSensorStart;       // systick at start of one sensor's read
+#if F_USING_GYRO
+    int32_t         iGyroStart;         // systick at start of the gyro's read
+#endif
+    uint16_t        iPosition = 0;      // position of pSensor in the list
 
+    SystickStartCount(&iStart);
     pSensor = sfg->pSensors;
 
-    for (pSensor = sfg->pSensors; pSensor != NULL; pSensor = pSensor->next)
+    for (pSensor = sfg->pSensors; pSensor != NULL; pSensor = pSensor->next, iPosition++)
     {   if (pSensor->isInitialized) {
             if ( 0 == (read_loop_counter % pSensor->schedule)) {
                 //read the sensor if it is its turn (per loop_counter)
+                TIMING_START(iSensorStart);
+#if F_USING_GYRO
+                // the gyro FIFO is drained from here, so its newest measurement is at most one
+                // sample interval older than this
+                if (pSensor->isInitialized & F_USING_GYRO) {
+                    SystickStartCount(&iGyroStart);
+                    sfg->Gyro.iReadTimestamp = (uint32_t) iGyroStart;
+                }
+#endif
                 s = pSensor->read(pSensor, sfg);
+#if F_TIMING_STATS
+                if (iPosition < TIMING_MAX_SENSORS)
+                    TIMING_STOP(sfg, TIMING_SENSOR_READ_0 + iPosition, iSensorStart);
+#endif
                 if(s != SENSOR_ERROR_NONE) {
                     //sensor reported error, so mark it uninitialized.
                     //If it becomes reinitialized next loop, init function will set flag back to sensor type
@@ -307,6 +425,8 @@ int8_t readSensors(
             }
         }
     }
+    sfg->systick_I2C = SystickElapsedMicros(iStart);
+    TIMING_ADD(sfg, TIMING_READ_SENSORS, sfg->systick_I2C);
     if (status == SENSOR_ERROR_NONE) {
         //change (or keep) status to NORMAL on next regular status update
         sfg->queueStatus(sfg, NORMAL);
@@ -323,16 +443,30 @@ int8_t readSensors(
 /// and calibration functions.
 /// This function is normally invoked via the "sfg." global pointer.
 void conditionSensorReadings(SensorFusionGlobals *sfg) {
+    int32_t iStart;                     // systick at start of each step
+
 #if F_USING_ACCEL
-    if (sfg->Accel.isEnabled) processAccelData(sfg);
+    if (sfg->Accel.isEnabled) {
+        TIMING_START(iStart);
+        processAccelData(sfg);
+        TIMING_STOP(sfg, TIMING_PROCESS_ACCEL, iStart);
+    }
 #endif
 
 #if F_USING_MAG
-    if (sfg->Mag.isEnabled) processMagData(sfg);
+    if (sfg->Mag.isEnabled) {
+        TIMING_START(iStart);
+        processMagData(sfg);
+        TIMING_STOP(sfg, TIMING_PROCESS_MAG, iStart);
+    }
 #endif
 
 #if F_USING_GYRO
-    if (sfg->Gyro.isEnabled) processGyroData(sfg);
+    if (sfg->Gyro.isEnabled) {
+        TIMING_START(iStart);
+        processGyroData(sfg);
+        TIMING_STOP(sfg, TIMING_PROCESS_GYRO, iStart);
+    }
 #endif
     return;
 } // end conditionSensorReadings()
@@ -483,6 +617,28 @@ void runFusion(SensorFusionGlobals *sfg)
                  pSV_6DOF_GB_BASIC, pSV_6DOF_GY_KALMAN,
                  pSV_9DOF_GBY_KALMAN, pAccel, pMag, pGyro,
                  pPressure, pMagCal);
+    // fFuseSensors() has timed each algorithm into its systick field
+#if F_1DOF_P_BASIC
+    TIMING_ADD(sfg, TIMING_FUSE_1DOF_P_BASIC, sfg->SV_1DOF_P_BASIC.systick);
+#endif
+#if F_3DOF_G_BASIC
+    TIMING_ADD(sfg, TIMING_FUSE_3DOF_G_BASIC, sfg->SV_3DOF_G_BASIC.systick);
+#endif
+#if F_3DOF_B_BASIC
+    TIMING_ADD(sfg, TIMING_FUSE_3DOF_B_BASIC, sfg->SV_3DOF_B_BASIC.systick);
+#endif
+#if F_3DOF_Y_BASIC
+    TIMING_ADD(sfg, TIMING_FUSE_3DOF_Y_BASIC, sfg->SV_3DOF_Y_BASIC.systick);
+#endif
+#if F_6DOF_GB_BASIC
+    TIMING_ADD(sfg, TIMING_FUSE_6DOF_GB_BASIC, sfg->SV_6DOF_GB_BASIC.systick);
+#endif
+#if F_6DOF_GY_KALMAN
+    TIMING_ADD(sfg, TIMING_FUSE_6DOF_GY_KALMAN, sfg->SV_6DOF_GY_KALMAN.systick);
+#endif
+#if F_9DOF_GBY_KALMAN
+    TIMING_ADD(sfg, TIMING_FUSE_9DOF_GBY_KALMAN, sfg->SV_9DOF_GBY_KALMAN.systick);
+#endif
     clearFIFOs(sfg);
 } // end runFusion()
 
@@ -525,9 +681,13 @@ void initializeFusionEngine(SensorFusionGlobals *sfg, int pin_i2c_sda, int pin_i
     // reset the loop counter to zero for first iteration
     sfg->loopcounter = 0;
 
-    // initialize the magnetic calibration and magnetometer data buffer
+    // initialize the magnetic calibration and magnetometer data buffer, refilling the buffer from the snapshot
+    // saved with the calibration, if any
 #if F_USING_MAG
     fInitializeMagCalibration(&sfg->MagCal, &sfg->MagBuffer);
+#if F_MAG_BUFFER_SNAPSHOT
+    RestoreMagBufferSnapshotFromNVM(sfg);
+#endif
 #endif
 
     // initialize the precision accelerometer calibration and accelerometer data buffer
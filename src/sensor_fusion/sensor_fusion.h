@@ -18,7 +18,9 @@
 #ifndef SENSOR_FUSION_H
 #define SENSOR_FUSION_H
 
+#ifndef SENSOR_FUSION_HOST
 #include <Arduino.h>
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -29,14 +31,17 @@ extern "C" {
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "board.h"						// Hardware-specific details (e.g. particular sensor ICs)
 #include "build.h"                      // This is where the build parameters are defined
+#include "calibration_scratch.h"        // Scratch matrices shared by the calibrations
 #include "driver_sensors_types.h"		// Typedefs for the sensor hardware
 #include "magnetic.h"                   // Magnetic calibration functions/structures
 #include "matrix.h"  					// Matrix math
 #include "orientation.h"                // Functions for manipulating orientations
 #include "precisionAccelerometer.h"     // Accel calibration functions/structures
+#include "timing_stats.h"               // Execution time statistics
 
 /// the quaternion type to be transmitted
 typedef enum quaternion {
@@ -250,6 +255,11 @@ struct GyroSensor
 	float fDegPerSecPerCount;		///< deg/s per count
 	int16_t iCountsPerDegPerSec;		///< counts per deg/s
 	int16_t iYs[3];				///< average measurement (counts)
+	uint32_t iReadTimestamp;		///< systick (us) at the start of the latest read of the FIFO
+	uint32_t iRateTimestamp;		///< systick (us) at the start of the current sample interval measurement
+	uint32_t iRateSamples;			///< measurements read since iRateTimestamp
+	bool isRateTimed;			///< true once iRateTimestamp is valid
+	float fSampleInterval;			///< measured interval between FIFO measurements (s)
 };
 
 /// \brief The FifoSensor union allows us to use common pointers for Accel, Mag & Gyro logical sensor structures.
@@ -431,6 +441,15 @@ struct SV_9DOF_GBY_KALMAN
 	float fAlphaQwbOver6;			///< (PI / 180 * fdeltat) * Qwb / 6
 	float fQwbOver3;			///< Qwb / 3
 	float fMaxGyroOffsetChange;		///< maximum permissible gyro offset change per iteration (deg/s)
+	// gyro prediction between Kalman updates, see fPredict_9DOF_GBY_KALMAN()
+	Quaternion fqPr;			///< predicted orientation quaternion: fqPl rotated by the gyro readings since the last update
+	float fPhiPr;				///< predicted roll (deg)
+	float fThePr;				///< predicted pitch (deg)
+	float fPsiPr;				///< predicted yaw (deg)
+	float fRhoPr;				///< predicted compass (deg)
+	float fChiPr;				///< predicted tilt from vertical (deg)
+	float fOmegaPr[3];			///< angular velocity of the latest gyro readings (deg/s)
+	int8_t iFIFOPredicted;			///< number of gyro FIFO readings already in fqPr
 	int8_t iFirstAccelMagLock;		///< denotes that 9DOF orientation has locked to 6DOF eCompass
 	int8_t resetflag;			///< flag to request re-initialization on next pass
 };
@@ -477,6 +496,12 @@ typedef struct SensorFusionGlobals
 	int32_t loopcounter;			///< counter incrementing each iteration of sensor fusion (typically 25Hz)
 	int32_t systick_I2C;			///< systick counter to benchmark I2C reads
 	int32_t systick_Spare;			///< systick counter for counts spare waiting for timing interrupt
+#if     F_USING_MAG
+	int32_t iMagCalBudgetMicros;		///< time allowed per fusion for magnetic calibration slices (us), 0 for one slice
+#endif
+#if     F_TIMING_STATS
+	TimingStats Timing;			///< execution time statistics for each stage of the fusion cycle
+#endif
         ///@}
         ///@{
         /// @name SensorRelatedStructures
@@ -500,6 +525,9 @@ typedef struct SensorFusionGlobals
 	struct GyroSensor 	Gyro;                   ///< gyro storage
 #endif
     struct TempSensor Temp;					//temperature storage
+#if     F_USING_ACCEL || F_USING_MAG
+	struct CalibrationScratch CalScratch;   ///< scratch matrices leased by the accel and mag calibrations
+#endif
 
         ///@}
         ///@{
@@ -566,6 +594,9 @@ void clearFIFOs(
 );
 runFusion_t runFusion;
 readSensors_t readSensors;
+setStatus_t setStatus;
+setStatus_t queueStatus;
+updateStatus_t updateStatus;
 void zeroArray(
     struct StatusSubsystem *pStatus,                    ///< Status subsystem pointer
     void* data,                                         ///< pointer to array to be zeroed
@@ -0,0 +1,298 @@
+/*
+ * Copyright (c) 2020-2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file sensor_log.c
+    \brief Raw sensor log recording, and a replay driver to play logs back.
+
+    See sensor_log.h for the log format.
+*/
+
+#include "sensor_fusion.h"      // Sensor fusion structures and functions
+#include "driver_sensors.h"     // prototypes for *_Init() and *_Read() methods
+#include "sensor_log.h"         // Header for this .c file
+
+// little-endian field access, independent of the byte order of the processor
+static void PutU16(uint8_t *buffer, uint16_t value)
+{
+    buffer[0] = (uint8_t) value;
+    buffer[1] = (uint8_t) (value >> 8);
+}
+
+static void PutU32(uint8_t *buffer, uint32_t value)
+{
+    PutU16(buffer, (uint16_t) value);
+    PutU16(buffer + 2, (uint16_t) (value >> 16));
+}
+
+static uint16_t GetU16(const uint8_t *buffer)
+{
+    return (uint16_t) (buffer[0] | (buffer[1] << 8));
+}
+
+static uint32_t GetU32(const uint8_t *buffer)
+{
+    return (uint32_t) GetU16(buffer) | ((uint32_t) GetU16(buffer + 2) << 16);
+}
+
+// append iCount samples from a FIFO to the record at *pIndex
+static void PutSamples(uint8_t *buffer, uint16_t *pIndex, int16_t fifo[][3], uint8_t iCount)
+{
+    uint8_t i, j;
+
+    for (i = 0; i < iCount; i++)
+    {
+        for (j = CHX; j <= CHZ; j++)
+        {
+            PutU16(buffer + *pIndex, (uint16_t) fifo[i][j]);
+            *pIndex += 2;
+        }
+    }
+}
+
+// push iCount samples from the record at *pIndex into a software FIFO, as a sensor driver would
+static void GetSamples(const uint8_t *buffer, uint16_t *pIndex, union FifoSensor *pSensor,
+                       uint16_t maxFifoSize, uint8_t iCount)
+{
+    int16_t sample[3];
+    uint8_t i, j;
+
+    for (i = 0; i < iCount; i++)
+    {
+        for (j = CHX; j <= CHZ; j++)
+        {
+            sample[j] = (int16_t) GetU16(buffer + *pIndex);
+            *pIndex += 2;
+        }
+        if (pSensor) addToFifo(pSensor, maxFifoSize, sample);
+    }
+}
+
+uint16_t SensorLogEncodeHeader(SensorFusionGlobals *sfg, uint8_t *buffer)
+{
+    uint8_t i;
+
+    for (i = 0; i < SENSOR_LOG_HEADER_BYTES; i++) buffer[i] = 0;
+    buffer[0] = 'S';
+    buffer[1] = 'F';
+    buffer[2] = 'L';
+    buffer[3] = 'G';
+    buffer[4] = SENSOR_LOG_VERSION;
+    buffer[5] = SENSOR_LOG_TEMPERATURE;
+#if F_USING_ACCEL
+    buffer[5] |= SENSOR_LOG_ACCEL;
+    buffer[6] = sfg->Accel.iWhoAmI;
+    PutU16(buffer + 10, (uint16_t) sfg->Accel.iCountsPerg);
+#endif
+#if F_USING_MAG
+    buffer[5] |= SENSOR_LOG_MAG;
+    buffer[7] = sfg->Mag.iWhoAmI;
+    PutU16(buffer + 12, (uint16_t) sfg->Mag.iCountsPeruT);
+#endif
+#if F_USING_GYRO
+    buffer[5] |= SENSOR_LOG_GYRO;
+    buffer[8] = sfg->Gyro.iWhoAmI;
+    PutU16(buffer + 14, (uint16_t) sfg->Gyro.iCountsPerDegPerSec);
+#endif
+    PutU16(buffer + 16, FUSION_HZ);
+    return SENSOR_LOG_HEADER_BYTES;
+} // end SensorLogEncodeHeader()
+
+uint16_t SensorLogEncodeRecord(SensorFusionGlobals *sfg, uint32_t timestamp, uint8_t *buffer)
+{
+    uint16_t iIndex;        // output buffer counter
+    uint16_t i;
+    uint8_t checksum;
+    float ftmp;
+
+    buffer[0] = SENSOR_LOG_SYNC;
+    PutU32(buffer + 3, timestamp);
+    ftmp = 100.0F * sfg->Temp.temperatureC;
+    ftmp = (ftmp < 0.0F) ? ftmp - 0.5F : ftmp + 0.5F;
+    PutU16(buffer + 7, (uint16_t) (int16_t) ftmp);
+    buffer[9] = buffer[10] = buffer[11] = 0;
+    iIndex = 12;
+#if F_USING_ACCEL
+    buffer[9] = sfg->Accel.iFIFOCount;
+    PutSamples(buffer, &iIndex, sfg->Accel.iGsFIFO, sfg->Accel.iFIFOCount);
+#endif
+#if F_USING_MAG
+    buffer[10] = sfg->Mag.iFIFOCount;
+    PutSamples(buffer, &iIndex, sfg->Mag.iBsFIFO, sfg->Mag.iFIFOCount);
+#endif
+#if F_USING_GYRO
+    buffer[11] = sfg->Gyro.iFIFOCount;
+    PutSamples(buffer, &iIndex, sfg->Gyro.iYsFIFO, sfg->Gyro.iFIFOCount);
+#endif
+    PutU16(buffer + 1, iIndex - 3);
+
+    checksum = 0;
+    for (i = 1; i < iIndex; i++) checksum ^= buffer[i];
+    buffer[iIndex++] = checksum;
+    return iIndex;
+} // end SensorLogEncodeRecord()
+
+int8_t SensorLogInstallReplay(SensorFusionGlobals *sfg, struct PhysicalSensor *sensor,
+                              SensorLogReplay *replay)
+{
+    int8_t status;
+
+    if (!replay || !replay->read) return SENSOR_ERROR_INVALID_PARAM;
+    replay->timestamp = 0;
+    replay->iRecords = 0;
+    replay->iCorrupt = 0;
+    replay->headerValid = false;
+    replay->finished = false;
+    status = sfg->installSensor(sfg, sensor, 0, 1, NULL,
+                                SensorLogReplay_Init, SensorLogReplay_Read);
+    // installSensor() clears the device context, so attach the replay state afterwards
+    sensor->deviceInfo.functionParam = replay;
+    return status;
+} // end SensorLogInstallReplay()
+
+// reads and checks the log header, and sets up the logical sensors as the logged drivers did
+int8_t SensorLogReplay_Init(struct PhysicalSensor *sensor, SensorFusionGlobals *sfg)
+{
+    SensorLogReplay *replay = (SensorLogReplay *) sensor->deviceInfo.functionParam;
+    uint8_t header[SENSOR_LOG_HEADER_BYTES];
+    uint8_t i;
+
+    if (!replay || replay->finished) return SENSOR_ERROR_INIT;
+    if (!replay->headerValid)
+    {
+        if (replay->read(replay->context, header, SENSOR_LOG_HEADER_BYTES) != SENSOR_LOG_HEADER_BYTES)
+        {
+            replay->finished = true;
+            return SENSOR_ERROR_INIT;
+        }
+        if (header[0] != 'S' || header[1] != 'F' || header[2] != 'L' || header[3] != 'G' ||
+            header[4] != SENSOR_LOG_VERSION)
+        {
+            replay->finished = true;
+            return SENSOR_ERROR_INIT;
+        }
+        replay->iSensors = header[5];
+        for (i = 0; i < 3; i++)
+        {
+            replay->iWhoAmI[i] = header[6 + i];
+            replay->iCountsPer[i] = (int16_t) GetU16(header + 10 + 2 * i);
+        }
+        replay->iFusionHz = GetU16(header + 16);
+        replay->headerValid = true;
+    }
+
+    sensor->isInitialized = F_USING_NONE;
+#if F_USING_ACCEL
+    if ((replay->iSensors & SENSOR_LOG_ACCEL) && replay->iCountsPer[0])
+    {
+        sfg->Accel.iWhoAmI = replay->iWhoAmI[0];
+        sfg->Accel.iCountsPerg = replay->iCountsPer[0];
+        sfg->Accel.fgPerCount = 1.0F / replay->iCountsPer[0];
+        sfg->Accel.isEnabled = true;
+        sensor->isInitialized |= F_USING_ACCEL;
+    }
+#endif
+#if F_USING_MAG
+    if ((replay->iSensors & SENSOR_LOG_MAG) && replay->iCountsPer[1])
+    {
+        sfg->Mag.iWhoAmI = replay->iWhoAmI[1];
+        sfg->Mag.iCountsPeruT = replay->iCountsPer[1];
+        sfg->Mag.fCountsPeruT = (float) replay->iCountsPer[1];
+        sfg->Mag.fuTPerCount = 1.0F / replay->iCountsPer[1];
+        sfg->Mag.isEnabled = true;
+        sensor->isInitialized |= F_USING_MAG;
+    }
+#endif
+#if F_USING_GYRO
+    if ((replay->iSensors & SENSOR_LOG_GYRO) && replay->iCountsPer[2])
+    {
+        sfg->Gyro.iWhoAmI = replay->iWhoAmI[2];
+        sfg->Gyro.iCountsPerDegPerSec = replay->iCountsPer[2];
+        sfg->Gyro.fDegPerSecPerCount = 1.0F / replay->iCountsPer[2];
+        sfg->Gyro.iFIFOCount = 0;
+        sfg->Gyro.isEnabled = true;
+        sensor->isInitialized |= F_USING_GYRO;
+    }
+#endif
+    // a log recorded without a sensor that this build fuses cannot be replayed
+    if (sensor->isInitialized != (F_USING_ACCEL | F_USING_MAG | F_USING_GYRO))
+    {
+        sensor->isInitialized = F_USING_NONE;
+        return SENSOR_ERROR_INIT;
+    }
+    return SENSOR_ERROR_NONE;
+} // end SensorLogReplay_Init()
+
+// loads the next intact record into the software FIFOs, skipping any corrupt ones
+int8_t SensorLogReplay_Read(struct PhysicalSensor *sensor, SensorFusionGlobals *sfg)
+{
+    SensorLogReplay *replay = (SensorLogReplay *) sensor->deviceInfo.functionParam;
+    uint8_t buffer[SENSOR_LOG_MAX_RECORD_BYTES];
+    uint16_t iLength;       // payload length
+    uint16_t iIndex;        // input buffer counter
+    uint16_t i;
+    uint8_t checksum;
+
+    if (!sensor->isInitialized || !replay) return SENSOR_ERROR_INIT;
+    while (!replay->finished)
+    {
+        // hunt for the start of a record
+        if (replay->read(replay->context, buffer, 1) != 1)
+        {
+            replay->finished = true;
+            break;
+        }
+        if (buffer[0] != SENSOR_LOG_SYNC) continue;
+        if (replay->read(replay->context, buffer + 1, 2) != 2)
+        {
+            replay->finished = true;
+            break;
+        }
+        iLength = GetU16(buffer + 1);
+        if ((iLength < SENSOR_LOG_RECORD_OVERHEAD - 4) ||
+            (iLength > SENSOR_LOG_MAX_RECORD_BYTES - 4))
+        {
+            replay->iCorrupt++;
+            continue;
+        }
+        if (replay->read(replay->context, buffer + 3, iLength + 1) != iLength + 1)
+        {
+            replay->finished = true;
+            break;
+        }
+        checksum = 0;
+        for (i = 1; i < iLength + 3; i++) checksum ^= buffer[i];
+        if ((checksum != buffer[iLength + 3]) ||
+            (buffer[9] > ACCEL_FIFO_SIZE) || (buffer[10] > MAG_FIFO_SIZE) ||
+            (buffer[11] > GYRO_FIFO_SIZE) ||
+            (iLength != 9 + 6 * (buffer[9] + buffer[10] + buffer[11])))
+        {
+            replay->iCorrupt++;
+            continue;
+        }
+
+        // an intact record: hand its contents over just as the hardware drivers would
+        replay->timestamp = GetU32(buffer + 3);
+        sfg->Temp.temperatureC = 0.01F * (int16_t) GetU16(buffer + 7);
+        iIndex = 12;
+#if F_USING_ACCEL
+        GetSamples(buffer, &iIndex, (union FifoSensor *) &(sfg->Accel), ACCEL_FIFO_SIZE, buffer[9]);
+#else
+        GetSamples(buffer, &iIndex, NULL, 0, buffer[9]);
+#endif
+#if F_USING_MAG
+        GetSamples(buffer, &iIndex, (union FifoSensor *) &(sfg->Mag), MAG_FIFO_SIZE, buffer[10]);
+#else
+        GetSamples(buffer, &iIndex, NULL, 0, buffer[10]);
+#endif
+#if F_USING_GYRO
+        GetSamples(buffer, &iIndex, (union FifoSensor *) &(sfg->Gyro), GYRO_FIFO_SIZE, buffer[11]);
+#endif
+        replay->iRecords++;
+        return SENSOR_ERROR_NONE;
+    }
+    return SENSOR_ERROR_READ;
+} // end SensorLogReplay_Read()
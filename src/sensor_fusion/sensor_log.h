@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2020-2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file sensor_log.h
+    \brief Raw sensor log recording, and a replay driver to play logs back.
+
+    A log is one header, followed by one record per fusion cycle. Each record
+    holds the raw (pre-HAL) contents of the accelerometer, magnetometer and
+    gyroscope software FIFOs as filled by readSensors(), together with the
+    temperature and the time at which the cycle ran. All multi-byte fields
+    are little-endian, so logs can be moved between targets and host.
+
+    Header (SENSOR_LOG_HEADER_BYTES):
+    - [0-3]   'S' 'F' 'L' 'G'
+    - [4]     format version (SENSOR_LOG_VERSION)
+    - [5]     sensors present (SENSOR_LOG_ACCEL | SENSOR_LOG_MAG | ...)
+    - [6-8]   accelerometer, magnetometer and gyroscope WHO_AM_I values
+    - [9]     reserved, 0
+    - [10-15] accel counts per g, mag counts per uT, gyro counts per deg/s
+    - [16-17] FUSION_HZ of the recording
+
+    Record (9 + 6 * number of samples + 4 bytes):
+    - [0]     SENSOR_LOG_SYNC
+    - [1-2]   payload length: bytes from [3] up to, not including, the checksum
+    - [3-6]   cycle timestamp (us)
+    - [7-8]   temperature (0.01 C)
+    - [9-11]  accelerometer, magnetometer and gyroscope FIFO counts
+    - [12-..] FIFO samples, x y z for each, accelerometer first then mag, gyro
+    - [last]  XOR of bytes [1] to the end of the samples
+
+    To record, call SensorLogEncodeHeader() once and then SensorLogEncodeRecord()
+    each cycle between readSensors() and runFusion(), storing the bytes wherever
+    the application likes (SD card, serial port...).
+
+    To replay, fill in a SensorLogReplay with a function that supplies the log
+    bytes and install it with SensorLogInstallReplay() instead of the hardware
+    sensor drivers. Each call to readSensors() then loads one record, so
+    the unchanged fusion runs on the logged data as fast as the CPU allows.
+*/
+
+#ifndef SENSOR_LOG_H
+#define SENSOR_LOG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "sensor_fusion.h"
+
+/// @name Sensor Log Format Constants
+///@{
+#define SENSOR_LOG_VERSION          1
+#define SENSOR_LOG_HEADER_BYTES     18
+#define SENSOR_LOG_SYNC             0xA5
+#define SENSOR_LOG_RECORD_OVERHEAD  13      ///< sync, length, timestamp, temperature, counts, checksum
+#define SENSOR_LOG_MAX_RECORD_BYTES (SENSOR_LOG_RECORD_OVERHEAD + \
+                                     6 * (ACCEL_FIFO_SIZE + MAG_FIFO_SIZE + GYRO_FIFO_SIZE))
+#define SENSOR_LOG_ACCEL            0x01    ///< accelerometer samples are logged
+#define SENSOR_LOG_MAG              0x02    ///< magnetometer samples are logged
+#define SENSOR_LOG_GYRO             0x04    ///< gyroscope samples are logged
+#define SENSOR_LOG_TEMPERATURE      0x10    ///< temperature is logged
+///@}
+
+/// Supplies the next num_bytes of a log. Returns the number of bytes actually
+/// placed in destination, which is less than num_bytes only at the end of the log.
+typedef uint16_t (sensorLogReader_t) (void *context, uint8_t *destination, uint16_t num_bytes);
+
+/// State of one log being replayed. Set read and context, then call
+/// SensorLogInstallReplay(); the remaining fields are maintained by the driver.
+typedef struct SensorLogReplay {
+    sensorLogReader_t *read;            ///< fetches log bytes
+    void *context;                      ///< passed unchanged to read()
+    uint32_t timestamp;                 ///< timestamp (us) of the record most recently replayed
+    uint32_t iRecords;                  ///< number of records replayed
+    uint32_t iCorrupt;                  ///< number of records skipped due to a bad length or checksum
+    uint16_t iFusionHz;                 ///< FUSION_HZ of the recording
+    uint8_t iSensors;                   ///< SENSOR_LOG_* flags from the header
+    uint8_t iWhoAmI[3];                 ///< accelerometer, magnetometer, gyroscope WHO_AM_I
+    int16_t iCountsPer[3];              ///< counts per g, per uT, per deg/s
+    bool headerValid;                   ///< header has been read and accepted
+    bool finished;                      ///< the end of the log has been reached
+} SensorLogReplay;
+
+/// Writes the log header describing the installed sensors into buffer, which
+/// must hold SENSOR_LOG_HEADER_BYTES. Returns the number of bytes written.
+uint16_t SensorLogEncodeHeader(SensorFusionGlobals *sfg, uint8_t *buffer);
+/// Writes one record of the current FIFO contents into buffer, which must hold
+/// SENSOR_LOG_MAX_RECORD_BYTES. Call after readSensors() and before runFusion(),
+/// which empties the FIFOs. Returns the number of bytes written.
+uint16_t SensorLogEncodeRecord(SensorFusionGlobals *sfg, uint32_t timestamp, uint8_t *buffer);
+/// Installs the replay driver in place of the hardware sensors, reading from replay.
+int8_t SensorLogInstallReplay(SensorFusionGlobals *sfg, struct PhysicalSensor *sensor,
+                              SensorLogReplay *replay);
+
+/// @name Replay Driver
+/// initializeSensor_t and readSensor_t functions for installSensor(). The
+/// SensorLogReplay must be in sensor->deviceInfo.functionParam, as set up by
+/// SensorLogInstallReplay().
+///@{
+int8_t SensorLogReplay_Init(struct PhysicalSensor *sensor, SensorFusionGlobals *sfg);
+int8_t SensorLogReplay_Read(struct PhysicalSensor *sensor, SensorFusionGlobals *sfg);
+///@}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SENSOR_LOG_H
@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2020-2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file sensor_pipeline.c
+    \brief Pipelined sensor reads, overlapping the I2C transfers with fusion.
+
+    See sensor_pipeline.h for a description of the pipeline.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sensor_fusion.h"
+#include "hal_timer.h"
+#include "sensor_pipeline.h"    // Header for this .c file
+
+// stands in for the status functions in the reader task's copy of the fusion globals,
+// so that only the fusion task changes the status; the read result travels in the batch
+static void fPipelineIgnoreStatus(SensorFusionGlobals *sfg, fusion_status_t status)
+{
+    (void) sfg;
+    (void) status;
+} // end fPipelineIgnoreStatus()
+
+// copies iCount samples between software FIFOs
+static void fPipelineCopySamples(int16_t iDst[][3], int16_t iSrc[][3], uint8_t iCount)
+{
+    uint8_t i;
+
+    for (i = 0; i < iCount; i++)
+    {
+        iDst[i][CHX] = iSrc[i][CHX];
+        iDst[i][CHY] = iSrc[i][CHY];
+        iDst[i][CHZ] = iSrc[i][CHZ];
+    }
+} // end fPipelineCopySamples()
+
+void SensorPipelineInit(SensorPipeline *pPipeline, SensorFusionGlobals *sfg,
+                        SensorFusionGlobals *pCapture, uint8_t iLoopsPerFusion,
+                        uint8_t iLoopCounter)
+{
+    *pCapture = *sfg;
+    pCapture->setStatus = fPipelineIgnoreStatus;
+    pCapture->queueStatus = fPipelineIgnoreStatus;
+    pCapture->clearFIFOs(pCapture);
+
+    pPipeline->pCapture = pCapture;
+    pPipeline->iHead = 0;
+    pPipeline->iTail = 0;
+    pPipeline->iOverruns = 0;
+    pPipeline->iEmpty = 0;
+    pPipeline->iMaxDepth = 0;
+    pPipeline->iOverrunsSeen = 0;
+    pPipeline->iLoopsPerFusion = iLoopsPerFusion;
+    pPipeline->iReadLoopCounter = iLoopCounter;
+} // end SensorPipelineInit()
+
+bool SensorPipelineProduce(SensorPipeline *pPipeline)
+{
+    SensorFusionGlobals *pCapture = pPipeline->pCapture;
+    SensorBatch *pBatch;
+    uint32_t iHead;
+    int32_t iStart;
+    int8_t iStatus;
+
+    // the FIFOs must be drained every cycle, even if the batch is then discarded
+    SystickStartCount(&iStart);
+    iStatus = pCapture->readSensors(pCapture, pPipeline->iReadLoopCounter);
+
+    // count the loops as the fusion task does, whether or not the batch is kept
+    if (pPipeline->iReadLoopCounter < pPipeline->iLoopsPerFusion)
+        (pPipeline->iReadLoopCounter)++;
+    else
+        pPipeline->iReadLoopCounter = 1;
+
+    iHead = pPipeline->iHead;
+    if (iHead - __atomic_load_n(&pPipeline->iTail, __ATOMIC_ACQUIRE) >= SENSOR_PIPELINE_DEPTH)
+    {
+        __atomic_store_n(&pPipeline->iOverruns, pPipeline->iOverruns + 1, __ATOMIC_RELAXED);
+        pCapture->clearFIFOs(pCapture);
+        return false;
+    }
+
+    pBatch = &(pPipeline->batch[iHead % SENSOR_PIPELINE_DEPTH]);
+    pBatch->iTimestamp = (uint32_t) iStart;
+#if F_USING_GYRO
+    pBatch->iGyroTimestamp = pCapture->Gyro.iReadTimestamp;
+#endif
+    pBatch->iReadMicros = pCapture->systick_I2C;
+    pBatch->fTemperatureC = pCapture->Temp.temperatureC;
+    pBatch->iStatus = iStatus;
+    pBatch->iAccelCount = pBatch->iMagCount = pBatch->iGyroCount = 0;
+#if F_USING_ACCEL
+    pBatch->iAccelCount = pCapture->Accel.iFIFOCount;
+    fPipelineCopySamples(pBatch->iGs, pCapture->Accel.iGsFIFO, pBatch->iAccelCount);
+#endif
+#if F_USING_MAG
+    pBatch->iMagCount = pCapture->Mag.iFIFOCount;
+    fPipelineCopySamples(pBatch->iBs, pCapture->Mag.iBsFIFO, pBatch->iMagCount);
+#endif
+#if F_USING_GYRO
+    pBatch->iGyroCount = pCapture->Gyro.iFIFOCount;
+    fPipelineCopySamples(pBatch->iYs, pCapture->Gyro.iYsFIFO, pBatch->iGyroCount);
+#endif
+    pCapture->clearFIFOs(pCapture);
+
+    // publish the batch only once it is complete
+    __atomic_store_n(&pPipeline->iHead, iHead + 1, __ATOMIC_RELEASE);
+    return true;
+} // end SensorPipelineProduce()
+
+bool SensorPipelineConsume(SensorPipeline *pPipeline, SensorFusionGlobals *sfg,
+                           uint32_t *pTimestamp)
+{
+    const SensorBatch *pBatch;
+    uint32_t iTail;
+    uint32_t iDepth;
+#if F_USING_GYRO
+    uint32_t iOverruns;
+#endif
+    uint8_t i;
+
+    iTail = pPipeline->iTail;
+    iDepth = __atomic_load_n(&pPipeline->iHead, __ATOMIC_ACQUIRE) - iTail;
+    if (iDepth == 0)
+    {
+        __atomic_store_n(&pPipeline->iEmpty, pPipeline->iEmpty + 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    if (iDepth > pPipeline->iMaxDepth)
+        __atomic_store_n(&pPipeline->iMaxDepth, iDepth, __ATOMIC_RELAXED);
+
+    // hand the samples over just as the sensor drivers would
+    pBatch = &(pPipeline->batch[iTail % SENSOR_PIPELINE_DEPTH]);
+#if F_USING_ACCEL
+    for (i = 0; i < pBatch->iAccelCount; i++)
+        addToFifo((union FifoSensor *) &(sfg->Accel), ACCEL_FIFO_SIZE, (int16_t *) pBatch->iGs[i]);
+#endif
+#if F_USING_MAG
+    for (i = 0; i < pBatch->iMagCount; i++)
+        addToFifo((union FifoSensor *) &(sfg->Mag), MAG_FIFO_SIZE, (int16_t *) pBatch->iBs[i]);
+#endif
+#if F_USING_GYRO
+    for (i = 0; i < pBatch->iGyroCount; i++)
+        addToFifo((union FifoSensor *) &(sfg->Gyro), GYRO_FIFO_SIZE, (int16_t *) pBatch->iYs[i]);
+    sfg->Gyro.iReadTimestamp = pBatch->iGyroTimestamp;
+
+    // the measurements of discarded batches are missing, so the gyro sample interval must be measured afresh
+    iOverruns = __atomic_load_n(&pPipeline->iOverruns, __ATOMIC_RELAXED);
+    if (iOverruns != pPipeline->iOverrunsSeen)
+    {
+        sfg->Gyro.isRateTimed = false;
+        pPipeline->iOverrunsSeen = iOverruns;
+    }
+#endif
+    sfg->Temp.temperatureC = pBatch->fTemperatureC;
+    sfg->systick_I2C = pBatch->iReadMicros;
+    TIMING_ADD(sfg, TIMING_READ_SENSORS, pBatch->iReadMicros);
+    if (pBatch->iStatus == SENSOR_ERROR_NONE)
+    {
+        sfg->queueStatus(sfg, NORMAL);
+    }
+    else
+    {
+        sfg->setStatus(sfg, SOFT_FAULT);
+    }
+    *pTimestamp = pBatch->iTimestamp;
+
+    // only now may the reader task reuse the entry
+    __atomic_store_n(&pPipeline->iTail, iTail + 1, __ATOMIC_RELEASE);
+    return true;
+} // end SensorPipelineConsume()
+
+void SensorPipelineGetStats(const SensorPipeline *pPipeline, SensorPipelineStats *pStats)
+{
+    pStats->iProduced = __atomic_load_n(&pPipeline->iHead, __ATOMIC_RELAXED);
+    pStats->iConsumed = __atomic_load_n(&pPipeline->iTail, __ATOMIC_RELAXED);
+    pStats->iOverruns = __atomic_load_n(&pPipeline->iOverruns, __ATOMIC_RELAXED);
+    pStats->iEmpty = __atomic_load_n(&pPipeline->iEmpty, __ATOMIC_RELAXED);
+    pStats->iMaxDepth = __atomic_load_n(&pPipeline->iMaxDepth, __ATOMIC_RELAXED);
+} // end SensorPipelineGetStats()
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2020-2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file sensor_pipeline.h
+    \brief Pipelined sensor reads, overlapping the I2C transfers with fusion.
+
+    Normally readSensors() and runFusion() run back to back in one task, and
+    draining the FXAS21002 FIFO alone takes 2-4 ms of each cycle. In pipelined
+    mode a reader task calls SensorPipelineProduce(), which reads the sensors
+    into a private copy of SensorFusionGlobals and moves the contents of its
+    software FIFOs into a ring of timestamped SensorBatch entries. The fusion
+    task calls SensorPipelineConsume() before conditionSensorReadings(), which
+    loads the oldest batch into the FIFOs of the real SensorFusionGlobals just
+    as the sensor drivers would. On a dual core ESP32 the reads for cycle N+1
+    then overlap the fusion of cycle N.
+
+    The ring has exactly one producer and one consumer, and needs no locks:
+    each side only writes its own index, with release/acquire ordering. If the
+    fusion falls SENSOR_PIPELINE_DEPTH cycles behind, the newest batch is
+    discarded and counted as an overrun, rather than overwriting a batch the
+    consumer may be reading.
+
+    The reader task's copy of SensorFusionGlobals reports sensor errors into
+    the batch instead of the status subsystem, so that the LEDs and status
+    are only ever changed from the fusion task. The read times of the
+    individual sensors are kept in the reader's copy; only the total read
+    time of each batch is added to the TIMING_READ_SENSORS statistics.
+*/
+
+#ifndef SENSOR_PIPELINE_H
+#define SENSOR_PIPELINE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "sensor_fusion.h"
+
+#define SENSOR_PIPELINE_DEPTH   4       ///< batches in the ring, a power of 2
+
+/// Sensor readings of one cycle, as gathered by readSensors().
+typedef struct SensorBatch
+{
+	uint32_t iTimestamp;                    ///< systick (us) at the start of the reads
+	uint32_t iGyroTimestamp;                ///< systick (us) at the start of the gyro read
+	int32_t iReadMicros;                    ///< time taken by readSensors() (us)
+	float fTemperatureC;                    ///< sensor die temperature
+	int8_t iStatus;                         ///< SENSOR_ERROR_NONE, or the first error reported
+	uint8_t iAccelCount;                    ///< number of accelerometer samples
+	uint8_t iMagCount;                      ///< number of magnetometer samples
+	uint8_t iGyroCount;                     ///< number of gyroscope samples
+#if F_USING_ACCEL
+	int16_t iGs[ACCEL_FIFO_SIZE][3];        ///< accelerometer samples (counts)
+#endif
+#if F_USING_MAG
+	int16_t iBs[MAG_FIFO_SIZE][3];          ///< magnetometer samples (counts)
+#endif
+#if F_USING_GYRO
+	int16_t iYs[GYRO_FIFO_SIZE][3];         ///< gyroscope samples (counts)
+#endif
+} SensorBatch;
+
+/// Counters describing the pipeline, for SensorPipelineGetStats().
+typedef struct SensorPipelineStats
+{
+	uint32_t iProduced;                     ///< batches placed in the ring
+	uint32_t iConsumed;                     ///< batches loaded for fusion
+	uint32_t iOverruns;                     ///< batches discarded because the ring was full
+	uint32_t iEmpty;                        ///< consume attempts that found no batch
+	uint32_t iMaxDepth;                     ///< most batches waiting at once
+} SensorPipelineStats;
+
+/// State of the pipeline. Set up with SensorPipelineInit().
+typedef struct SensorPipeline
+{
+	SensorFusionGlobals *pCapture;          ///< reader task's copy of the fusion globals
+	SensorBatch batch[SENSOR_PIPELINE_DEPTH];       ///< the ring
+	uint32_t iHead;                         ///< batches produced; written only by the reader task
+	uint32_t iTail;                         ///< batches consumed; written only by the fusion task
+	uint32_t iOverruns;                     ///< written only by the reader task
+	uint32_t iEmpty;                        ///< written only by the fusion task
+	uint32_t iMaxDepth;                     ///< written only by the fusion task
+	uint32_t iOverrunsSeen;                 ///< iOverruns at the previous consume; fusion task only
+	uint8_t iLoopsPerFusion;                ///< reads per fusion, as in the fusion task
+	uint8_t iReadLoopCounter;               ///< loop counter for the next readSensors(); reader task only
+} SensorPipeline;
+
+/// Prepares the pipeline once sfg has been initialized and its sensors
+/// installed (after initializeFusionEngine()). pCapture receives a copy of
+/// *sfg, and must stay allocated for as long as the pipeline is used.
+/// The reader task passes readSensors() a loop counter that starts at
+/// iLoopCounter and runs from 1 to iLoopsPerFusion, as the fusion task's
+/// would, so that sensors with a schedule above 1 are read in their turn.
+void SensorPipelineInit(SensorPipeline *pPipeline, SensorFusionGlobals *sfg,
+                        SensorFusionGlobals *pCapture, uint8_t iLoopsPerFusion,
+                        uint8_t iLoopCounter);
+/// Reader task: reads the sensors and queues their samples as one batch.
+/// Returns false if the ring was full and the batch was discarded.
+bool SensorPipelineProduce(SensorPipeline *pPipeline);
+/// Fusion task: loads the oldest batch into the FIFOs of sfg, applies its
+/// status, and sets *pTimestamp to its timestamp. Returns false, leaving sfg
+/// unchanged, if no batch is waiting.
+bool SensorPipelineConsume(SensorPipeline *pPipeline, SensorFusionGlobals *sfg,
+                           uint32_t *pTimestamp);
+/// Any task: fills pStats from the pipeline counters.
+void SensorPipelineGetStats(const SensorPipeline *pPipeline, SensorPipelineStats *pStats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SENSOR_PIPELINE_H
@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2020-2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file timing_stats.c
+    \brief Execution time statistics for each stage of the fusion cycle.
+
+    See timing_stats.h for a description of the histogram.
+*/
+
+#include <stddef.h>
+
+#include "timing_stats.h"       // Header for this .c file
+
+static const char *const sStageNames[TIMING_NUM_STAGES] = {
+    "sensor 0 read",
+    "sensor 1 read",
+    "sensor 2 read",
+    "sensor 3 read",
+    "readSensors",
+    "processAccel",
+    "processMag",
+    "processGyro",
+    "magCal slice",
+    "1DOF_P_BASIC",
+    "3DOF_G_BASIC",
+    "3DOF_B_BASIC",
+    "3DOF_Y_BASIC",
+    "6DOF_GB_BASIC",
+    "6DOF_GY_KALMAN",
+    "9DOF_GBY_KALMAN",
+    "createPackets",
+    "sendSerial",
+    "cycle",
+    "magCal sweeps",
+    "magCal slices"
+};
+
+// returns the histogram bucket for a time of iMicros
+static uint16_t iTimingBucket(uint32_t iMicros)
+{
+    uint16_t iOctave = 0;
+    uint32_t iIndex;
+
+    if (iMicros < TIMING_SUB_BUCKETS) return (uint16_t) iMicros;
+    // shift down until iMicros lies in [TIMING_SUB_BUCKETS, 2 * TIMING_SUB_BUCKETS)
+    while (iMicros >= 2 * TIMING_SUB_BUCKETS)
+    {
+        iMicros >>= 1;
+        iOctave++;
+    }
+    iIndex = TIMING_SUB_BUCKETS * (iOctave + 1) + (iMicros - TIMING_SUB_BUCKETS);
+    if (iIndex >= TIMING_BUCKETS) iIndex = TIMING_BUCKETS - 1;
+    return (uint16_t) iIndex;
+} // end iTimingBucket()
+
+// returns the longest time counted in histogram bucket iIndex
+static uint32_t iTimingBucketTop(uint16_t iIndex)
+{
+    uint16_t iOctave;
+
+    if (iIndex < TIMING_SUB_BUCKETS) return iIndex;
+    iOctave = iIndex / TIMING_SUB_BUCKETS - 1;
+    return (((uint32_t) (TIMING_SUB_BUCKETS + iIndex % TIMING_SUB_BUCKETS + 1)) << iOctave) - 1;
+} // end iTimingBucketTop()
+
+void TimingStatReset(TimingStat *pStat)
+{
+    uint16_t i;
+
+    pStat->iCount = 0;
+    pStat->iMin = UINT32_MAX;
+    pStat->iMax = 0;
+    pStat->iSum = 0;
+    pStat->iOverruns = 0;
+    for (i = 0; i < TIMING_BUCKETS; i++) pStat->iBucket[i] = 0;
+} // end TimingStatReset()
+
+void TimingStatsReset(TimingStats *pStats, uint32_t iBudget)
+{
+    uint16_t i;
+
+    for (i = 0; i < TIMING_NUM_STAGES; i++)
+    {
+        TimingStatReset(&(pStats->stage[i]));
+        pStats->stage[i].iBudget = iBudget;
+    }
+} // end TimingStatsReset()
+
+void TimingStatAdd(TimingStat *pStat, int32_t iMicros)
+{
+    uint32_t iTime;
+    uint16_t iIndex;
+    uint16_t i;
+
+    if (iMicros < 0) return;
+    iTime = (uint32_t) iMicros;
+
+    pStat->iCount++;
+    pStat->iSum += iTime;
+    if (iTime < pStat->iMin) pStat->iMin = iTime;
+    if (iTime > pStat->iMax) pStat->iMax = iTime;
+    if (iTime > pStat->iBudget) pStat->iOverruns++;
+
+    iIndex = iTimingBucket(iTime);
+    if (pStat->iBucket[iIndex] == UINT16_MAX)
+    {
+        // age the histogram rather than let this bucket wrap
+        for (i = 0; i < TIMING_BUCKETS; i++) pStat->iBucket[i] >>= 1;
+    }
+    pStat->iBucket[iIndex]++;
+} // end TimingStatAdd()
+
+void TimingStatSummarize(const TimingStat *pStat, TimingSummary *pSummary)
+{
+    uint32_t iTotal = 0;
+    uint32_t iTarget;
+    uint32_t iRunning = 0;
+    uint16_t i;
+
+    pSummary->iCount = pStat->iCount;
+    pSummary->iOverruns = pStat->iOverruns;
+    pSummary->iBudget = pStat->iBudget;
+    if (pStat->iCount == 0)
+    {
+        pSummary->iMin = pSummary->iMax = pSummary->iMean = pSummary->iP99 = 0;
+        return;
+    }
+    pSummary->iMin = pStat->iMin;
+    pSummary->iMax = pStat->iMax;
+    pSummary->iMean = (uint32_t) (pStat->iSum / pStat->iCount);
+
+    // the 99th percentile is the top of the bucket holding the sample ranked
+    // 99% of the way up, limited to the observed range
+    for (i = 0; i < TIMING_BUCKETS; i++) iTotal += pStat->iBucket[i];
+    iTarget = iTotal - iTotal / 100;
+    for (i = 0; i < TIMING_BUCKETS - 1; i++)
+    {
+        iRunning += pStat->iBucket[i];
+        if (iRunning >= iTarget) break;
+    }
+    pSummary->iP99 = iTimingBucketTop(i);
+    if (pSummary->iP99 > pStat->iMax) pSummary->iP99 = pStat->iMax;
+    if (pSummary->iP99 < pStat->iMin) pSummary->iP99 = pStat->iMin;
+} // end TimingStatSummarize()
+
+const char *TimingStageName(timing_stage_t stage)
+{
+    if ((unsigned) stage >= TIMING_NUM_STAGES) return "unknown";
+    return sStageNames[stage];
+} // end TimingStageName()
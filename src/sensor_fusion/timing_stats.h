@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2020-2021, Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*! \file timing_stats.h
+    \brief Execution time statistics for each stage of the fusion cycle.
+
+    When F_TIMING_STATS is set in build.h, every sensor read, the three
+    process*Data() steps, the magnetic calibration slice, each fusion algorithm,
+    packet creation and serial output record their execution time (in us) into
+    a TimingStat. Two further stages count rather than time: the sweeps of the
+    eigen-decomposition and the time slices taken by each magnetic calibration.
+    Each TimingStat keeps the count, min, max and sum of its samples, the
+    number of samples that exceeded a budget, and a fixed-bucket histogram from
+    which a 99th percentile is estimated. Adding a sample costs a handful of
+    integer operations and no floating point.
+
+    The histogram is log-linear: values below TIMING_SUB_BUCKETS us each have
+    their own bucket, and every power of two above that is split into
+    TIMING_SUB_BUCKETS equal buckets, so the percentile is accurate to within
+    1/TIMING_SUB_BUCKETS (25%) of the value. Values too long for the last
+    bucket are counted in it. When a bucket is about to overflow, all buckets
+    are halved, so the histogram keeps its shape while ageing old samples.
+
+    With F_TIMING_STATS set to 0x0000 the TIMING_* macros compile to nothing.
+*/
+
+#ifndef TIMING_STATS_H
+#define TIMING_STATS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "build.h"
+
+/// @name Timing Histogram Dimensions
+///@{
+#define TIMING_SUB_BUCKETS  4       ///< buckets per power of two
+#define TIMING_BUCKETS      64      ///< covers 0 to 131 ms
+#define TIMING_MAX_SENSORS  4       ///< sensors individually timed (the first in the sensor list)
+///@}
+
+/// Stages of the fusion cycle that are timed. Sensor reads are numbered by
+/// their position in the sfg->pSensors list, which is the reverse of the
+/// order in which they were installed.
+typedef enum timing_stage {
+    TIMING_SENSOR_READ_0,       ///< read() of the first sensor in the list
+    TIMING_SENSOR_READ_1,
+    TIMING_SENSOR_READ_2,
+    TIMING_SENSOR_READ_3,
+    TIMING_READ_SENSORS,        ///< all of readSensors(), also kept in sfg->systick_I2C
+    TIMING_PROCESS_ACCEL,       ///< processAccelData()
+    TIMING_PROCESS_MAG,         ///< processMagData(), including the calibration slices
+    TIMING_PROCESS_GYRO,        ///< processGyroData()
+    TIMING_MAG_CAL,             ///< one slice of fRunMagCalibration()
+    TIMING_FUSE_1DOF_P_BASIC,   ///< fRun_1DOF_P_BASIC(), from the algorithm systick
+    TIMING_FUSE_3DOF_G_BASIC,
+    TIMING_FUSE_3DOF_B_BASIC,
+    TIMING_FUSE_3DOF_Y_BASIC,
+    TIMING_FUSE_6DOF_GB_BASIC,
+    TIMING_FUSE_6DOF_GY_KALMAN,
+    TIMING_FUSE_9DOF_GBY_KALMAN,
+    TIMING_CREATE_PACKETS,      ///< CreateOutgoingPackets() when not throttled
+    TIMING_SEND_SERIAL,         ///< SendSerialBytesOut()
+    TIMING_CYCLE,               ///< SensorFusion::ReadSensors() through RunFusion()
+    TIMING_MAG_CAL_SWEEPS,      ///< eigen-decomposition sweeps of each 7 or 10 element calibration (a count, not us)
+    TIMING_MAG_CAL_SLICES,      ///< time slices of each magnetic calibration (a count, not us)
+    TIMING_NUM_STAGES
+} timing_stage_t;
+
+/// Statistics for one stage. All times are in microseconds.
+typedef struct TimingStat {
+    uint32_t iCount;                    ///< number of samples since the last reset
+    uint32_t iMin;                      ///< shortest sample
+    uint32_t iMax;                      ///< longest sample
+    uint64_t iSum;                      ///< sum of all samples, for the mean
+    uint32_t iOverruns;                 ///< number of samples longer than iBudget
+    uint32_t iBudget;                   ///< overrun threshold
+    uint16_t iBucket[TIMING_BUCKETS];   ///< histogram
+} TimingStat;
+
+/// Statistics for every stage, as kept in SensorFusionGlobals.
+typedef struct TimingStats {
+    TimingStat stage[TIMING_NUM_STAGES];
+} TimingStats;
+
+/// Condensed form of a TimingStat, as returned to the application.
+typedef struct TimingSummary {
+    uint32_t iCount;                    ///< number of samples
+    uint32_t iMin;                      ///< shortest (us)
+    uint32_t iMax;                      ///< longest (us)
+    uint32_t iMean;                     ///< mean (us)
+    uint32_t iP99;                      ///< 99th percentile estimate (us)
+    uint32_t iOverruns;                 ///< samples longer than iBudget
+    uint32_t iBudget;                   ///< overrun threshold (us)
+} TimingSummary;
+
+/// Clears all stages, and sets every overrun threshold to iBudget us.
+void TimingStatsReset(TimingStats *pStats, uint32_t iBudget);
+/// Clears one stage, keeping its overrun threshold.
+void TimingStatReset(TimingStat *pStat);
+/// Records one execution time. Negative values (clock wrap) are ignored.
+void TimingStatAdd(TimingStat *pStat, int32_t iMicros);
+/// Fills pSummary from pStat. All fields are 0 if no samples have been taken.
+void TimingStatSummarize(const TimingStat *pStat, TimingSummary *pSummary);
+/// Returns a short printable name for the stage.
+const char *TimingStageName(timing_stage_t stage);
+
+/// @name Instrumentation Macros
+/// Use as:
+///   int32_t start;
+///   TIMING_START(start);
+///   ...work...
+///   TIMING_STOP(sfg, TIMING_PROCESS_MAG, start);
+/// hal_timer.h must be included where TIMING_START and TIMING_STOP are used.
+///@{
+#if F_TIMING_STATS
+#define TIMING_START(start)             SystickStartCount(&(start))
+#define TIMING_STOP(sfg, id, start)     \
+    TimingStatAdd(&((sfg)->Timing.stage[(id)]), SystickElapsedMicros(start))
+#define TIMING_ADD(sfg, id, micros)     TimingStatAdd(&((sfg)->Timing.stage[(id)]), (micros))
+#else
+#define TIMING_START(start)             ((void)(start))
+#define TIMING_STOP(sfg, id, start)     ((void)(start))
+#define TIMING_ADD(sfg, id, micros)     ((void)0)
+#endif
+///@}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TIMING_STATS_H
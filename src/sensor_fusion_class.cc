@@ -25,12 +25,21 @@
 
 #include "sensor_fusion_class.h"
 
+#ifdef SENSOR_FUSION_HOST
+#include "sensor_fusion/hal_host.h"  // provides Stream on host builds
+#else
 #include <Stream.h>
+#endif
 #include <stdint.h>
 
 #include "sensor_fusion/sensor_fusion.h"
 #include "sensor_fusion/control.h"
 #include "sensor_fusion/driver_sensors.h"
+#include "sensor_fusion/fusion.h"
+#include "sensor_fusion/fusion_snapshot.h"
+#include "sensor_fusion/hal_timer.h"
+#include "sensor_fusion/sensor_log.h"
+#include "sensor_fusion/sensor_pipeline.h"
 #include "sensor_fusion/status.h"
 
 const float kDegToRads = PI / 180.0;   ///< To convert Degrees to Radians, multiply by this constant.
@@ -56,6 +65,8 @@ SensorFusion::SensorFusion() {
   InitializeInputOutputSubsystem();
   InitializeStatusSubsystem();
   InitializeSensorFusionGlobals();
+  FusionSnapshotReset(&snapshot_latch_);
+  OrientationHistoryReset(&history_, 2 * 1000000 / FUSION_HZ);
 
 }  // end SensorFusion()
 
@@ -123,6 +134,27 @@ bool SensorFusion::InstallSensor(uint8_t sensor_i2c_addr,
   return true;
 }  // end InstallSensor()
 
+/**
+ * @brief Install a raw sensor log as the source of all sensor readings
+ * Used instead of InstallSensor(), this feeds previously recorded data
+ * (see GetSensorLogRecord()) through the unchanged fusion, one log record
+ * per ReadSensors() call, as fast as the caller cares to go.
+ * @param replay describes where the log bytes come from. It must remain
+ * valid while the sensor is installed.
+ * @return True if the replay sensor was installed, else False
+ */
+bool SensorFusion::InstallReplaySensor(SensorLogReplay *replay) {
+  if (num_sensors_installed_ >= MAX_NUM_SENSORS) {
+    return false;
+  }
+  if (SensorLogInstallReplay(sfg_, &sensors_[num_sensors_installed_], replay) !=
+      SENSOR_ERROR_NONE) {
+    return false;
+  }
+  ++num_sensors_installed_;
+  return true;
+}  // end InstallReplaySensor()
+
 /**
  * Initialize the Control subsystem, which receives external commands and sends
  * data packets.
@@ -150,6 +182,95 @@ void SensorFusion::Begin(int pin_i2c_sda, int pin_i2c_scl) {
 
 }  // end InitializeFusionEngine()
 
+/**
+ * @brief Switch to pipelined mode, in which the sensors are read by one task
+ * and fused by another (see sensor_pipeline.h).
+ * Call once, after Begin() and before either task starts. From then on, call
+ * ReadSensors() only from the reader task, at LOOP_RATE_HZ, and RunFusion()
+ * and all other methods only from the fusion task (GetOrientationSnapshot()
+ * and GetPipelineStats() excepted). Each ReadSensors() reads the sensors due
+ * in that loop (see kLoopsPerMagRead, etc.) and queues one batch of samples;
+ * each RunFusion() fuses the oldest waiting batch, or returns at once if there
+ * is none. On an ESP32 put the two tasks on different cores, so that the I2C
+ * transfers overlap the fusion.
+ * @return True if pipelined mode is on, False if memory could not be allocated
+ */
+bool SensorFusion::EnablePipelinedReads(void) {
+  if (pipeline_ != NULL) {
+    return true;
+  }
+  capture_sfg_ = new SensorFusionGlobals();
+  pipeline_ = new SensorPipeline();
+  if (capture_sfg_ == NULL || pipeline_ == NULL) {
+    delete capture_sfg_;
+    delete pipeline_;
+    capture_sfg_ = NULL;
+    pipeline_ = NULL;
+    return false;
+  }
+  SensorPipelineInit(pipeline_, sfg_, capture_sfg_, kLoopsPerFusionCalc,
+                     loops_per_fuse_counter_);
+  return true;
+}  // end EnablePipelinedReads()
+
+/**
+ * @brief Get the counters of the pipelined mode. May be called from any task.
+ * A non-zero overrun count means the fusion task fell more than
+ * SENSOR_PIPELINE_DEPTH cycles behind the reader task, and sensor readings
+ * were discarded.
+ * @param stats filled with the numbers of batches produced, consumed and
+ * discarded, and the deepest the ring has been
+ * @return False if pipelined mode is not enabled
+ */
+bool SensorFusion::GetPipelineStats(SensorPipelineStats *stats) {
+  if (pipeline_ == NULL) {
+    return false;
+  }
+  SensorPipelineGetStats(pipeline_, stats);
+  return true;
+}  // end GetPipelineStats()
+
+/**
+ * @brief Solve the magnetic calibrations in a worker task rather than in time
+ * slices of RunFusion() (see mag_cal_worker.h).
+ * Call once, after Begin() and before the worker task starts. The worker task
+ * then calls RunBackgroundMagCalibration() repeatedly, waiting a while
+ * whenever it returns false. Give it a lower priority than the fusion task
+ * and, on an ESP32, the other core. RunFusion() hands each calibration to it
+ * and applies the result at the start of a later cycle, and calibrations are
+ * tried every BACKGROUND_CAL_INTERVAL_SECS rather than CAL_INTERVAL_SECS.
+ * @return True if the worker is attached, False if memory could not be
+ * allocated or the build has no magnetometer
+ */
+bool SensorFusion::EnableBackgroundMagCalibration(void) {
+#if F_USING_MAG
+  if (mag_cal_worker_ != NULL) {
+    return true;
+  }
+  mag_cal_worker_ = new MagCalWorker();
+  if (mag_cal_worker_ == NULL) {
+    return false;
+  }
+  MagCalWorkerInit(mag_cal_worker_);
+  sfg_->MagCal.pWorker = mag_cal_worker_;
+  return true;
+#else
+  return false;
+#endif
+}  // end EnableBackgroundMagCalibration()
+
+/**
+ * @brief Solve the magnetic calibration handed over by RunFusion(), if any.
+ * Call only from the worker task, after EnableBackgroundMagCalibration().
+ * @return True if a calibration was solved, False at once if none was waiting
+ */
+bool SensorFusion::RunBackgroundMagCalibration(void) {
+  if (mag_cal_worker_ == NULL) {
+    return false;
+  }
+  return MagCalWorkerRun(mag_cal_worker_);
+}  // end RunBackgroundMagCalibration()
+
 /**
  * @brief Update the TCP client pointer.
  * Call when a new TCP connection is made, as reported by WiFiServer::available()
@@ -169,6 +290,11 @@ void SensorFusion::UpdateWiFiStream(void *tcp_client) {
  * See kLoopsPerMagRead, etc., in sensor_fusion_class.h
  */
 void SensorFusion::ReadSensors(void) {
+  if (pipeline_ != NULL) {
+    SensorPipelineProduce(pipeline_);  // overruns are counted in the pipeline
+    return;
+  }
+  SystickStartCount(&cycle_start_ticks_);
   sfg_->readSensors(
       sfg_,
       loops_per_fuse_counter_);  // Reads sensors, applies HAL, removes -32768
@@ -180,14 +306,32 @@ void SensorFusion::ReadSensors(void) {
  * Sensor readings contained in global struct are calibrated and processed.
  * Status is updated and displayed.
  * Loop counter used for coordinating sensor reads is reset.
+ * In pipelined mode the readings are taken from the oldest waiting batch, and
+ * the cycle time (TIMING_CYCLE) runs from the start of that batch's reads.
  * 
  */
 void SensorFusion::RunFusion(void) {
   // applies fusion algorithm to data accumulated in buffers
 
+  if (pipeline_ != NULL) {
+    // fetch the readings of the next ReadSensors() from the reader task
+    uint32_t read_start_ticks;
+    if (!SensorPipelineConsume(pipeline_, sfg_, &read_start_ticks)) {
+      return;
+    }
+    cycle_start_ticks_ = (int32_t)read_start_ticks;
+  }
+
   // only run fusion every kLoopsPerFusionCalc'th time through loop
   if (loops_per_fuse_counter_ < kLoopsPerFusionCalc) {
     ++loops_per_fuse_counter_;
+#if F_9DOF_GBY_KALMAN
+    // in between fusions, bring the orientation up to date from the gyro alone
+    if (kLoopsPerFusionCalc > 1 && sfg_->loopcounter > 0) {
+      fPredict_9DOF_GBY_KALMAN(&sfg_->SV_9DOF_GBY_KALMAN, &sfg_->Gyro);
+      PublishSnapshot();
+    }
+#endif
     return;
   }
 
@@ -203,15 +347,112 @@ void SensorFusion::RunFusion(void) {
   if (0 == sfg_->loopcounter % 4) {
     sfg_->updateStatus(sfg_);  // make pending status updates visible
   }
+  PublishSnapshot();  // make this cycle's results visible to other tasks
 
   // assume NORMAL status next pass through the loop
   // this resets temporary error conditions (SOFT_FAULT)
   sfg_->queueStatus(sfg_, NORMAL);
 
+  // time from the last sensor read to here, and what remains of the loop period
+  int32_t cycle_micros = SystickElapsedMicros(cycle_start_ticks_);
+  sfg_->systick_Spare = (1000000 / LOOP_RATE_HZ) - cycle_micros;
+  TIMING_ADD(sfg_, TIMING_CYCLE, cycle_micros);
+
   loops_per_fuse_counter_ = 1;  // reset loop counter
 
 }  // end RunFusion()
 
+/**
+ * @brief Fill buffer with the header of a raw sensor log.
+ * Call once after Begin(), and store the bytes ahead of the log records.
+ * @param buffer must hold SENSOR_LOG_HEADER_BYTES
+ * @return number of bytes placed in buffer
+ */
+uint16_t SensorFusion::GetSensorLogHeader(uint8_t *buffer) {
+  return SensorLogEncodeHeader(sfg_, buffer);
+}  // end GetSensorLogHeader()
+
+/**
+ * @brief Fill buffer with one raw sensor log record.
+ * The record holds the sensor readings gathered since the last fusion, so
+ * call it just before each RunFusion() that will fuse (with the default
+ * kLoopsPerFusionCalc of 1, that is every pass).
+ * @param buffer must hold SENSOR_LOG_MAX_RECORD_BYTES
+ * @return number of bytes placed in buffer
+ */
+uint16_t SensorFusion::GetSensorLogRecord(uint8_t *buffer) {
+  int32_t timestamp;
+  SystickStartCount(&timestamp);
+  return SensorLogEncodeRecord(sfg_, (uint32_t)timestamp, buffer);
+}  // end GetSensorLogRecord()
+
+/**
+ * @brief Get execution time statistics for one stage of the fusion cycle.
+ * Requires F_TIMING_STATS in build.h. All times are in microseconds, but
+ * TIMING_MAG_CAL_SWEEPS and TIMING_MAG_CAL_SLICES are counts.
+ * The same statistics are streamed in Toolbox packet type 9 after the
+ * command "TM+ " is received.
+ * @param stage which stage, e.g. TIMING_FUSE_9DOF_GBY_KALMAN or TIMING_CYCLE
+ * @param summary filled with count, min, max, mean, p99 and overrun count
+ * @return false if timing statistics are not compiled in, or stage is invalid
+ */
+bool SensorFusion::GetTimingStats(timing_stage_t stage, TimingSummary *summary) {
+#if F_TIMING_STATS
+  if ((unsigned)stage < TIMING_NUM_STAGES) {
+    TimingStatSummarize(&(sfg_->Timing.stage[stage]), summary);
+    return true;
+  }
+#else
+  (void)stage;
+  (void)summary;
+#endif
+  return false;
+}  // end GetTimingStats()
+
+/**
+ * @brief Discard all execution time statistics, keeping the overrun budgets.
+ */
+void SensorFusion::ResetTimingStats(void) {
+#if F_TIMING_STATS
+  for (int i = 0; i < TIMING_NUM_STAGES; i++) {
+    TimingStatReset(&(sfg_->Timing.stage[i]));
+  }
+#endif
+}  // end ResetTimingStats()
+
+/**
+ * @brief Set the time above which an execution of a stage counts as an overrun.
+ * The default for every stage is one fusion period, 1000000 / FUSION_HZ us.
+ * @param stage which stage
+ * @param budget_micros overrun threshold in microseconds
+ */
+void SensorFusion::SetTimingBudget(timing_stage_t stage, uint32_t budget_micros) {
+#if F_TIMING_STATS
+  if ((unsigned)stage < TIMING_NUM_STAGES) {
+    sfg_->Timing.stage[stage].iBudget = budget_micros;
+  }
+#else
+  (void)stage;
+  (void)budget_micros;
+#endif
+}  // end SetTimingBudget()
+
+/**
+ * @brief Set the time each fusion cycle may spend on the magnetic calibration.
+ * One time slice of a calibration in progress always runs, and further
+ * slices run while the next is expected to fit in the budget, so a
+ * calibration completes in fewer cycles when the loop has time to spare.
+ * The default is MAG_CAL_BUDGET_MICROS in build.h.
+ * @param budget_micros time per fusion cycle in microseconds, 0 for one slice
+ */
+void SensorFusion::SetMagCalibrationBudget(uint32_t budget_micros) {
+#if F_USING_MAG
+  sfg_->iMagCalBudgetMicros = (int32_t)budget_micros;
+#else
+  (void)budget_micros;
+#endif
+}  // end SetMagCalibrationBudget()
+
 /**
  * @brief Generate and send out data, formatted for NXP Orientation Sensor Toolbox.
  * It is not mandatory to call this routine, if Toolbox output is not needed.
@@ -290,6 +531,13 @@ void SensorFusion::InjectCommand(const char *command) {
  * then these new parameters replace the current ones in RAM.
  * However, it is only via this command that the parameters can be
  * caused to persist beyond the next system reset.
+ *
+ * With F_MAG_BUFFER_SNAPSHOT in build.h, the readings in the magnetic
+ * buffer are saved as well, and restored when the system starts, so
+ * that calibration resumes at once rather than once the buffer has
+ * refilled. If the readings taken in the first MAGSNAPSHOTCHECKSECS
+ * after the start no longer fit the saved calibration, the restored
+ * readings are discarded (see calibration_storage.cc).
  */
 void SensorFusion::SaveMagneticCalibration(void) {
   InjectCommand("SVMC");
@@ -344,9 +592,9 @@ int SensorFusion::GetSystemStatus(void) {
  */
 float SensorFusion::GetHeadingDegrees(void) {
   // TODO - make generic so it's not dependent on algorithm used
-  return (sfg_->SV_9DOF_GBY_KALMAN.fRhoPl <= 90)
-             ? (sfg_->SV_9DOF_GBY_KALMAN.fRhoPl + 270.0)
-             : (sfg_->SV_9DOF_GBY_KALMAN.fRhoPl - 90.0);
+  return (sfg_->SV_9DOF_GBY_KALMAN.fRhoPr <= 90)
+             ? (sfg_->SV_9DOF_GBY_KALMAN.fRhoPr + 270.0)
+             : (sfg_->SV_9DOF_GBY_KALMAN.fRhoPr - 90.0);
 }  // end GetHeadingDegrees()
 
 /**
@@ -360,7 +608,7 @@ float SensorFusion::GetHeadingRadians(void) {
  * @brief @return Return the Pitch in degrees
  */
 float SensorFusion::GetPitchDegrees(void) {
-  return sfg_->SV_9DOF_GBY_KALMAN.fPhiPl;
+  return sfg_->SV_9DOF_GBY_KALMAN.fPhiPr;
 }  // end GetPitchDegrees()
 
 /**
@@ -374,7 +622,7 @@ float SensorFusion::GetPitchRadians(void) {
  * @brief @return Return the Roll in degrees
  */
 float SensorFusion::GetRollDegrees(void) {
-  return -(sfg_->SV_9DOF_GBY_KALMAN.fThePl);
+  return -(sfg_->SV_9DOF_GBY_KALMAN.fThePr);
 }  // end GetRollDegrees()
 
 /**
@@ -410,7 +658,7 @@ float SensorFusion::GetTemperatureK(void) {
  * @brief @return Return the Turn Rate in degrees
  */
 float SensorFusion::GetTurnRateDegPerS(void) {
-  return sfg_->SV_9DOF_GBY_KALMAN.fOmega[2];
+  return sfg_->SV_9DOF_GBY_KALMAN.fOmegaPr[2];
 }  // end GetTurnRateDegPerS()
 
 /**
@@ -424,7 +672,7 @@ float SensorFusion::GetTurnRateRadPerS(void) {
  * @brief @return Return the Pitch Rate in degrees/s
  */
 float SensorFusion::GetPitchRateDegPerS(void) {
-  return sfg_->SV_9DOF_GBY_KALMAN.fOmega[0];
+  return sfg_->SV_9DOF_GBY_KALMAN.fOmegaPr[0];
 }  // end GetPitchRateDegPerS()
 
 /**
@@ -438,7 +686,7 @@ float SensorFusion::GetPitchRateRadPerS(void) {
  * @brief @return Return the Roll Rate in degrees/s
  */
 float SensorFusion::GetRollRateDegPerS(void) {
-  return -(sfg_->SV_9DOF_GBY_KALMAN.fOmega[1]);
+  return -(sfg_->SV_9DOF_GBY_KALMAN.fOmegaPr[1]);
 }  // end GetRollRateDegPerS()
 
 /**
@@ -493,14 +741,53 @@ float SensorFusion::GetAccelZMPerSS(void) {
 /**
  * @brief Return the orientation as a quaternion
  * @param quat pointer to quaternion structure, to be filled by this method
+ *
+ * Like the angle and rate getters, this returns the gyro-predicted
+ * orientation, which equals the Kalman filter result just after each
+ * fusion and is updated from the gyro on the reads in between.
  */
 void  SensorFusion::GetOrientationQuaternion(Quaternion *quat) {
-  quat->q0 = sfg_->SV_9DOF_GBY_KALMAN.fqPl.q0;
-  quat->q1 = sfg_->SV_9DOF_GBY_KALMAN.fqPl.q1;
-  quat->q2 = sfg_->SV_9DOF_GBY_KALMAN.fqPl.q2;
-  quat->q3 = sfg_->SV_9DOF_GBY_KALMAN.fqPl.q3;
+  quat->q0 = sfg_->SV_9DOF_GBY_KALMAN.fqPr.q0;
+  quat->q1 = sfg_->SV_9DOF_GBY_KALMAN.fqPr.q1;
+  quat->q2 = sfg_->SV_9DOF_GBY_KALMAN.fqPr.q2;
+  quat->q3 = sfg_->SV_9DOF_GBY_KALMAN.fqPr.q3;
 }  // end GetOrientationQuaternion()
 
+/**
+ * @brief Get the orientation at a given time, rather than at the latest read
+ * Useful to line the orientation up with a GPS fix or a camera frame. Within
+ * the last ORIENTATION_HISTORY_SIZE results the orientation is interpolated;
+ * up to two fusion periods after the latest result it is extrapolated at the
+ * latest angular velocity (see orientation_history.h).
+ * Each result is stamped with the time the gyro FIFO was read; the newest
+ * gyro measurement it was rotated by may be up to 1/GYRO_ODR_HZ older.
+ * The history is not synchronized: call this only from the task that runs
+ * RunFusion(). Other tasks can use GetOrientationSnapshot(), whose
+ * iTimestamp is that of the same result.
+ * @param micros time of interest, on the micros() clock
+ * @param quat pointer to quaternion structure, to be filled by this method
+ * with the orientation at micros, or the nearest available estimate
+ * @return True if micros lies within the history or the extrapolation limit
+ */
+bool SensorFusion::GetOrientationAt(uint32_t micros, Quaternion *quat) {
+  return OrientationHistoryQuery(&history_, micros, quat) >= 0;
+}  // end GetOrientationAt()
+
+/**
+ * @brief Get a consistent copy of the results of the latest fusion cycle.
+ * Unlike the individual Get____() methods, this may be called from any task
+ * or core while the fusion loop runs: all fields come from the same cycle.
+ * It never blocks RunFusion(). Values follow the same conventions as the
+ * Get____() methods (see fusion_snapshot.h).
+ * @param snapshot filled with the latest results
+ * @return number of cycles published so far; 0 (and snapshot zeroed) before
+ * the first. A caller can compare it with the previous value to tell
+ * whether the snapshot is new.
+ */
+uint32_t SensorFusion::GetOrientationSnapshot(FusionSnapshot *snapshot) {
+  return FusionSnapshotRead(&snapshot_latch_, snapshot);
+}  // end GetOrientationSnapshot()
+
 /**
  * @brief @return Return magnetic fit error of trial calibration
  * 
@@ -618,6 +905,27 @@ float SensorFusion::GetMagneticCalSolver(void) {
   return (float)(sfg_->MagCal.iValidMagCal);
 }  // end GetMagneticCalSolver()
 
+/**
+ * @brief @return Return number of magnetic calibrations solved since Begin()
+ *
+ * Every calibration that a solver completes is counted, whether or not it
+ * was accepted in place of the current one.
+ */
+uint32_t SensorFusion::GetMagneticCalCount(void) {
+  return sfg_->MagCal.iCalsSolved;
+}  // end GetMagneticCalCount()
+
+/**
+ * @brief @return Return number of readings in the magnetic calibration buffer
+ *
+ * The 4, 7 and 10 element solvers are first tried once the buffer holds
+ * 110, 220 and 330 readings, out of at most 360. When restored from the
+ * snapshot saved by SaveMagneticCalibration(), the buffer is full at start up.
+ */
+int SensorFusion::GetMagneticBufferCount(void) {
+  return sfg_->MagBuffer.iMagBufferCount;
+}  // end GetMagneticBufferCount()
+
 //================= end of Get____() methods ==================
 //================= start of private methods ==================
 
@@ -638,3 +946,38 @@ void SensorFusion::InitializeSensorFusionGlobals(void) {
   initSensorFusionGlobals(sfg_, status_subsystem_, control_subsystem_);
 
 }  // end InitializeSensorFusionGlobals()
+
+/**
+ * @brief Publish the results of the fusion cycle just run, for
+ * GetOrientationSnapshot(), and add the orientation to the history for
+ * GetOrientationAt(). Called from RunFusion().
+ */
+void SensorFusion::PublishSnapshot(void) {
+  FusionSnapshot snapshot;
+
+  GetOrientationQuaternion(&snapshot.fqPl);
+  snapshot.fHeadingDeg = GetHeadingDegrees();
+  snapshot.fPitchDeg = GetPitchDegrees();
+  snapshot.fRollDeg = GetRollDegrees();
+  snapshot.fTurnRateDegPerS = GetTurnRateDegPerS();
+  snapshot.fPitchRateDegPerS = GetPitchRateDegPerS();
+  snapshot.fRollRateDegPerS = GetRollRateDegPerS();
+  snapshot.fAccelGees[0] = GetAccelXGees();
+  snapshot.fAccelGees[1] = GetAccelYGees();
+  snapshot.fAccelGees[2] = GetAccelZGees();
+#if F_USING_GYRO
+  // the orientation was last rotated by the newest gyro measurement, not at the start of the cycle
+  snapshot.iTimestamp = sfg_->Gyro.iReadTimestamp;
+#else
+  snapshot.iTimestamp = (uint32_t)cycle_start_ticks_;
+#endif
+  snapshot.iLoopcounter = sfg_->loopcounter;
+  snapshot.iStatus = GetSystemStatus();
+  snapshot.iValid = IsDataValid() ? 1 : 0;
+  FusionSnapshotPublish(&snapshot_latch_, &snapshot);
+
+  if (!sfg_->SV_9DOF_GBY_KALMAN.resetflag) {
+    OrientationHistoryAdd(&history_, snapshot.iTimestamp, &snapshot.fqPl,
+                          sfg_->SV_9DOF_GBY_KALMAN.fOmegaPr);
+  }
+}  // end PublishSnapshot()
@@ -14,12 +14,21 @@
 #ifndef SENSOR_FUSION_CLASS_H_
 #define SENSOR_FUSION_CLASS_H_
 
+#ifdef SENSOR_FUSION_HOST
+#include "sensor_fusion/hal_host.h"  // provides Stream on host builds
+#else
 #include <Stream.h>
+#endif
 
 #include "board.h"
 #include "build.h"
 #include "sensor_fusion/sensor_fusion.h"
 #include "sensor_fusion/control.h"
+#include "sensor_fusion/fusion_snapshot.h"
+#include "sensor_fusion/mag_cal_worker.h"
+#include "sensor_fusion/orientation_history.h"
+#include "sensor_fusion/sensor_log.h"
+#include "sensor_fusion/sensor_pipeline.h"
 #include "sensor_fusion/status.h"
 
 /**
@@ -42,17 +51,32 @@ enum class SensorType {
  *  sensor fusion code into easier to use methods. Not all the
  *  lower-level functions are exposed however; for more advanced
  *  use it will be necessary to call them directly.
+ *
+ *  The Get____() methods read the fusion structures directly, so call
+ *  them from the task that runs the fusion loop. Other tasks, including
+ *  those on the other ESP32 core, should use GetOrientationSnapshot().
  */
 class SensorFusion {
  public:
   SensorFusion();
   bool InstallSensor(uint8_t sensor_i2c_addr, SensorType sensor_type);
+  bool InstallReplaySensor(SensorLogReplay *replay);
   bool InitializeInputOutputSubsystem(const Stream *serial_port = NULL,
                                       const void *tcp_client = NULL);
   void Begin(int pin_i2c_sda = -1, int pin_i2c_scl = -1);
+  bool EnablePipelinedReads(void);
+  bool GetPipelineStats(SensorPipelineStats *stats);
+  bool EnableBackgroundMagCalibration(void);
+  bool RunBackgroundMagCalibration(void);
   void UpdateWiFiStream(void *tcp_client);
   void ReadSensors(void);
   void RunFusion(void);
+  uint16_t GetSensorLogHeader(uint8_t *buffer);
+  uint16_t GetSensorLogRecord(uint8_t *buffer);
+  bool GetTimingStats(timing_stage_t stage, TimingSummary *summary);
+  void ResetTimingStats(void);
+  void SetTimingBudget(timing_stage_t stage, uint32_t budget_micros);
+  void SetMagCalibrationBudget(uint32_t budget_micros);
   void ProduceToolboxOutput(void);
   bool SendArbitraryData(const char *buffer, uint16_t data_length);
   void ProcessCommands(void);
@@ -81,6 +105,8 @@ class SensorFusion {
   float GetTemperatureC(void);
   float GetTemperatureK(void);
   void  GetOrientationQuaternion(Quaternion *quat);
+  bool GetOrientationAt(uint32_t micros, Quaternion *quat);
+  uint32_t GetOrientationSnapshot(FusionSnapshot *snapshot);
   float GetMagneticFitError(void);
   float GetMagneticFitErrorTrial(void);
   float GetMagneticBMag(void);
@@ -89,16 +115,24 @@ class SensorFusion {
   float GetMagneticInclinationRad(void);
   float GetMagneticNoiseCovariance(void);
   float GetMagneticCalSolver(void);
+  uint32_t GetMagneticCalCount(void);
+  int GetMagneticBufferCount(void);
 
  private:
   void InitializeStatusSubsystem(void);
   void InitializeSensorFusionGlobals(void);
+  void PublishSnapshot(void);
 
   SensorFusionGlobals *sfg_;  ///< Primary sensor fusion data structure
   ControlSubsystem
       *control_subsystem_;             ///< command and data streaming structure
   StatusSubsystem *status_subsystem_;  ///< visual status indicator structure
   PhysicalSensor *sensors_;            ///< linked list of up to 4 sensors
+  FusionSnapshotLatch snapshot_latch_; ///< results published for other tasks
+  OrientationHistory history_;         ///< recent orientations, for GetOrientationAt()
+  SensorPipeline *pipeline_ = NULL;    ///< ring of sensor batches, if pipelined
+  SensorFusionGlobals *capture_sfg_ = NULL;  ///< reader task's copy of sfg_
+  MagCalWorker *mag_cal_worker_ = NULL;  ///< background magnetic calibration solver, if enabled
   uint8_t num_sensors_installed_ =
       0;  ///< tracks how many sensors have been added to list
 
@@ -108,7 +142,10 @@ class SensorFusion {
    * Normally there is a 1:1 relationship (i.e. read, fuse, read, fuse,...)
    * but other arrangements are possible (e.g. read, read, fuse, read,
    * read,...) The rate at which main loop() executes is set by
-   * LOOP_RATE_HZ in build.h
+   * LOOP_RATE_HZ in build.h, and the fusion runs at FUSION_HZ. When
+   * LOOP_RATE_HZ is a multiple of FUSION_HZ, the reads in between fusions
+   * update the gyro-predicted orientation (see fPredict_9DOF_GBY_KALMAN()),
+   * so the Get____() methods and snapshot follow at LOOP_RATE_HZ.
    */
   const uint8_t kLoopsPerMagRead =
       1;  ///< how often a magnetometer read is performed
@@ -118,10 +155,14 @@ class SensorFusion {
       1;  ///< how often an accelerometer read is performed
   const uint8_t kLoopsPerGyroRead =
       1;  ///< how often a gyroscope read is performed
+  static_assert(LOOP_RATE_HZ >= FUSION_HZ && LOOP_RATE_HZ % FUSION_HZ == 0,
+                "LOOP_RATE_HZ in build.h must be a multiple of FUSION_HZ");
   const uint8_t kLoopsPerFusionCalc =
-      1;  ///< how often to fuse. Usually the max of previous 3 constants.
+      LOOP_RATE_HZ / FUSION_HZ;  ///< how often to fuse. At least the max of previous 3 constants.
   uint8_t loops_per_fuse_counter_ =
       0;  ///< counts how many times through loop have been done
+  int32_t cycle_start_ticks_ =
+      0;  ///< systick at the start of ReadSensors(), for the cycle time
 
 };  // end SensorFusion
 
@@ -0,0 +1,512 @@
+/**
+ * Copyright (c) 2020-2021 Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+/**
+ * @file sensor_fusion_template.h
+ *
+ * Compile-time configured wrapper for the NXP Sensor Fusion v7 functions.
+ *
+ * sensor_fusion::SensorFusion<Algorithms, CoordSystem, SensorSet> is a lean
+ * alternative to the SensorFusion class for firmware that knows its
+ * configuration when it is compiled. The class runs every algorithm enabled
+ * in build.h through the function pointers in SensorFusionGlobals; this
+ * template calls the sensor read, conditioning and the listed fusion
+ * algorithms directly, so the calls are inlined, and algorithms compiled in
+ * but not listed are never run. Instances with different algorithm lists,
+ * output frames or sensors can coexist in one firmware, for example
+ *
+ *   using Imu = sensor_fusion::Fxos8700Fxas21002<0x1F, 0x21>;
+ *   sensor_fusion::SensorFusion<sensor_fusion::FusionAlgorithms<
+ *       sensor_fusion::Kalman9Dof>, sensor_fusion::Ned, Imu> ned_fusion;
+ *   sensor_fusion::SensorFusion<sensor_fusion::FusionAlgorithms<
+ *       sensor_fusion::Kalman9Dof>, sensor_fusion::Enu, Imu> enu_fusion;
+ *
+ * The fusion kernels themselves are compiled once, for the algorithms and the
+ * THISCOORDSYSTEM selected in build.h, and the state of every algorithm
+ * enabled there stays in SensorFusionGlobals; disable an algorithm in build.h
+ * to remove its code and RAM altogether. The kernels run in NED, and the
+ * CoordSystem only chooses the frame in which the results are returned.
+ *
+ * The SensorFusion class remains the full-featured interface: the Toolbox
+ * output, commands, pipelined reads, snapshots and history are only there.
+ */
+
+#ifndef SENSOR_FUSION_TEMPLATE_H_
+#define SENSOR_FUSION_TEMPLATE_H_
+
+#include <math.h>
+#include <stdint.h>
+
+#include "board.h"
+#include "build.h"
+#include "sensor_fusion/sensor_fusion.h"
+#include "sensor_fusion/control.h"
+#include "sensor_fusion/driver_sensors.h"
+#include "sensor_fusion/fusion.h"
+#include "sensor_fusion/hal_timer.h"
+#include "sensor_fusion/sensor_log.h"
+#include "sensor_fusion/status.h"
+
+namespace sensor_fusion {
+
+/**
+ * @name Algorithms
+ * Each fusion algorithm enabled in build.h has a policy that runs it and
+ * reads its results. Run() times the algorithm into its TIMING_FUSE_ stage as
+ * runFusion() does. Predict() brings the orientation up to date from the gyro
+ * between fusions, where the algorithm can. Orientation() and
+ * AngularVelocityDegPerS() are in the sensor frame and NED global frame.
+ */
+///@{
+#if F_1DOF_P_BASIC
+/// 1DOF pressure (altitude) and temperature; has no orientation.
+struct Pressure1Dof {
+  static void Run(SensorFusionGlobals *sfg) {
+    SystickStartCount(&(sfg->SV_1DOF_P_BASIC.systick));
+    fRun_1DOF_P_BASIC(&(sfg->SV_1DOF_P_BASIC), &(sfg->Pressure));
+    sfg->SV_1DOF_P_BASIC.systick = SystickElapsedMicros(sfg->SV_1DOF_P_BASIC.systick);
+    TIMING_ADD(sfg, TIMING_FUSE_1DOF_P_BASIC, sfg->SV_1DOF_P_BASIC.systick);
+  }
+  static void Predict(SensorFusionGlobals *sfg) { (void)sfg; }
+};
+#endif
+
+#if F_3DOF_G_BASIC
+/// 3DOF accelerometer tilt.
+struct Tilt3Dof {
+  static void Run(SensorFusionGlobals *sfg) {
+    SystickStartCount(&(sfg->SV_3DOF_G_BASIC.systick));
+    fRun_3DOF_G_BASIC(&(sfg->SV_3DOF_G_BASIC), &(sfg->Accel));
+    sfg->SV_3DOF_G_BASIC.systick = SystickElapsedMicros(sfg->SV_3DOF_G_BASIC.systick);
+    TIMING_ADD(sfg, TIMING_FUSE_3DOF_G_BASIC, sfg->SV_3DOF_G_BASIC.systick);
+  }
+  static void Predict(SensorFusionGlobals *sfg) { (void)sfg; }
+  static const Quaternion &Orientation(const SensorFusionGlobals *sfg) {
+    return sfg->SV_3DOF_G_BASIC.fLPq;
+  }
+  static const float *AngularVelocityDegPerS(const SensorFusionGlobals *sfg) {
+    return sfg->SV_3DOF_G_BASIC.fOmega;
+  }
+  static bool IsReset(const SensorFusionGlobals *sfg) {
+    return sfg->SV_3DOF_G_BASIC.resetflag;
+  }
+};
+#endif
+
+#if F_3DOF_B_BASIC
+/// 3DOF magnetometer vehicle compass.
+struct Compass3Dof {
+  static void Run(SensorFusionGlobals *sfg) {
+    SystickStartCount(&(sfg->SV_3DOF_B_BASIC.systick));
+    fRun_3DOF_B_BASIC(&(sfg->SV_3DOF_B_BASIC), &(sfg->Mag));
+    sfg->SV_3DOF_B_BASIC.systick = SystickElapsedMicros(sfg->SV_3DOF_B_BASIC.systick);
+    TIMING_ADD(sfg, TIMING_FUSE_3DOF_B_BASIC, sfg->SV_3DOF_B_BASIC.systick);
+  }
+  static void Predict(SensorFusionGlobals *sfg) { (void)sfg; }
+  static const Quaternion &Orientation(const SensorFusionGlobals *sfg) {
+    return sfg->SV_3DOF_B_BASIC.fLPq;
+  }
+  static const float *AngularVelocityDegPerS(const SensorFusionGlobals *sfg) {
+    return sfg->SV_3DOF_B_BASIC.fOmega;
+  }
+  static bool IsReset(const SensorFusionGlobals *sfg) {
+    return sfg->SV_3DOF_B_BASIC.resetflag;
+  }
+};
+#endif
+
+#if F_3DOF_Y_BASIC
+/// 3DOF gyro integration.
+struct Gyro3Dof {
+  static void Run(SensorFusionGlobals *sfg) {
+    SystickStartCount(&(sfg->SV_3DOF_Y_BASIC.systick));
+    fRun_3DOF_Y_BASIC(&(sfg->SV_3DOF_Y_BASIC), &(sfg->Gyro));
+    sfg->SV_3DOF_Y_BASIC.systick = SystickElapsedMicros(sfg->SV_3DOF_Y_BASIC.systick);
+    TIMING_ADD(sfg, TIMING_FUSE_3DOF_Y_BASIC, sfg->SV_3DOF_Y_BASIC.systick);
+  }
+  static void Predict(SensorFusionGlobals *sfg) { (void)sfg; }
+  static const Quaternion &Orientation(const SensorFusionGlobals *sfg) {
+    return sfg->SV_3DOF_Y_BASIC.fq;
+  }
+  static const float *AngularVelocityDegPerS(const SensorFusionGlobals *sfg) {
+    return sfg->SV_3DOF_Y_BASIC.fOmega;
+  }
+  static bool IsReset(const SensorFusionGlobals *sfg) {
+    return sfg->SV_3DOF_Y_BASIC.resetflag;
+  }
+};
+#endif
+
+#if F_6DOF_GB_BASIC
+/// 6DOF accelerometer and magnetometer eCompass.
+struct ECompass6Dof {
+  static void Run(SensorFusionGlobals *sfg) {
+    SystickStartCount(&(sfg->SV_6DOF_GB_BASIC.systick));
+    fRun_6DOF_GB_BASIC(&(sfg->SV_6DOF_GB_BASIC), &(sfg->Mag), &(sfg->Accel));
+    sfg->SV_6DOF_GB_BASIC.systick = SystickElapsedMicros(sfg->SV_6DOF_GB_BASIC.systick);
+    TIMING_ADD(sfg, TIMING_FUSE_6DOF_GB_BASIC, sfg->SV_6DOF_GB_BASIC.systick);
+  }
+  static void Predict(SensorFusionGlobals *sfg) { (void)sfg; }
+  static const Quaternion &Orientation(const SensorFusionGlobals *sfg) {
+    return sfg->SV_6DOF_GB_BASIC.fLPq;
+  }
+  static const float *AngularVelocityDegPerS(const SensorFusionGlobals *sfg) {
+    return sfg->SV_6DOF_GB_BASIC.fOmega;
+  }
+  static bool IsReset(const SensorFusionGlobals *sfg) {
+    return sfg->SV_6DOF_GB_BASIC.resetflag;
+  }
+};
+#endif
+
+#if F_6DOF_GY_KALMAN
+/// 6DOF accelerometer and gyro Kalman filter.
+struct Kalman6Dof {
+  static void Run(SensorFusionGlobals *sfg) {
+    SystickStartCount(&(sfg->SV_6DOF_GY_KALMAN.systick));
+    fRun_6DOF_GY_KALMAN(&(sfg->SV_6DOF_GY_KALMAN), &(sfg->Accel), &(sfg->Gyro));
+    sfg->SV_6DOF_GY_KALMAN.systick = SystickElapsedMicros(sfg->SV_6DOF_GY_KALMAN.systick);
+    TIMING_ADD(sfg, TIMING_FUSE_6DOF_GY_KALMAN, sfg->SV_6DOF_GY_KALMAN.systick);
+  }
+  static void Predict(SensorFusionGlobals *sfg) { (void)sfg; }
+  static const Quaternion &Orientation(const SensorFusionGlobals *sfg) {
+    return sfg->SV_6DOF_GY_KALMAN.fqPl;
+  }
+  static const float *AngularVelocityDegPerS(const SensorFusionGlobals *sfg) {
+    return sfg->SV_6DOF_GY_KALMAN.fOmega;
+  }
+  static bool IsReset(const SensorFusionGlobals *sfg) {
+    return sfg->SV_6DOF_GY_KALMAN.resetflag;
+  }
+};
+#endif
+
+#if F_9DOF_GBY_KALMAN
+/// 9DOF accelerometer, magnetometer and gyro Kalman filter. Its results are
+/// the gyro-predicted ones, which equal the Kalman results after each fusion.
+struct Kalman9Dof {
+  static void Run(SensorFusionGlobals *sfg) {
+    SystickStartCount(&(sfg->SV_9DOF_GBY_KALMAN.systick));
+    fRun_9DOF_GBY_KALMAN(&(sfg->SV_9DOF_GBY_KALMAN), &(sfg->Accel), &(sfg->Mag),
+                         &(sfg->Gyro), &(sfg->MagCal));
+    sfg->SV_9DOF_GBY_KALMAN.systick = SystickElapsedMicros(sfg->SV_9DOF_GBY_KALMAN.systick);
+    TIMING_ADD(sfg, TIMING_FUSE_9DOF_GBY_KALMAN, sfg->SV_9DOF_GBY_KALMAN.systick);
+  }
+  static void Predict(SensorFusionGlobals *sfg) {
+    fPredict_9DOF_GBY_KALMAN(&(sfg->SV_9DOF_GBY_KALMAN), &(sfg->Gyro));
+  }
+  static const Quaternion &Orientation(const SensorFusionGlobals *sfg) {
+    return sfg->SV_9DOF_GBY_KALMAN.fqPr;
+  }
+  static const float *AngularVelocityDegPerS(const SensorFusionGlobals *sfg) {
+    return sfg->SV_9DOF_GBY_KALMAN.fOmegaPr;
+  }
+  static bool IsReset(const SensorFusionGlobals *sfg) {
+    return sfg->SV_9DOF_GBY_KALMAN.resetflag;
+  }
+};
+#endif
+///@}
+
+/**
+ * The list of algorithms an instance runs, in order, each fusion cycle. The
+ * first provides the results.
+ */
+template <typename... Kernels>
+struct FusionAlgorithms;
+
+template <typename First, typename... Rest>
+struct FusionAlgorithms<First, Rest...> {
+  typedef First Primary;
+  static void Run(SensorFusionGlobals *sfg) {
+    First::Run(sfg);
+    FusionAlgorithms<Rest...>::Run(sfg);
+  }
+  static void Predict(SensorFusionGlobals *sfg) {
+    First::Predict(sfg);
+    FusionAlgorithms<Rest...>::Predict(sfg);
+  }
+};
+
+template <>
+struct FusionAlgorithms<> {
+  static void Run(SensorFusionGlobals *sfg) { (void)sfg; }
+  static void Predict(SensorFusionGlobals *sfg) { (void)sfg; }
+};
+
+/**
+ * @name CoordSystem
+ * The frame in which an instance returns its results. FromNed() converts the
+ * orientation of the kernels (sensor frame x forward, y right, z down, in the
+ * North East Down global frame) and BodyFromNed() converts a sensor frame
+ * vector.
+ */
+///@{
+/// Aerospace: sensor frame forward right down, global frame North East Down.
+struct Ned {
+  static_assert(THISCOORDSYSTEM == NED, "the kernels must be built for NED in build.h");
+  static void FromNed(const Quaternion &q, Quaternion *out) { *out = q; }
+  static void BodyFromNed(const float v[3], float out[3]) {
+    out[CHX] = v[CHX];
+    out[CHY] = v[CHY];
+    out[CHZ] = v[CHZ];
+  }
+};
+
+/// Robotics (ROS REP 103): sensor frame forward left up, global frame East North Up.
+struct Enu {
+  static_assert(THISCOORDSYSTEM == NED, "the kernels must be built for NED in build.h");
+  // q_enu = q_w * q_ned * q_b, with q_w the half turn about North + East that
+  // takes NED to ENU and q_b the half turn about forward that takes FLU to FRD
+  static void FromNed(const Quaternion &q, Quaternion *out) {
+    const float kHalfRoot2 = 0.70710678F;
+    out->q0 = kHalfRoot2 * (q.q0 + q.q3);
+    out->q1 = kHalfRoot2 * (q.q1 + q.q2);
+    out->q2 = kHalfRoot2 * (q.q1 - q.q2);
+    out->q3 = kHalfRoot2 * (q.q0 - q.q3);
+  }
+  static void BodyFromNed(const float v[3], float out[3]) {
+    out[CHX] = v[CHX];
+    out[CHY] = -v[CHY];
+    out[CHZ] = -v[CHZ];
+  }
+};
+///@}
+
+/**
+ * @name SensorSet
+ * The sensors an instance reads. Install() puts them in the linked list of
+ * physical sensors and Begin() initializes them with the Config given to
+ * SensorFusion::Begin().
+ */
+///@{
+/// FXOS8700 accelerometer/magnetometer and FXAS21002 gyroscope on I2C, as on
+/// the Adafruit breakout board #3643.
+template <uint8_t kAccelMagI2cAddr = 0x1F, uint8_t kGyroI2cAddr = 0x21>
+struct Fxos8700Fxas21002 {
+  static const int kNumSensors = 2;
+  struct Config {
+    int pin_i2c_sda = -1;
+    int pin_i2c_scl = -1;
+  };
+  static bool Install(SensorFusionGlobals *sfg, PhysicalSensor *sensors) {
+    return installSensor(sfg, &sensors[0], kAccelMagI2cAddr, 1, NULL,
+                         FXOS8700_Init, FXOS8700_Read) == 0 &&
+           installSensor(sfg, &sensors[1], kGyroI2cAddr, 1, NULL,
+                         FXAS21002_Init, FXAS21002_Read) == 0;
+  }
+  static bool Begin(SensorFusionGlobals *sfg, PhysicalSensor *sensors,
+                    const Config &config) {
+    (void)sensors;
+    initializeFusionEngine(sfg, config.pin_i2c_sda, config.pin_i2c_scl);
+    return true;
+  }
+};
+
+/// A raw sensor log (see sensor_log.h), one record per ReadSensors().
+struct ReplaySensors {
+  static const int kNumSensors = 1;
+  struct Config {
+    SensorLogReplay *replay = NULL;  ///< must remain valid while in use
+  };
+  static bool Install(SensorFusionGlobals *sfg, PhysicalSensor *sensors) {
+    (void)sfg;
+    (void)sensors;
+    return true;  // the replay is only known at Begin()
+  }
+  static bool Begin(SensorFusionGlobals *sfg, PhysicalSensor *sensors,
+                    const Config &config) {
+    if (config.replay == NULL ||
+        SensorLogInstallReplay(sfg, &sensors[0], config.replay) != SENSOR_ERROR_NONE) {
+      return false;
+    }
+    initializeFusionEngine(sfg, -1, -1);
+    return true;
+  }
+};
+///@}
+
+/**
+ *  Sensor fusion instance whose algorithms, output frame and sensors are
+ *  fixed at compile time. Use as the SensorFusion class: Begin() once, then
+ *  ReadSensors() at LOOP_RATE_HZ and RunFusion() after each read. It holds
+ *  all its state itself, without heap allocation; at several kB it belongs
+ *  at file scope or on the heap rather than on a task stack.
+ */
+template <typename Algorithms, typename CoordSystem, typename SensorSet>
+class SensorFusion {
+ public:
+  typedef typename SensorSet::Config Config;  ///< settings passed to Begin()
+
+  SensorFusion();
+  bool Begin(const Config &config = Config());
+  void ReadSensors(void);
+  void RunFusion(void);
+  bool IsDataValid(void);
+  void GetOrientationQuaternion(Quaternion *quat);
+  float GetYawDegrees(void);
+  float GetPitchDegrees(void);
+  float GetRollDegrees(void);
+  void GetAngularVelocityDegPerS(float omega[3]);
+  SensorFusionGlobals *GetGlobals(void) { return &sfg_; }
+
+ private:
+  typedef typename Algorithms::Primary Primary;
+
+  SensorFusionGlobals sfg_;                         ///< sensor fusion data structure
+  ControlSubsystem control_subsystem_;              ///< command and data streaming structure (unused)
+  StatusSubsystem status_subsystem_;                ///< status indicator structure
+  PhysicalSensor sensors_[SensorSet::kNumSensors];  ///< the installed sensors
+  bool installed_ = false;                          ///< SensorSet::Install() succeeded
+  static_assert(LOOP_RATE_HZ >= FUSION_HZ && LOOP_RATE_HZ % FUSION_HZ == 0,
+                "LOOP_RATE_HZ in build.h must be a multiple of FUSION_HZ");
+  const uint8_t kLoopsPerFusionCalc =
+      LOOP_RATE_HZ / FUSION_HZ;  ///< reads per fusion, see sensor_fusion_class.h
+  uint8_t loops_per_fuse_counter_ = 0;  ///< reads since the last fusion
+  int32_t cycle_start_ticks_ = 0;       ///< systick at the start of ReadSensors()
+};  // end SensorFusion
+
+/**
+ * Constructor zeroes and initializes the control and status subsystems and
+ * the fusion data structure, and installs the sensors of the SensorSet.
+ */
+template <typename Algorithms, typename CoordSystem, typename SensorSet>
+SensorFusion<Algorithms, CoordSystem, SensorSet>::SensorFusion()
+    : sfg_(), control_subsystem_(), status_subsystem_(), sensors_() {
+  initializeIOSubsystem(&control_subsystem_, NULL, NULL);
+  initializeStatusSubsystem(&status_subsystem_);
+  initSensorFusionGlobals(&sfg_, &status_subsystem_, &control_subsystem_);
+  installed_ = SensorSet::Install(&sfg_, sensors_);
+}  // end SensorFusion()
+
+/**
+ * @brief Initialize the sensors and the fusion. Set status to Normal.
+ * @param config the sensor set's settings, e.g. I2C pins or the log to replay
+ * @return False if the sensors could not be installed
+ */
+template <typename Algorithms, typename CoordSystem, typename SensorSet>
+bool SensorFusion<Algorithms, CoordSystem, SensorSet>::Begin(const Config &config) {
+  if (!installed_ || !SensorSet::Begin(&sfg_, sensors_, config)) {
+    return false;
+  }
+  setStatus(&sfg_, NORMAL);
+  readSensors(&sfg_, 0);  // updates the status to show whether initialization worked
+  return true;
+}  // end Begin()
+
+/**
+ * @brief Reads all sensors into the software FIFOs, as SensorFusion::ReadSensors().
+ */
+template <typename Algorithms, typename CoordSystem, typename SensorSet>
+void SensorFusion<Algorithms, CoordSystem, SensorSet>::ReadSensors(void) {
+  SystickStartCount(&cycle_start_ticks_);
+  readSensors(&sfg_, loops_per_fuse_counter_);
+}  // end ReadSensors()
+
+/**
+ * @brief Condition the readings and run the listed algorithms, every
+ * kLoopsPerFusionCalc'th call; in between, only Predict() them.
+ */
+template <typename Algorithms, typename CoordSystem, typename SensorSet>
+void SensorFusion<Algorithms, CoordSystem, SensorSet>::RunFusion(void) {
+  if (loops_per_fuse_counter_ < kLoopsPerFusionCalc) {
+    ++loops_per_fuse_counter_;
+    if (kLoopsPerFusionCalc > 1 && sfg_.loopcounter > 0) {
+      Algorithms::Predict(&sfg_);
+    }
+    return;
+  }
+
+  conditionSensorReadings(&sfg_);
+  Algorithms::Run(&sfg_);
+  clearFIFOs(&sfg_);
+
+  sfg_.loopcounter++;
+  if (0 == sfg_.loopcounter % 4) {
+    updateStatus(&sfg_);
+  }
+  queueStatus(&sfg_, NORMAL);
+
+  int32_t cycle_micros = SystickElapsedMicros(cycle_start_ticks_);
+  sfg_.systick_Spare = (1000000 / LOOP_RATE_HZ) - cycle_micros;
+  TIMING_ADD(&sfg_, TIMING_CYCLE, cycle_micros);
+
+  loops_per_fuse_counter_ = 1;
+}  // end RunFusion()
+
+/**
+ * @brief @return True if the status is Normal and the algorithm providing the
+ * results has run since its last reset
+ */
+template <typename Algorithms, typename CoordSystem, typename SensorSet>
+bool SensorFusion<Algorithms, CoordSystem, SensorSet>::IsDataValid(void) {
+  return NORMAL == status_subsystem_.status && !Primary::IsReset(&sfg_);
+}  // end IsDataValid()
+
+/**
+ * @brief Get the orientation, rotating sensor frame vectors into the global
+ * frame of CoordSystem.
+ * @param quat filled with the orientation quaternion
+ */
+template <typename Algorithms, typename CoordSystem, typename SensorSet>
+void SensorFusion<Algorithms, CoordSystem, SensorSet>::GetOrientationQuaternion(
+    Quaternion *quat) {
+  CoordSystem::FromNed(Primary::Orientation(&sfg_), quat);
+}  // end GetOrientationQuaternion()
+
+/**
+ * @brief @return Yaw (deg) about the global z axis of CoordSystem, 0 to 360.
+ * For Ned this is the compass heading; for Enu it is counterclockwise from
+ * East.
+ */
+template <typename Algorithms, typename CoordSystem, typename SensorSet>
+float SensorFusion<Algorithms, CoordSystem, SensorSet>::GetYawDegrees(void) {
+  Quaternion q;
+  GetOrientationQuaternion(&q);
+  float yaw = atan2f(2.0F * (q.q0 * q.q3 + q.q1 * q.q2),
+                     1.0F - 2.0F * (q.q2 * q.q2 + q.q3 * q.q3)) * (180.0F / PI);
+  return (yaw < 0.0F) ? yaw + 360.0F : yaw;
+}  // end GetYawDegrees()
+
+/**
+ * @brief @return Pitch (deg) about the sensor y axis, -90 to 90, following
+ * the yaw
+ */
+template <typename Algorithms, typename CoordSystem, typename SensorSet>
+float SensorFusion<Algorithms, CoordSystem, SensorSet>::GetPitchDegrees(void) {
+  Quaternion q;
+  GetOrientationQuaternion(&q);
+  float sine = 2.0F * (q.q0 * q.q2 - q.q3 * q.q1);
+  sine = (sine > 1.0F) ? 1.0F : ((sine < -1.0F) ? -1.0F : sine);
+  return asinf(sine) * (180.0F / PI);
+}  // end GetPitchDegrees()
+
+/**
+ * @brief @return Roll (deg) about the sensor x axis, -180 to 180, following
+ * the yaw and pitch
+ */
+template <typename Algorithms, typename CoordSystem, typename SensorSet>
+float SensorFusion<Algorithms, CoordSystem, SensorSet>::GetRollDegrees(void) {
+  Quaternion q;
+  GetOrientationQuaternion(&q);
+  return atan2f(2.0F * (q.q0 * q.q1 + q.q2 * q.q3),
+                1.0F - 2.0F * (q.q1 * q.q1 + q.q2 * q.q2)) * (180.0F / PI);
+}  // end GetRollDegrees()
+
+/**
+ * @brief Get the angular velocity in the sensor frame of CoordSystem.
+ * @param omega filled with the x, y and z rates (deg/s)
+ */
+template <typename Algorithms, typename CoordSystem, typename SensorSet>
+void SensorFusion<Algorithms, CoordSystem, SensorSet>::GetAngularVelocityDegPerS(
+    float omega[3]) {
+  CoordSystem::BodyFromNed(Primary::AngularVelocityDegPerS(&sfg_), omega);
+}  // end GetAngularVelocityDegPerS()
+
+}  // namespace sensor_fusion
+
+#endif /* SENSOR_FUSION_TEMPLATE_H_ */
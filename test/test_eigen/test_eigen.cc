@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2020-2021 Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+/**
+ * @file test_eigen.cc
+ * @brief Unit tests of the warm started magnetic calibration eigen-decomposition.
+ *
+ * Checks iNextEigElement() (magnetic.c), which picks the next above diagonal
+ * element the time sliced Jacobi sweeps rotate, and fEigenWarmStart10()
+ * (matrix.c), which resumes the decomposition from the eigenvectors of an
+ * earlier matrix, against a cold fEigenCompute10().
+ *
+ * Run with:  pio test -e native_test -f test_eigen
+ */
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include <unity.h>
+
+#include "build.h"
+#include "sensor_fusion/sensor_fusion.h"
+#include "sensor_fusion/magnetic.h"
+#include "sensor_fusion/matrix.h"
+
+#if F_USING_MAG && F_WARM_START_EIGEN
+namespace {
+
+constexpr int8_t kSize = 10;
+constexpr int8_t kElements = kSize * (kSize - 1) / 2;
+
+/// Sets A to a symmetric matrix with distinct, well separated eigenvalues, plus
+/// scale times a symmetric perturbation.
+void SetTestMatrix(float A[][10], float scale) {
+  for (int8_t i = 0; i < kSize; i++) {
+    for (int8_t j = 0; j < kSize; j++) {
+      A[i][j] = 1.0F / (1.0F + i + j) + scale * sinf(1.0F + i + j + 0.3F * i * j);
+    }
+    A[i][i] += 1.0F + i;
+  }
+}
+
+/// Runs Jacobi sweeps of the n square matrix A, with diagonal fvecA and
+/// eigenvectors fmatB, the way the time sliced 7 and 10 element calibrations
+/// do, until no element is left to rotate. Returns the number of sweeps.
+int RunSweeps(float A[][10], float fvecA[], float fmatB[][10], int8_t n) {
+  const int8_t elements = n * (n - 1) / 2;
+  int8_t i, j;
+  int sweeps = 0;
+  while (iNextEigElement(A, fvecA, n, 0, &i, &j) < elements && sweeps < EIGENMAXSWEEPS) {
+    int8_t k = 0;
+    while ((k = iNextEigElement(A, fvecA, n, k, &i, &j)) < elements) {
+      fComputeEigSlice(A, fmatB, fvecA, i, j, n);
+      k++;
+    }
+    sweeps++;
+  }
+  return sweeps;
+}
+
+/// Returns the largest element of A.v - lambda.v over the columns v of eigvec,
+/// relative to the largest |lambda|.
+float EigenResidual(float A[][10], const float eigval[], float eigvec[][10], int8_t n) {
+  float largest = 0.0F;
+  float residual = 0.0F;
+  for (int8_t m = 0; m < n; m++) {
+    largest = std::max(largest, fabsf(eigval[m]));
+    for (int8_t i = 0; i < n; i++) {
+      float sum = -eigval[m] * eigvec[i][m];
+      for (int8_t k = 0; k < n; k++) sum += A[i][k] * eigvec[k][m];
+      residual = std::max(residual, fabsf(sum));
+    }
+  }
+  return residual / largest;
+}
+
+}  // namespace
+#endif  // F_USING_MAG && F_WARM_START_EIGEN
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+#if F_USING_MAG && F_WARM_START_EIGEN
+void test_next_element_in_row_order(void) {
+  float A[10][10] = {};
+  float fvecA[10] = {1.0F, 4.0F, 9.0F, 16.0F};
+  int8_t i, j;
+
+  // elements 0..5 are [0][1], [0][2], [0][3], [1][2], [1][3], [2][3]
+  A[0][2] = 1.0F;
+  A[1][3] = 0.5F;
+  TEST_ASSERT_EQUAL_INT(1, iNextEigElement(A, fvecA, 4, 0, &i, &j));
+  TEST_ASSERT_EQUAL_INT(0, i);
+  TEST_ASSERT_EQUAL_INT(2, j);
+  TEST_ASSERT_EQUAL_INT(4, iNextEigElement(A, fvecA, 4, 2, &i, &j));
+  TEST_ASSERT_EQUAL_INT(1, i);
+  TEST_ASSERT_EQUAL_INT(3, j);
+  TEST_ASSERT_EQUAL_INT(6, iNextEigElement(A, fvecA, 4, 5, &i, &j));
+}
+
+void test_next_element_skips_negligible(void) {
+  float A[10][10] = {};
+  float fvecA[10] = {1.0F, 4.0F, 9.0F, 16.0F};
+  int8_t i, j;
+
+  // the tolerance of [0][2] is EIGENTOLERANCE * 1 * 3, and of [2][3] EIGENTOLERANCE * 3 * 4
+  A[0][2] = 2.0F * EIGENTOLERANCE;
+  A[2][3] = 13.0F * EIGENTOLERANCE;
+  TEST_ASSERT_EQUAL_INT(5, iNextEigElement(A, fvecA, 4, 0, &i, &j));
+  TEST_ASSERT_EQUAL_INT(2, i);
+  TEST_ASSERT_EQUAL_INT(3, j);
+}
+
+void test_next_element_zero_diagonal(void) {
+  float A[10][10] = {};
+  float fvecA[10] = {0.0F, 1.0F, 1.0F};
+  int8_t i, j;
+
+  // a zero diagonal element leaves no tolerance, so any element in its row or column is rotated
+  A[0][1] = 1E-20F;
+  TEST_ASSERT_EQUAL_INT(0, iNextEigElement(A, fvecA, 3, 0, &i, &j));
+  TEST_ASSERT_EQUAL_INT(0, i);
+  TEST_ASSERT_EQUAL_INT(1, j);
+}
+
+void test_next_element_none_left(void) {
+  float A[10][10] = {};
+  float fvecA[10];
+  int8_t i = -1, j = -1;
+
+  for (int8_t k = 0; k < kSize; k++) fvecA[k] = A[k][k] = 1.0F + k;
+  TEST_ASSERT_EQUAL_INT(kElements, iNextEigElement(A, fvecA, kSize, 0, &i, &j));
+  TEST_ASSERT_EQUAL_INT(0, i);
+  TEST_ASSERT_EQUAL_INT(0, j);
+  i = j = -1;
+  TEST_ASSERT_EQUAL_INT(21, iNextEigElement(A, fvecA, 7, 0, &i, &j));
+  TEST_ASSERT_EQUAL_INT(0, i);
+  TEST_ASSERT_EQUAL_INT(0, j);
+}
+
+void test_sweeps_match_cold_decomposition(void) {
+  float A[10][10], Awork[10][10], V[10][10];
+  float fvecA[10], eigval[10];
+
+  // cold sweeps from the identity
+  SetTestMatrix(A, 0.1F);
+  memcpy(Awork, A, sizeof(A));
+  memset(V, 0, sizeof(V));
+  for (int8_t k = 0; k < kSize; k++) {
+    V[k][k] = 1.0F;
+    fvecA[k] = Awork[k][k];
+  }
+  TEST_ASSERT_LESS_THAN_INT(EIGENMAXSWEEPS, RunSweeps(Awork, fvecA, V, kSize));
+  TEST_ASSERT_LESS_THAN_FLOAT(1E-4F, EigenResidual(A, fvecA, V, kSize));
+
+  // against fEigenCompute10()
+  float eigvec[10][10];
+  memcpy(Awork, A, sizeof(A));
+  fEigenCompute10(Awork, eigval, eigvec, kSize);
+
+  std::sort(fvecA, fvecA + kSize);
+  std::sort(eigval, eigval + kSize);
+  for (int8_t k = 0; k < kSize; k++) TEST_ASSERT_FLOAT_WITHIN(1E-4F * eigval[kSize - 1], eigval[k], fvecA[k]);
+}
+
+void test_warm_start_matches_cold_decomposition(void) {
+  float A0[10][10], A1[10][10], Awork[10][10];
+  float V0[10][10], eigvec[10][10], coldvec[10][10];
+  float eigval0[10], eigval[10], coldval[10];
+
+  // eigenvectors of the earlier matrix A0
+  SetTestMatrix(A0, 0.1F);
+  fEigenCompute10(A0, eigval0, V0, kSize);
+
+  // A1 differs from A0 as the matrix of a calibration a few readings later does
+  SetTestMatrix(A1, 0.1F);
+  for (int8_t i = 0; i < kSize; i++) {
+    for (int8_t j = 0; j < kSize; j++) A1[i][j] += 1E-3F * cosf(2.0F + i + j);
+  }
+
+  // warm start from V0, then sweep
+  memcpy(Awork, A1, sizeof(A1));
+  fEigenWarmStart10(Awork, eigval, eigvec, V0, kSize);
+  int warm_sweeps = RunSweeps(Awork, eigval, eigvec, kSize);
+
+  // the same sweeps from the identity
+  float Acold[10][10], Icold[10][10] = {}, fvecA[10];
+  memcpy(Acold, A1, sizeof(A1));
+  for (int8_t k = 0; k < kSize; k++) {
+    Icold[k][k] = 1.0F;
+    fvecA[k] = Acold[k][k];
+  }
+  int cold_sweeps = RunSweeps(Acold, fvecA, Icold, kSize);
+  TEST_ASSERT_LESS_THAN_INT(cold_sweeps, warm_sweeps);
+
+  // the warm started eigenvectors and eigenvalues are those of A1
+  TEST_ASSERT_LESS_THAN_FLOAT(1E-4F, EigenResidual(A1, eigval, eigvec, kSize));
+
+  // and its eigenvalues are those of the cold fEigenCompute10()
+  memcpy(Awork, A1, sizeof(A1));
+  fEigenCompute10(Awork, coldval, coldvec, kSize);
+  std::sort(eigval, eigval + kSize);
+  std::sort(coldval, coldval + kSize);
+  for (int8_t k = 0; k < kSize; k++) TEST_ASSERT_FLOAT_WITHIN(1E-4F * coldval[kSize - 1], coldval[k], eigval[k]);
+}
+#endif  // F_USING_MAG && F_WARM_START_EIGEN
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+#if F_USING_MAG && F_WARM_START_EIGEN
+  RUN_TEST(test_next_element_in_row_order);
+  RUN_TEST(test_next_element_skips_negligible);
+  RUN_TEST(test_next_element_zero_diagonal);
+  RUN_TEST(test_next_element_none_left);
+  RUN_TEST(test_sweeps_match_cold_decomposition);
+  RUN_TEST(test_warm_start_matches_cold_decomposition);
+#endif
+  return UNITY_END();
+}
@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2020-2021 Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+/**
+ * @file test_kalman_gain.cc
+ * @brief Unit tests of the closed form per axis Kalman gains.
+ *
+ * Checks fKalmanGain_9DOF_GBY_Block() and fKalmanGain_6DOF_GY_Block()
+ * (fusion.c) against the general matrix computations of
+ * fKalmanGain_9DOF_GBY_Generic() and fKalmanGain_6DOF_GY_Generic(), on
+ * covariance matrices Qw built as fRun_9DOF_GBY_KALMAN() and
+ * fRun_6DOF_GY_KALMAN() build them.
+ *
+ * Run with:  pio test -e native_test -f test_kalman_gain
+ */
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include <unity.h>
+
+#include "build.h"
+#include "sensor_fusion/sensor_fusion.h"
+#include "sensor_fusion/fusion.h"
+
+namespace {
+
+constexpr float kQvY = 0.3F;  ///< gyro measurement noise variance, (deg/s)^2
+
+/// Sets the 9DOF fAlphaOver2, fQv6x1 and fQw9x9 as fRun_9DOF_GBY_KALMAN() does
+/// for a fusion period of deltat (s), measurement noises qvg and qvm, gyro
+/// offset noise qwb, and a posteriori errors qg, qm and b of the last iteration.
+void SetState9(struct SV_9DOF_GBY_KALMAN *sv, float deltat, float qvg, float qvm, float qwb,
+               const float qg[3], const float qm[3], const float b[3]) {
+  const float alpha = 3.14159265F / 180.0F * deltat;
+  memset(sv, 0, sizeof(*sv));
+  sv->fAlphaOver2 = 0.5F * alpha;
+  float alpha_sq_qvy_qwb_over12 = alpha * alpha * (kQvY + qwb) / 12.0F;
+  for (int8_t i = CHX; i <= CHZ; i++) {
+    sv->fQv6x1[i] = qvg + alpha_sq_qvy_qwb_over12;
+    sv->fQv6x1[i + 3] = qvm + alpha_sq_qvy_qwb_over12;
+    float tilt = 0.25F * alpha * alpha * b[i] * b[i] + alpha_sq_qvy_qwb_over12;
+    sv->fQw9x9[i][i] = qg[i] * qg[i] + tilt;
+    sv->fQw9x9[i + 3][i + 3] = qm[i] * qm[i] + tilt;
+    sv->fQw9x9[i + 6][i + 6] = b[i] * b[i] + qwb / 3.0F;
+    sv->fQw9x9[i][i + 6] = sv->fQw9x9[i + 6][i] = qg[i] * b[i] - sv->fAlphaOver2 * sv->fQw9x9[i + 6][i + 6];
+    sv->fQw9x9[i + 3][i + 6] = sv->fQw9x9[i + 6][i + 3] = qm[i] * b[i] - sv->fAlphaOver2 * sv->fQw9x9[i + 6][i + 6];
+  }
+}
+
+/// Checks that the block and generic gains of sv agree to within float
+/// rounding, and have their zero elements in the same places.
+void CheckGains9(struct SV_9DOF_GBY_KALMAN *sv) {
+  struct SV_9DOF_GBY_KALMAN generic = *sv;
+  fKalmanGain_9DOF_GBY_Generic(&generic);
+  fKalmanGain_9DOF_GBY_Block(sv);
+
+  float largest_k = 0.0F, largest_qwct = 0.0F;
+  for (int8_t i = 0; i < 9; i++) {
+    for (int8_t j = 0; j < 6; j++) {
+      largest_k = std::max(largest_k, fabsf(generic.fK9x6[i][j]));
+      largest_qwct = std::max(largest_qwct, fabsf(generic.fQwCT9x6[i][j]));
+    }
+  }
+  TEST_ASSERT_TRUE(largest_k > 0.0F);
+  for (int8_t i = 0; i < 9; i++) {
+    for (int8_t j = 0; j < 6; j++) {
+      TEST_ASSERT_FLOAT_WITHIN(1E-5F * largest_k, generic.fK9x6[i][j], sv->fK9x6[i][j]);
+      TEST_ASSERT_FLOAT_WITHIN(1E-5F * largest_qwct, generic.fQwCT9x6[i][j], sv->fQwCT9x6[i][j]);
+      TEST_ASSERT_EQUAL_INT(generic.fK9x6[i][j] == 0.0F, sv->fK9x6[i][j] == 0.0F);
+    }
+  }
+}
+
+/// Sets the 6DOF fAlphaOver2, fQv and fQw6x6 as fRun_6DOF_GY_KALMAN() does for
+/// a fusion period of deltat (s), measurement noise qvg, gyro offset noise qwb,
+/// and a posteriori errors qg and b of the last iteration.
+void SetState6(struct SV_6DOF_GY_KALMAN *sv, float deltat, float qvg, float qwb, const float qg[3],
+               const float b[3]) {
+  const float alpha = 3.14159265F / 180.0F * deltat;
+  memset(sv, 0, sizeof(*sv));
+  sv->fAlphaOver2 = 0.5F * alpha;
+  float alpha_sq_qvy_qwb_over12 = alpha * alpha * (kQvY + qwb) / 12.0F;
+  sv->fQv = qvg + alpha_sq_qvy_qwb_over12;
+  for (int8_t i = CHX; i <= CHZ; i++) {
+    sv->fQw6x6[i][i] = qg[i] * qg[i] + 0.25F * alpha * alpha * b[i] * b[i] + alpha_sq_qvy_qwb_over12;
+    sv->fQw6x6[i + 3][i + 3] = b[i] * b[i] + qwb / 3.0F;
+    sv->fQw6x6[i][i + 3] = sv->fQw6x6[i + 3][i] = qg[i] * b[i] - sv->fAlphaOver2 * sv->fQw6x6[i + 3][i + 3];
+  }
+}
+
+/// Checks that the block and generic gains of sv agree to within float
+/// rounding, and have their zero elements in the same places.
+void CheckGains6(struct SV_6DOF_GY_KALMAN *sv) {
+  struct SV_6DOF_GY_KALMAN generic = *sv;
+  fKalmanGain_6DOF_GY_Generic(&generic);
+  fKalmanGain_6DOF_GY_Block(sv);
+
+  float largest_k = 0.0F, largest_qwct = 0.0F;
+  for (int8_t i = 0; i < 6; i++) {
+    for (int8_t j = 0; j < 3; j++) {
+      largest_k = std::max(largest_k, fabsf(generic.fK6x3[i][j]));
+      largest_qwct = std::max(largest_qwct, fabsf(generic.fQwCT6x3[i][j]));
+    }
+  }
+  TEST_ASSERT_TRUE(largest_k > 0.0F);
+  for (int8_t i = 0; i < 6; i++) {
+    for (int8_t j = 0; j < 3; j++) {
+      TEST_ASSERT_FLOAT_WITHIN(1E-5F * largest_k, generic.fK6x3[i][j], sv->fK6x3[i][j]);
+      TEST_ASSERT_FLOAT_WITHIN(1E-5F * largest_qwct, generic.fQwCT6x3[i][j], sv->fQwCT6x3[i][j]);
+      TEST_ASSERT_EQUAL_INT(generic.fK6x3[i][j] == 0.0F, sv->fK6x3[i][j] == 0.0F);
+    }
+  }
+}
+
+}  // namespace
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_9dof_block_gain_converged(void) {
+  // a settled filter at 40 Hz: small tilt errors, gyro offset known to 0.02 deg/s
+  const float qg[3] = {1E-3F, -2E-3F, 5E-4F};
+  const float qm[3] = {3E-3F, 1E-3F, -4E-3F};
+  const float b[3] = {0.02F, -0.01F, 0.015F};
+  struct SV_9DOF_GBY_KALMAN sv;
+  SetState9(&sv, 0.025F, 1.2E-3F, 2.5E-3F, 2E-3F, qg, qm, b);
+  CheckGains9(&sv);
+}
+
+void test_9dof_block_gain_large_alpha(void) {
+  // a slow update with large errors makes the gyro offset terms of C and Qw dominate
+  const float qg[3] = {0.05F, -0.08F, 0.02F};
+  const float qm[3] = {-0.1F, 0.04F, 0.07F};
+  const float b[3] = {2.0F, -3.0F, 1.5F};
+  struct SV_9DOF_GBY_KALMAN sv;
+  SetState9(&sv, 1.0F, 1.2E-3F, 2.5E-3F, 0.5F, qg, qm, b);
+  CheckGains9(&sv);
+}
+
+void test_9dof_block_gain_singular(void) {
+  // no measurement noise and no covariance leaves C * Qw * C^T + Qv singular, so both gains are zero
+  struct SV_9DOF_GBY_KALMAN sv;
+  memset(&sv, 0, sizeof(sv));
+  sv.fAlphaOver2 = 0.5F * 3.14159265F / 180.0F * 0.025F;
+  for (int8_t i = 0; i < 9; i++) {
+    for (int8_t j = 0; j < 6; j++) sv.fK9x6[i][j] = 1.0F;
+  }
+  struct SV_9DOF_GBY_KALMAN generic = sv;
+  fKalmanGain_9DOF_GBY_Generic(&generic);
+  fKalmanGain_9DOF_GBY_Block(&sv);
+  for (int8_t i = 0; i < 9; i++) {
+    for (int8_t j = 0; j < 6; j++) {
+      TEST_ASSERT_EQUAL_FLOAT(0.0F, generic.fK9x6[i][j]);
+      TEST_ASSERT_EQUAL_FLOAT(0.0F, sv.fK9x6[i][j]);
+    }
+  }
+}
+
+void test_6dof_block_gain_converged(void) {
+  const float qg[3] = {1E-3F, -2E-3F, 5E-4F};
+  const float b[3] = {0.02F, -0.01F, 0.015F};
+  struct SV_6DOF_GY_KALMAN sv;
+  SetState6(&sv, 0.025F, 1.2E-3F, 2E-3F, qg, b);
+  CheckGains6(&sv);
+}
+
+void test_6dof_block_gain_large_alpha(void) {
+  const float qg[3] = {0.05F, -0.08F, 0.02F};
+  const float b[3] = {2.0F, -3.0F, 1.5F};
+  struct SV_6DOF_GY_KALMAN sv;
+  SetState6(&sv, 1.0F, 1.2E-3F, 0.5F, qg, b);
+  CheckGains6(&sv);
+}
+
+void test_6dof_block_gain_singular(void) {
+  struct SV_6DOF_GY_KALMAN sv;
+  memset(&sv, 0, sizeof(sv));
+  sv.fAlphaOver2 = 0.5F * 3.14159265F / 180.0F * 0.025F;
+  for (int8_t i = 0; i < 6; i++) {
+    for (int8_t j = 0; j < 3; j++) sv.fK6x3[i][j] = 1.0F;
+  }
+  struct SV_6DOF_GY_KALMAN generic = sv;
+  fKalmanGain_6DOF_GY_Generic(&generic);
+  fKalmanGain_6DOF_GY_Block(&sv);
+  for (int8_t i = 0; i < 6; i++) {
+    for (int8_t j = 0; j < 3; j++) {
+      TEST_ASSERT_EQUAL_FLOAT(0.0F, generic.fK6x3[i][j]);
+      TEST_ASSERT_EQUAL_FLOAT(0.0F, sv.fK6x3[i][j]);
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_9dof_block_gain_converged);
+  RUN_TEST(test_9dof_block_gain_large_alpha);
+  RUN_TEST(test_9dof_block_gain_singular);
+  RUN_TEST(test_6dof_block_gain_converged);
+  RUN_TEST(test_6dof_block_gain_large_alpha);
+  RUN_TEST(test_6dof_block_gain_singular);
+  return UNITY_END();
+}
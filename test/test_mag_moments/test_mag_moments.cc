@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2020-2021 Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+/**
+ * @file test_mag_moments.cc
+ * @brief Unit tests of the running moments of the magnetic buffer.
+ *
+ * Feeds readings of a rotating magnetometer through iUpdateMagBuffer()
+ * (magnetic.c), as it fills the buffer, overwrites its bins and retires its
+ * oldest readings, and checks after every reading that the running moments
+ * kept with F_INCREMENTAL_MAG_SUMS are exactly those of a rescan of the
+ * buffer about the same center.
+ *
+ * Run with:  pio test -e native_test -f test_mag_moments
+ */
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <unity.h>
+
+#include "build.h"
+#include "sensor_fusion/sensor_fusion.h"
+#include "sensor_fusion/magnetic.h"
+
+#if F_USING_MAG && F_INCREMENTAL_MAG_SUMS
+namespace {
+
+constexpr int16_t kFieldCounts = 500;  ///< geomagnetic field magnitude (counts), 50 uT
+
+struct MagCalibration cal;
+struct MagBuffer buffer;
+struct MagSensor mag;
+
+/// Sets iMoments to the sums of u^a.v^b.w^c over the readings that the running
+/// moments of pthisMagBuffer hold, in the order iUpdateMagBuffer() keeps them:
+/// every active bin but the pending one, with the earlier reading of the
+/// pending bin if the moments hold it.
+void RescanMoments(const struct MagBuffer *pthisMagBuffer, int64_t iMoments[]) {
+  memset(iMoments, 0, MAGMOMENTS * sizeof(iMoments[0]));
+  for (int8_t j = 0; j < MAGBUFFSIZEX; j++) {
+    for (int8_t k = 0; k < MAGBUFFSIZEY; k++) {
+      int16_t iBs[3];
+      if (j * MAGBUFFSIZEY + k == pthisMagBuffer->iPendingBin) {
+        if (!pthisMagBuffer->iPendingHeld) continue;
+        memcpy(iBs, pthisMagBuffer->iPendingBs, sizeof(iBs));
+      } else if (iMagBufferBinActive(pthisMagBuffer, j, k)) {
+        for (int8_t i = CHX; i <= CHZ; i++) iBs[i] = MAGBUFFER_BS(pthisMagBuffer, i, j, k);
+      } else {
+        continue;
+      }
+
+      int64_t u[3];
+      for (int8_t i = CHX; i <= CHZ; i++) u[i] = iBs[i] - pthisMagBuffer->iMomentCenter[i];
+      int8_t n = 0;
+      for (int8_t a = 0; a <= 4; a++) {
+        for (int8_t b = 0; a + b <= 4; b++) {
+          for (int8_t c = 0; a + b + c <= 4; c++) {
+            int64_t term = 1;
+            for (int8_t p = 0; p < a; p++) term *= u[CHX];
+            for (int8_t p = 0; p < b; p++) term *= u[CHY];
+            for (int8_t p = 0; p < c; p++) term *= u[CHZ];
+            iMoments[n++] += term;
+          }
+        }
+      }
+    }
+  }
+}
+
+/// Returns true, after reporting the first difference, if the running moments
+/// of the buffer are valid and equal to a rescan.
+bool MomentsMatchRescan(int32_t loopcounter) {
+  int64_t rescan[MAGMOMENTS];
+  if (!buffer.iMomentsValid) {
+    printf("moments invalid at reading %ld\n", (long) loopcounter);
+    return false;
+  }
+  RescanMoments(&buffer, rescan);
+  for (int8_t n = 0; n < MAGMOMENTS; n++) {
+    if (buffer.iMoments[n] != rescan[n]) {
+      printf("moment %d is %lld, rescan %lld, at reading %ld\n", n, (long long) buffer.iMoments[n],
+             (long long) rescan[n], (long) loopcounter);
+      return false;
+    }
+  }
+  return true;
+}
+
+/// Sets the magnetometer readings for a sensor turned to yaw, pitch and roll
+/// (rad) in a field with inclination 60 degrees, with hard iron offset
+/// offset[] (counts) and a little noise from noise_seed.
+void SetReading(float yaw, float pitch, float roll, const int16_t offset[], uint32_t noise_seed) {
+  const float field[3] = {0.5F * kFieldCounts, 0.0F, 0.866F * kFieldCounts};
+  float cy = cosf(yaw), sy = sinf(yaw), cp = cosf(pitch), sp = sinf(pitch), cr = cosf(roll), sr = sinf(roll);
+  // rows of the transpose of Rz(yaw).Ry(pitch).Rx(roll), rotating the field into the sensor frame
+  const float r[3][3] = {{cy * cp, sy * cp, -sp},
+                         {cy * sp * sr - sy * cr, sy * sp * sr + cy * cr, cp * sr},
+                         {cy * sp * cr + sy * sr, sy * sp * cr - cy * sr, cp * cr}};
+  for (int8_t i = CHX; i <= CHZ; i++) {
+    float b = r[i][0] * field[0] + r[i][1] * field[1] + r[i][2] * field[2];
+    int16_t noise = (int16_t) ((noise_seed >> (8 * i)) % 7) - 3;
+    mag.iBc[i] = (int16_t) lrintf(b) + noise;
+    mag.iBs[i] = mag.iBc[i] + offset[i];
+  }
+}
+
+/// Returns the next value of a linear congruential generator.
+uint32_t NextRandom(uint32_t *state) {
+  *state = *state * 1664525U + 1013904223U;
+  return *state;
+}
+
+}  // namespace
+#endif  // F_USING_MAG && F_INCREMENTAL_MAG_SUMS
+
+void setUp(void) {
+#if F_USING_MAG && F_INCREMENTAL_MAG_SUMS
+  memset(&cal, 0, sizeof(cal));
+  memset(&buffer, 0, sizeof(buffer));
+  memset(&mag, 0, sizeof(mag));
+  fInitializeMagCalibration(&cal, &buffer);
+#endif
+}
+
+void tearDown(void) {}
+
+#if F_USING_MAG && F_INCREMENTAL_MAG_SUMS
+void test_moments_fill_and_overwrite(void) {
+  // a slow tumble that fills the buffer, then keeps overwriting and retiring its readings
+  const int16_t offset[3] = {320, -150, 75};
+  uint32_t seed = 1;
+  for (int32_t loopcounter = 1; loopcounter <= 20000; loopcounter++) {
+    float t = 0.01F * loopcounter;
+    SetReading(0.7F * t, 1.3F * sinf(0.11F * t), 2.9F * sinf(0.037F * t), offset, NextRandom(&seed));
+    iUpdateMagBuffer(&buffer, &mag, loopcounter);
+    if (!MomentsMatchRescan(loopcounter)) TEST_FAIL();
+  }
+  TEST_ASSERT_EQUAL_INT(MAXMEASUREMENTS, buffer.iMagBufferCount);
+}
+
+void test_moments_recenter(void) {
+  // the hard iron offset drifts far beyond MOMENTRECENTERCOUNTS, so the moments are recentered on the way
+  int16_t offset[3] = {0, 0, 0};
+  int16_t first_center[3];
+  uint32_t seed = 2;
+  for (int32_t loopcounter = 1; loopcounter <= 40000; loopcounter++) {
+    float t = 0.01F * loopcounter;
+    offset[CHX] = (int16_t) (loopcounter / 20);
+    offset[CHY] = (int16_t) (-loopcounter / 40);
+    SetReading(0.9F * t, 1.4F * sinf(0.13F * t), 3.0F * sinf(0.041F * t), offset, NextRandom(&seed));
+    iUpdateMagBuffer(&buffer, &mag, loopcounter);
+    if (loopcounter == 1) memcpy(first_center, buffer.iMomentCenter, sizeof(first_center));
+    if (!MomentsMatchRescan(loopcounter)) TEST_FAIL();
+  }
+  TEST_ASSERT_TRUE(buffer.iMomentCenter[CHX] - first_center[CHX] > MOMENTRECENTERCOUNTS);
+}
+#endif  // F_USING_MAG && F_INCREMENTAL_MAG_SUMS
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+#if F_USING_MAG && F_INCREMENTAL_MAG_SUMS
+  RUN_TEST(test_moments_fill_and_overwrite);
+  RUN_TEST(test_moments_recenter);
+#endif
+  return UNITY_END();
+}
@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2020-2021 Bjarne Hansen
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+/**
+ * @file test_matrix.cc
+ * @brief Unit tests of the symmetric positive definite matrix inversion.
+ *
+ * Checks the LDL^T factorization, solution and inversion of matrix.c
+ * (fmatrixLDLTFactor(), fmatrixLDLTSolve() and fmatrixAeqInvSymA()) against
+ * the Gauss-Jordan inversion fmatrixAeqInvA() that they replace for the
+ * symmetric positive definite matrices of the Kalman gains and calibrations.
+ *
+ * Run with:  pio test -e native_test -f test_matrix
+ */
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include <unity.h>
+
+#include "build.h"
+#include "sensor_fusion/sensor_fusion.h"
+#include "sensor_fusion/matrix.h"
+
+namespace {
+
+constexpr int8_t kMaxSize = 6;
+
+/// A square matrix with the row pointers the matrix.c functions take.
+class TestMatrix {
+ public:
+  float m[kMaxSize][kMaxSize];
+  float *rows[kMaxSize];
+
+  TestMatrix() {
+    memset(m, 0, sizeof(m));
+    SetRows();
+  }
+  TestMatrix(const TestMatrix &other) {
+    memcpy(m, other.m, sizeof(m));
+    SetRows();
+  }
+  TestMatrix &operator=(const TestMatrix &other) {
+    memcpy(m, other.m, sizeof(m));
+    return *this;
+  }
+
+ private:
+  void SetRows() {
+    for (int8_t i = 0; i < kMaxSize; i++) rows[i] = m[i];
+  }
+};
+
+/// Sets the n square a to a symmetric positive definite matrix whose condition
+/// number grows with spread, like the normal matrix of a calibration fit.
+void SetSpdMatrix(TestMatrix *a, int8_t n, float spread) {
+  for (int8_t i = 0; i < n; i++) {
+    for (int8_t j = 0; j < n; j++) {
+      a->m[i][j] = 1.0F / (1.0F + i + j) + 0.1F * cosf(1.0F + i * j);
+    }
+  }
+  for (int8_t i = 0; i < n; i++) {
+    for (int8_t j = 0; j < i; j++) a->m[j][i] = a->m[i][j];
+    a->m[i][i] += 1.0F + spread * i;
+  }
+}
+
+/// Returns the largest element of a.b - I for the n square matrices a and b.
+float IdentityResidual(const TestMatrix &a, const TestMatrix &b, int8_t n) {
+  float residual = 0.0F;
+  for (int8_t i = 0; i < n; i++) {
+    for (int8_t j = 0; j < n; j++) {
+      float sum = (i == j) ? -1.0F : 0.0F;
+      for (int8_t k = 0; k < n; k++) sum += a.m[i][k] * b.m[k][j];
+      residual = std::max(residual, fabsf(sum));
+    }
+  }
+  return residual;
+}
+
+/// Checks that fmatrixAeqInvSymA() and fmatrixAeqInvA() invert the n square a
+/// to within float rounding.
+void CheckInverse(const TestMatrix &a, int8_t n) {
+  TestMatrix sym = a, gauss = a;
+  int8_t col[kMaxSize], row[kMaxSize], pivot[kMaxSize];
+  int8_t sym_error = true, gauss_error = true;
+
+  fmatrixAeqInvSymA(sym.rows, n, &sym_error);
+  fmatrixAeqInvA(gauss.rows, col, row, pivot, n, &gauss_error);
+  TEST_ASSERT_FALSE(sym_error);
+  TEST_ASSERT_FALSE(gauss_error);
+
+  float largest = 0.0F;
+  for (int8_t i = 0; i < n; i++) {
+    for (int8_t j = 0; j < n; j++) largest = std::max(largest, fabsf(gauss.m[i][j]));
+  }
+  for (int8_t i = 0; i < n; i++) {
+    for (int8_t j = 0; j < n; j++) {
+      TEST_ASSERT_FLOAT_WITHIN(1E-5F * largest, gauss.m[i][j], sym.m[i][j]);
+      TEST_ASSERT_EQUAL_FLOAT(sym.m[i][j], sym.m[j][i]);
+    }
+  }
+  TEST_ASSERT_LESS_THAN_FLOAT(1E-5F, IdentityResidual(a, sym, n));
+}
+
+}  // namespace
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_inverse_4x4(void) {
+  // the size of the 4 element calibration normal matrix
+  TestMatrix a;
+  SetSpdMatrix(&a, 4, 2.0F);
+  CheckInverse(a, 4);
+}
+
+void test_inverse_6x6(void) {
+  // the size of the 9DOF innovation covariance
+  TestMatrix a;
+  SetSpdMatrix(&a, 6, 10.0F);
+  CheckInverse(a, 6);
+}
+
+void test_inverse_reads_lower_triangle(void) {
+  TestMatrix a, lower;
+  SetSpdMatrix(&a, 6, 1.0F);
+  lower = a;
+  for (int8_t i = 0; i < 6; i++) {
+    for (int8_t j = i + 1; j < 6; j++) lower.m[i][j] = -99.0F;
+  }
+  int8_t error = true;
+  fmatrixAeqInvSymA(lower.rows, 6, &error);
+  TEST_ASSERT_FALSE(error);
+  TEST_ASSERT_LESS_THAN_FLOAT(1E-5F, IdentityResidual(a, lower, 6));
+}
+
+void test_ldlt_solve(void) {
+  TestMatrix a, ldlt;
+  float b[kMaxSize], x[kMaxSize];
+  int8_t error = true;
+
+  SetSpdMatrix(&a, 5, 3.0F);
+  for (int8_t i = 0; i < 5; i++) x[i] = b[i] = 1.0F - 0.5F * i;
+  ldlt = a;
+  fmatrixLDLTFactor(ldlt.rows, 5, &error);
+  TEST_ASSERT_FALSE(error);
+  fmatrixLDLTSolve(ldlt.rows, x, 5);
+  for (int8_t i = 0; i < 5; i++) {
+    float sum = 0.0F;
+    for (int8_t k = 0; k < 5; k++) sum += a.m[i][k] * x[k];
+    TEST_ASSERT_FLOAT_WITHIN(1E-5F, b[i], sum);
+  }
+}
+
+void test_inverse_not_positive_definite(void) {
+  // symmetric and invertible, but with a negative eigenvalue
+  TestMatrix a;
+  a.m[0][0] = 1.0F;
+  a.m[0][1] = a.m[1][0] = 2.0F;
+  a.m[1][1] = 1.0F;
+  a.m[2][2] = 3.0F;
+  int8_t error = false;
+  fmatrixAeqInvSymA(a.rows, 3, &error);
+  TEST_ASSERT_TRUE(error);
+  for (int8_t i = 0; i < 3; i++) {
+    for (int8_t j = 0; j < 3; j++) TEST_ASSERT_EQUAL_FLOAT(i == j ? 1.0F : 0.0F, a.m[i][j]);
+  }
+}
+
+void test_inverse_singular(void) {
+  // both inversions flag a singular matrix through the same error flag
+  TestMatrix sym, gauss;
+  int8_t col[kMaxSize], row[kMaxSize], pivot[kMaxSize];
+  int8_t sym_error = false, gauss_error = false;
+  for (int8_t i = 0; i < 4; i++) {
+    for (int8_t j = 0; j < 4; j++) sym.m[i][j] = gauss.m[i][j] = 1.0F;
+  }
+  fmatrixAeqInvSymA(sym.rows, 4, &sym_error);
+  fmatrixAeqInvA(gauss.rows, col, row, pivot, 4, &gauss_error);
+  TEST_ASSERT_TRUE(sym_error);
+  TEST_ASSERT_TRUE(gauss_error);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_inverse_4x4);
+  RUN_TEST(test_inverse_6x6);
+  RUN_TEST(test_inverse_reads_lower_triangle);
+  RUN_TEST(test_ldlt_solve);
+  RUN_TEST(test_inverse_not_positive_definite);
+  RUN_TEST(test_inverse_singular);
+  return UNITY_END();
+}